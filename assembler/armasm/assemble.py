@@ -18,13 +18,16 @@ class AssemblyParser:
         self.symbol_table = {}
         self.instructions = []
 
-    def assemble(self, input: str, output = None):
+    def assemble(self, input: str, output = None, symbols = None):
         with open(input, "r") as file:
             self.program = file.read().upper().splitlines()
 
         self.first_pass()
         self.second_pass(output)
 
+        if symbols:
+            self.write_symbols(symbols)
+
     def first_pass(self):
         for i, line in enumerate(self.program):
             line = line.split(';', 1)[0]
@@ -47,6 +50,10 @@ class AssemblyParser:
                 self.instructions.append(Multiply(line))
             elif op[0:3] == 'LDR' or op[0:3] == 'STR':
                 self.instructions.append(SingleDataTransfer(line))
+            elif op[0:3] in ('LDM', 'STM') or op[0:4] == 'PUSH' or op[0:3] == 'POP':
+                self.instructions.append(BlockDataTransfer(line))
+            elif op[0:3] in ('SWI', 'SVC'):
+                self.instructions.append(SoftwareInterrupt(line))
             else:
                 raise SyntaxError(line)
 
@@ -62,4 +69,8 @@ class AssemblyParser:
                 ins.encode()
                 f.write(struct.pack('<I', ins.encoding))
 
-
+    #side-car symbol file for the emulator's profiler: one "0x<address> <label>" line per label, by address
+    def write_symbols(self, output):
+        with open(output, 'w') as f:
+            for label, location in sorted(self.symbol_table.items(), key=lambda item: item[1]):
+                f.write(f'0x{location * 4:08x} {label}\n')
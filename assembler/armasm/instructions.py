@@ -355,3 +355,125 @@ class SingleDataTransfer(Instruction):
         self.encoding |= self.rn << 16
         self.encoding |= self.rd << 12
         self.encoding |= self.offset
+
+
+
+class BlockDataTransfer(Instruction):
+    #both the ldm{cond}{mode} and the ldm{mode}{cond} order
+    MODE_RE = '(IA|IB|DA|DB|FD|ED|FA|EA)'
+    MATCH_RE = ['(LDM|STM)' + MODE_RE + '?' + Instruction.COND_RE + '$',
+                '(LDM|STM)' + Instruction.COND_RE + MODE_RE + '$']
+
+    #pre-index and up bits of each addressing mode, the stack modes depend on the direction
+    MODES = {'IA': (0, 1), 'IB': (1, 1), 'DA': (0, 0), 'DB': (1, 0)}
+    STACK_MODES = {'LDM': {'FD': 'IA', 'ED': 'IB', 'FA': 'DA', 'EA': 'DB'},
+                   'STM': {'FD': 'DB', 'ED': 'DA', 'FA': 'IB', 'EA': 'IA'}}
+
+    def __init__(self, line: list[str]):
+        super().__init__(line)
+
+    def tokenize(self):
+        op, operands = self.line.split(maxsplit=1)
+
+        #push and pop are stmfd and ldmfd on r13 with writeback
+        if op[0:4] == 'PUSH':
+            op, operands = 'STM' + op[4:] + 'FD', 'R13!, ' + operands
+        elif op[0:3] == 'POP':
+            op, operands = 'LDM' + op[3:] + 'FD', 'R13!, ' + operands
+
+        m = re.match(r'([^,]*),\s*\{(.*)\}$', operands.strip())
+
+        if not m:
+            raise SyntaxError
+
+        self.tokens = [op, m.group(1).strip(), m.group(2)]
+
+    @staticmethod
+    def parse_register_list(text: str) -> int:
+        registers = 0
+
+        for item in text.split(','):
+            bounds = item.strip().split('-')
+
+            if len(bounds) > 2:
+                raise SyntaxError
+
+            first = parse_register(bounds[0].strip())
+            last = parse_register(bounds[-1].strip())
+
+            if last < first:
+                raise SyntaxError
+
+            for reg in range(first, last + 1):
+                registers |= 1 << reg
+
+        return registers
+
+    def parse_line(self):
+        self.tokenize()
+
+        m = re.match(self.MATCH_RE[0], self.tokens[0])
+        if m:
+            op, mode, cond = m.group(1), m.group(2), m.group(3)
+        else:
+            m = re.match(self.MATCH_RE[1], self.tokens[0])
+            if not m:
+                raise SyntaxError
+            op, cond, mode = m.group(1), m.group(2), m.group(3)
+
+        mode = self.STACK_MODES[op].get(mode, mode) if mode else 'IA'
+        self.is_load = op == 'LDM'
+        self.cond = self.CONDS[cond] if cond else self.CONDS['AL']
+        self.is_preindex, self.is_up = self.MODES[mode]
+        self.is_writeback = self.tokens[1].endswith('!')
+        self.rn = parse_register(self.tokens[1].rstrip('!').strip())
+        self.registers = self.parse_register_list(self.tokens[2])
+
+    def encode(self):
+        self.encoding |= self.cond << 28
+        self.encoding |= 0b100 << 25
+        self.encoding |= self.is_preindex << 24
+        self.encoding |= self.is_up << 23
+        self.encoding |= self.is_writeback << 21
+        self.encoding |= self.is_load << 20
+        self.encoding |= self.rn << 16
+        self.encoding |= self.registers
+
+
+
+class SoftwareInterrupt(Instruction):
+    MATCH_RE = '(SWI|SVC)' + Instruction.COND_RE + '$'
+
+    #the emulator's semihosting services, by the number in the comment field
+    SERVICES = {'EXIT': 0, 'WRITE': 1, 'READ': 2, 'MEMCPY': 3, 'MEMSET': 4, 'MEMCMP': 5}
+
+    def __init__(self, line: list[str]):
+        super().__init__(line)
+
+    def tokenize(self):
+        self.tokens = self.line.split()
+
+    #swi{cond} #<number> or swi{cond} <service>
+    def parse_line(self):
+        self.tokenize()
+        m = re.match(self.MATCH_RE, self.tokens[0])
+
+        if not m or len(self.tokens) != 2:
+            raise SyntaxError
+
+        self.cond = self.CONDS[m.group(2)] if m.group(2) else self.CONDS['AL']
+
+        if self.tokens[1] in self.SERVICES:
+            self.number = self.SERVICES[self.tokens[1]]
+        elif is_imm(self.tokens[1]):
+            self.number = parse_immediate(self.tokens[1])
+        else:
+            self.number = parse_immediate('#' + self.tokens[1])
+
+        if self.number < 0 or self.number > 0xFFFFFF:
+            raise SyntaxError
+
+    def encode(self):
+        self.encoding |= self.cond << 28
+        self.encoding |= 0b1111 << 24
+        self.encoding |= self.number
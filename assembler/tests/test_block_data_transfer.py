@@ -0,0 +1,38 @@
+#!/usr/bin/python3
+import unittest
+from armasm.instructions import BlockDataTransfer
+
+class TestBlockDataTransfer(unittest.TestCase):
+    def encode(self, line):
+        i = BlockDataTransfer(line)
+        i.parse_line()
+        i.encode()
+        return i.encoding
+
+    def test_increment_after(self):
+        self.assertEqual(self.encode('LDMIA R0, {R1, R2}'), 0xE8900006)
+        self.assertEqual(self.encode('LDM R0, {R1,R2}'), 0xE8900006)
+
+    def test_increment_before(self):
+        self.assertEqual(self.encode('STMIB R1!, {R4}'), 0xE9A10010)
+
+    def test_decrement_after(self):
+        self.assertEqual(self.encode('STMDA R3, {R0}'), 0xE8030001)
+
+    def test_decrement_before(self):
+        self.assertEqual(self.encode('LDMEQDB R2, {R5-R7}'), 0x091200E0)
+        self.assertEqual(self.encode('LDMDBEQ R2, {R5-R7}'), 0x091200E0)
+
+    def test_stack_modes(self):
+        self.assertEqual(self.encode('STMFD R13!, {R0-R3, R14}'), 0xE92D400F)
+        self.assertEqual(self.encode('LDMFD R13!, {R0-R3, R15}'), 0xE8BD800F)
+        self.assertEqual(self.encode('LDMNEEA R1!, {R2}'), 0x19310004)
+
+    def test_push_pop(self):
+        self.assertEqual(self.encode('PUSH {R4, R14}'), 0xE92D4010)
+        self.assertEqual(self.encode('POP {R4, R15}'), 0xE8BD8010)
+
+    def test_invalid(self):
+        for line in ['LDMIA R0, R1', 'STMIA R0, {R3-R1}', 'LDMXX R0, {R1}', 'STMIA R0, {R1-R2-R3}']:
+            with self.assertRaises(SyntaxError):
+                self.encode(line)
@@ -0,0 +1,32 @@
+#!/usr/bin/python3
+import unittest
+from armasm.instructions import SoftwareInterrupt
+
+class TestSoftwareInterrupt(unittest.TestCase):
+    def encode(self, line):
+        i = SoftwareInterrupt(line)
+        i.parse_line()
+        i.encode()
+        return i.encoding
+
+    def test_number(self):
+        self.assertEqual(self.encode('SWI #0'), 0xEF000000)
+        self.assertEqual(self.encode('SWI 3'), 0xEF000003)
+        self.assertEqual(self.encode('SVC #16777215'), 0xEFFFFFFF)
+
+    def test_condition(self):
+        self.assertEqual(self.encode('SWINE #1'), 0x1F000001)
+        self.assertEqual(self.encode('SVCEQ #2'), 0x0F000002)
+
+    def test_service_names(self):
+        self.assertEqual(self.encode('SWI EXIT'), 0xEF000000)
+        self.assertEqual(self.encode('SWI WRITE'), 0xEF000001)
+        self.assertEqual(self.encode('SWI MEMCMP'), 0xEF000005)
+
+    def test_invalid(self):
+        for line in ('SWI', 'SWI #16777216', 'SWI #-1', 'SWI NOPE', 'SWIXX #0'):
+            with self.assertRaises(SyntaxError):
+                self.encode(line)
+
+if __name__ == '__main__':
+    unittest.main()
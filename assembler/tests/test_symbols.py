@@ -0,0 +1,36 @@
+#!/usr/bin/python3
+import os
+import tempfile
+import unittest
+from armasm.assemble import AssemblyParser
+
+class TestSymbols(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        self.source = os.path.join(self.directory.name, 'prog.s')
+        self.binary = os.path.join(self.directory.name, 'prog.bin')
+        self.symbols = os.path.join(self.directory.name, 'prog.sym')
+
+        with open(self.source, 'w') as f:
+            f.write('    mov r1, #0\n'
+                    'loop: add r1, r1, #1\n'
+                    '    cmp r1, #10 ; ten times\n'
+                    '    bne loop\n'
+                    'done:\n'
+                    '    mov r0, r1\n')
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def test1(self):
+        AssemblyParser().assemble(self.source, self.binary, self.symbols)
+
+        with open(self.symbols) as f:
+            self.assertEqual(f.read(), '0x00000004 LOOP\n0x00000010 DONE\n')
+
+    def test2(self):
+        AssemblyParser().assemble(self.source, self.binary)
+        self.assertFalse(os.path.exists(self.symbols))
+
+if __name__ == '__main__':
+    unittest.main()
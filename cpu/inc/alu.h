@@ -0,0 +1,263 @@
+#ifndef ALU_H
+#define ALU_H
+
+#include "execute.h"
+
+/* Shifter, ALU and flag semantics shared by execute() and the specialized
+   handlers of the threaded interpreter. They are inline so a handler that
+   passes a constant opcode or shift type only keeps the code it needs. */
+
+static inline uint32_t
+shiftLogicalLeft
+(
+    uint32_t  sequence,
+    uint32_t  amount,
+    uint32_t  carryIn,
+    uint32_t *pCarry
+)
+{
+    if (amount == 0)
+    {
+        *pCarry = carryIn;
+        return sequence;
+    }
+
+    if (amount >= 32)
+    {
+        *pCarry = amount == 32 ? sequence & 1 : 0;
+        return 0;
+    }
+
+    *pCarry = (sequence >> (32 - amount)) & 1;
+    return sequence << amount;
+}
+
+static inline uint32_t
+shiftLogicalRight
+(
+    uint32_t  sequence,
+    uint32_t  amount,
+    uint32_t *pCarry
+)
+{
+    // lsr #0 encodes lsr #32
+    if (amount == 0)
+    {
+        amount = 32;
+    }
+
+    if (amount >= 32)
+    {
+        *pCarry = amount == 32 ? sequence >> 31 : 0;
+        return 0;
+    }
+
+    *pCarry = (sequence >> (amount - 1)) & 1;
+    return sequence >> amount;
+}
+
+static inline uint32_t
+shiftArithmeticRight
+(
+    uint32_t  sequence,
+    uint32_t  amount,
+    uint32_t *pCarry
+)
+{
+    // asr #0 encodes asr #32
+    if (amount == 0 || amount > 31)
+    {
+        *pCarry = sequence >> 31;
+        return (uint32_t)((int32_t)sequence >> 31);
+    }
+
+    *pCarry = (sequence >> (amount - 1)) & 1;
+    return (uint32_t)((int32_t)sequence >> amount);
+}
+
+static inline uint32_t
+shiftRotateRight
+(
+    uint32_t  sequence,
+    uint32_t  amount,
+    uint32_t  carryIn,
+    uint32_t *pCarry
+)
+{
+    while (amount > 32)
+    {
+        amount -= 32;
+    }
+
+    // ror #0 encodes rrx
+    if (amount == 0)
+    {
+        *pCarry = sequence & 1;
+        return (sequence >> 1) | (carryIn << 31);
+    }
+
+    *pCarry = (sequence >> (amount - 1)) & 1;
+    return amount == 32 ? sequence : (sequence >> amount) | (sequence << (32 - amount));
+}
+
+static inline uint32_t
+barrelShift
+(
+    ShiftType type,
+    uint32_t  sequence,
+    uint32_t  amount,
+    uint32_t  carryIn,
+    uint32_t *pCarry
+)
+{
+    switch(type)
+    {
+    case LSL:
+        return shiftLogicalLeft(sequence, amount, carryIn, pCarry);
+    case LSR:
+        return shiftLogicalRight(sequence, amount, pCarry);
+    case ASR:
+        return shiftArithmeticRight(sequence, amount, pCarry);
+    case ROR:
+        return shiftRotateRight(sequence, amount, carryIn, pCarry);
+    }
+
+    return sequence;
+}
+
+static inline uint32_t
+aluOperation
+(
+    uint32_t opcode,
+    uint32_t operand1,
+    uint32_t operand2,
+    uint32_t carryIn
+)
+{
+    switch(opcode)
+    {
+    case AND:
+    case TST:
+        return operand1 & operand2;
+    case EOR:
+    case TEQ:
+        return operand1 ^ operand2;
+    case SUB:
+    case CMP:
+        return operand1 - operand2;
+    case RSB:
+        return operand2 - operand1;
+    case ADD:
+    case CMN:
+        return operand1 + operand2;
+    case ADC:
+        return operand1 + operand2 + carryIn;
+    case SBC:
+        return operand1 - operand2 + carryIn - 1;
+    case RSC:
+        return operand2 - operand1 + carryIn - 1;
+    case ORR:
+        return operand1 | operand2;
+    case MOV:
+        return operand2;
+    case BIC:
+        return operand1 & ~operand2;
+    case MVN:
+        return ~operand2;
+    }
+
+    return 0;
+}
+
+static inline bool
+aluLogicOperation
+(
+    uint32_t opcode
+)
+{
+    return opcode != SUB && opcode != RSB && opcode != ADD && opcode != ADC &&
+           opcode != SBC && opcode != RSC && opcode != CMN;
+}
+
+static inline bool
+aluCarryIn
+(
+    uint32_t opcode
+)
+{
+    return opcode == ADC || opcode == SBC || opcode == RSC;
+}
+
+static inline bool
+aluWriteback
+(
+    uint32_t opcode
+)
+{
+    return opcode != TST && opcode != TEQ && opcode != CMP && opcode != CMN;
+}
+
+static inline uint32_t
+logicFlags
+(
+    uint32_t currentProcessStateRegister,
+    uint32_t result,
+    uint32_t carry
+)
+{
+    currentProcessStateRegister = changeBit(currentProcessStateRegister, Z, result == 0);
+    currentProcessStateRegister = changeBit(currentProcessStateRegister, N, bit(result, 31));
+    return changeBit(currentProcessStateRegister, C, carry);
+}
+
+static inline bool
+arithmeticOverflow
+(
+    uint32_t operand1,
+    uint32_t operand2,
+    uint32_t result
+)
+{
+    return ((bit(31, operand1) ^ bit(31, operand2)) == 0) && (bit(31, result) != bit(31, operand1));
+}
+
+static inline bool
+arithmeticCarry
+(
+    uint32_t operand1,
+    uint32_t result
+)
+{
+    return result < operand1;
+}
+
+static inline uint32_t
+arithmeticFlags
+(
+    uint32_t currentProcessStateRegister,
+    uint32_t operand1,
+    uint32_t operand2,
+    uint32_t result
+)
+{
+    bool overflow = arithmeticOverflow(operand1, operand2, result);
+    bool carry = arithmeticCarry(operand1, result);
+
+    currentProcessStateRegister = changeBit(currentProcessStateRegister, Z, result == 0);
+    currentProcessStateRegister = changeBit(currentProcessStateRegister, N, bit(result, 31));
+    currentProcessStateRegister = changeBit(currentProcessStateRegister, V, overflow);
+    return changeBit(currentProcessStateRegister, C, carry);
+}
+
+static inline uint32_t
+multiplyFlags
+(
+    uint32_t currentProcessStateRegister,
+    uint32_t result
+)
+{
+    currentProcessStateRegister = changeBit(currentProcessStateRegister, N, bit(result, 31));
+    return changeBit(currentProcessStateRegister, Z, result == 0);
+}
+
+#endif
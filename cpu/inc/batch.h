@@ -0,0 +1,43 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "miniarm.h"
+
+/* Batch mode of the cpu front end. A manifest lists one job per line, an
+   image path followed by optional initial register values:
+
+       prog.bin r0=5 r1=0x100 cpsr=0x20000000
+
+   Blank lines and lines starting with # are skipped. The jobs run on a
+   work-stealing pool of threads, each job in a context of its own, and
+   their final state is written to stdout as one JSON object per line in
+   manifest order. */
+
+typedef struct BatchOptions
+{
+    int      mode;
+    uint64_t memorySize;
+
+    // instructions per job, 0 runs every job until it halts
+    uint64_t limit;
+
+    // worker threads, 0 uses one per online core
+    uint32_t threads;
+
+    // prints the job count, instructions and MIPS of the batch to stderr
+    bool     benchmark;
+
+    // runs the jobs of each image in runMiniArmLockstep() groups, under
+    // benchmark also times the batch again in the interpreter to compare
+    bool     lockstep;
+
+    // times each job on the pipeline model and adds its cycles to the output
+    bool     timing;
+} BatchOptions;
+
+int runBatch(const char *manifest, const BatchOptions *pOptions);
+
+// the register index of a name like r7, sp or cpsr, -1 for anything else
+int parseRegister(const char *name, size_t length);
+
+#endif
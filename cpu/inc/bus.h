@@ -0,0 +1,42 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdio.h>
+#include "mem_op.h"
+#include "miniarm.h"
+
+/* Device bus. Devices are mapped page by page into the window from
+   DEVICE_BASE to the end of the address space, which RAM never reaches,
+   so a RAM access keeps its single bounds check and only an access that
+   misses RAM looks up the device of its page here. The standard devices
+   are the console, the cycle counter, the input and the halt register
+   at the MINIARM_ addresses. */
+
+#define BUS_PAGES   ((uint32_t)((MAX_MEMORY_SIZE - DEVICE_BASE) >> PAGE_SHIFT))
+#define BUS_DEVICES 16
+
+typedef struct BusDevice
+{
+    MiniArmDevice device;
+    uint32_t      address;
+} BusDevice;
+
+typedef struct Bus
+{
+    BusDevice  devices[BUS_DEVICES];
+    uint32_t   deviceCount;
+
+    // the device of each page of the window, NULL for none
+    BusDevice *pPages[BUS_PAGES];
+
+    // state of the standard devices
+    Memory    *pMemory;
+    FILE      *pOutput;
+    FILE      *pInput;
+    uint32_t   cyclesHigh;
+} Bus;
+
+int mapDevice(Bus *pBus, Memory *pMemory, uint32_t address, uint32_t length, const MiniArmDevice *pDevice);
+int mapStandardDevices(Bus *pBus, Memory *pMemory, FILE *pOutput, FILE *pInput);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "interpreter.h"
+#include "miniarm.h"
+
+/* Cache model of split L1 instruction and data caches over a unified L2,
+   driven by the interpreter as it fetches and by memoryReference() as it
+   accesses memory. The only state per line is one word of its set: the
+   line address shifted up by 2, a valid bit and a dirty bit, 0 for an
+   empty line. Sets keep their lines most recently filled (or, for LRU,
+   used) first, so LRU and FIFO both evict the last line and a hit on the
+   line used last is found first. The caches write back and allocate on
+   writes; a dirty line leaving L1 is written to L2. Device accesses and
+   the memory services bypass the model. */
+
+#define CACHE_VALID 1u
+#define CACHE_DIRTY 2u
+
+typedef struct Cache
+{
+    // sets * ways line words, NULL when the level is absent
+    uint32_t *pLines;
+    uint32_t  setMask;
+    uint32_t  ways;
+    uint32_t  lineShift;
+    int       replacement;
+    uint32_t  random;
+
+    MiniArmCacheStatistics statistics;
+} Cache;
+
+typedef struct Caches
+{
+    Cache               levels[MINIARM_CACHE_LEVELS];
+
+    // per instruction word of the image, the pc field unused
+    MiniArmCacheCounts *pCounts;
+    uint32_t            words;
+} Caches;
+
+int  createCaches(Caches *pCaches, const MiniArmCacheConfig configs[], uint32_t imageSize);
+void destroyCaches(Caches *pCaches);
+void cacheFetch(Caches *pCaches, uint32_t pc);
+void cacheReference(Caches *pCaches, uint32_t pc, const TemporaryRegisters *pTemporaryRegisters);
+
+#endif
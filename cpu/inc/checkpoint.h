@@ -0,0 +1,51 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <sys/types.h>
+#include "interpreter.h"
+
+/* Checkpoint files, in the byte order of the host that wrote them: a
+   header, a table of extents and then the extents themselves. An extent
+   is a run of RAM holding pages that were written, aligned in both RAM
+   and the file to the host page size of the writer, so a resume maps it
+   straight over guest RAM copy-on-write. A forked child writes the file
+   from its copy of the process while the emulator goes on, then renames
+   it over the path, which therefore always holds a whole checkpoint. */
+
+#define CHECKPOINT_MAGIC "MINIARM1"
+
+typedef struct CheckpointHeader
+{
+    char     magic[8];
+    uint32_t alignment;
+    uint32_t extentCount;
+    uint64_t memorySize;
+    uint64_t instructions;
+    uint32_t registers[17];
+    uint32_t programSize;
+    uint32_t faulted;
+    uint32_t faultAddress;
+    uint32_t halted;
+    uint32_t exitStatus;
+
+    // standard devices, the input offsets -1 for streams that can't seek
+    uint32_t cyclesHigh;
+    int64_t  inputOffset;
+    int64_t  deviceInputOffset;
+} CheckpointHeader;
+
+typedef struct CheckpointExtent
+{
+    uint64_t address;
+    uint64_t length;
+    uint64_t offset;
+} CheckpointExtent;
+
+// the pid of the writer, -1 with errno set if it couldn't be started
+pid_t startCheckpoint(CpuState *pState, const char *path);
+
+// 0 once the writer succeeded, 1 while it runs when not waiting, -1 with EIO if it failed
+int   finishCheckpoint(pid_t writer, bool wait);
+int   loadCheckpoint(CpuState *pState, const char *path);
+
+#endif
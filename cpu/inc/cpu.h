@@ -10,7 +10,9 @@
 #define C 29
 #define V 28
 #define CPSR 16
-#define MEMORY_SIZE 0x1000
+
+// default RAM size, the full 32-bit address space
+#define MEMORY_SIZE 0x100000000ull
 
 typedef struct TemporaryRegisters 
 {
@@ -26,17 +28,28 @@ typedef struct TemporaryRegisters
     uint32_t condition;
     bool     writeback;
     bool     link;
+    const struct DecodedInstruction *pDecoded;
+
+    // the words an LDM or STM moves, lowest address first
+    uint32_t blockData[16];
 } TemporaryRegisters;
 
 enum 
 {
     DATA = 0,
+    UNDEFINED = 1,
+
+    // never decoded from an instruction, marks a breakpoint in the decode cache
+    BREAKPOINT = 2,
     MUL = 0x90,
     LDR = 0x04100000,
     LDRB = 0x04500000,
     STR = 0x04000000,
     STRB = 0x04400000,
-    BRANCH = 0x0A000000
+    LDM = 0x08100000,
+    STM = 0x08000000,
+    BRANCH = 0x0A000000,
+    SWI = 0x0F000000
 };
 
 enum 
@@ -44,7 +57,9 @@ enum
     MULT_MASK = 0x0FC000F0,
     DATA_MASK = 0x0C000000,
     BRANCH_MASK = 0x0E000000,
-    SDT_MASK = 0x0C500000
+    SDT_MASK = 0x0C500000,
+    BLOCK_MASK = 0x0E100000,
+    SWI_MASK = 0x0F000000
 };
 
 #endif
@@ -0,0 +1,52 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "interpreter.h"
+
+/* Breakpoints and watchpoints, at no cost to code that doesn't hit them.
+   A breakpoint replaces the decoded instruction at its address with a
+   BREAKPOINT entry, which fails the condition of the interpreters and has
+   a threaded handler and JIT blocks of its own, so the engines only notice
+   it when they reach it and stop in front of it. A watchpoint marks its
+   pages PAGE_WATCH, which makes stores to them take the same slow path as
+   stores to code, where the watched range is checked; the run stops once
+   the storing instruction completes. */
+
+#define DEBUG_BREAKPOINTS 64
+#define DEBUG_WATCHPOINTS 16
+
+// why the last run stopped early
+enum
+{
+    DEBUG_NONE,
+    DEBUG_BREAKPOINT,
+    DEBUG_WATCHPOINT
+};
+
+typedef struct Watchpoint
+{
+    uint32_t address;
+    uint32_t length;
+} Watchpoint;
+
+typedef struct Debug
+{
+    uint32_t   breakpoints[DEBUG_BREAKPOINTS];
+    uint32_t   breakpointCount;
+    Watchpoint watchpoints[DEBUG_WATCHPOINTS];
+    uint32_t   watchpointCount;
+    uint32_t   stop;
+
+    // the store that hit a watchpoint
+    uint32_t   watchAddress;
+} Debug;
+
+int  setBreakpoint(CpuState *pState, uint32_t address, bool enabled);
+bool isBreakpoint(const Debug *pDebug, uint32_t address);
+int  setWatchpoint(CpuState *pState, uint32_t address, uint32_t length, bool enabled);
+
+// the engine has already put the PC back on the breakpoint
+void stopAtBreakpoint(CpuState *pState);
+bool watchWritten(CpuState *pState, uint32_t address, uint32_t length);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdio.h>
+#include "miniarm.h"
+
+/* Interactive debug mode of the cpu front end, modeled on GDB. Commands
+   are read from input, one per line, and an empty line repeats the last
+   one. Locations are addresses or labels of the symbol file.
+
+       step [n]             s   run n instructions, 1 by default
+       continue             c   run until a breakpoint, watchpoint or the end
+       break <location>     b   stop in front of the instruction there
+       delete <location>    d   remove a breakpoint
+       watch <address> [n]  w   stop after stores to n bytes, 4 by default
+       unwatch <address> [n]    remove a watchpoint
+       info                 i   list breakpoints and watchpoints
+       print [register]     p   print the registers, or one of them
+       x <address> [n]          print n words of memory, 1 by default
+       quit                 q
+
+   Breakpoints and watchpoints go through libminiarm, which patches them
+   into the execution engines, so continue runs at full speed in any
+   mode. */
+
+int runDebugger(MiniArm *pMiniArm, const char *symbolPath, FILE *input);
+
+#endif
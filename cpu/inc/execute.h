@@ -5,7 +5,9 @@
 #include "utils.h"
 #include "mem_op.h"
 
-void execute(TemporaryRegisters*, uint32_t registers[]);
+struct LazyFlags;
+
+void execute(TemporaryRegisters*, uint32_t registers[], struct LazyFlags *pFlags);
 
 enum 
 {
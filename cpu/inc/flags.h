@@ -0,0 +1,176 @@
+#ifndef FLAGS_H
+#define FLAGS_H
+
+#include "alu.h"
+
+/* Lazy CPSR flags. A flag setting instruction only records its kind and
+   the values the flags derive from; validCondition() and the carry-in
+   readers compute the single flag they need from the record, and the
+   CPSR register itself is brought up to date only when it is read whole.
+   The kinds are ordered by the flags they write (multiply writes N and Z,
+   logic adds C, arithmetic adds V), so a new record has to fold the
+   pending one into the CPSR first only when the pending kind is greater.
+
+   Building with -DCHECK_LAZY_FLAGS keeps an eagerly computed CPSR next
+   to the record and aborts on the first flag the two disagree on. */
+
+enum
+{
+    FLAGS_EAGER = 0,
+    FLAGS_MULTIPLY = 1,
+    FLAGS_LOGIC = 2,
+    FLAGS_ARITHMETIC = 3
+};
+
+typedef struct LazyFlags
+{
+    uint32_t kind;
+    uint32_t operand1;
+    uint32_t operand2;
+    uint32_t result;
+    uint32_t carry;
+#ifdef CHECK_LAZY_FLAGS
+    uint32_t eager;
+#endif
+} LazyFlags;
+
+static inline uint32_t
+applyFlags
+(
+    uint32_t         currentProcessStateRegister,
+    const LazyFlags *pFlags
+)
+{
+    switch(pFlags->kind)
+    {
+    case FLAGS_MULTIPLY:
+        return multiplyFlags(currentProcessStateRegister, pFlags->result);
+    case FLAGS_LOGIC:
+        return logicFlags(currentProcessStateRegister, pFlags->result, pFlags->carry);
+    case FLAGS_ARITHMETIC:
+        return arithmeticFlags(currentProcessStateRegister, pFlags->operand1, pFlags->operand2, pFlags->result);
+    }
+
+    return currentProcessStateRegister;
+}
+
+static inline void
+checkFlags
+(
+    const LazyFlags *pFlags,
+    uint32_t         index,
+    uint32_t         value
+)
+{
+#ifdef CHECK_LAZY_FLAGS
+    if (bit(pFlags->eager, index) != value)
+    {
+        fprintf(stderr, "lazy flag %u is %u, eager evaluation gives %u (kind %u)\n", 
+                index, value, bit(pFlags->eager, index), pFlags->kind);
+        abort();
+    }
+#else
+    (void)pFlags;
+    (void)index;
+    (void)value;
+#endif
+}
+
+static inline uint32_t
+lazyFlag
+(
+    uint32_t         currentProcessStateRegister,
+    const LazyFlags *pFlags,
+    uint32_t         index
+)
+{
+    uint32_t value;
+
+    if (pFlags->kind != FLAGS_EAGER && (index == Z || index == N))
+    {
+        value = index == Z ? pFlags->result == 0 : bit(pFlags->result, 31);
+    }
+    else if (pFlags->kind == FLAGS_LOGIC && index == C)
+    {
+        value = pFlags->carry;
+    }
+    else if (pFlags->kind == FLAGS_ARITHMETIC && index == C)
+    {
+        value = arithmeticCarry(pFlags->operand1, pFlags->result);
+    }
+    else if (pFlags->kind == FLAGS_ARITHMETIC && index == V)
+    {
+        value = arithmeticOverflow(pFlags->operand1, pFlags->operand2, pFlags->result);
+    }
+    else
+    {
+        value = bit(currentProcessStateRegister, index);
+    }
+
+    checkFlags(pFlags, index, value);
+    return value;
+}
+
+// folds the pending record into the CPSR
+static inline void
+materializeFlags
+(
+    uint32_t  *pCurrentProcessStateRegister,
+    LazyFlags *pFlags
+)
+{
+    *pCurrentProcessStateRegister = applyFlags(*pCurrentProcessStateRegister, pFlags);
+    pFlags->kind = FLAGS_EAGER;
+
+    checkFlags(pFlags, N, bit(*pCurrentProcessStateRegister, N));
+    checkFlags(pFlags, Z, bit(*pCurrentProcessStateRegister, Z));
+    checkFlags(pFlags, C, bit(*pCurrentProcessStateRegister, C));
+    checkFlags(pFlags, V, bit(*pCurrentProcessStateRegister, V));
+}
+
+// replaces the whole CPSR, dropping the pending record
+static inline void
+writeFlags
+(
+    uint32_t  *pCurrentProcessStateRegister,
+    LazyFlags *pFlags,
+    uint32_t   value
+)
+{
+    *pCurrentProcessStateRegister = value;
+    pFlags->kind = FLAGS_EAGER;
+
+#ifdef CHECK_LAZY_FLAGS
+    pFlags->eager = value;
+#endif
+}
+
+static inline void
+recordFlags
+(
+    uint32_t  *pCurrentProcessStateRegister,
+    LazyFlags *pFlags,
+    uint32_t   kind,
+    uint32_t   operand1,
+    uint32_t   operand2,
+    uint32_t   result,
+    uint32_t   carry
+)
+{
+    if (pFlags->kind > kind)
+    {
+        materializeFlags(pCurrentProcessStateRegister, pFlags);
+    }
+
+    pFlags->kind = kind;
+    pFlags->operand1 = operand1;
+    pFlags->operand2 = operand2;
+    pFlags->result = result;
+    pFlags->carry = carry;
+
+#ifdef CHECK_LAZY_FLAGS
+    pFlags->eager = applyFlags(pFlags->eager, pFlags);
+#endif
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "flags.h"
+#include "miniarm.h"
+#include "predecode.h"
+
+typedef struct CpuState
+{
+    // last index is the CPSR
+    uint32_t    registers[17];
+
+    // registers[CPSR] lags behind while a flag record is pending
+    LazyFlags   flags;
+    Memory      memory;
+    DecodeCache decodeCache;
+    uint32_t    programSize;
+    uint64_t    instructions;
+
+    // a run stops once instructions reaches limit, chained JIT blocks check chainLimit
+    uint64_t    limit;
+    uint64_t    chainLimit;
+
+    // set by a breakpoint or watchpoint, the engines stop at the next instruction they check it before
+    bool        stopped;
+
+    // instructions run in a lockstep group and how often this state left one for a PC of its own
+    uint64_t    lockstepInstructions;
+    uint64_t    divergences;
+
+    // pairs the threaded interpreter ran as one fused handler
+    uint64_t    fusions[MINIARM_FUSIONS];
+    struct Jit *pJit;
+
+    // set while the pipeline timing model runs
+    struct Pipeline *pPipeline;
+
+    // set while the cache model runs
+    struct Caches *pCaches;
+
+    // set while the branch predictors run
+    struct Predictors *pPredictors;
+
+    // an ahead of time translation of the loaded image, dropped once the image is written
+    const struct NativeImage *pNative;
+
+    // per handler instruction counts of a STATS=1 build
+    struct ExecutionCounts *pCounts;
+
+    // set while an execution trace is written
+    struct Tracer *pTracer;
+
+    // breakpoints and watchpoints, set once either was used
+    struct Debug *pDebug;
+
+    // the streams of the write and read services, NULL refuses them
+    FILE *pOutput;
+    FILE *pInput;
+} CpuState;
+
+bool validCondition(uint32_t condition, uint32_t currentProcessStateRegister, const LazyFlags *pFlags);
+void codeWritten(CpuState *pState, uint32_t address, uint32_t length);
+bool storeWritten(CpuState *pState, uint32_t address, uint32_t length);
+bool executeRecorded(CpuState *pState, const DecodedInstruction *pDecoded, TemporaryRegisters *pTemporaryRegisters);
+bool executeDecoded(CpuState *pState, const DecodedInstruction *pDecoded);
+void interpret(CpuState *pState);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "interpreter.h"
+#include "x86.h"
+
+#define JIT_BUFFER_SIZE        0x1000000
+#define JIT_BLOCK_INSTRUCTIONS 64
+
+// block entries are allocated per 64 KiB of guest code
+#define JIT_REGION_SHIFT       16
+#define JIT_REGION_ENTRIES     ((1u << JIT_REGION_SHIFT) / 4)
+
+// worst case bytes of host code for one guest instruction plus the block exit
+#define JIT_INSTRUCTION_BYTES  256
+
+/* A block returns the rel32 of its exit jump when the exit has a fixed
+   target, so the dispatcher can chain it straight to the next block, or
+   NULL when the next PC is only known at run time. */
+typedef uint8_t *(*JitBlock)(CpuState *pState);
+
+typedef struct JitEntry
+{
+    JitBlock block;
+    uint8_t *pBody;
+    uint32_t end;
+} JitEntry;
+
+typedef struct JitStatistics
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t chained;
+    uint64_t invalidations;
+    uint64_t flushes;
+} JitStatistics;
+
+typedef struct Jit
+{
+    uint8_t      *pBuffer;
+    size_t        size;
+    size_t        used;
+    JitEntry    **ppRegions;
+    uint32_t      regionCount;
+    uint32_t      regionsUsed;
+    JitStatistics statistics;
+} Jit;
+
+int  createJit(Jit *pJit, uint64_t memorySize);
+void destroyJit(Jit *pJit);
+void flushJit(Jit *pJit);
+void invalidateJitPage(Jit *pJit, uint32_t page);
+void runJit(CpuState *pState);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "interpreter.h"
+
+/* Lockstep execution of several instances of the same program. The
+   register files of the instances are kept as structure of arrays, one
+   vector per guest register with an element per instance, so data
+   processing and multiplies run as vector instructions (AVX2 when the
+   host has it, SSE otherwise) and conditions become per-lane masks.
+   Loads and stores go to each instance's own memory. An instance whose
+   PC stops agreeing with the others leaves the group and finishes on
+   its own; so does every instance once one of them writes to code. */
+
+// make LANES=16 builds 16-wide groups
+#ifndef LOCKSTEP_LANES
+#define LOCKSTEP_LANES 8
+#endif
+
+// code is fetched from the first state, the others must hold the same program
+void runLockstep(CpuState *pStates[], uint32_t count);
+
+#endif
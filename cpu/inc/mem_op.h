@@ -1,11 +1,279 @@
 #ifndef MEM_OP_H
 #define MEM_OP_H
 
+#include <string.h>
 #include "utils.h"
 
-uint32_t load8(uint8_t *pMemory, uint8_t address);
-uint32_t load32(uint8_t *pMemory, uint32_t address);
-void store8(uint8_t *pMemory, uint32_t address, uint8_t data);
-void store32(uint8_t *pMemory, uint32_t address, uint32_t data);
+#define PAGE_SHIFT 8
+#define PAGE_SIZE  (1u << PAGE_SHIFT)
+
+// the whole 32-bit address space, RAM is reserved up front and committed on first touch
+#define MAX_MEMORY_SIZE 0x100000000ull
+
+// RAM stops short of the last 64 KiB, where devices are mapped
+#define DEVICE_BASE     0xFFFF0000u
+
+// per page flags, PAGE_CODE is set while decoded or translated code depends on the page
+enum
+{
+    PAGE_CODE = 1 << 0,
+    PAGE_DIRTY = 1 << 1,
+
+    // a watchpoint covers part of the page
+    PAGE_WATCH = 1 << 2,
+
+    // stored to at some point, unlike PAGE_DIRTY never cleared, so checkpoints know which pages to write
+    PAGE_WRITTEN = 1 << 3
+};
+
+// pages per bit of Memory.writtenChunks, 1 MiB of RAM
+#define WRITTEN_CHUNK_SHIFT 12
+#define WRITTEN_CHUNKS      (MAX_MEMORY_SIZE >> PAGE_SHIFT >> WRITTEN_CHUNK_SHIFT)
+
+/* An access that doesn't fit below `size` goes to the device bus, and
+   faults unless a device is mapped there: loads read 0, stores are
+   dropped, and the fault is latched for the run loop to stop on. A store
+   to the halt device or the exit service latches the same way with
+   `halted` set, so the engines stop on either without a check of their
+   own. */
+
+struct Bus;
+struct Replay;
+
+typedef struct Memory
+{
+    uint8_t    *pBytes;
+    uint8_t    *pPageFlags;
+    uint64_t    size;
+    bool        faulted;
+    uint32_t    faultAddress;
+    bool        halted;
+    uint32_t    exitStatus;
+    struct Bus *pBus;
+
+    // pages first stored to since the snapshot, NULL without one
+    uint32_t   *pDirtyPages;
+    uint32_t    dirtyCount;
+
+    // a bit per chunk of pages holding a PAGE_WRITTEN one, so a walk over those skips the rest of RAM
+    uint64_t    writtenChunks[WRITTEN_CHUNKS / 64];
+
+    // set while the run is recorded or replayed, device loads go through it
+    struct Replay *pReplay;
+} Memory;
+
+void *allocateZeroed(size_t size);
+void  freeZeroed(void *pBlock, size_t size);
+int   createMemory(Memory *pMemory, uint64_t size);
+void  destroyMemory(Memory *pMemory);
+int   mapImage(Memory *pMemory, int fd, uint64_t length);
+void  memoryFault(Memory *pMemory, uint32_t address);
+void  memoryHalt(Memory *pMemory, uint32_t status);
+void  pageDirtied(Memory *pMemory, uint32_t page);
+
+// the slow path of an access that missed RAM, in bus.c
+uint32_t deviceLoad(Memory *pMemory, uint32_t address, uint32_t width);
+void     deviceStore(Memory *pMemory, uint32_t address, uint32_t data, uint32_t width);
+
+static inline bool
+inMemory
+(
+    const Memory *pMemory,
+    uint32_t      address,
+    uint32_t      width
+)
+{
+    return (uint64_t)address + width <= pMemory->size;
+}
+
+// marks the pages of a store dirty and reports whether any of them holds code or is watched
+static inline bool
+markDirty
+(
+    Memory  *pMemory,
+    uint32_t address,
+    uint32_t length
+)
+{
+    uint32_t first = address >> PAGE_SHIFT;
+    uint32_t last = (address + length - 1) >> PAGE_SHIFT;
+    uint8_t  flags = pMemory->pPageFlags[first] | pMemory->pPageFlags[last];
+
+    // only the first store to a page since the snapshot leaves the fast path
+    if (!(pMemory->pPageFlags[first] & pMemory->pPageFlags[last] & PAGE_DIRTY))
+    {
+        pageDirtied(pMemory, first);
+        pageDirtied(pMemory, last);
+    }
+
+    return flags & (PAGE_CODE | PAGE_WATCH);
+}
+
+// markDirty for a range of any length, which a bulk copy can write
+static inline bool
+markRangeDirty
+(
+    Memory  *pMemory,
+    uint32_t address,
+    uint32_t length
+)
+{
+    uint32_t first = address >> PAGE_SHIFT;
+    uint32_t last = (address + length - 1) >> PAGE_SHIFT;
+    uint8_t  flags = 0;
+
+    for (uint32_t page = first; page <= last; page++)
+    {
+        flags |= pMemory->pPageFlags[page];
+        pageDirtied(pMemory, page);
+    }
+
+    return flags & (PAGE_CODE | PAGE_WATCH);
+}
+
+static inline uint32_t 
+load8
+(
+    Memory  *pMemory, 
+    uint32_t address
+)
+{
+    if (!inMemory(pMemory, address, 1))
+    {
+        return deviceLoad(pMemory, address, 1);
+    }
+
+    return pMemory->pBytes[address];
+}
+
+static inline uint32_t 
+load32
+(
+    Memory  *pMemory, 
+    uint32_t address
+)
+{
+    uint32_t wordBoundaryOffset = address % 4;
+    uint32_t aligned = address - wordBoundaryOffset;
+
+    if (!inMemory(pMemory, aligned, 4))
+    {
+        return deviceLoad(pMemory, address, 4);
+    }
+
+    uint8_t *pBytes = pMemory->pBytes + aligned;
+    uint32_t data = pBytes[0] | pBytes[1] << 8 | pBytes[2] << 16 | (uint32_t)pBytes[3] << 24;
+    return wordBoundaryOffset ? rotateRight(data, 8 * wordBoundaryOffset) : data;
+}
+
+static inline bool 
+store8
+(
+    Memory  *pMemory, 
+    uint32_t address, 
+    uint8_t  data
+)
+{
+    if (!inMemory(pMemory, address, 1))
+    {
+        deviceStore(pMemory, address, data, 1);
+        return false;
+    }
+
+    pMemory->pBytes[address] = data;
+    return markDirty(pMemory, address, 1);
+}
+
+static inline bool 
+store32
+(
+    Memory  *pMemory, 
+    uint32_t address, 
+    uint32_t data
+)
+{
+    if (!inMemory(pMemory, address, 4))
+    {
+        deviceStore(pMemory, address, data, 4);
+        return false;
+    }
+
+    uint8_t *pBytes = pMemory->pBytes + address;
+
+    pBytes[0] = bits(data, 7, 0);
+    pBytes[1] = bits(data, 15, 8);
+    pBytes[2] = bits(data, 23, 16);
+    pBytes[3] = bits(data, 31, 24);
+    return markDirty(pMemory, address, 4);
+} 
+
+/* LDM and STM move their words with one bounds check and one copy. A
+   block that doesn't fit in RAM as a whole faults like a single access,
+   at its lowest address; devices only take single loads and stores. */
+static inline void
+loadBlock
+(
+    Memory   *pMemory,
+    uint32_t  address,
+    uint32_t  words[],
+    uint32_t  count
+)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (!inMemory(pMemory, address, 4 * count))
+    {
+        memoryFault(pMemory, address);
+        memset(words, 0, 4 * count);
+        return;
+    }
+
+    memcpy(words, pMemory->pBytes + address, 4 * count);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (uint32_t word = 0; word < count; word++)
+    {
+        words[word] = __builtin_bswap32(words[word]);
+    }
+#endif
+}
+
+// like store32 reports whether the block hit a page holding code or a watchpoint
+static inline bool
+storeBlock
+(
+    Memory         *pMemory,
+    uint32_t        address,
+    const uint32_t  words[],
+    uint32_t        count
+)
+{
+    if (count == 0)
+    {
+        return false;
+    }
+
+    if (!inMemory(pMemory, address, 4 * count))
+    {
+        memoryFault(pMemory, address);
+        return false;
+    }
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (uint32_t word = 0; word < count; word++)
+    {
+        uint32_t swapped = __builtin_bswap32(words[word]);
+
+        memcpy(pMemory->pBytes + address + 4 * word, &swapped, 4);
+    }
+#else
+    memcpy(pMemory->pBytes + address, words, 4 * count);
+#endif
+
+    return markDirty(pMemory, address, 4 * count);
+}
 
 #endif
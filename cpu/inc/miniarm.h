@@ -0,0 +1,390 @@
+#ifndef MINIARM_H
+#define MINIARM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* libminiarm, the emulator as a library. Every emulated machine lives in
+   its own MiniArm context, so a process can create, run and destroy as
+   many of them as it likes. Calls on different contexts may run in
+   parallel, calls on the same context may not. Functions returning int
+   give 0 or a MINIARM_ status on success and -1 with errno set on error. */
+
+typedef struct MiniArm MiniArm;
+
+// execution modes
+enum
+{
+    MINIARM_INTERPRETER,
+    MINIARM_THREADED,
+    MINIARM_JIT
+};
+
+// why runMiniArm() returned
+enum
+{
+    MINIARM_HALTED,
+    MINIARM_LIMIT,
+    MINIARM_FAULT,
+
+    // stopped in front of a breakpoint, or after a store to a watchpoint
+    MINIARM_BREAKPOINT,
+    MINIARM_WATCHPOINT
+};
+
+// r0-r15 then the CPSR
+#define MINIARM_REGISTERS 17
+#define MINIARM_PC        15
+#define MINIARM_CPSR      16
+
+// the default RAM size, the full 32-bit address space less the device window
+#define MINIARM_MEMORY_SIZE 0x100000000ull
+
+// devices are mapped from here to the end of the address space, RAM ends below
+#define MINIARM_DEVICE_BASE 0xFFFF0000u
+
+/* The standard devices of mapMiniArmDevices(). Storing a byte or word to
+   the console at +0 prints it as a character, at +4 as a signed decimal
+   number and at +8 as 8 hex digits. The cycle counter reads the host's
+   time stamp counter (nanoseconds where there is none) at +0, then its
+   high word as of that read at +4. Each load from the input gives its
+   next byte, all ones at the end. A store to the halt register ends the
+   run with MINIARM_HALTED and the value as the exit status. */
+#define MINIARM_CONSOLE     0xFFFF0000u
+#define MINIARM_CYCLES      0xFFFF0100u
+#define MINIARM_INPUT       0xFFFF0200u
+#define MINIARM_HALT        0xFFFF0300u
+
+/* SWI services, numbered by the comment field of the SWI. They take
+   their arguments in r0-r2 and leave their result in r0, all ones when
+   the service doesn't exist or has no stream to use. */
+enum
+{
+    // r0 the exit status, the run ends with MINIARM_HALTED
+    MINIARM_SERVICE_EXIT,
+
+    // r0 address, r1 length, r0 = bytes written or read
+    MINIARM_SERVICE_WRITE,
+    MINIARM_SERVICE_READ,
+
+    // r0 destination, r1 source or byte, r2 length, r0 = destination; ranges may overlap
+    MINIARM_SERVICE_MEMCPY,
+    MINIARM_SERVICE_MEMSET,
+
+    // r0 and r1 the ranges, r2 length, r0 = -1, 0 or 1
+    MINIARM_SERVICE_MEMCMP
+};
+
+// offset is from the device's address, width 1 or 4; a device without load or store faults on it
+typedef struct MiniArmDevice
+{
+    uint32_t (*load)(void *pContext, uint32_t offset, uint32_t width);
+    void     (*store)(void *pContext, uint32_t offset, uint32_t value, uint32_t width);
+    void     *pContext;
+} MiniArmDevice;
+
+// superinstructions of the threaded interpreter, see threaded.h
+enum
+{
+    MINIARM_FUSION_COMPARE_BRANCH,
+    MINIARM_FUSION_ARITHMETIC_COMPARE,
+    MINIARM_FUSION_LOAD_USE,
+    MINIARM_FUSIONS
+};
+
+typedef struct MiniArmStatistics
+{
+    uint64_t instructions;
+
+    // translation cache counters, all 0 outside MINIARM_JIT
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t chained;
+    uint64_t invalidations;
+    uint64_t flushes;
+
+    // instructions run in a runMiniArmLockstep() group, times a branch made the instance leave one
+    uint64_t lockstepInstructions;
+    uint64_t divergences;
+
+    // pipeline timing model, all 0 unless setMiniArmTiming() enabled it
+    uint64_t cycles;
+    uint64_t loadUseStalls;
+    uint64_t flushCycles;
+    uint64_t pipelineFlushes;
+
+    // instructions written to execution traces, and run while the trace ring was full and dropped from them
+    uint64_t tracedInstructions;
+    uint64_t traceDropped;
+
+    // pairs run as one fused handler by MINIARM_THREADED, by MINIARM_FUSION_ kind
+    uint64_t fusions[MINIARM_FUSIONS];
+} MiniArmStatistics;
+
+// cache levels of setMiniArmCaches() and their replacement policies
+enum
+{
+    MINIARM_CACHE_L1I,
+    MINIARM_CACHE_L1D,
+    MINIARM_CACHE_L2,
+    MINIARM_CACHE_LEVELS
+};
+
+enum
+{
+    MINIARM_CACHE_LRU,
+    MINIARM_CACHE_FIFO,
+    MINIARM_CACHE_RANDOM
+};
+
+// sizes in bytes, powers of two, a size of 0 leaves the level out
+typedef struct MiniArmCacheConfig
+{
+    uint32_t size;
+    uint32_t ways;
+    uint32_t lineSize;
+    int      replacement;
+} MiniArmCacheConfig;
+
+typedef struct MiniArmCacheStatistics
+{
+    uint64_t accesses;
+    uint64_t misses;
+    uint64_t writebacks;
+} MiniArmCacheStatistics;
+
+// what one instruction did to the caches, its fetches are the times it ran
+typedef struct MiniArmCacheCounts
+{
+    uint32_t pc;
+    uint64_t fetches;
+    uint64_t fetchMisses;
+    uint64_t dataAccesses;
+    uint64_t dataMisses;
+    uint64_t l2Misses;
+} MiniArmCacheCounts;
+
+// direction predictors of setMiniArmPredictors(), all evaluated on the same run
+enum
+{
+    MINIARM_PREDICTOR_BTFN,
+    MINIARM_PREDICTOR_BIMODAL,
+    MINIARM_PREDICTOR_GSHARE,
+    MINIARM_PREDICTORS
+};
+
+// table sizes in entries, powers of two; gshare hashes historyBits of global history into its table
+typedef struct MiniArmPredictorConfig
+{
+    uint32_t bimodalEntries;
+    uint32_t gshareEntries;
+    uint32_t historyBits;
+    uint32_t btbEntries;
+} MiniArmPredictorConfig;
+
+typedef struct MiniArmBranchStatistics
+{
+    // conditional branches, executed or not, how many were taken and how many each predictor got wrong
+    uint64_t conditional;
+    uint64_t taken;
+    uint64_t mispredictions[MINIARM_PREDICTORS];
+
+    // taken branches and other PC writes, and how many of their targets the BTB didn't hold
+    uint64_t transfers;
+    uint64_t btbMisses;
+
+    // other conditional instructions and how many of them failed their condition
+    uint64_t predicated;
+    uint64_t predicatedSkipped;
+} MiniArmBranchStatistics;
+
+// what one branch did, its executions count the times its condition was evaluated
+typedef struct MiniArmBranchCounts
+{
+    uint32_t pc;
+    uint64_t executions;
+    uint64_t taken;
+    uint64_t mispredictions[MINIARM_PREDICTORS];
+    uint64_t btbMisses;
+} MiniArmBranchCounts;
+
+/* What the guest executed, kept only by a library built with make STATS=1.
+   Counts of executed instructions leave out the ones whose condition
+   failed, which are counted in conditionFailed instead. */
+typedef struct MiniArmExecutionStatistics
+{
+    // executed and condition failed
+    uint64_t instructions;
+    uint64_t conditionFailed;
+
+    uint64_t dataProcessing;
+    uint64_t multiplies;
+    uint64_t byteLoads;
+    uint64_t wordLoads;
+    uint64_t byteStores;
+    uint64_t wordStores;
+
+    // LDM and STM, and the words they moved
+    uint64_t blockLoads;
+    uint64_t blockStores;
+    uint64_t blockWordsLoaded;
+    uint64_t blockWordsStored;
+    uint64_t takenBranches;
+    uint64_t untakenBranches;
+    uint64_t serviceCalls;
+    uint64_t undefined;
+
+    // data processing by opcode, AND through MVN in encoding order
+    uint64_t opcodes[16];
+} MiniArmExecutionStatistics;
+
+MiniArm *createMiniArm(uint64_t memorySize, int mode);
+void     destroyMiniArm(MiniArm *pMiniArm);
+
+// a program halts when the PC reaches the end of its image, loaded at address 0
+int      loadMiniArmImage(MiniArm *pMiniArm, const void *pImage, size_t size);
+int      loadMiniArmFile(MiniArm *pMiniArm, const char *path);
+
+// runs at most count instructions, or until the program halts when count is 0
+int      runMiniArm(MiniArm *pMiniArm, uint64_t count);
+
+/* Runs count contexts holding the same program side by side, each for at
+   most instructionCount instructions, and stores what runMiniArm() would
+   have returned for each in results. Up to getMiniArmLockstepLanes()
+   contexts step together as one SIMD group while their PCs agree, the
+   rest of the way each runs in its own mode. Contexts whose image differs
+   from the first of their group run alone. */
+int      runMiniArmLockstep(MiniArm *pMiniArms[], uint32_t count, uint64_t instructionCount, int results[]);
+uint32_t getMiniArmLockstepLanes(void);
+
+/* Times every instruction on a model of a 5-stage in-order pipeline with
+   forwarding, counting cycles along with load-use stalls and the cycles
+   taken branches flush. The threaded interpreter times runs in either
+   threaded or JIT mode, as translated code isn't timed; runs in
+   interpreter mode, with caches or with predictors are interpreted.
+   Enabling it again keeps the counts, disabling it drops them. */
+void     setMiniArmTiming(MiniArm *pMiniArm, bool enabled);
+
+/* Simulates the caches of configs[MINIARM_CACHE_LEVELS] on every fetch
+   and data access from now on, NULL stops and drops the simulation.
+   Cached runs are interpreted in any mode. An invalid geometry fails
+   with EINVAL. Counts per instruction cover the image loaded before the
+   call; getMiniArmCacheHotspots() fills up to count of them, the
+   instructions that missed L1 most first, and returns how many. */
+int      setMiniArmCaches(MiniArm *pMiniArm, const MiniArmCacheConfig configs[]);
+void     getMiniArmCacheStatistics(const MiniArm *pMiniArm, MiniArmCacheStatistics statistics[]);
+uint32_t getMiniArmCacheHotspots(const MiniArm *pMiniArm, MiniArmCacheCounts counts[], uint32_t count);
+
+/* Predicts every control-flow decision from now on with static
+   backward-taken/forward-not-taken, bimodal and gshare direction
+   predictors side by side, and every taken branch or other PC write with
+   a direct-mapped BTB, NULL stops and drops the predictors. Branches are
+   B and BL and the instructions that write the PC; other conditional
+   instructions are only counted, so an if-converted loop and a branchy
+   one can be compared. Predicted runs are interpreted in any mode. An
+   invalid table size fails with EINVAL. Counts per branch cover the image
+   loaded before the call; getMiniArmBranchHotspots() fills up to count of
+   them, the ones predictor and the BTB got wrong most first. */
+int      setMiniArmPredictors(MiniArm *pMiniArm, const MiniArmPredictorConfig *pConfig);
+void     getMiniArmBranchStatistics(const MiniArm *pMiniArm, MiniArmBranchStatistics *pStatistics);
+uint32_t getMiniArmBranchHotspots(const MiniArm *pMiniArm, int predictor, MiniArmBranchCounts counts[], uint32_t count);
+
+/* Breakpoints stop a run in front of the instruction at their address,
+   which runs when the run is resumed. Watchpoints stop it after a guest
+   store to any of their bytes; getMiniArmWatchpoint() gives the first
+   watched address the store wrote. Both are patched into the engines,
+   so code that doesn't hit one runs at full speed in any mode. Setting
+   one that exists or clearing one that doesn't fails with EEXIST or
+   ENOENT. */
+int      setMiniArmBreakpoint(MiniArm *pMiniArm, uint32_t address, bool enabled);
+int      setMiniArmWatchpoint(MiniArm *pMiniArm, uint32_t address, uint32_t length, bool enabled);
+bool     getMiniArmWatchpoint(const MiniArm *pMiniArm, uint32_t *pAddress);
+
+/* Writes every instruction the context runs from now on to a compact
+   binary trace at path: its address and encoding, the registers it wrote
+   and the memory it accessed. The records go through a ring buffer to a
+   writer thread of the context, so the run never waits on the file or
+   the writer: while the ring is full, instructions run without a record
+   and the trace counts them in a gap. Traced runs are interpreted in
+   any mode, and still timed, cached and predicted when those are on.
+   Stopping flushes and closes the trace, and fails if any of it could
+   not be written; tracedump prints it. */
+int      startMiniArmTrace(MiniArm *pMiniArm, const char *path);
+int      stopMiniArmTrace(MiniArm *pMiniArm);
+
+/* Maps a device over whole 256-byte pages of the device window, where
+   guest loads and stores of a byte or word call it instead of faulting.
+   RAM accesses don't pay for the devices, only those that miss RAM look
+   up the page they hit. A context takes up to 16 devices, mapping over
+   another one fails with EEXIST. mapMiniArmDevices() maps the standard
+   devices with the console writing to pOutput and the input reading
+   from pInput, which may be NULL for no input. */
+int      mapMiniArmDevice(MiniArm *pMiniArm, uint32_t address, uint32_t length, const MiniArmDevice *pDevice);
+int      mapMiniArmDevices(MiniArm *pMiniArm, FILE *pOutput, FILE *pInput);
+
+/* Sets the streams the write and read services use, both NULL until
+   then, which makes the services fail. The other services need none. */
+void     setMiniArmSemihosting(MiniArm *pMiniArm, FILE *pOutput, FILE *pInput);
+
+// the value stored to the halt register or passed to the exit service, false if the program halted otherwise
+bool     getMiniArmExitStatus(const MiniArm *pMiniArm, uint32_t *pStatus);
+
+uint32_t getMiniArmRegister(MiniArm *pMiniArm, int index);
+void     setMiniArmRegister(MiniArm *pMiniArm, int index, uint32_t value);
+int      readMiniArmMemory(MiniArm *pMiniArm, uint32_t address, void *pBuffer, size_t length);
+int      writeMiniArmMemory(MiniArm *pMiniArm, uint32_t address, const void *pBuffer, size_t length);
+
+/* Saves the registers, the CPSR, guest RAM, the image size and the
+   instruction count, and rolls the context back to them, as often as
+   needed. From the snapshot on every page is logged on its first store,
+   so a restore copies back only the pages the run wrote and costs what it
+   touched, not the size of RAM. Devices, streams, breakpoints, models
+   and statistics stay as they are. Taking another snapshot replaces the
+   last one, restoring without one fails with ENOENT. */
+int      snapshotMiniArm(MiniArm *pMiniArm);
+int      restoreMiniArm(MiniArm *pMiniArm);
+
+/* Writes the registers, the CPSR, every page of RAM ever written, the
+   image size, the instruction count and the state of the standard
+   devices to a checkpoint at path. A forked copy of the process writes
+   it while the run goes on and renames it over path when done, so path
+   holds the last whole checkpoint; starting one while the last is still
+   written fails with EBUSY, waitMiniArmCheckpoint() waits for it and
+   fails with EIO if it could not be written. resumeMiniArm() maps a
+   checkpoint back into a context that has had nothing loaded or run
+   (EBUSY otherwise), and seeks its input streams back to where they were
+   if they can seek, so they have to be set before. */
+int      checkpointMiniArm(MiniArm *pMiniArm, const char *path);
+int      waitMiniArmCheckpoint(MiniArm *pMiniArm);
+int      resumeMiniArm(MiniArm *pMiniArm, const char *path);
+
+/* Records what the run from now on takes from outside to a log at path:
+   the value of every device load and the bytes of every read service,
+   each with the instruction count it happened at, after a hash of the
+   state recording starts from. Nothing else is logged, so a recorded run
+   is as fast as any other. replayMiniArm() runs a context holding that
+   same state, with the same devices mapped and streams set, from such a
+   log instead: the guest gets the logged values rather than what the
+   devices and the input have now, in any mode, and the run stops where
+   the recording did. A log of another state fails with EINVAL. A load or
+   service call the log doesn't have at that instruction stops the run
+   with a fault, getMiniArmReplayDivergence() gives its count. Stopping a
+   recording ends the log with a hash of the registers and the memory,
+   and fails with EIO if any of it could not be written; stopping a
+   replay that got as far compares them, a difference counts as a
+   divergence at the end. A context takes one log at a time (EBUSY). */
+int      recordMiniArm(MiniArm *pMiniArm, const char *path);
+int      replayMiniArm(MiniArm *pMiniArm, const char *path);
+int      stopMiniArmReplay(MiniArm *pMiniArm);
+bool     getMiniArmReplayDivergence(const MiniArm *pMiniArm, uint64_t *pInstruction);
+
+// the address of the access that stopped the run, false if none did
+bool     getMiniArmFault(const MiniArm *pMiniArm, uint32_t *pAddress);
+void     getMiniArmStatistics(const MiniArm *pMiniArm, MiniArmStatistics *pStatistics);
+
+// fails with ENOSYS when the library was built without STATS=1
+int      getMiniArmExecutionStatistics(const MiniArm *pMiniArm, MiniArmExecutionStatistics *pStatistics);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include "flags.h"
+#include "interpreter.h"
+#include "miniarm.h"
+#include "semihost.h"
+
+/* Runtime of images translated ahead of time by aot, which writes a C
+   file with the image and a run function holding one labelled block per
+   basic block of it. Direct branches go from block to block, other PC
+   writes through a switch over the block addresses; the run function
+   returns whenever the PC has no block, the next block doesn't fit the
+   budget, or the run has to stop. The interpreter takes each instruction
+   the translation doesn't cover, and the rest of the run once a store or
+   a service writes to the image, whose translation is then stale. */
+
+typedef struct NativeImage
+{
+    // runs blocks from registers[PC] for up to budget instructions, counting them in pState->instructions
+    void          (*run)(CpuState *pState, uint64_t budget);
+    const uint8_t  *pImage;
+    uint32_t        size;
+} NativeImage;
+
+// the image has to be loaded already, a translation of another size fails with EINVAL
+int  setMiniArmNative(MiniArm *pMiniArm, const NativeImage *pNative);
+void runNative(CpuState *pState);
+
+// main() of a translated program, takes the -n, -b and -D options of cpu
+int  runNativeProgram(const NativeImage *pNative, int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "interpreter.h"
+
+/* Timing model of a classic in-order IF/ID/EX/MEM/WB pipeline, driven by
+   the interpreter or the threaded interpreter as they execute. Results
+   are forwarded to EX from MEM and WB, and to MEM for store data, so the
+   only data hazard left is a load followed by an instruction that needs
+   the loaded register in EX, which stalls one cycle. Branches resolve in
+   EX and a PC loaded from memory in MEM; a taken one flushes the
+   instructions fetched behind it. LDM and STM hold MEM for a cycle per
+   word, and the last word an LDM loads is the one a following
+   instruction can have to wait for. */
+
+#define PIPELINE_STAGES        5
+#define PIPELINE_BRANCH_FLUSH  2
+#define PIPELINE_LOAD_PC_FLUSH 3
+
+// no load in flight
+#define PIPELINE_NO_REGISTER   0xFF
+
+typedef struct Pipeline
+{
+    uint64_t cycles;
+    uint64_t loadUseStalls;
+    uint64_t flushCycles;
+    uint64_t flushes;
+
+    // destination of a load still in MEM when the next instruction is in EX
+    uint8_t  loadRegister;
+} Pipeline;
+
+void resetPipeline(Pipeline *pPipeline);
+void interpretTimed(CpuState *pState);
+
+// store data isn't needed before MEM, where it is forwarded in time
+static inline bool
+readsInExecute
+(
+    const DecodedInstruction *pDecoded,
+    uint32_t                  index
+)
+{
+    switch(pDecoded->operation)
+    {
+    case DATA:
+        if (pDecoded->opcode != MOV && pDecoded->opcode != MVN && pDecoded->rn == index)
+        {
+            return true;
+        }
+
+        if (pDecoded->operand2 == OPERAND_IMMEDIATE)
+        {
+            return false;
+        }
+
+        return pDecoded->rm == index || (pDecoded->operand2 == OPERAND_REGISTER_SHIFT && pDecoded->rs == index);
+    case MUL:
+        return pDecoded->rs == index || pDecoded->rm == index || (pDecoded->accumulate && pDecoded->rd == index);
+    case LDR:
+    case LDRB:
+    case STR:
+    case STRB:
+        return pDecoded->rn == index || (pDecoded->operand2 != OPERAND_IMMEDIATE && pDecoded->rm == index);
+    case LDM:
+    case STM:
+        return pDecoded->rn == index;
+    case SWI:
+        return index <= 2;
+    }
+
+    return false;
+}
+
+/* Times an instruction once it has executed or failed its condition. The
+   interpreter and the threaded handlers both retire every instruction
+   through here, in program order; sequential is false when it wrote the
+   PC anywhere but the next instruction. */
+static inline void
+retireTimed
+(
+    Pipeline                 *pPipeline,
+    const DecodedInstruction *pDecoded,
+    bool                      executed,
+    bool                      sequential
+)
+{
+    // the first instruction completes once it has gone through every stage
+    if (pPipeline->cycles == 0)
+    {
+        pPipeline->cycles = PIPELINE_STAGES - 1;
+    }
+
+    pPipeline->cycles++;
+
+    // the ID stage can't tell yet whether the condition passes, so it stalls regardless
+    if (pPipeline->loadRegister != PIPELINE_NO_REGISTER && readsInExecute(pDecoded, pPipeline->loadRegister))
+    {
+        pPipeline->cycles++;
+        pPipeline->loadUseStalls++;
+    }
+
+    uint8_t loaded = PIPELINE_NO_REGISTER;
+
+    if (executed && (pDecoded->operation == LDR || pDecoded->operation == LDRB))
+    {
+        loaded = pDecoded->rd;
+    }
+    else if (executed && (pDecoded->operation == LDM || pDecoded->operation == STM) && pDecoded->registerCount)
+    {
+        pPipeline->cycles += pDecoded->registerCount - 1;
+
+        if (pDecoded->operation == LDM)
+        {
+            loaded = 31 - __builtin_clz(pDecoded->immediate);
+        }
+    }
+
+    pPipeline->loadRegister = loaded;
+
+    // fetch runs ahead sequentially, a taken branch or any other PC write flushes it
+    if (!sequential)
+    {
+        uint32_t flush = loaded == PC ? PIPELINE_LOAD_PC_FLUSH : PIPELINE_BRANCH_FLUSH;
+
+        pPipeline->cycles += flush;
+        pPipeline->flushCycles += flush;
+        pPipeline->flushes++;
+    }
+}
+
+#endif
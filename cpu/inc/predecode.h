@@ -0,0 +1,119 @@
+#ifndef PREDECODE_H
+#define PREDECODE_H
+
+#include "cpu.h"
+#include "utils.h"
+#include "mem_op.h"
+
+enum
+{
+    OPERAND_IMMEDIATE = 0,
+    OPERAND_REGISTER = 1,
+    OPERAND_REGISTER_SHIFT = 2
+};
+
+/* Every bitfield the execute stage needs, extracted once per address.
+   For data processing `immediate` is the already rotated operand2 and
+   `shiftAmount` the rotation, for transfers it is the 12-bit offset, for
+   block transfers the register list, for branches the final PC
+   adjustment and for SWI the service number. `handler` is the threaded
+   handler of the instruction alone, `dispatch` the one the threaded
+   interpreter jumps to, a fused handler when the entry starts a pair. */
+
+typedef struct DecodedInstruction
+{
+    uint32_t instruction;
+    uint32_t operation;
+    uint32_t immediate;
+    uint16_t handler;
+    uint16_t dispatch;
+    uint8_t  condition;
+    uint8_t  opcode;
+    uint8_t  rn;
+    uint8_t  rd;
+    uint8_t  rs;
+    uint8_t  rm;
+    uint8_t  operand2;
+    uint8_t  shiftType;
+    uint8_t  shiftAmount;
+    uint8_t  registerCount;
+    bool     alterCPSR;
+    bool     accumulate;
+    bool     preindex;
+    bool     up;
+    bool     link;
+    bool     writeback;
+    bool     valid;
+} DecodedInstruction;
+
+// decoded entries are allocated a region at a time, the first time code runs there
+#define DECODE_REGION_SHIFT   16
+#define DECODE_REGION_ENTRIES ((1u << DECODE_REGION_SHIFT) / 4)
+
+// what a fetch outside RAM executes, an undefined instruction
+#define FAULT_INSTRUCTION     0xEC000000
+
+// the condition of a breakpoint entry, which no engine passes
+#define CONDITION_BREAKPOINT  16
+
+typedef struct DecodeCache
+{
+    DecodedInstruction **ppRegions;
+    DecodedInstruction   scratch;
+    uint32_t             regionCount;
+
+    // one past the highest region allocated, bounds the walks over them
+    uint32_t             regionsUsed;
+
+    // addresses decoded as BREAKPOINT entries
+    const uint32_t      *pBreakpoints;
+    uint32_t             breakpointCount;
+} DecodeCache;
+
+uint32_t            decode(uint32_t instruction);
+void                predecode(uint32_t instruction, DecodedInstruction *pDecoded);
+int                 createDecodeCache(DecodeCache *pCache, uint64_t memorySize);
+void                destroyDecodeCache(DecodeCache *pCache);
+DecodedInstruction *fetchDecoded(DecodeCache *pCache, Memory *pMemory, uint32_t address);
+void                invalidateDecoded(DecodeCache *pCache, uint32_t address, uint32_t length);
+bool                writesProgramCounter(const DecodedInstruction *pDecoded);
+
+/* The lowest address an LDM or STM transfers, and in pWritten the base
+   it leaves behind: IA starts at the base, IB above it, DA and DB end at
+   or below it. The low address bits are ignored. */
+static inline uint32_t
+blockAddress
+(
+    const DecodedInstruction *pDecoded,
+    uint32_t                  base,
+    uint32_t                 *pWritten
+)
+{
+    uint32_t length = 4 * pDecoded->registerCount;
+    uint32_t end = pDecoded->up ? base + length : base - length;
+    uint32_t start = pDecoded->up ? base + 4 * pDecoded->preindex : end + 4 * !pDecoded->preindex;
+
+    *pWritten = pDecoded->writeback ? end : base;
+    return start & ~3u;
+}
+
+// the entry for an aligned address when it is already decoded
+static inline DecodedInstruction *
+lookupDecoded
+(
+    const DecodeCache *pCache,
+    uint32_t           address
+)
+{
+    uint32_t region = address >> DECODE_REGION_SHIFT;
+
+    if (address % 4 != 0 || region >= pCache->regionCount || !pCache->ppRegions[region])
+    {
+        return NULL;
+    }
+
+    DecodedInstruction *pDecoded = &pCache->ppRegions[region][address % (1u << DECODE_REGION_SHIFT) / 4];
+    return pDecoded->valid ? pDecoded : NULL;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include "interpreter.h"
+#include "miniarm.h"
+
+/* Branch prediction models, told the outcome of every instruction by
+   executeRecorded(). A branch is B or BL, or any other instruction that
+   writes the PC. Conditional branches go to the direction predictors:
+   BTFN predicts a B or BL taken when it jumps backwards and anything else
+   not taken, bimodal keeps a 2-bit saturating counter per PC and gshare
+   one per PC xor the global history of conditional outcomes. Every taken
+   branch looks its PC up in the BTB, which only hits when it holds the
+   target the branch went to. The counters start weakly not taken. */
+
+typedef struct BranchTarget
+{
+    uint32_t pc;
+    uint32_t target;
+} BranchTarget;
+
+typedef struct Predictors
+{
+    uint8_t      *pBimodal;
+    uint8_t      *pGshare;
+    BranchTarget *pTargets;
+    uint32_t      bimodalMask;
+    uint32_t      gshareMask;
+    uint32_t      historyMask;
+    uint32_t      history;
+    uint32_t      targetMask;
+
+    MiniArmBranchStatistics statistics;
+
+    // per instruction word of the image, the pc field unused
+    MiniArmBranchCounts *pCounts;
+    uint32_t             words;
+} Predictors;
+
+int  createPredictors(Predictors *pPredictors, const MiniArmPredictorConfig *pConfig, uint32_t imageSize);
+void destroyPredictors(Predictors *pPredictors);
+void predictBranch(Predictors *pPredictors, const DecodedInstruction *pDecoded, uint32_t pc, bool executed,
+                   uint32_t next);
+
+#endif
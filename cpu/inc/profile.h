@@ -0,0 +1,32 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include "miniarm.h"
+
+/* Sampling profiler of the cpu front end. The program runs in slices of
+   `interval` instructions and the PC is sampled between them, so it works
+   in every mode and costs next to nothing at large intervals; an interval
+   of 1 counts every instruction exactly. Samples are attributed to the
+   labels of the side-car symbol file the assembler writes, one
+   "0x<address> <label>" line per label. */
+
+typedef struct Profile
+{
+    uint32_t  interval;
+    uint64_t  samples;
+
+    // samples per instruction word of the image, and with the PC beyond it
+    uint64_t *pCounts;
+    uint32_t  words;
+    uint64_t  outside;
+} Profile;
+
+int  createProfile(Profile *pProfile, uint32_t interval, uint64_t imageSize);
+void destroyProfile(Profile *pProfile);
+
+// runMiniArm() with count 0 meaning until the program stops, sampling as it goes
+int  runProfiled(MiniArm *pMiniArm, uint64_t count, Profile *pProfile);
+int  printProfile(const Profile *pProfile, const char *symbolPath, FILE *output);
+
+#endif
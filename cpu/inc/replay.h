@@ -0,0 +1,76 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "interpreter.h"
+
+/* Record and replay. A recorded run logs only what the guest can't compute
+   itself: the value of every device load and the bytes of every read
+   service, each stamped with the count of the instruction that made it.
+   A replay hands the logged values back in the same order instead of
+   asking the devices and the input, so the run repeats itself exactly.
+   The engines bring the instruction count up to date before a device load
+   or a service call, so a log recorded in one mode replays in any other.
+
+   A log starts with REPLAY_MAGIC, a version byte, 3 reserved bytes, the
+   RAM size and a hash of the state recording started from: the registers,
+   the instruction count and every page written, the image among them.
+   Both are 64-bit little endian words. Each event then takes a tag byte,
+   a varint of the instructions since the previous event and:
+
+       REPLAY_LOAD   a varint of the address less DEVICE_BASE and one of
+                     the value loaded
+       REPLAY_READ   a varint of the bytes read, then the bytes
+       REPLAY_END    the hash of the state the recording stopped in
+
+   A log without its end, from a recording that never stopped, replays up
+   to its last whole event. */
+
+#define REPLAY_MAGIC   "MARP"
+#define REPLAY_VERSION 1
+
+enum
+{
+    REPLAY_LOAD = 1,
+    REPLAY_READ,
+    REPLAY_END
+};
+
+typedef struct Replay
+{
+    CpuState *pState;
+    bool      replaying;
+
+    // the log being recorded
+    FILE     *pLog;
+    uint64_t  recorded;
+
+    // the log being replayed, read whole, and the next event in it
+    uint8_t  *pEvents;
+    size_t    size;
+    size_t    next;
+    uint8_t   kind;
+    uint64_t  at;
+
+    // the instruction count the log ends at, UINT64_MAX without an end
+    uint64_t  end;
+    uint64_t  endHash;
+
+    // the instruction count of the first access the log didn't have
+    bool      diverged;
+    uint64_t  divergence;
+} Replay;
+
+int  startRecording(Replay *pReplay, CpuState *pState, const char *path);
+int  startReplay(Replay *pReplay, CpuState *pState, const char *path);
+
+// writes the end of a recording, or checks a replay that got there against it
+int  stopReplay(Replay *pReplay);
+
+// a device load or read service in a replay, false when the log has another access there
+bool replayLoad(Replay *pReplay, uint32_t address, uint32_t *pValue);
+bool replayRead(Replay *pReplay, uint8_t *pBuffer, uint32_t length, uint32_t *pCount);
+void recordLoad(Replay *pReplay, uint32_t address, uint32_t value);
+void recordRead(Replay *pReplay, const uint8_t *pBuffer, uint32_t count);
+
+#endif
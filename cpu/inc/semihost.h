@@ -0,0 +1,16 @@
+#ifndef SEMIHOST_H
+#define SEMIHOST_H
+
+#include "interpreter.h"
+
+/* SWI semihosting. The comment field of an SWI picks one of the
+   MINIARM_SERVICE_ services, which take their arguments in r0-r2 and
+   leave their result in r0. The bulk memory services run as a single
+   host memmove, memset or memcmp over guest RAM, with one bounds check
+   for the whole range; a range that doesn't fit in RAM faults at its
+   start. Exit halts the run like a store to the halt device. */
+
+// true when a watchpoint stops the run, like storeWritten()
+bool semihost(CpuState *pState, uint32_t service);
+
+#endif
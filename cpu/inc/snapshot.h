@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "interpreter.h"
+
+/* A saved CPU state for restoreMiniArm() to roll back to. RAM is copied
+   into a reservation of its own size, of which only the pages written
+   before the first snapshot get committed. From then on the memory logs
+   each page on its first store, see pageDirtied(), so a restore copies
+   back the logged pages alone and a later snapshot only takes those. */
+
+typedef struct Snapshot
+{
+    // NULL until the first snapshot
+    uint8_t  *pBytes;
+    uint64_t  size;
+
+    uint32_t  registers[17];
+    LazyFlags flags;
+    uint32_t  programSize;
+    uint64_t  instructions;
+    bool      faulted;
+    uint32_t  faultAddress;
+    bool      halted;
+    uint32_t  exitStatus;
+
+    // the translation in use, still valid once the image is copied back
+    const struct NativeImage *pNative;
+} Snapshot;
+
+int  takeSnapshot(Snapshot *pSnapshot, CpuState *pState);
+void restoreSnapshot(const Snapshot *pSnapshot, CpuState *pState);
+void destroySnapshot(Snapshot *pSnapshot, Memory *pMemory);
+
+#endif
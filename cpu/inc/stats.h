@@ -0,0 +1,36 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "miniarm.h"
+#include "threaded.h"
+
+/* Execution statistics, compiled in with make STATS=1. The engines count
+   every instruction under its threaded handler id, once executed or once
+   skipped by its condition, which costs a single increment, and LDM and
+   STM add up the words they move. The breakdown
+   by class, opcode and access width is worked out from the handler ids
+   when the counts are read. Without MINIARM_STATS the counting macros
+   expand to nothing. */
+
+typedef struct ExecutionCounts
+{
+    uint64_t executed[HANDLER_COUNT];
+    uint64_t skipped[HANDLER_COUNT];
+
+    // words moved by LDM and by STM, which the handler ids alone don't tell
+    uint64_t blockWords[2];
+} ExecutionCounts;
+
+void summarizeCounts(const ExecutionCounts *pCounts, MiniArmExecutionStatistics *pStatistics);
+
+#ifdef MINIARM_STATS
+#define COUNT_EXECUTED(pCounts, pDecoded) ((pCounts)->executed[(pDecoded)->handler]++)
+#define COUNT_SKIPPED(pCounts, pDecoded)  ((pCounts)->skipped[(pDecoded)->handler]++)
+#define COUNT_BLOCK(pCounts, pDecoded)    ((pCounts)->blockWords[(pDecoded)->operation == STM] += (pDecoded)->registerCount)
+#else
+#define COUNT_EXECUTED(pCounts, pDecoded) ((void)0)
+#define COUNT_SKIPPED(pCounts, pDecoded)  ((void)0)
+#define COUNT_BLOCK(pCounts, pDecoded)    ((void)0)
+#endif
+
+#endif
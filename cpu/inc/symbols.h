@@ -0,0 +1,20 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+
+/* The side-car symbol file the assembler writes, one "0x<address> <label>"
+   line per label, as used by the profiler and the debugger. */
+
+typedef struct Symbol
+{
+    uint32_t address;
+    char    *pName;
+} Symbol;
+
+int      loadSymbols(const char *path, Symbol **ppSymbols, uint32_t *pCount);
+void     freeSymbols(Symbol *pSymbols, uint32_t count);
+uint32_t findSymbol(const Symbol *pSymbols, uint32_t count, uint32_t address);
+uint32_t findSymbolNamed(const Symbol *pSymbols, uint32_t count, const char *name);
+
+#endif
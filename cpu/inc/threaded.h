@@ -0,0 +1,106 @@
+#ifndef THREADED_H
+#define THREADED_H
+
+#include "interpreter.h"
+
+/* Handler lists for the threaded interpreter. Every data processing
+   instruction gets a handler specialized on its opcode, S bit, operand2
+   form (IMM rotated immediate, REG register shifted by an immediate, RSH
+   register shifted by a register) and shift type. The lists drive both the
+   HANDLER_ ids stored by predecode and the handler bodies in threaded.c.
+
+   Fused handlers run a pair of instructions on one page as a single
+   superinstruction: TST, TEQ, CMP or CMN then a conditional B or BL, ADD
+   or SUB of an immediate then a CMP of its result, and an LDR with an
+   immediate offset then a data processing instruction reading the loaded
+   register. Pages are invalidated as a whole, so a pair goes stale with
+   both its halves. Builds with -DNO_FUSION leave every pair apart. */
+
+#define OPERAND2_VARIANTS(X, opcode, s) \
+    X(opcode, s, IMM, LSL)              \
+    X(opcode, s, REG, LSL)              \
+    X(opcode, s, REG, LSR)              \
+    X(opcode, s, REG, ASR)              \
+    X(opcode, s, REG, ROR)              \
+    X(opcode, s, RSH, LSL)              \
+    X(opcode, s, RSH, LSR)              \
+    X(opcode, s, RSH, ASR)              \
+    X(opcode, s, RSH, ROR)
+
+#define OPERAND2_VARIANT_COUNT 9
+
+#define FLAG_VARIANTS(X, opcode)    \
+    OPERAND2_VARIANTS(X, opcode, 0) \
+    OPERAND2_VARIANTS(X, opcode, 1)
+
+// opcodes in encoding order so a handler id can be computed from the opcode
+#define DATA_HANDLERS(X) \
+    FLAG_VARIANTS(X, AND) \
+    FLAG_VARIANTS(X, EOR) \
+    FLAG_VARIANTS(X, SUB) \
+    FLAG_VARIANTS(X, RSB) \
+    FLAG_VARIANTS(X, ADD) \
+    FLAG_VARIANTS(X, ADC) \
+    FLAG_VARIANTS(X, SBC) \
+    FLAG_VARIANTS(X, RSC) \
+    FLAG_VARIANTS(X, TST) \
+    FLAG_VARIANTS(X, TEQ) \
+    FLAG_VARIANTS(X, CMP) \
+    FLAG_VARIANTS(X, CMN) \
+    FLAG_VARIANTS(X, ORR) \
+    FLAG_VARIANTS(X, MOV) \
+    FLAG_VARIANTS(X, BIC) \
+    FLAG_VARIANTS(X, MVN)
+
+// MUL handlers are ordered by (accumulate, S) and transfers by OPERAND_ kind
+#define OTHER_HANDLERS(X) \
+    X(UNDEFINED)          \
+    X(MUL)                \
+    X(MULS)               \
+    X(MLA)                \
+    X(MLAS)               \
+    X(LDR_IMM)            \
+    X(LDR_REG)            \
+    X(LDRB_IMM)           \
+    X(LDRB_REG)           \
+    X(STR_IMM)            \
+    X(STR_REG)            \
+    X(STRB_IMM)           \
+    X(STRB_REG)           \
+    X(B)                  \
+    X(BL)                 \
+    X(LDM)                \
+    X(STM)                \
+    X(SWI)                \
+    X(BREAKPOINT)         \
+    FUSED_HANDLERS(X)
+
+// compares in encoding order, each with an IMM and a plain REG operand2
+#define FUSED_HANDLERS(X) \
+    X(TST_IMM_B)          \
+    X(TST_REG_B)          \
+    X(TEQ_IMM_B)          \
+    X(TEQ_REG_B)          \
+    X(CMP_IMM_B)          \
+    X(CMP_REG_B)          \
+    X(CMN_IMM_B)          \
+    X(CMN_REG_B)          \
+    X(ADD_IMM_CMP)        \
+    X(SUB_IMM_CMP)        \
+    X(LDR_IMM_USE)
+
+#define HANDLER_ID(name) HANDLER_##name,
+#define DATA_HANDLER_ID(opcode, s, kind, type) HANDLER_##opcode##_##s##_##kind##_##type,
+
+enum
+{
+    OTHER_HANDLERS(HANDLER_ID)
+    DATA_HANDLERS(DATA_HANDLER_ID)
+    HANDLER_COUNT
+};
+
+#define HANDLER_DATA HANDLER_AND_0_IMM_LSL
+
+void interpretThreaded(CpuState *pState);
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "interpreter.h"
+
+/* Execution trace. The interpreter fills one TraceRecord per instruction
+   into a single-producer single-consumer ring, and a writer thread drains
+   the ring, delta-encodes the records and writes them out, so the thread
+   running the guest never touches the file. It never waits for the writer
+   either: the instructions it runs while the ring is full are dropped and
+   counted, and once there is room again a gap record takes their place.
+
+   A trace file starts with TRACE_MAGIC, a version byte, 3 reserved bytes
+   and the 17 registers when tracing started, as 32-bit little endian
+   words, then the count of instructions dropped as a 64-bit little endian
+   word, filled in when tracing stops. A trace that can't be seeked back
+   into, such as a pipe, keeps 0 there and only its gap records count them.
+   Each instruction then takes a tag byte followed by:
+
+       pc          zigzag varint, the difference from the address after
+                   the previous instruction, present under TRACE_JUMP
+       instruction 4 bytes, left out under TRACE_CACHED when it equals the
+                   last instruction traced at an address with the same
+                   bits 2-13
+       writes      per register written: the register number byte and
+                   a zigzag varint difference from its previous value
+       access      a zigzag varint difference from the previous access
+                   address, then the data as a varint; for LDM and STM
+                   the data is the register list, followed by each word
+                   moved as a varint, lowest address first
+       cpsr        a varint, the XOR with the previous CPSR, present
+                   under TRACE_CPSR
+
+   PC writes show up as the jump of the next record, the registers an
+   LDM loads only as its words.
+
+   A gap has TRACE_GAP in the writes bits of its tag, a varint of how many
+   instructions were dropped and the 17 registers after them as varints.
+   The next record carries on from those. */
+
+#define TRACE_MAGIC          "MATR"
+#define TRACE_VERSION        3
+
+// the writes of a gap record, which can't be an instruction's
+#define TRACE_GAP            3
+
+enum
+{
+    TRACE_JUMP = 1 << 0,
+    TRACE_CACHED = 1 << 1,
+    TRACE_CPSR = 1 << 5
+};
+
+// access kinds, held in bits 2-4 of the tag
+enum
+{
+    TRACE_ACCESS_NONE,
+    TRACE_ACCESS_LDR,
+    TRACE_ACCESS_LDRB,
+    TRACE_ACCESS_STR,
+    TRACE_ACCESS_STRB,
+    TRACE_ACCESS_LDM,
+    TRACE_ACCESS_STM,
+
+    // the condition failed, nothing was written
+    TRACE_ACCESS_SKIPPED = 7
+};
+
+#define TRACE_ACCESS_SHIFT   2
+#define TRACE_WRITES_SHIFT   6
+#define TRACE_CACHE_ENTRIES  4096
+
+// records in the ring, a power of 2
+#define TRACE_RING_RECORDS   (1u << 16)
+
+typedef struct TraceRecord
+{
+    uint32_t pc;
+    uint32_t instruction;
+    uint32_t address;
+    uint32_t data;
+    uint32_t values[2];
+    uint32_t cpsr;
+    uint8_t  registers[2];
+    uint8_t  writes;
+    uint8_t  access;
+    bool     cpsrWritten;
+
+    // the words of an LDM or STM, the registers after a gap, whose length is in values
+    uint32_t block[16];
+} TraceRecord;
+
+typedef struct Tracer
+{
+    TraceRecord *pRing;
+    CpuState    *pState;
+
+    // head is only written by the emulator, tail only by the writer thread
+    _Alignas(64) _Atomic uint64_t head;
+    _Alignas(64) _Atomic uint64_t tail;
+    _Alignas(64) _Atomic bool     stopping;
+
+    // the emulator's view, kept off the shared cache lines, and the instructions dropped since the last record
+    _Alignas(64) uint64_t cachedTail;
+    uint64_t     gap;
+    uint64_t     gaps;
+    uint64_t     dropped;
+
+    // the writer thread's encoder state
+    FILE        *f;
+    pthread_t    writer;
+    int          error;
+    uint32_t     expected;
+    uint32_t     lastAddress;
+    uint32_t     registers[17];
+    uint32_t     cacheAddresses[TRACE_CACHE_ENTRIES];
+    uint32_t     cacheInstructions[TRACE_CACHE_ENTRIES];
+} Tracer;
+
+int  startTrace(Tracer *pTracer, CpuState *pState, const char *path);
+int  stopTrace(Tracer *pTracer);
+void interpretTraced(CpuState *pState);
+
+static inline uint32_t
+zigzag
+(
+    int32_t value
+)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t
+unzigzag
+(
+    uint32_t value
+)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+#endif
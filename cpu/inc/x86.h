@@ -0,0 +1,92 @@
+#ifndef X86_H
+#define X86_H
+
+#include "utils.h"
+
+/* Just enough of an x86-64 encoder for the JIT. Operands are 32-bit
+   general purpose registers and [rbx + displacement] memory operands,
+   rbx always holding the CpuState of the running guest. */
+
+typedef enum X86Register
+{
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    EBX = 3,
+    ESP = 4,
+    EBP = 5,
+    ESI = 6,
+    EDI = 7
+} X86Register;
+
+enum
+{
+    X86_ADD = 0,
+    X86_OR = 1,
+    X86_ADC = 2,
+    X86_SBB = 3,
+    X86_AND = 4,
+    X86_SUB = 5,
+    X86_XOR = 6,
+    X86_CMP = 7
+};
+
+enum
+{
+    X86_ROL = 0,
+    X86_ROR = 1,
+    X86_SHL = 4,
+    X86_SHR = 5,
+    X86_SAR = 7
+};
+
+enum
+{
+    X86_JB = 0x2,
+    X86_JAE = 0x3,
+    X86_JE = 0x4,
+    X86_JNE = 0x5,
+    X86_JBE = 0x6,
+    X86_JL = 0xC,
+    X86_JGE = 0xD
+};
+
+typedef struct Emitter
+{
+    uint8_t *pCode;
+    size_t   offset;
+    size_t   size;
+} Emitter;
+
+void     emit8(Emitter *pEmitter, uint8_t byte);
+void     emit32(Emitter *pEmitter, uint32_t word);
+void     emitLoad(Emitter *pEmitter, X86Register destination, int32_t displacement);
+void     emitLoad64(Emitter *pEmitter, X86Register destination, int32_t displacement);
+void     emitStore(Emitter *pEmitter, int32_t displacement, X86Register source);
+void     emitStoreImmediate(Emitter *pEmitter, int32_t displacement, uint32_t immediate);
+void     emitMoveImmediate(Emitter *pEmitter, X86Register destination, uint32_t immediate);
+void     emitMove(Emitter *pEmitter, X86Register destination, X86Register source);
+void     emitArithmetic(Emitter *pEmitter, int operation, X86Register destination, X86Register source);
+void     emitArithmeticImmediate(Emitter *pEmitter, int operation, X86Register destination, uint32_t immediate);
+void     emitShift(Emitter *pEmitter, int operation, X86Register destination, uint8_t amount);
+void     emitRotateRightCarry(Emitter *pEmitter, X86Register destination);
+void     emitNot(Emitter *pEmitter, X86Register destination);
+void     emitMultiply(Emitter *pEmitter, X86Register destination, X86Register source);
+void     emitCompareMemory(Emitter *pEmitter, int32_t displacement, uint32_t immediate);
+void     emitCompareMemory64(Emitter *pEmitter, int32_t displacement, X86Register source);
+void     emitTestMemory(Emitter *pEmitter, int32_t displacement, uint32_t immediate);
+void     emitTestMemory8(Emitter *pEmitter, int32_t displacement, uint8_t immediate);
+void     emitTest(Emitter *pEmitter, X86Register destination, X86Register source);
+void     emitBitTest(Emitter *pEmitter, int32_t displacement, uint8_t index);
+void     emitComplementCarry(Emitter *pEmitter);
+void     emitAddMemory64(Emitter *pEmitter, int32_t displacement, uint32_t immediate);
+void     emitCall(Emitter *pEmitter, const void *pFunction);
+void     emitMoveStateArgument(Emitter *pEmitter);
+void     emitMovePointer(Emitter *pEmitter, X86Register destination, const void *pPointer);
+void     emitPrologue(Emitter *pEmitter);
+void     emitReturn(Emitter *pEmitter);
+size_t   emitJump(Emitter *pEmitter);
+size_t   emitJumpCondition(Emitter *pEmitter, uint8_t condition);
+void     patchJump(Emitter *pEmitter, size_t jump, size_t target);
+
+#endif
@@ -0,0 +1,669 @@
+#include <string.h>
+#include <unistd.h>
+#include "alu.h"
+#include "predecode.h"
+
+/* Translates an image ahead of time into a C program, see native.h. The
+   basic blocks are found by following branches from address 0: a block
+   ends at a branch or any other PC write and starts at a branch target,
+   after a conditional branch or a BL and after what isn't translated,
+   undefined instructions and invalid conditions, which are left to the
+   interpreter. Each instruction is written out with the shifter, ALU and
+   lazy flags of alu.h and flags.h, specialized on its fields, and the PC
+   reads as a constant. */
+
+static const char *opcodeNames[16] =
+{
+    "AND", "EOR", "SUB", "RSB", "ADD", "ADC", "SBC", "RSC",
+    "TST", "TEQ", "CMP", "CMN", "ORR", "MOV", "BIC", "MVN"
+};
+
+static const char *shiftNames[4] = { "LSL", "LSR", "ASR", "ROR" };
+
+// EQ through LE, AL has no test
+static const char *conditionTests[AL] =
+{
+    "FLAG(Z)", "!FLAG(Z)", "FLAG(C)", "!FLAG(C)", "FLAG(N)", "!FLAG(N)", "FLAG(V)", "!FLAG(V)",
+    "FLAG(C) && !FLAG(Z)", "!FLAG(C) || FLAG(Z)", "FLAG(N) == FLAG(V)", "FLAG(N) != FLAG(V)",
+    "!FLAG(Z) && FLAG(N) == FLAG(V)", "FLAG(Z) || FLAG(N) != FLAG(V)"
+};
+
+typedef struct Translator
+{
+    FILE               *f;
+    DecodedInstruction *pDecoded;
+    uint32_t            words;
+
+    // instructions reached from address 0 and the ones that start a block
+    bool               *pReached;
+    bool               *pLeaders;
+} Translator;
+
+static bool
+translatable
+(
+    const DecodedInstruction *pDecoded
+)
+{
+    return pDecoded->operation != UNDEFINED && pDecoded->condition <= AL;
+}
+
+// the word at address as a block successor, untranslated and out of the image ones included
+static void
+addLeader
+(
+    Translator *pTranslator,
+    uint32_t    address,
+    uint32_t   *pPending,
+    uint32_t   *pCount
+)
+{
+    if (address % 4 != 0 || address / 4 >= pTranslator->words || pTranslator->pLeaders[address / 4])
+    {
+        return;
+    }
+
+    pTranslator->pLeaders[address / 4] = true;
+    pPending[(*pCount)++] = address / 4;
+}
+
+// every word is a leader at most once, so the pending stack never holds more than the image
+static void
+findBlocks
+(
+    Translator *pTranslator,
+    uint32_t   *pPending
+)
+{
+    uint32_t count = 0;
+
+    addLeader(pTranslator, 0, pPending, &count);
+
+    while (count > 0)
+    {
+        for (uint32_t word = pPending[--count]; word < pTranslator->words && !pTranslator->pReached[word]; word++)
+        {
+            const DecodedInstruction *pDecoded = &pTranslator->pDecoded[word];
+            uint32_t                  pc = 4 * word;
+
+            pTranslator->pReached[word] = true;
+
+            if (!translatable(pDecoded))
+            {
+                addLeader(pTranslator, pc + 4, pPending, &count);
+                break;
+            }
+
+            if (pDecoded->operation == BRANCH)
+            {
+                addLeader(pTranslator, pc + 4 + pDecoded->immediate, pPending, &count);
+            }
+
+            if (writesProgramCounter(pDecoded))
+            {
+                // where a failed condition falls through to, or a call returns to
+                if (pDecoded->condition != AL || pDecoded->link)
+                {
+                    addLeader(pTranslator, pc + 4, pPending, &count);
+                }
+
+                break;
+            }
+        }
+    }
+}
+
+// a register operand, the PC reads 4 past the instruction
+static const char *
+source
+(
+    char     buffer[],
+    uint32_t index,
+    uint32_t pc
+)
+{
+    if (index == PC)
+    {
+        sprintf(buffer, "0x%08xu", pc + 4);
+    }
+    else
+    {
+        sprintf(buffer, "registers[%u]", index);
+    }
+
+    return buffer;
+}
+
+// continues at address, straight into its block when there is one
+static void
+emitJump
+(
+    Translator *pTranslator,
+    uint32_t    address,
+    const char *pIndent
+)
+{
+    if (address % 4 == 0 && address / 4 < pTranslator->words && pTranslator->pLeaders[address / 4] &&
+        translatable(&pTranslator->pDecoded[address / 4]))
+    {
+        fprintf(pTranslator->f, "%sgoto block_%08x;\n", pIndent, address);
+    }
+    else
+    {
+        fprintf(pTranslator->f, "%sregisters[PC] = 0x%08xu;\n%sgoto done;\n", pIndent, address, pIndent);
+    }
+}
+
+// leaves the block after a fault or a write to the image, rest instructions early
+static void
+emitStop
+(
+    Translator *pTranslator,
+    const char *pTest,
+    uint32_t    pc,
+    uint32_t    rest,
+    bool        writesPC
+)
+{
+    FILE *f = pTranslator->f;
+
+    fprintf(f, "\n        if (%s)\n        {\n", pTest);
+
+    if (!writesPC)
+    {
+        fprintf(f, "            registers[PC] = 0x%08xu;\n", pc + 4);
+    }
+
+    if (rest)
+    {
+        fprintf(f, "            left += %u;\n", rest);
+    }
+
+    fprintf(f, "            goto done;\n        }\n");
+}
+
+static void
+emitData
+(
+    Translator               *pTranslator,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  pc
+)
+{
+    FILE       *f = pTranslator->f;
+    const char *opcode = opcodeNames[pDecoded->opcode];
+    const char *shift = shiftNames[pDecoded->shiftType];
+    bool        logicFlags = pDecoded->alterCPSR && aluLogicOperation(pDecoded->opcode);
+    char        rn[16];
+    char        rm[16];
+    char        rs[16];
+
+    // a compare that doesn't set the flags does nothing
+    if (!pDecoded->alterCPSR && !aluWriteback(pDecoded->opcode))
+    {
+        return;
+    }
+
+    source(rn, pDecoded->rn, pc);
+    source(rm, pDecoded->rm, pc);
+    source(rs, pDecoded->rs, pc);
+
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE)
+    {
+        if (logicFlags)
+        {
+            fprintf(f, "        uint32_t carry = %s;\n",
+                    pDecoded->shiftAmount ? (bit(pDecoded->immediate, 31) ? "1" : "0") : "FLAG(C)");
+        }
+
+        fprintf(f, "        uint32_t operand2 = 0x%08xu;\n", pDecoded->immediate);
+    }
+    else if (pDecoded->operand2 == OPERAND_REGISTER)
+    {
+        fprintf(f, "        uint32_t carry;\n");
+        fprintf(f, "        uint32_t operand2 = barrelShift(%s, %s, %u, %s, &carry);\n", shift, rm,
+                pDecoded->shiftAmount, pDecoded->shiftAmount == 0 ? "FLAG(C)" : "0");
+    }
+    else
+    {
+        fprintf(f, "        uint32_t carry;\n");
+        fprintf(f, "        uint32_t amount = %s & 0xFF;\n", rs);
+        fprintf(f, "        uint32_t operand2 = amount == 0 ? (carry = FLAG(C), %s) : barrelShift(%s, %s, amount, 0, "
+                "&carry);\n", rm, shift, rm);
+    }
+
+    fprintf(f, "        uint32_t operand1 = %s;\n", rn);
+    fprintf(f, "        uint32_t result = aluOperation(%s, operand1, operand2, %s);\n", opcode,
+            aluCarryIn(pDecoded->opcode) ? "FLAG(C)" : "0");
+
+    if (logicFlags)
+    {
+        fprintf(f, "\n        recordFlags(&registers[CPSR], pFlags, FLAGS_LOGIC, 0, 0, result, carry);\n");
+    }
+    else if (pDecoded->alterCPSR)
+    {
+        fprintf(f, "\n        recordFlags(&registers[CPSR], pFlags, FLAGS_ARITHMETIC, operand1, operand2, result, 0);\n");
+    }
+
+    if (aluWriteback(pDecoded->opcode))
+    {
+        fprintf(f, "        registers[%u] = result;\n", pDecoded->rd);
+    }
+}
+
+static void
+emitMultiply
+(
+    Translator               *pTranslator,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  pc
+)
+{
+    FILE *f = pTranslator->f;
+    char  rs[16];
+    char  rm[16];
+    char  rd[16];
+
+    fprintf(f, "        uint32_t result = %s * %s", source(rs, pDecoded->rs, pc), source(rm, pDecoded->rm, pc));
+
+    if (pDecoded->accumulate)
+    {
+        fprintf(f, " + %s", source(rd, pDecoded->rd, pc));
+    }
+
+    fprintf(f, ";\n");
+
+    if (pDecoded->alterCPSR)
+    {
+        fprintf(f, "\n        recordFlags(&registers[CPSR], pFlags, FLAGS_MULTIPLY, 0, 0, result, 0);\n");
+    }
+
+    fprintf(f, "        registers[%u] = result;\n", pDecoded->rn);
+}
+
+// base writeback first, a loaded register wins over it
+static void
+emitTransfer
+(
+    Translator               *pTranslator,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  pc,
+    uint32_t                  rest,
+    bool                      writesPC
+)
+{
+    FILE       *f = pTranslator->f;
+    const char *sign = pDecoded->up ? "+" : "-";
+    bool        load = pDecoded->operation == LDR || pDecoded->operation == LDRB;
+    bool        word = pDecoded->operation == LDR || pDecoded->operation == STR;
+    char        rn[16];
+    char        rd[16];
+    char        rm[16];
+
+    fprintf(f, "        uint32_t base = %s;\n", source(rn, pDecoded->rn, pc));
+
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE)
+    {
+        fprintf(f, "        uint32_t offset = %uu;\n", pDecoded->immediate);
+    }
+    else
+    {
+        fprintf(f, "        uint32_t carry;\n");
+        fprintf(f, "        uint32_t offset = barrelShift(%s, %s, %u, %s, &carry);\n", shiftNames[pDecoded->shiftType],
+                source(rm, pDecoded->rm, pc), pDecoded->shiftAmount, pDecoded->shiftAmount == 0 ? "FLAG(C)" : "0");
+    }
+
+    fprintf(f, "        uint32_t address = %s;\n", pDecoded->preindex ? (pDecoded->up ? "base + offset" : "base - offset")
+                                                                        : "base");
+
+    if (load)
+    {
+        fprintf(f, "        uint32_t data = load%s(pMemory, address);\n\n", word ? "32" : "8");
+        fprintf(f, "        registers[%u] = base %s offset;\n", pDecoded->rn, sign);
+        fprintf(f, "        registers[%u] = data;\n", pDecoded->rd);
+        emitStop(pTranslator, "pMemory->faulted", pc, rest, writesPC);
+        return;
+    }
+
+    fprintf(f, "\n        if (store%s(pMemory, address, %s))\n", word ? "32" : "8", source(rd, pDecoded->rd, pc));
+    fprintf(f, "        {\n            storeWritten(pState, address, %u);\n        }\n\n", word ? 4 : 1);
+    fprintf(f, "        registers[%u] = base %s offset;\n", pDecoded->rn, sign);
+    emitStop(pTranslator, "pMemory->faulted || !pState->pNative", pc, rest, writesPC);
+}
+
+// the words in blockAddress() order, see predecode.h
+static void
+emitBlock
+(
+    Translator               *pTranslator,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  pc,
+    uint32_t                  rest,
+    bool                      writesPC
+)
+{
+    FILE    *f = pTranslator->f;
+    uint32_t count = pDecoded->registerCount;
+    uint32_t length = 4 * count;
+    uint32_t word = 0;
+    char     rn[16];
+    char     value[16];
+
+    fprintf(f, "        uint32_t base = %s;\n", source(rn, pDecoded->rn, pc));
+
+    if (pDecoded->up)
+    {
+        fprintf(f, "        uint32_t address = (base + %u) & ~3u;\n", 4 * pDecoded->preindex);
+    }
+    else
+    {
+        fprintf(f, "        uint32_t address = (base - %u) & ~3u;\n", length - 4 * !pDecoded->preindex);
+    }
+
+    fprintf(f, "        uint32_t words[%u];\n", count ? count : 1);
+
+    if (pDecoded->operation == STM)
+    {
+        for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+        {
+            fprintf(f, "        words[%u] = %s;\n", word++, source(value, __builtin_ctz(list), pc));
+        }
+
+        fprintf(f, "\n        if (storeBlock(pMemory, address, words, %u))\n", count);
+        fprintf(f, "        {\n            storeWritten(pState, address, %u);\n        }\n\n", length);
+    }
+    else
+    {
+        fprintf(f, "\n        loadBlock(pMemory, address, words, %u);\n", count);
+    }
+
+    if (pDecoded->writeback)
+    {
+        fprintf(f, "        registers[%u] = base %s %u;\n", pDecoded->rn, pDecoded->up ? "+" : "-", length);
+    }
+
+    for (uint32_t list = pDecoded->immediate; pDecoded->operation == LDM && list; list &= list - 1)
+    {
+        fprintf(f, "        registers[%u] = words[%u];\n", __builtin_ctz(list), word++);
+    }
+
+    emitStop(pTranslator, pDecoded->operation == STM ? "pMemory->faulted || !pState->pNative" : "pMemory->faulted",
+             pc, rest, writesPC);
+}
+
+static void
+emitInstruction
+(
+    Translator *pTranslator,
+    uint32_t    pc,
+    uint32_t    rest
+)
+{
+    FILE                     *f = pTranslator->f;
+    const DecodedInstruction *pDecoded = &pTranslator->pDecoded[pc / 4];
+    bool                      writesPC = writesProgramCounter(pDecoded);
+
+    fprintf(f, "\n    // 0x%08x  %08x\n", pc, pDecoded->instruction);
+
+    if (pDecoded->condition != AL)
+    {
+        fprintf(f, "    if (%s)\n", conditionTests[pDecoded->condition]);
+    }
+
+    fprintf(f, "    {\n");
+
+    switch(pDecoded->operation)
+    {
+    case DATA:
+        emitData(pTranslator, pDecoded, pc);
+        break;
+    case MUL:
+        emitMultiply(pTranslator, pDecoded, pc);
+        break;
+    case LDR:
+    case LDRB:
+    case STR:
+    case STRB:
+        emitTransfer(pTranslator, pDecoded, pc, rest, writesPC);
+        break;
+    case LDM:
+    case STM:
+        emitBlock(pTranslator, pDecoded, pc, rest, writesPC);
+        break;
+    case BRANCH:
+        if (pDecoded->link)
+        {
+            fprintf(f, "        registers[LR] = 0x%08xu;\n", pc + 4);
+        }
+
+        emitJump(pTranslator, pc + 4 + pDecoded->immediate, "        ");
+        break;
+    case SWI:
+        fprintf(f, "        semihost(pState, %u);\n", pDecoded->immediate);
+        emitStop(pTranslator, "pMemory->faulted || !pState->pNative", pc, rest, false);
+        break;
+    }
+
+    // any other PC write goes wherever it went through the dispatch
+    if (writesPC && pDecoded->operation != BRANCH)
+    {
+        fprintf(f, "        goto dispatch;\n");
+    }
+
+    fprintf(f, "    }\n");
+}
+
+static void
+emitBlocks
+(
+    Translator *pTranslator
+)
+{
+    FILE *f = pTranslator->f;
+
+    for (uint32_t first = 0; first < pTranslator->words; first++)
+    {
+        if (!pTranslator->pLeaders[first] || !translatable(&pTranslator->pDecoded[first]))
+        {
+            continue;
+        }
+
+        uint32_t end = first;
+
+        // up to the first PC write, or what the interpreter takes or another block starts with
+        while (end < pTranslator->words && translatable(&pTranslator->pDecoded[end]) &&
+               (end == first || !pTranslator->pLeaders[end]))
+        {
+            if (writesProgramCounter(&pTranslator->pDecoded[end++]))
+            {
+                break;
+            }
+        }
+
+        uint32_t length = end - first;
+
+        fprintf(f, "\nblock_%08x:\n    if (left < %u)\n    {\n", 4 * first, length);
+        fprintf(f, "        registers[PC] = 0x%08xu;\n        goto done;\n    }\n\n    left -= %u;\n", 4 * first,
+                length);
+
+        for (uint32_t word = first; word < end; word++)
+        {
+            emitInstruction(pTranslator, 4 * word, end - word - 1);
+        }
+
+        // the instruction after the block, also where a failed last condition goes
+        fprintf(f, "\n");
+        emitJump(pTranslator, 4 * end, "    ");
+    }
+}
+
+static int
+translate
+(
+    FILE          *f,
+    const uint8_t *pImage,
+    uint32_t       size,
+    const char    *name
+)
+{
+    Translator translator = { f, NULL, size / 4, NULL, NULL };
+    uint32_t  *pPending = (uint32_t *)malloc((translator.words + 1) * sizeof *pPending);
+
+    translator.pDecoded = (DecodedInstruction *)calloc(translator.words + 1, sizeof *translator.pDecoded);
+    translator.pReached = (bool *)calloc(translator.words + 1, sizeof *translator.pReached);
+    translator.pLeaders = (bool *)calloc(translator.words + 1, sizeof *translator.pLeaders);
+
+    if (!pPending || !translator.pDecoded || !translator.pReached || !translator.pLeaders)
+    {
+        free(pPending);
+        free(translator.pDecoded);
+        free(translator.pReached);
+        free(translator.pLeaders);
+        return -1;
+    }
+
+    for (uint32_t word = 0; word < translator.words; word++)
+    {
+        const uint8_t *pBytes = pImage + 4 * word;
+
+        predecode(pBytes[0] | pBytes[1] << 8 | pBytes[2] << 16 | (uint32_t)pBytes[3] << 24, &translator.pDecoded[word]);
+    }
+
+    findBlocks(&translator, pPending);
+
+    fprintf(f, "/* %s translated by aot, build it with\n   cc -O2 -I cpu/inc <this file> "
+            "cpu/build/libminiarm.a -pthread */\n\n#include \"native.h\"\n\n", name);
+    fprintf(f, "#define FLAG(index) lazyFlag(registers[CPSR], pFlags, index)\n\n");
+    fprintf(f, "static const uint8_t image[%u] =\n{", size ? size : 1);
+
+    for (uint32_t offset = 0; offset < size; offset++)
+    {
+        fprintf(f, "%s0x%02x,", offset % 16 ? " " : "\n    ", pImage[offset]);
+    }
+
+    fprintf(f, "%s\n};\n\n", size ? "" : "\n    0");
+    fprintf(f, "static void\nrun\n(\n    CpuState *pState,\n    uint64_t  budget\n)\n{\n");
+    fprintf(f, "    uint32_t  *registers = pState->registers;\n    LazyFlags *pFlags = &pState->flags;\n");
+    fprintf(f, "    Memory    *pMemory = &pState->memory;\n    uint64_t   left = budget;\n\n");
+    fprintf(f, "    (void)pFlags;\n    (void)pMemory;\n\ndispatch:\n    switch(registers[PC])\n    {\n");
+
+    for (uint32_t word = 0; word < translator.words; word++)
+    {
+        if (translator.pLeaders[word] && translatable(&translator.pDecoded[word]))
+        {
+            fprintf(f, "    case 0x%08xu:\n        goto block_%08x;\n", 4 * word, 4 * word);
+        }
+    }
+
+    fprintf(f, "    default:\n        goto done;\n    }\n");
+
+    emitBlocks(&translator);
+
+    fprintf(f, "\ndone:\n    pState->instructions += budget - left;\n}\n\n");
+    fprintf(f, "static const NativeImage native = { run, image, %u };\n\n", size);
+    fprintf(f, "int\nmain\n(\n    int   argc,\n    char *argv[]\n)\n{\n"
+            "    return runNativeProgram(&native, argc, argv);\n}\n");
+
+    free(pPending);
+    free(translator.pDecoded);
+    free(translator.pReached);
+    free(translator.pLeaders);
+    return ferror(f) ? -1 : 0;
+}
+
+static int
+usage
+(
+    const char *program
+)
+{
+    printf("Usage: %s [-o output.c] <image>\n", program);
+    return 1;
+}
+
+int
+main
+(
+    int   argc,
+    char *argv[]
+)
+{
+    char *outputPath = NULL;
+    int   option;
+
+    while ((option = getopt(argc, argv, "o:")) != -1)
+    {
+        switch(option)
+        {
+        case 'o':
+            outputPath = optarg;
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        return usage(argv[0]);
+    }
+
+    FILE *pInput = fopen(argv[optind], "rb");
+
+    if (!pInput)
+    {
+        perror("fopen() failed");
+        return 1;
+    }
+
+    // images are loaded at address 0 and the PC is 32 bits, so anything bigger can't run
+    uint8_t *pImage = NULL;
+    size_t   size = 0;
+    size_t   capacity = 0;
+    size_t   read;
+
+    do
+    {
+        if (size == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 1 << 16;
+
+            uint8_t *pGrown = (uint8_t *)realloc(pImage, capacity);
+
+            if (!pGrown || capacity > UINT32_MAX)
+            {
+                fprintf(stderr, "%s is too big\n", argv[optind]);
+                free(pGrown ? pGrown : pImage);
+                fclose(pInput);
+                return 1;
+            }
+
+            pImage = pGrown;
+        }
+
+        read = fread(pImage + size, 1, capacity - size, pInput);
+        size += read;
+    } while (read > 0);
+
+    fclose(pInput);
+
+    FILE *f = outputPath ? fopen(outputPath, "w") : stdout;
+
+    if (!f)
+    {
+        perror("fopen() failed");
+        free(pImage);
+        return 1;
+    }
+
+    int status = translate(f, pImage, size, argv[optind]);
+
+    if ((outputPath && fclose(f) != 0) || status == -1)
+    {
+        perror("translate() failed");
+        status = 1;
+    }
+
+    free(pImage);
+    return status ? 1 : 0;
+}
@@ -0,0 +1,767 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "batch.h"
+
+// job status besides the MINIARM_ run results
+#define BATCH_ERROR -1
+
+typedef struct BatchJob
+{
+    char    *pImage;
+    uint32_t line;
+    uint32_t initial[MINIARM_REGISTERS];
+
+    // bit n set when the manifest gives register n
+    uint32_t assigned;
+
+    // written only by the worker that ran the job
+    int      status;
+    int      error;
+    uint64_t instructions;
+    uint32_t faultAddress;
+    uint32_t registers[MINIARM_REGISTERS];
+    uint64_t lockstepInstructions;
+    uint64_t divergences;
+    uint64_t cycles;
+    uint64_t loadUseStalls;
+    uint64_t flushCycles;
+} BatchJob;
+
+// what a worker takes off a queue, a lockstep group or a single job
+typedef struct BatchUnit
+{
+    uint32_t first;
+    uint32_t count;
+} BatchUnit;
+
+/* A worker's share of the jobs is the index range [head, tail), packed
+   into one word so the owner taking from the head and thieves taking the
+   back half from the tail both claim jobs with a single CAS. Each queue
+   gets a cache line of its own. */
+typedef struct WorkQueue
+{
+    _Alignas(64) _Atomic uint64_t range;
+} WorkQueue;
+
+typedef struct Batch
+{
+    BatchJob           *pJobs;
+    uint32_t            jobCount;
+
+    // jobs in the order units refer to them, by image under lockstep
+    BatchJob          **ppOrder;
+    BatchUnit          *pUnits;
+    uint32_t            unitCount;
+    WorkQueue          *pQueues;
+    uint32_t            workerCount;
+    const BatchOptions *pOptions;
+} Batch;
+
+typedef struct Worker
+{
+    Batch   *pBatch;
+    uint32_t index;
+} Worker;
+
+static uint64_t
+packRange
+(
+    uint32_t head,
+    uint32_t tail
+)
+{
+    return (uint64_t)tail << 32 | head;
+}
+
+static bool
+takeUnit
+(
+    Batch    *pBatch,
+    uint32_t  worker,
+    uint32_t *pUnit
+)
+{
+    WorkQueue *pOwn = &pBatch->pQueues[worker];
+    uint64_t   range = atomic_load(&pOwn->range);
+
+    while ((uint32_t)range != (uint32_t)(range >> 32))
+    {
+        uint32_t head = (uint32_t)range;
+
+        if (atomic_compare_exchange_weak(&pOwn->range, &range, packRange(head + 1, range >> 32)))
+        {
+            *pUnit = head;
+            return true;
+        }
+    }
+
+    // out of work, steal the back half of the first queue that has any
+    for (uint32_t offset = 1; offset < pBatch->workerCount; offset++)
+    {
+        WorkQueue *pVictim = &pBatch->pQueues[(worker + offset) % pBatch->workerCount];
+
+        range = atomic_load(&pVictim->range);
+
+        while ((uint32_t)range != (uint32_t)(range >> 32))
+        {
+            uint32_t head = (uint32_t)range;
+            uint32_t tail = (uint32_t)(range >> 32);
+            uint32_t stolen = tail - (tail - head) / 2 - 1;
+
+            if (atomic_compare_exchange_weak(&pVictim->range, &range, packRange(head, stolen)))
+            {
+                atomic_store(&pOwn->range, packRange(stolen + 1, tail));
+                *pUnit = stolen;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static MiniArm *
+prepareJob
+(
+    BatchJob           *pJob,
+    const BatchOptions *pOptions
+)
+{
+    MiniArm *pMiniArm = createMiniArm(pOptions->memorySize, pOptions->mode);
+
+    if (!pMiniArm)
+    {
+        pJob->status = BATCH_ERROR;
+        pJob->error = errno;
+        return NULL;
+    }
+
+    if (loadMiniArmFile(pMiniArm, pJob->pImage) == -1)
+    {
+        pJob->status = BATCH_ERROR;
+        pJob->error = errno;
+        destroyMiniArm(pMiniArm);
+        return NULL;
+    }
+
+    for (int index = 0; index < MINIARM_REGISTERS; index++)
+    {
+        if (pJob->assigned & (1u << index))
+        {
+            setMiniArmRegister(pMiniArm, index, pJob->initial[index]);
+        }
+    }
+
+    setMiniArmTiming(pMiniArm, pOptions->timing);
+    return pMiniArm;
+}
+
+static void
+finishJob
+(
+    BatchJob *pJob,
+    MiniArm  *pMiniArm,
+    int       status
+)
+{
+    MiniArmStatistics statistics;
+
+    pJob->status = status;
+    getMiniArmFault(pMiniArm, &pJob->faultAddress);
+    getMiniArmStatistics(pMiniArm, &statistics);
+    pJob->instructions = statistics.instructions;
+    pJob->lockstepInstructions = statistics.lockstepInstructions;
+    pJob->divergences = statistics.divergences;
+    pJob->cycles = statistics.cycles;
+    pJob->loadUseStalls = statistics.loadUseStalls;
+    pJob->flushCycles = statistics.flushCycles;
+
+    for (int index = 0; index < MINIARM_REGISTERS; index++)
+    {
+        pJob->registers[index] = getMiniArmRegister(pMiniArm, index);
+    }
+
+    destroyMiniArm(pMiniArm);
+}
+
+static void
+runUnit
+(
+    Batch           *pBatch,
+    const BatchUnit *pUnit
+)
+{
+    const BatchOptions *pOptions = pBatch->pOptions;
+    BatchJob          **ppJobs = &pBatch->ppOrder[pUnit->first];
+
+    if (pUnit->count == 1)
+    {
+        MiniArm *pMiniArm = prepareJob(ppJobs[0], pOptions);
+
+        if (pMiniArm)
+        {
+            finishJob(ppJobs[0], pMiniArm, runMiniArm(pMiniArm, pOptions->limit));
+        }
+
+        return;
+    }
+
+    // a group never holds more than getMiniArmLockstepLanes() jobs
+    MiniArm  *pMiniArms[pUnit->count];
+    BatchJob *pReady[pUnit->count];
+    int       results[pUnit->count];
+    uint32_t  ready = 0;
+
+    for (uint32_t job = 0; job < pUnit->count; job++)
+    {
+        MiniArm *pMiniArm = prepareJob(ppJobs[job], pOptions);
+
+        if (pMiniArm)
+        {
+            pMiniArms[ready] = pMiniArm;
+            pReady[ready++] = ppJobs[job];
+        }
+    }
+
+    runMiniArmLockstep(pMiniArms, ready, pOptions->limit, results);
+
+    for (uint32_t job = 0; job < ready; job++)
+    {
+        finishJob(pReady[job], pMiniArms[job], results[job]);
+    }
+}
+
+static void *
+work
+(
+    void *pArgument
+)
+{
+    Worker  *pWorker = (Worker *)pArgument;
+    uint32_t unit;
+
+    while (takeUnit(pWorker->pBatch, pWorker->index, &unit))
+    {
+        runUnit(pWorker->pBatch, &pWorker->pBatch->pUnits[unit]);
+    }
+
+    return NULL;
+}
+
+// r0-r15, sp, lr, pc or cpsr
+int
+parseRegister
+(
+    const char *name,
+    size_t      length
+)
+{
+    static const struct
+    {
+        const char *name;
+        int         index;
+    } aliases[] =
+    {
+        { "sp", 13 },
+        { "lr", 14 },
+        { "pc", MINIARM_PC },
+        { "cpsr", MINIARM_CPSR }
+    };
+
+    for (size_t alias = 0; alias < sizeof aliases / sizeof aliases[0]; alias++)
+    {
+        if (strlen(aliases[alias].name) == length && strncasecmp(name, aliases[alias].name, length) == 0)
+        {
+            return aliases[alias].index;
+        }
+    }
+
+    if (length < 2 || length > 3 || (name[0] != 'r' && name[0] != 'R'))
+    {
+        return -1;
+    }
+
+    int index = 0;
+
+    for (size_t digit = 1; digit < length; digit++)
+    {
+        if (name[digit] < '0' || name[digit] > '9')
+        {
+            return -1;
+        }
+
+        index = index * 10 + name[digit] - '0';
+    }
+
+    return index < MINIARM_CPSR ? index : -1;
+}
+
+static int
+parseJob
+(
+    BatchJob *pJob,
+    char     *pLine,
+    uint32_t  line
+)
+{
+    char *pSave;
+    char *pToken = strtok_r(pLine, " \t\r\n", &pSave);
+
+    pJob->pImage = strdup(pToken);
+    pJob->line = line;
+
+    if (!pJob->pImage)
+    {
+        return -1;
+    }
+
+    while ((pToken = strtok_r(NULL, " \t\r\n", &pSave)) != NULL)
+    {
+        char *pValue = strchr(pToken, '=');
+        char *pEnd;
+        int   index = pValue ? parseRegister(pToken, pValue - pToken) : -1;
+
+        if (index == -1)
+        {
+            fprintf(stderr, "manifest line %u: expected register=value, got %s\n", line, pToken);
+            return -1;
+        }
+
+        unsigned long long value = strtoull(pValue + 1, &pEnd, 0);
+
+        if (pEnd == pValue + 1 || *pEnd != '\0' || value > UINT32_MAX)
+        {
+            fprintf(stderr, "manifest line %u: invalid value for %.*s\n", line, (int)(pValue - pToken), pToken);
+            return -1;
+        }
+
+        pJob->initial[index] = value;
+        pJob->assigned |= 1u << index;
+    }
+
+    return 0;
+}
+
+static int
+readManifest
+(
+    Batch      *pBatch,
+    const char *manifest
+)
+{
+    FILE *f = fopen(manifest, "r");
+
+    if (!f)
+    {
+        perror("fopen() failed");
+        return -1;
+    }
+
+    char    *pLine = NULL;
+    size_t   size = 0;
+    uint32_t capacity = 0;
+    uint32_t line = 0;
+    int      result = 0;
+
+    while (getline(&pLine, &size, f) != -1)
+    {
+        char *pStart = pLine + strspn(pLine, " \t\r\n");
+
+        line++;
+
+        if (*pStart == '\0' || *pStart == '#')
+        {
+            continue;
+        }
+
+        if (pBatch->jobCount == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+
+            BatchJob *pJobs = (BatchJob *)realloc(pBatch->pJobs, capacity * sizeof *pJobs);
+
+            if (!pJobs)
+            {
+                perror("realloc() failed");
+                result = -1;
+                break;
+            }
+
+            pBatch->pJobs = pJobs;
+        }
+
+        BatchJob *pJob = &pBatch->pJobs[pBatch->jobCount++];
+
+        memset(pJob, 0, sizeof *pJob);
+
+        if (parseJob(pJob, pStart, line) == -1)
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    free(pLine);
+    fclose(f);
+    return result;
+}
+
+static void
+printString
+(
+    const char *text
+)
+{
+    putchar('"');
+
+    for (const unsigned char *pCharacter = (const unsigned char *)text; *pCharacter; pCharacter++)
+    {
+        if (*pCharacter == '"' || *pCharacter == '\\')
+        {
+            printf("\\%c", *pCharacter);
+        }
+        else if (*pCharacter < 0x20)
+        {
+            printf("\\u%04x", *pCharacter);
+        }
+        else
+        {
+            putchar(*pCharacter);
+        }
+    }
+
+    putchar('"');
+}
+
+static void
+printJob
+(
+    const BatchJob     *pJob,
+    const BatchOptions *pOptions
+)
+{
+    static const char *statuses[] = { "halted", "limit", "fault" };
+
+    printf("{\"line\":%u,\"image\":", pJob->line);
+    printString(pJob->pImage);
+
+    if (pJob->status == BATCH_ERROR)
+    {
+        printf(",\"status\":\"error\",\"error\":");
+        printString(strerror(pJob->error));
+        printf("}\n");
+        return;
+    }
+
+    printf(",\"status\":\"%s\",\"instructions\":%llu", statuses[pJob->status],
+           (unsigned long long)pJob->instructions);
+
+    if (pOptions->timing)
+    {
+        printf(",\"cycles\":%llu,\"load_use_stalls\":%llu,\"flush_cycles\":%llu", (unsigned long long)pJob->cycles,
+               (unsigned long long)pJob->loadUseStalls, (unsigned long long)pJob->flushCycles);
+    }
+
+    if (pJob->status == MINIARM_FAULT)
+    {
+        printf(",\"fault_address\":%u", pJob->faultAddress);
+    }
+
+    printf(",\"registers\":[");
+
+    for (int index = 0; index < MINIARM_CPSR; index++)
+    {
+        printf(index ? ",%u" : "%u", pJob->registers[index]);
+    }
+
+    printf("],\"cpsr\":%u}\n", pJob->registers[MINIARM_CPSR]);
+}
+
+static int
+compareImages
+(
+    const void *pLeft,
+    const void *pRight
+)
+{
+    const BatchJob *pLeftJob = *(BatchJob *const *)pLeft;
+    const BatchJob *pRightJob = *(BatchJob *const *)pRight;
+    int             order = strcmp(pLeftJob->pImage, pRightJob->pImage);
+
+    if (order != 0)
+    {
+        return order;
+    }
+
+    return pLeftJob->line < pRightJob->line ? -1 : pLeftJob->line > pRightJob->line;
+}
+
+// one unit per job, or under lockstep the jobs of an image in groups of up to a lane each
+static int
+buildUnits
+(
+    Batch *pBatch,
+    bool   lockstep
+)
+{
+    pBatch->ppOrder = (BatchJob **)malloc((pBatch->jobCount + 1) * sizeof *pBatch->ppOrder);
+    pBatch->pUnits = (BatchUnit *)malloc((pBatch->jobCount + 1) * sizeof *pBatch->pUnits);
+    pBatch->unitCount = 0;
+
+    if (!pBatch->ppOrder || !pBatch->pUnits)
+    {
+        return -1;
+    }
+
+    for (uint32_t job = 0; job < pBatch->jobCount; job++)
+    {
+        pBatch->ppOrder[job] = &pBatch->pJobs[job];
+    }
+
+    if (lockstep)
+    {
+        qsort(pBatch->ppOrder, pBatch->jobCount, sizeof *pBatch->ppOrder, compareImages);
+    }
+
+    uint32_t lanes = lockstep ? getMiniArmLockstepLanes() : 1;
+
+    for (uint32_t job = 0; job < pBatch->jobCount; job++)
+    {
+        BatchUnit *pLast = pBatch->unitCount ? &pBatch->pUnits[pBatch->unitCount - 1] : NULL;
+
+        if (pLast && pLast->count < lanes && strcmp(pBatch->ppOrder[pLast->first]->pImage, pBatch->ppOrder[job]->pImage) == 0)
+        {
+            pLast->count++;
+        }
+        else
+        {
+            pBatch->pUnits[pBatch->unitCount++] = (BatchUnit){ job, 1 };
+        }
+    }
+
+    return 0;
+}
+
+// runs every unit on the pool and returns the wall time it took
+static double
+runPool
+(
+    Batch   *pBatch,
+    uint32_t threads
+)
+{
+    Worker    *pWorkers = (Worker *)calloc(threads, sizeof *pWorkers);
+    pthread_t *pThreads = (pthread_t *)calloc(threads, sizeof *pThreads);
+
+    if (!pWorkers || !pThreads)
+    {
+        free(pWorkers);
+        free(pThreads);
+        return -1;
+    }
+
+    // contiguous shares to start with, stealing evens out what the units cost
+    for (uint32_t worker = 0; worker < threads; worker++)
+    {
+        uint32_t head = (uint64_t)pBatch->unitCount * worker / threads;
+        uint32_t tail = (uint64_t)pBatch->unitCount * (worker + 1) / threads;
+
+        atomic_init(&pBatch->pQueues[worker].range, packRange(head, tail));
+        pWorkers[worker] = (Worker){ pBatch, worker };
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the calling thread is the first worker
+    uint32_t started = 1;
+
+    for (; started < threads; started++)
+    {
+        if (pthread_create(&pThreads[started], NULL, work, &pWorkers[started]) != 0)
+        {
+            break;
+        }
+    }
+
+    work(&pWorkers[0]);
+
+    // units of workers that failed to start are stolen by the running ones
+    for (uint32_t worker = 1; worker < started; worker++)
+    {
+        pthread_join(pThreads[worker], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(pWorkers);
+    free(pThreads);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static bool
+sameResult
+(
+    const BatchJob *pJob,
+    const BatchJob *pOther
+)
+{
+    return pJob->status == pOther->status && pJob->instructions == pOther->instructions &&
+           (pJob->status != MINIARM_FAULT || pJob->faultAddress == pOther->faultAddress) &&
+           memcmp(pJob->registers, pOther->registers, sizeof pJob->registers) == 0;
+}
+
+/* Reruns the batch one job at a time in the plain interpreter, the
+   baseline lockstep is measured against, and reports the speedup per
+   instance along with any job whose result differs. */
+static void
+compareLockstep
+(
+    Batch   *pBatch,
+    double   seconds,
+    uint32_t threads
+)
+{
+    const BatchOptions *pLockstepOptions = pBatch->pOptions;
+    BatchOptions        options = *pLockstepOptions;
+    BatchJob           *pLockstep = (BatchJob *)malloc(pBatch->jobCount * sizeof *pLockstep);
+    uint64_t            instructions = 0;
+    uint64_t            lockstepInstructions = 0;
+    uint64_t            divergences = 0;
+    uint32_t            mismatches = 0;
+
+    free(pBatch->ppOrder);
+    free(pBatch->pUnits);
+
+    if (!pLockstep || buildUnits(pBatch, false) == -1)
+    {
+        perror("compareLockstep() failed");
+        free(pLockstep);
+        return;
+    }
+
+    memcpy(pLockstep, pBatch->pJobs, pBatch->jobCount * sizeof *pLockstep);
+    options.mode = MINIARM_INTERPRETER;
+    options.lockstep = false;
+    pBatch->pOptions = &options;
+
+    double baseline = runPool(pBatch, threads);
+
+    for (uint32_t job = 0; job < pBatch->jobCount; job++)
+    {
+        instructions += pLockstep[job].instructions;
+        lockstepInstructions += pLockstep[job].lockstepInstructions;
+        divergences += pLockstep[job].divergences;
+
+        if (!sameResult(&pLockstep[job], &pBatch->pJobs[job]))
+        {
+            fprintf(stderr, "line %u: lockstep result differs from the interpreter\n", pLockstep[job].line);
+            mismatches++;
+        }
+    }
+
+    fprintf(stderr, "lockstep: %u lanes, %.1f%% of instructions in groups, %llu divergences\n",
+            getMiniArmLockstepLanes(), instructions ? 100.0 * lockstepInstructions / instructions : 0.0,
+            (unsigned long long)divergences);
+    fprintf(stderr, "interpreter: %.3fs, lockstep %.3fs, %.2fx per instance, %u mismatches\n",
+            baseline, seconds, seconds > 0 ? baseline / seconds : 0.0, mismatches);
+
+    // the printed results are the lockstep ones
+    memcpy(pBatch->pJobs, pLockstep, pBatch->jobCount * sizeof *pLockstep);
+    pBatch->pOptions = pLockstepOptions;
+    free(pLockstep);
+}
+
+int
+runBatch
+(
+    const char         *manifest,
+    const BatchOptions *pOptions
+)
+{
+    Batch    batch = { .pOptions = pOptions };
+    uint32_t threads = pOptions->threads;
+    int      status = 0;
+
+    if (readManifest(&batch, manifest) == -1)
+    {
+        status = 1;
+        goto done;
+    }
+
+    if (buildUnits(&batch, pOptions->lockstep) == -1)
+    {
+        perror("runBatch() failed");
+        status = 1;
+        goto done;
+    }
+
+    if (threads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? cores : 1;
+    }
+
+    if (threads > batch.unitCount)
+    {
+        threads = batch.unitCount ? batch.unitCount : 1;
+    }
+
+    batch.workerCount = threads;
+    batch.pQueues = (WorkQueue *)aligned_alloc(_Alignof(WorkQueue), threads * sizeof(WorkQueue));
+
+    double seconds = batch.pQueues ? runPool(&batch, threads) : -1;
+
+    if (seconds < 0)
+    {
+        perror("runBatch() failed");
+        status = 1;
+        goto done;
+    }
+
+    uint64_t instructions = 0;
+
+    for (uint32_t job = 0; job < batch.jobCount; job++)
+    {
+        instructions += batch.pJobs[job].instructions;
+    }
+
+    if (pOptions->benchmark)
+    {
+        fprintf(stderr, "%u jobs on %u threads, %llu instructions in %.3fs (%.2f MIPS)\n", batch.jobCount,
+                threads, (unsigned long long)instructions, seconds, instructions / seconds / 1e6);
+
+        if (pOptions->lockstep)
+        {
+            compareLockstep(&batch, seconds, threads);
+        }
+    }
+
+    for (uint32_t job = 0; job < batch.jobCount; job++)
+    {
+        printJob(&batch.pJobs[job], pOptions);
+
+        if (batch.pJobs[job].status == BATCH_ERROR || batch.pJobs[job].status == MINIARM_FAULT)
+        {
+            status = 1;
+        }
+    }
+
+done:
+    for (uint32_t job = 0; job < batch.jobCount; job++)
+    {
+        free(batch.pJobs[job].pImage);
+    }
+
+    free(batch.pJobs);
+    free(batch.ppOrder);
+    free(batch.pUnits);
+    free(batch.pQueues);
+    return status;
+}
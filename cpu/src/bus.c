@@ -0,0 +1,274 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include "bus.h"
+#include "replay.h"
+
+uint32_t
+deviceLoad
+(
+    Memory  *pMemory,
+    uint32_t address,
+    uint32_t width
+)
+{
+    Bus       *pBus = pMemory->pBus;
+    BusDevice *pDevice = pBus && address >= DEVICE_BASE ? pBus->pPages[(address - DEVICE_BASE) >> PAGE_SHIFT] : NULL;
+
+    if (!pDevice || !pDevice->device.load)
+    {
+        memoryFault(pMemory, address);
+        return 0;
+    }
+
+    Replay  *pReplay = pMemory->pReplay;
+    uint32_t value;
+
+    // a replayed load never reaches the device, a load the log doesn't have stops the run
+    if (pReplay && pReplay->replaying)
+    {
+        if (!replayLoad(pReplay, address, &value))
+        {
+            memoryFault(pMemory, address);
+            return 0;
+        }
+
+        return value;
+    }
+
+    value = pDevice->device.load(pDevice->device.pContext, address - pDevice->address, width);
+
+    if (pReplay)
+    {
+        recordLoad(pReplay, address, value);
+    }
+
+    return value;
+}
+
+void
+deviceStore
+(
+    Memory  *pMemory,
+    uint32_t address,
+    uint32_t data,
+    uint32_t width
+)
+{
+    Bus       *pBus = pMemory->pBus;
+    BusDevice *pDevice = pBus && address >= DEVICE_BASE ? pBus->pPages[(address - DEVICE_BASE) >> PAGE_SHIFT] : NULL;
+
+    if (!pDevice || !pDevice->device.store)
+    {
+        memoryFault(pMemory, address);
+        return;
+    }
+
+    pDevice->device.store(pDevice->device.pContext, address - pDevice->address, data, width);
+}
+
+// whole pages of the window that no other device has
+int
+mapDevice
+(
+    Bus                 *pBus,
+    Memory              *pMemory,
+    uint32_t             address,
+    uint32_t             length,
+    const MiniArmDevice *pDevice
+)
+{
+    if (address < DEVICE_BASE || length == 0 || (address | length) % PAGE_SIZE != 0 ||
+        length > MAX_MEMORY_SIZE - address)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t first = (address - DEVICE_BASE) >> PAGE_SHIFT;
+    uint32_t count = length >> PAGE_SHIFT;
+
+    for (uint32_t page = first; page < first + count; page++)
+    {
+        if (pBus->pPages[page])
+        {
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    if (pBus->deviceCount == BUS_DEVICES)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    BusDevice *pEntry = &pBus->devices[pBus->deviceCount++];
+
+    pEntry->device = *pDevice;
+    pEntry->address = address;
+
+    for (uint32_t page = first; page < first + count; page++)
+    {
+        pBus->pPages[page] = pEntry;
+    }
+
+    pMemory->pBus = pBus;
+    return 0;
+}
+
+static uint32_t
+loadNothing
+(
+    void    *pContext,
+    uint32_t offset,
+    uint32_t width
+)
+{
+    (void)pContext;
+    (void)offset;
+    (void)width;
+    return 0;
+}
+
+static void
+storeNothing
+(
+    void    *pContext,
+    uint32_t offset,
+    uint32_t value,
+    uint32_t width
+)
+{
+    (void)pContext;
+    (void)offset;
+    (void)value;
+    (void)width;
+}
+
+// a character at +0, a signed decimal number at +4 and a hexadecimal one at +8
+static void
+storeConsole
+(
+    void    *pContext,
+    uint32_t offset,
+    uint32_t value,
+    uint32_t width
+)
+{
+    Bus *pBus = (Bus *)pContext;
+
+    (void)width;
+
+    switch(offset)
+    {
+    case 0:
+        putc((uint8_t)value, pBus->pOutput);
+
+        // a line is out as soon as the guest finishes it, even through a pipe
+        if ((uint8_t)value == '\n')
+        {
+            fflush(pBus->pOutput);
+        }
+        break;
+    case 4:
+        fprintf(pBus->pOutput, "%" PRId32, (int32_t)value);
+        break;
+    case 8:
+        fprintf(pBus->pOutput, "0x%08" PRIx32, value);
+        break;
+    }
+}
+
+// the host's cycle counter, the high word is the one latched by the last read of the low word
+static uint32_t
+loadCycles
+(
+    void    *pContext,
+    uint32_t offset,
+    uint32_t width
+)
+{
+    Bus *pBus = (Bus *)pContext;
+
+    (void)width;
+
+    if (offset == 4)
+    {
+        return pBus->cyclesHigh;
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    uint64_t cycles = __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t cycles = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+
+    pBus->cyclesHigh = cycles >> 32;
+    return (uint32_t)cycles;
+}
+
+// the next input byte, all ones once the input has ended
+static uint32_t
+loadInput
+(
+    void    *pContext,
+    uint32_t offset,
+    uint32_t width
+)
+{
+    Bus *pBus = (Bus *)pContext;
+    int  byte = pBus->pInput ? getc(pBus->pInput) : EOF;
+
+    (void)offset;
+    (void)width;
+
+    return byte == EOF ? UINT32_MAX : (uint32_t)byte;
+}
+
+// the stored value is the exit status, the run stops after the storing instruction
+static void
+storeHalt
+(
+    void    *pContext,
+    uint32_t offset,
+    uint32_t value,
+    uint32_t width
+)
+{
+    (void)offset;
+    (void)width;
+    memoryHalt(((Bus *)pContext)->pMemory, value);
+}
+
+int
+mapStandardDevices
+(
+    Bus    *pBus,
+    Memory *pMemory,
+    FILE   *pOutput,
+    FILE   *pInput
+)
+{
+    MiniArmDevice console = { loadNothing, storeConsole, pBus };
+    MiniArmDevice cycles = { loadCycles, storeNothing, pBus };
+    MiniArmDevice input = { loadInput, storeNothing, pBus };
+    MiniArmDevice halt = { loadNothing, storeHalt, pBus };
+
+    pBus->pMemory = pMemory;
+    pBus->pOutput = pOutput;
+    pBus->pInput = pInput;
+
+    if (mapDevice(pBus, pMemory, MINIARM_CONSOLE, PAGE_SIZE, &console) == -1 ||
+        mapDevice(pBus, pMemory, MINIARM_CYCLES, PAGE_SIZE, &cycles) == -1 ||
+        mapDevice(pBus, pMemory, MINIARM_INPUT, PAGE_SIZE, &input) == -1 ||
+        mapDevice(pBus, pMemory, MINIARM_HALT, PAGE_SIZE, &halt) == -1)
+    {
+        return -1;
+    }
+
+    return 0;
+}
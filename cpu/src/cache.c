@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <string.h>
+#include "cache.h"
+
+// which level served an access
+enum
+{
+    SERVED_L1,
+    SERVED_L2,
+    SERVED_MEMORY
+};
+
+static bool
+powerOfTwo
+(
+    uint32_t value
+)
+{
+    return value && !(value & (value - 1));
+}
+
+static int
+createCache
+(
+    Cache                    *pCache,
+    const MiniArmCacheConfig *pConfig
+)
+{
+    memset(pCache, 0, sizeof *pCache);
+
+    if (pConfig->size == 0)
+    {
+        return 0;
+    }
+
+    if (!powerOfTwo(pConfig->size) || !powerOfTwo(pConfig->lineSize) || pConfig->lineSize < 4 ||
+        pConfig->ways == 0 || pConfig->ways > pConfig->size / pConfig->lineSize ||
+        !powerOfTwo(pConfig->size / pConfig->lineSize / pConfig->ways) ||
+        pConfig->size % (pConfig->lineSize * pConfig->ways) != 0 ||
+        pConfig->replacement < MINIARM_CACHE_LRU || pConfig->replacement > MINIARM_CACHE_RANDOM)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t lines = pConfig->size / pConfig->lineSize;
+
+    pCache->pLines = (uint32_t *)calloc(lines, sizeof *pCache->pLines);
+
+    if (!pCache->pLines)
+    {
+        return -1;
+    }
+
+    pCache->setMask = lines / pConfig->ways - 1;
+    pCache->ways = pConfig->ways;
+    pCache->lineShift = __builtin_ctz(pConfig->lineSize);
+    pCache->replacement = pConfig->replacement;
+    pCache->random = 0x9E3779B9;
+    return 0;
+}
+
+int
+createCaches
+(
+    Caches                   *pCaches,
+    const MiniArmCacheConfig  configs[],
+    uint32_t                  imageSize
+)
+{
+    memset(pCaches, 0, sizeof *pCaches);
+
+    for (int level = 0; level < MINIARM_CACHE_LEVELS; level++)
+    {
+        if (createCache(&pCaches->levels[level], &configs[level]) == -1)
+        {
+            int error = errno;
+
+            destroyCaches(pCaches);
+            errno = error;
+            return -1;
+        }
+    }
+
+    pCaches->words = (imageSize + 3) / 4;
+    pCaches->pCounts = (MiniArmCacheCounts *)calloc(pCaches->words ? pCaches->words : 1, sizeof *pCaches->pCounts);
+
+    if (!pCaches->pCounts)
+    {
+        destroyCaches(pCaches);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+destroyCaches
+(
+    Caches *pCaches
+)
+{
+    for (int level = 0; level < MINIARM_CACHE_LEVELS; level++)
+    {
+        free(pCaches->levels[level].pLines);
+        pCaches->levels[level].pLines = NULL;
+    }
+
+    free(pCaches->pCounts);
+    pCaches->pCounts = NULL;
+}
+
+/* Looks the line of address up in its set, true on a hit. A miss fills
+   the line in place of the victim, whose line word is left in pVictim
+   when it was dirty. */
+static inline bool
+accessLine
+(
+    Cache    *pCache,
+    uint32_t  address,
+    bool      write,
+    uint32_t *pVictim
+)
+{
+    uint32_t  line = address >> pCache->lineShift;
+    uint32_t *pSet = pCache->pLines + (line & pCache->setMask) * pCache->ways;
+    uint32_t  tag = line << 2 | CACHE_VALID;
+    uint32_t  dirty = write ? CACHE_DIRTY : 0;
+    uint32_t  empty = pCache->ways;
+
+    pCache->statistics.accesses++;
+
+    for (uint32_t way = 0; way < pCache->ways; way++)
+    {
+        if ((pSet[way] & ~CACHE_DIRTY) == tag)
+        {
+            uint32_t entry = pSet[way] | dirty;
+
+            if (pCache->replacement == MINIARM_CACHE_LRU && way != 0)
+            {
+                memmove(pSet + 1, pSet, way * sizeof *pSet);
+                pSet[0] = entry;
+            }
+            else
+            {
+                pSet[way] = entry;
+            }
+
+            return true;
+        }
+
+        if (!pSet[way] && empty == pCache->ways)
+        {
+            empty = way;
+        }
+    }
+
+    pCache->statistics.misses++;
+
+    uint32_t victim = pCache->ways - 1;
+
+    if (pCache->replacement == MINIARM_CACHE_RANDOM)
+    {
+        // xorshift32, an empty way is taken first
+        pCache->random ^= pCache->random << 13;
+        pCache->random ^= pCache->random >> 17;
+        pCache->random ^= pCache->random << 5;
+        victim = empty < pCache->ways ? empty : pCache->random % pCache->ways;
+    }
+
+    if (pSet[victim] & CACHE_DIRTY)
+    {
+        pCache->statistics.writebacks++;
+        *pVictim = pSet[victim];
+    }
+
+    if (pCache->replacement == MINIARM_CACHE_RANDOM)
+    {
+        pSet[victim] = tag | dirty;
+    }
+    else
+    {
+        memmove(pSet + 1, pSet, victim * sizeof *pSet);
+        pSet[0] = tag | dirty;
+    }
+
+    return false;
+}
+
+// the L1 cache given, then L2, then memory
+static inline uint32_t
+accessLevels
+(
+    Caches  *pCaches,
+    Cache   *pL1,
+    uint32_t address,
+    bool     write
+)
+{
+    Cache   *pL2 = &pCaches->levels[MINIARM_CACHE_L2];
+    uint32_t victim = 0;
+    uint32_t ignored;
+
+    if (pL1->pLines)
+    {
+        if (accessLine(pL1, address, write, &victim))
+        {
+            return SERVED_L1;
+        }
+
+        // the line fill reads L2, an L1 write only dirties L1
+        write = false;
+    }
+
+    if (!pL2->pLines)
+    {
+        return SERVED_MEMORY;
+    }
+
+    if (victim)
+    {
+        accessLine(pL2, (victim >> 2) << pL1->lineShift, true, &ignored);
+    }
+
+    return accessLine(pL2, address, write, &ignored) ? SERVED_L2 : SERVED_MEMORY;
+}
+
+void
+cacheFetch
+(
+    Caches  *pCaches,
+    uint32_t pc
+)
+{
+    uint32_t served = accessLevels(pCaches, &pCaches->levels[MINIARM_CACHE_L1I], pc, false);
+
+    if (pc / 4 < pCaches->words)
+    {
+        MiniArmCacheCounts *pCounts = &pCaches->pCounts[pc / 4];
+
+        pCounts->fetches++;
+        pCounts->fetchMisses += served != SERVED_L1;
+        pCounts->l2Misses += served == SERVED_MEMORY;
+    }
+}
+
+// every line an executed load or store touches
+void
+cacheReference
+(
+    Caches                   *pCaches,
+    uint32_t                  pc,
+    const TemporaryRegisters *pTemporaryRegisters
+)
+{
+    uint32_t address = pTemporaryRegisters->ALUOutput;
+    uint32_t length;
+    bool     write;
+
+    switch(pTemporaryRegisters->operation)
+    {
+    case LDR:
+    case STR:
+        address &= ~3u;
+        length = 4;
+        break;
+    case LDRB:
+    case STRB:
+        length = 1;
+        break;
+    case LDM:
+    case STM:
+        length = 4 * pTemporaryRegisters->pDecoded->registerCount;
+        break;
+    default:
+        return;
+    }
+
+    Cache *pL1 = &pCaches->levels[MINIARM_CACHE_L1D];
+    Cache *pL2 = &pCaches->levels[MINIARM_CACHE_L2];
+
+    // with only an instruction cache there are no data lines to count accesses in
+    if (length == 0 || address >= DEVICE_BASE || (!pL1->pLines && !pL2->pLines))
+    {
+        return;
+    }
+
+    write = pTemporaryRegisters->operation == STR || pTemporaryRegisters->operation == STRB ||
+            pTemporaryRegisters->operation == STM;
+
+    uint32_t            shift = pL1->pLines ? pL1->lineShift : pL2->lineShift;
+    MiniArmCacheCounts *pCounts = pc / 4 < pCaches->words ? &pCaches->pCounts[pc / 4] : NULL;
+    uint64_t            end = (uint64_t)address + length;
+
+    // a block transfer can span lines, every line counts as an access
+    for (uint64_t line = address >> shift; line <= (end - 1) >> shift; line++)
+    {
+        uint32_t served = accessLevels(pCaches, pL1, (uint32_t)(line << shift), write);
+
+        if (pCounts)
+        {
+            pCounts->dataAccesses++;
+            pCounts->dataMisses += served != SERVED_L1;
+            pCounts->l2Misses += served == SERVED_MEMORY;
+        }
+    }
+}
@@ -0,0 +1,428 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bus.h"
+#include "checkpoint.h"
+
+static int64_t
+streamOffset
+(
+    FILE *pStream
+)
+{
+    // pipes and terminals can't tell
+    return pStream ? ftell(pStream) : -1;
+}
+
+static int
+writeAll
+(
+    int         fd,
+    const void *pBuffer,
+    uint64_t    length,
+    uint64_t    offset
+)
+{
+    const uint8_t *pBytes = (const uint8_t *)pBuffer;
+
+    while (length > 0)
+    {
+        ssize_t written = pwrite(fd, pBytes, length, offset);
+
+        if (written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            return -1;
+        }
+
+        pBytes += written;
+        length -= written;
+        offset += written;
+    }
+
+    return 0;
+}
+
+static int
+readAll
+(
+    int      fd,
+    void    *pBuffer,
+    uint64_t length,
+    uint64_t offset
+)
+{
+    uint8_t *pBytes = (uint8_t *)pBuffer;
+
+    while (length > 0)
+    {
+        ssize_t read = pread(fd, pBytes, length, offset);
+
+        if (read == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (read <= 0)
+        {
+            errno = read == 0 ? EINVAL : errno;
+            return -1;
+        }
+
+        pBytes += read;
+        length -= read;
+        offset += read;
+    }
+
+    return 0;
+}
+
+static bool
+chunkWritten
+(
+    const Memory *pMemory,
+    uint64_t      address,
+    uint64_t      alignment
+)
+{
+    uint64_t end = address + alignment < pMemory->size ? address + alignment : pMemory->size;
+
+    for (uint64_t page = address >> PAGE_SHIFT; page < end >> PAGE_SHIFT; page++)
+    {
+        if (pMemory->pPageFlags[page] & PAGE_WRITTEN)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// the next run of aligned chunks holding written pages from *pAddress on, false when there is none
+static bool
+nextExtent
+(
+    const Memory *pMemory,
+    uint64_t      alignment,
+    uint64_t     *pAddress,
+    uint64_t     *pLength
+)
+{
+    uint64_t address = *pAddress;
+
+    while (address < pMemory->size && !chunkWritten(pMemory, address, alignment))
+    {
+        address += alignment;
+    }
+
+    if (address >= pMemory->size)
+    {
+        return false;
+    }
+
+    uint64_t end = address;
+
+    while (end < pMemory->size && chunkWritten(pMemory, end, alignment))
+    {
+        end += alignment;
+    }
+
+    *pAddress = address;
+    *pLength = (end < pMemory->size ? end : pMemory->size) - address;
+    return true;
+}
+
+// runs in the child, on its copy of the memory
+static int
+writeCheckpoint
+(
+    const CpuState   *pState,
+    CheckpointHeader *pHeader,
+    int               fd
+)
+{
+    const Memory *pMemory = &pState->memory;
+    uint64_t      alignment = pHeader->alignment;
+    uint64_t      address;
+    uint64_t      length;
+
+    for (address = 0; nextExtent(pMemory, alignment, &address, &length); address += length)
+    {
+        pHeader->extentCount++;
+    }
+
+    uint64_t table = sizeof *pHeader;
+    uint64_t offset = (table + pHeader->extentCount * sizeof(CheckpointExtent) + alignment - 1) / alignment * alignment;
+
+    if (writeAll(fd, pHeader, sizeof *pHeader, 0) == -1)
+    {
+        return -1;
+    }
+
+    for (address = 0; nextExtent(pMemory, alignment, &address, &length); address += length)
+    {
+        CheckpointExtent extent = { address, length, offset };
+
+        if (writeAll(fd, &extent, sizeof extent, table) == -1 ||
+            writeAll(fd, pMemory->pBytes + address, length, offset) == -1)
+        {
+            return -1;
+        }
+
+        table += sizeof extent;
+        offset += (length + alignment - 1) / alignment * alignment;
+    }
+
+    return 0;
+}
+
+pid_t
+startCheckpoint
+(
+    CpuState   *pState,
+    const char *path
+)
+{
+    Memory          *pMemory = &pState->memory;
+    Bus             *pBus = pMemory->pBus;
+    CheckpointHeader header;
+    char             temporary[PATH_MAX];
+
+    if (snprintf(temporary, sizeof temporary, "%s.tmp", path) >= (int)sizeof temporary)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof header.magic);
+    header.alignment = sysconf(_SC_PAGESIZE);
+    header.memorySize = pMemory->size;
+    header.instructions = pState->instructions;
+    memcpy(header.registers, pState->registers, sizeof header.registers);
+    header.registers[CPSR] = applyFlags(pState->registers[CPSR], &pState->flags);
+    header.programSize = pState->programSize;
+    header.faulted = pMemory->faulted;
+    header.faultAddress = pMemory->faultAddress;
+    header.halted = pMemory->halted;
+    header.exitStatus = pMemory->exitStatus;
+    header.cyclesHigh = pBus ? pBus->cyclesHigh : 0;
+    header.inputOffset = streamOffset(pState->pInput);
+    header.deviceInputOffset = streamOffset(pBus ? pBus->pInput : NULL);
+
+    // opened here so a bad path fails the call rather than the writer
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    pid_t writer = fork();
+
+    if (writer == 0)
+    {
+        // the stdio buffers are copies of ours, so the child leaves through _exit() without flushing them
+        bool written = writeCheckpoint(pState, &header, fd) == 0 && fsync(fd) == 0 && rename(temporary, path) == 0;
+
+        _exit(written ? 0 : 1);
+    }
+
+    int error = errno;
+
+    close(fd);
+
+    if (writer == -1)
+    {
+        unlink(temporary);
+        errno = error;
+    }
+
+    return writer;
+}
+
+int
+finishCheckpoint
+(
+    pid_t writer,
+    bool  wait
+)
+{
+    int   status;
+    pid_t result;
+
+    do
+    {
+        result = waitpid(writer, &status, wait ? 0 : WNOHANG);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == 0)
+    {
+        return 1;
+    }
+
+    if (result == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+// extents in ascending order inside the guest RAM the checkpoint was taken with and inside the file, after the table
+static bool
+validExtents
+(
+    const CheckpointHeader *pHeader,
+    const CheckpointExtent *pExtents,
+    uint64_t                fileSize
+)
+{
+    uint64_t table = sizeof *pHeader + (uint64_t)pHeader->extentCount * sizeof *pExtents;
+    uint64_t end = 0;
+
+    for (uint32_t index = 0; index < pHeader->extentCount; index++)
+    {
+        const CheckpointExtent *pExtent = &pExtents[index];
+
+        if (pExtent->address % pHeader->alignment != 0 || pExtent->offset % pHeader->alignment != 0 ||
+            pExtent->length == 0 || pExtent->address < end || pExtent->address > pHeader->memorySize ||
+            pExtent->length > pHeader->memorySize - pExtent->address ||
+            pExtent->offset < table || pExtent->offset > fileSize || pExtent->length > fileSize - pExtent->offset)
+        {
+            return false;
+        }
+
+        end = pExtent->address + pExtent->length;
+    }
+
+    return true;
+}
+
+int
+loadCheckpoint
+(
+    CpuState   *pState,
+    const char *path
+)
+{
+    Memory          *pMemory = &pState->memory;
+    Bus             *pBus = pMemory->pBus;
+    CheckpointHeader header;
+    struct stat      status;
+    int              fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    if (fstat(fd, &status) == -1)
+    {
+        int error = errno;
+
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    if (readAll(fd, &header, sizeof header, 0) == -1 || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof header.magic) != 0 ||
+        header.alignment < PAGE_SIZE || (header.alignment & (header.alignment - 1)) != 0 ||
+        header.programSize > header.memorySize ||
+        (uint64_t)header.extentCount * sizeof(CheckpointExtent) > (uint64_t)status.st_size - sizeof header)
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (header.memorySize > pMemory->size)
+    {
+        close(fd);
+        errno = EFBIG;
+        return -1;
+    }
+
+    // the whole table is read and checked before the first extent touches guest RAM
+    CheckpointExtent *pExtents = (CheckpointExtent *)malloc(((uint64_t)header.extentCount + 1) * sizeof *pExtents);
+
+    if (!pExtents)
+    {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (readAll(fd, pExtents, (uint64_t)header.extentCount * sizeof *pExtents, sizeof header) == -1 ||
+        !validExtents(&header, pExtents, status.st_size))
+    {
+        free(pExtents);
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // a writer with larger pages than ours still maps, one with smaller ones is read
+    bool mapped = header.alignment % sysconf(_SC_PAGESIZE) == 0;
+
+    for (uint32_t index = 0; index < header.extentCount; index++)
+    {
+        CheckpointExtent *pExtent = &pExtents[index];
+
+        if (mapped ? mmap(pMemory->pBytes + pExtent->address, pExtent->length, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_FIXED, fd, pExtent->offset) == MAP_FAILED
+                   : readAll(fd, pMemory->pBytes + pExtent->address, pExtent->length, pExtent->offset) == -1)
+        {
+            int error = errno;
+
+            free(pExtents);
+            close(fd);
+            errno = error;
+            return -1;
+        }
+
+        markRangeDirty(pMemory, pExtent->address, pExtent->length);
+        codeWritten(pState, pExtent->address, pExtent->length);
+    }
+
+    // the mappings keep their own reference to the file
+    free(pExtents);
+    close(fd);
+
+    memcpy(pState->registers, header.registers, sizeof pState->registers);
+    writeFlags(&pState->registers[CPSR], &pState->flags, header.registers[CPSR]);
+    pState->programSize = header.programSize;
+    pState->instructions = header.instructions;
+    pMemory->faulted = header.faulted;
+    pMemory->faultAddress = header.faultAddress;
+    pMemory->halted = header.halted;
+    pMemory->exitStatus = header.exitStatus;
+
+    if (pBus)
+    {
+        pBus->cyclesHigh = header.cyclesHigh;
+
+        if (pBus->pInput && header.deviceInputOffset >= 0)
+        {
+            fseek(pBus->pInput, header.deviceInputOffset, SEEK_SET);
+        }
+    }
+
+    if (pState->pInput && header.inputOffset >= 0)
+    {
+        fseek(pState->pInput, header.inputOffset, SEEK_SET);
+    }
+
+    return 0;
+}
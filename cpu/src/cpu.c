@@ -1,200 +1,605 @@
-#include "execute.h"
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "debugger.h"
+#include "profile.h"
+#include "symbols.h"
+#include "utils.h"
 
-bool 
-validCondition
+/* Command line front end, everything it runs goes through libminiarm. */
+
+// sizes like 65536, 0x10000, 64k, 16M or 4G
+int
+parseSize
 (
-    uint32_t condition, 
-    uint32_t currentProcessStateRegister
+    const char *text,
+    uint64_t   *pSize
 )
 {
-    switch(condition) 
-    {
-    case EQ:
-        return bit(currentProcessStateRegister, Z);
-    case NE:
-        return !bit(currentProcessStateRegister, Z);
-    case CS:
-        return bit(currentProcessStateRegister, C);
-    case CC:
-        return !bit(currentProcessStateRegister, C);
-    case MI:
-        return bit(currentProcessStateRegister, N);
-    case PL:
-        return !bit(currentProcessStateRegister, N);
-    case VS:
-        return bit(currentProcessStateRegister, V);
-    case VC:
-        return !bit(currentProcessStateRegister, V);
-    case HI:
-        return bit(currentProcessStateRegister, C) && !bit(currentProcessStateRegister, Z);
-    case LS:
-        return !bit(currentProcessStateRegister, C) || bit(currentProcessStateRegister, Z);
-    case GE:
-        return bit(currentProcessStateRegister, N) == bit(currentProcessStateRegister, V);
-    case LT:
-        return bit(currentProcessStateRegister, N) != bit(currentProcessStateRegister, V);
-    case GT:
-        return !bit(currentProcessStateRegister, Z) && 
-            (bit(currentProcessStateRegister, N) == bit(currentProcessStateRegister, V));
-    case LE:
-        return bit(currentProcessStateRegister, Z) || 
-            (bit(currentProcessStateRegister, N) != bit(currentProcessStateRegister, V));
-    case AL:
-        return  true;
-    default:
-        printf("Invalid Condition");
-    }
-
-    return false;
+    char              *pEnd;
+    unsigned long long size = strtoull(text, &pEnd, 0);
+
+    switch(tolower((unsigned char)*pEnd))
+    {
+    case 'k':
+        size <<= 10;
+        pEnd++;
+        break;
+    case 'm':
+        size <<= 20;
+        pEnd++;
+        break;
+    case 'g':
+        size <<= 30;
+        pEnd++;
+        break;
+    }
+
+    if (pEnd == text || *pEnd != '\0')
+    {
+        return -1;
+    }
+
+    *pSize = size;
+    return 0;
 }
 
-void 
-memoryReference
+static const char *cacheNames[MINIARM_CACHE_LEVELS] = { "l1i", "l1d", "l2" };
+static const char *replacementNames[] = { "lru", "fifo", "random" };
+
+// how many instructions the cache report lists
+#define CACHE_TOP 20
+
+/* "default", or levels like l1i=16k:2:32,l1d=32k:4:32:fifo,l2=256k:8:64,
+   each its size, ways, line size and optionally lru, fifo or random. The
+   levels left out are absent. */
+static int
+parseCaches
 (
-    uint8_t            *pMemory, 
-    TemporaryRegisters *pTemporaryRegisters
+    const char         *text,
+    MiniArmCacheConfig  configs[]
 )
 {
-    switch(pTemporaryRegisters->operation) {
-    case LDR:
-        pTemporaryRegisters->loadMemoryData = load32(pMemory, pTemporaryRegisters->ALUOutput);
-        break;
-    case LDRB:
-        pTemporaryRegisters->loadMemoryData = load8(pMemory, pTemporaryRegisters->ALUOutput);
-        break;
-    case STR:
-        store32(pMemory, pTemporaryRegisters->ALUOutput, pTemporaryRegisters->b);
-        break;
-    case STRB:
-        store8(pMemory, pTemporaryRegisters->ALUOutput, pTemporaryRegisters->b);
-        break;
+    char  copy[256];
+    char *pSave;
+
+    memset(configs, 0, MINIARM_CACHE_LEVELS * sizeof *configs);
+
+    if (strcmp(text, "default") == 0)
+    {
+        configs[MINIARM_CACHE_L1I] = (MiniArmCacheConfig){ 32 << 10, 4, 64, MINIARM_CACHE_LRU };
+        configs[MINIARM_CACHE_L1D] = (MiniArmCacheConfig){ 32 << 10, 8, 64, MINIARM_CACHE_LRU };
+        configs[MINIARM_CACHE_L2] = (MiniArmCacheConfig){ 1 << 20, 16, 64, MINIARM_CACHE_LRU };
+        return 0;
+    }
+
+    if (snprintf(copy, sizeof copy, "%s", text) >= (int)sizeof copy)
+    {
+        return -1;
+    }
+
+    for (char *pLevel = strtok_r(copy, ",", &pSave); pLevel; pLevel = strtok_r(NULL, ",", &pSave))
+    {
+        char    *pFields = strchr(pLevel, '=');
+        char    *pField;
+        char    *pFieldSave;
+        uint64_t values[3];
+        int      level;
+
+        if (!pFields)
+        {
+            return -1;
+        }
+
+        *pFields++ = '\0';
+
+        for (level = 0; level < MINIARM_CACHE_LEVELS && strcmp(pLevel, cacheNames[level]) != 0; level++)
+        {
+        }
+
+        if (level == MINIARM_CACHE_LEVELS)
+        {
+            return -1;
+        }
+
+        pField = strtok_r(pFields, ":", &pFieldSave);
+
+        for (int index = 0; index < 3; index++, pField = strtok_r(NULL, ":", &pFieldSave))
+        {
+            if (!pField || parseSize(pField, &values[index]) == -1 || values[index] > UINT32_MAX)
+            {
+                return -1;
+            }
+        }
+
+        int replacement = MINIARM_CACHE_LRU;
+
+        if (pField)
+        {
+            for (replacement = 0; replacement <= MINIARM_CACHE_RANDOM && strcmp(pField, replacementNames[replacement]);
+                 replacement++)
+            {
+            }
+
+            if (replacement > MINIARM_CACHE_RANDOM || strtok_r(NULL, ":", &pFieldSave))
+            {
+                return -1;
+            }
+        }
+
+        configs[level] = (MiniArmCacheConfig){ values[0], values[1], values[2], replacement };
     }
-} 
 
-void 
-registerWriteback
+    return 0;
+}
+
+static void
+printCaches
 (
-    TemporaryRegisters *pTemporaryRegisters, 
-    uint32_t            registers[]
+    MiniArm                  *pMiniArm,
+    const MiniArmCacheConfig  configs[],
+    const char               *symbolPath
 )
 {
-    uint32_t rs = bits(pTemporaryRegisters->instruction, 19, 16);
-    uint32_t rt = bits(pTemporaryRegisters->instruction, 15, 12);
+    MiniArmCacheStatistics statistics[MINIARM_CACHE_LEVELS];
+    MiniArmCacheCounts     counts[CACHE_TOP];
+    Symbol                *pSymbols = NULL;
+    uint32_t               symbolCount = 0;
 
-    if (pTemporaryRegisters->operation == LDR || pTemporaryRegisters->operation == LDRB) 
+    getMiniArmCacheStatistics(pMiniArm, statistics);
+
+    for (int level = 0; level < MINIARM_CACHE_LEVELS; level++)
     {
-        registers[rs] = pTemporaryRegisters->singleDataTransferOffset;
-        registers[rt] = pTemporaryRegisters->loadMemoryData;
-    } 
-    else if (pTemporaryRegisters->operation == STR || pTemporaryRegisters->operation == STRB) 
+        const MiniArmCacheConfig *pConfig = &configs[level];
+
+        if (pConfig->size == 0)
+        {
+            continue;
+        }
+
+        fprintf(stderr, "cache %s: %u KiB, %u-way, %u-byte lines, %s: %llu accesses, %llu misses (%.2f%%), "
+                "%llu writebacks\n", cacheNames[level], pConfig->size >> 10, pConfig->ways, pConfig->lineSize,
+                replacementNames[pConfig->replacement], (unsigned long long)statistics[level].accesses,
+                (unsigned long long)statistics[level].misses,
+                statistics[level].accesses ? 100.0 * statistics[level].misses / statistics[level].accesses : 0.0,
+                (unsigned long long)statistics[level].writebacks);
+    }
+
+    uint32_t hotspots = getMiniArmCacheHotspots(pMiniArm, counts, CACHE_TOP);
+
+    if (hotspots == 0)
     {
-        registers[rs] = pTemporaryRegisters->singleDataTransferOffset;
-    } 
-    else if (pTemporaryRegisters->operation == DATA && pTemporaryRegisters->writeback) 
+        return;
+    }
+
+    // without symbols the report just has no labels
+    if (symbolPath && loadSymbols(symbolPath, &pSymbols, &symbolCount) == -1)
     {
-        registers[rt] = pTemporaryRegisters->ALUOutput;
+        symbolCount = 0;
     }
-    else if (pTemporaryRegisters->operation == MUL)
+
+    fprintf(stderr, "%12s %12s %12s %12s %12s  %s\n", "fetches", "i-misses", "d-accesses", "d-misses", "l2-misses",
+            "address");
+
+    for (uint32_t rank = 0; rank < hotspots; rank++)
     {
-        registers[rs] = pTemporaryRegisters->ALUOutput;
+        const MiniArmCacheCounts *pCounts = &counts[rank];
+        uint32_t                  symbol = findSymbol(pSymbols, symbolCount, pCounts->pc);
+
+        fprintf(stderr, "%12llu %12llu %12llu %12llu %12llu  0x%08x", (unsigned long long)pCounts->fetches,
+                (unsigned long long)pCounts->fetchMisses, (unsigned long long)pCounts->dataAccesses,
+                (unsigned long long)pCounts->dataMisses, (unsigned long long)pCounts->l2Misses, pCounts->pc);
+
+        if (symbol < symbolCount)
+        {
+            fprintf(stderr, "  %s+0x%x", pSymbols[symbol].pName, pCounts->pc - pSymbols[symbol].address);
+        }
+
+        fprintf(stderr, "\n");
     }
-    else if (pTemporaryRegisters->operation == BRANCH)
+
+    freeSymbols(pSymbols, symbolCount);
+}
+
+static const char *predictorNames[MINIARM_PREDICTORS] = { "btfn", "bimodal", "gshare" };
+
+// how many branches the predictor report lists
+#define BRANCH_TOP 20
+
+/* "default", or sizes like bimodal=4k,gshare=16k:14,btb=1k; gshare takes
+   its history length after the table size. What is left out keeps the
+   default of 4k bimodal and gshare counters, 12 bits of history and 512
+   BTB entries. */
+static int
+parsePredictors
+(
+    const char             *text,
+    MiniArmPredictorConfig *pConfig
+)
+{
+    char  copy[256];
+    char *pSave;
+
+    *pConfig = (MiniArmPredictorConfig){ 4 << 10, 4 << 10, 12, 512 };
+
+    if (strcmp(text, "default") == 0)
+    {
+        return 0;
+    }
+
+    if (snprintf(copy, sizeof copy, "%s", text) >= (int)sizeof copy)
+    {
+        return -1;
+    }
+
+    for (char *pTable = strtok_r(copy, ",", &pSave); pTable; pTable = strtok_r(NULL, ",", &pSave))
     {
-        if (pTemporaryRegisters->link)
+        char    *pValue = strchr(pTable, '=');
+        char    *pHistory;
+        uint64_t entries;
+        uint64_t history = pConfig->historyBits;
+
+        if (!pValue)
+        {
+            return -1;
+        }
+
+        *pValue++ = '\0';
+        pHistory = strchr(pValue, ':');
+
+        if (pHistory)
+        {
+            *pHistory++ = '\0';
+
+            if (strcmp(pTable, "gshare") != 0 || parseSize(pHistory, &history) == -1 || history > 31)
+            {
+                return -1;
+            }
+        }
+
+        if (parseSize(pValue, &entries) == -1 || entries > UINT32_MAX)
         {
-            registers[LR] = registers[PC];
+            return -1;
         }
 
-        registers[PC] += pTemporaryRegisters->ALUOutput;
+        if (strcmp(pTable, "bimodal") == 0)
+        {
+            pConfig->bimodalEntries = entries;
+        }
+        else if (strcmp(pTable, "gshare") == 0)
+        {
+            pConfig->gshareEntries = entries;
+            pConfig->historyBits = history;
+        }
+        else if (strcmp(pTable, "btb") == 0)
+        {
+            pConfig->btbEntries = entries;
+        }
+        else
+        {
+            return -1;
+        }
     }
+
+    return 0;
 }
 
-void 
-registerFetch
+static double
+percent
 (
-    uint32_t            instruction, 
-    TemporaryRegisters *pTemporaryRegisters,
-    uint32_t            registers[]
+    uint64_t part,
+    uint64_t whole
 )
 {
-    uint32_t rs = bits(instruction, 19, 16);
-    uint32_t rt = bits(instruction, 15, 12);
-    uint32_t ru = bits(instruction, 11, 8);
-    uint32_t rv = bits(instruction, 3, 0);
-
-    pTemporaryRegisters->a = registers[rs];
-    pTemporaryRegisters->b = registers[rt];
-    pTemporaryRegisters->c = registers[ru];
-    pTemporaryRegisters->d = registers[rv];
-    pTemporaryRegisters->instruction = instruction;
-    pTemporaryRegisters->condition = bits(instruction, 31, 28);
+    return whole ? 100.0 * part / whole : 0.0;
 }
 
-uint32_t 
-decode
+static void
+printPredictors
 (
-    uint32_t instruction
+    MiniArm    *pMiniArm,
+    const char *symbolPath
 )
 {
-    uint32_t operation;
+    MiniArmBranchStatistics statistics;
+    MiniArmBranchCounts     counts[BRANCH_TOP];
+    Symbol                 *pSymbols = NULL;
+    uint32_t                symbolCount = 0;
+
+    getMiniArmBranchStatistics(pMiniArm, &statistics);
 
-    if ((instruction & MULT_MASK) == MUL)
+    fprintf(stderr, "branches: %llu conditional (%.2f%% taken), %llu taken branches and PC writes, "
+            "%llu BTB misses (%.2f%%)\n", (unsigned long long)statistics.conditional,
+            percent(statistics.taken, statistics.conditional), (unsigned long long)statistics.transfers,
+            (unsigned long long)statistics.btbMisses, percent(statistics.btbMisses, statistics.transfers));
+
+    for (int predictor = 0; predictor < MINIARM_PREDICTORS; predictor++)
     {
-        operation = MUL;
+        fprintf(stderr, "  %-8s %12llu mispredictions, %.2f%% accurate\n", predictorNames[predictor],
+                (unsigned long long)statistics.mispredictions[predictor],
+                100.0 - percent(statistics.mispredictions[predictor], statistics.conditional));
     }
-    else if ((instruction & SDT_MASK) == LDR)
+
+    fprintf(stderr, "predicated: %llu other conditional instructions, %.2f%% skipped\n",
+            (unsigned long long)statistics.predicated,
+            percent(statistics.predicatedSkipped, statistics.predicated));
+
+    uint32_t hotspots = getMiniArmBranchHotspots(pMiniArm, MINIARM_PREDICTOR_GSHARE, counts, BRANCH_TOP);
+
+    if (hotspots == 0)
     {
-        operation = LDR;
+        return;
     }
-    else if ((instruction & SDT_MASK) == LDRB)
+
+    // without symbols the report just has no labels
+    if (symbolPath && loadSymbols(symbolPath, &pSymbols, &symbolCount) == -1)
     {
-        operation = LDRB;
+        symbolCount = 0;
     }
-    else if ((instruction & SDT_MASK) == STR)
+
+    fprintf(stderr, "%12s %12s %12s %12s %12s %12s  %s\n", "executions", "taken", "btfn", "bimodal", "gshare",
+            "btb-misses", "address");
+
+    for (uint32_t rank = 0; rank < hotspots; rank++)
     {
-        operation = STR;
+        const MiniArmBranchCounts *pCounts = &counts[rank];
+        uint32_t                   symbol = findSymbol(pSymbols, symbolCount, pCounts->pc);
+
+        fprintf(stderr, "%12llu %12llu %12llu %12llu %12llu %12llu  0x%08x", (unsigned long long)pCounts->executions,
+                (unsigned long long)pCounts->taken,
+                (unsigned long long)pCounts->mispredictions[MINIARM_PREDICTOR_BTFN],
+                (unsigned long long)pCounts->mispredictions[MINIARM_PREDICTOR_BIMODAL],
+                (unsigned long long)pCounts->mispredictions[MINIARM_PREDICTOR_GSHARE],
+                (unsigned long long)pCounts->btbMisses, pCounts->pc);
+
+        if (symbol < symbolCount)
+        {
+            fprintf(stderr, "  %s+0x%x", pSymbols[symbol].pName, pCounts->pc - pSymbols[symbol].address);
+        }
+
+        fprintf(stderr, "\n");
     }
-    else if ((instruction & SDT_MASK) == STRB)
+
+    freeSymbols(pSymbols, symbolCount);
+}
+
+static const char *opcodeNames[16] =
+{
+    "and", "eor", "sub", "rsb", "add", "adc", "sbc", "rsc",
+    "tst", "teq", "cmp", "cmn", "orr", "mov", "bic", "mvn"
+};
+
+static void
+printStatistics
+(
+    const MiniArmExecutionStatistics *pStatistics,
+    double                            seconds
+)
+{
+    unsigned long long instructions = pStatistics->instructions;
+    unsigned long long loads = pStatistics->byteLoads + pStatistics->wordLoads + pStatistics->blockLoads;
+    unsigned long long stores = pStatistics->byteStores + pStatistics->wordStores + pStatistics->blockStores;
+    unsigned long long traffic = pStatistics->byteLoads + pStatistics->byteStores + 
+                                 4 * (pStatistics->wordLoads + pStatistics->wordStores +
+                                      pStatistics->blockWordsLoaded + pStatistics->blockWordsStored);
+
+    fprintf(stderr, "%llu instructions in %.3fs (%.2f MIPS), %llu failed their condition (%.1f%%)\n",
+            instructions, seconds, instructions / seconds / 1e6, (unsigned long long)pStatistics->conditionFailed,
+            instructions ? 100.0 * pStatistics->conditionFailed / instructions : 0.0);
+    fprintf(stderr, "executed: %llu data processing, %llu multiplies, %llu loads, %llu stores, %llu branches, "
+            "%llu service calls, %llu undefined\n", (unsigned long long)pStatistics->dataProcessing,
+            (unsigned long long)pStatistics->multiplies, loads, stores,
+            (unsigned long long)pStatistics->takenBranches, (unsigned long long)pStatistics->serviceCalls,
+            (unsigned long long)pStatistics->undefined);
+    fprintf(stderr, "memory: %llu byte and %llu word loads, %llu byte and %llu word stores, %llu bytes\n",
+            (unsigned long long)pStatistics->byteLoads, (unsigned long long)pStatistics->wordLoads,
+            (unsigned long long)pStatistics->byteStores, (unsigned long long)pStatistics->wordStores, traffic);
+    fprintf(stderr, "blocks: %llu LDM of %llu words, %llu STM of %llu words\n",
+            (unsigned long long)pStatistics->blockLoads, (unsigned long long)pStatistics->blockWordsLoaded,
+            (unsigned long long)pStatistics->blockStores, (unsigned long long)pStatistics->blockWordsStored);
+    fprintf(stderr, "branches: %llu taken, %llu not taken\n", (unsigned long long)pStatistics->takenBranches,
+            (unsigned long long)pStatistics->untakenBranches);
+    fprintf(stderr, "opcodes:");
+
+    for (int opcode = 0; opcode < 16; opcode++)
     {
-        operation = STRB;
+        if (pStatistics->opcodes[opcode])
+        {
+            fprintf(stderr, " %s %llu", opcodeNames[opcode], (unsigned long long)pStatistics->opcodes[opcode]);
+        }
     }
-    else if ((instruction & DATA_MASK) == DATA)
+
+    fprintf(stderr, "\n");
+}
+
+static int
+writeStatistics
+(
+    const char                       *path,
+    const MiniArmExecutionStatistics *pStatistics,
+    double                            seconds
+)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f)
     {
-        operation = DATA;
+        return -1;
     }
-    else if ((instruction & BRANCH_MASK) == BRANCH)
+
+    fprintf(f, "{\"instructions\":%llu,\"seconds\":%.6f,\"mips\":%.2f,\"condition_failed\":%llu,"
+            "\"data_processing\":%llu,\"multiplies\":%llu,\"service_calls\":%llu,\"undefined\":%llu,",
+            (unsigned long long)pStatistics->instructions, seconds, pStatistics->instructions / seconds / 1e6,
+            (unsigned long long)pStatistics->conditionFailed, (unsigned long long)pStatistics->dataProcessing,
+            (unsigned long long)pStatistics->multiplies, (unsigned long long)pStatistics->serviceCalls,
+            (unsigned long long)pStatistics->undefined);
+    fprintf(f, "\"loads\":{\"byte\":%llu,\"word\":%llu},\"stores\":{\"byte\":%llu,\"word\":%llu},"
+            "\"blocks\":{\"ldm\":%llu,\"ldm_words\":%llu,\"stm\":%llu,\"stm_words\":%llu},"
+            "\"branches\":{\"taken\":%llu,\"not_taken\":%llu},\"opcodes\":{",
+            (unsigned long long)pStatistics->byteLoads, (unsigned long long)pStatistics->wordLoads,
+            (unsigned long long)pStatistics->byteStores, (unsigned long long)pStatistics->wordStores,
+            (unsigned long long)pStatistics->blockLoads, (unsigned long long)pStatistics->blockWordsLoaded,
+            (unsigned long long)pStatistics->blockStores, (unsigned long long)pStatistics->blockWordsStored,
+            (unsigned long long)pStatistics->takenBranches, (unsigned long long)pStatistics->untakenBranches);
+
+    for (int opcode = 0; opcode < 16; opcode++)
     {
-        operation = BRANCH;
+        fprintf(f, "%s\"%s\":%llu", opcode ? "," : "", opcodeNames[opcode],
+                (unsigned long long)pStatistics->opcodes[opcode]);
     }
 
-    return operation;
+    fprintf(f, "}}\n");
+    return fclose(f);
 }
 
-int 
-loadProgram
+// prog.bin with its extension replaced, e.g. by the .sym the assembler writes next to it
+static char *
+pathWithExtension
 (
-    uint8_t *pMemory, 
-    char    *program
+    const char *image,
+    const char *extension
 )
 {
-    FILE *f;
-    f = fopen(program, "rb");
+    const char *pSlash = strrchr(image, '/');
+    const char *pDot = strrchr(image, '.');
+    size_t      length = pDot && (!pSlash || pDot > pSlash) ? (size_t)(pDot - image) : strlen(image);
+    char       *path = (char *)malloc(length + strlen(extension) + 1);
 
-    if (!f) 
+    if (!path)
     {
-        return -1;
+        return NULL;
+    }
+
+    memcpy(path, image, length);
+    strcpy(path + length, extension);
+    return path;
+}
+
+// prog.bin pairs with the prog.sym the assembler writes next to it
+static char *
+symbolPathFor
+(
+    const char *image
+)
+{
+    char *path = pathWithExtension(image, ".sym");
+
+    if (path && access(path, R_OK) != 0)
+    {
+        free(path);
+        return NULL;
+    }
+
+    return path;
+}
+
+/* Runs in slices of every instructions with a checkpoint after each,
+   otherwise like runMiniArm(). A checkpoint still being written when the
+   next is due is left to finish and the next slice tries again; a run
+   stopped by its limit ends with one more, so it can be resumed. */
+static int
+runCheckpointed
+(
+    MiniArm    *pMiniArm,
+    uint64_t    limit,
+    uint64_t    every,
+    const char *path
+)
+{
+    uint64_t run = 0;
+    int      result;
+
+    for (;;)
+    {
+        uint64_t count = limit && limit - run < every ? limit - run : every;
+
+        result = runMiniArm(pMiniArm, count);
+        run += count;
+
+        if (result != MINIARM_LIMIT || run == limit)
+        {
+            break;
+        }
+
+        if (checkpointMiniArm(pMiniArm, path) == -1 && errno != EBUSY)
+        {
+            perror("checkpointMiniArm() failed");
+        }
+    }
+
+    if (result == MINIARM_LIMIT && (waitMiniArmCheckpoint(pMiniArm) == -1 || checkpointMiniArm(pMiniArm, path) == -1))
+    {
+        perror("checkpointMiniArm() failed");
+    }
+
+    if (waitMiniArmCheckpoint(pMiniArm) == -1)
+    {
+        perror("waitMiniArmCheckpoint() failed");
     }
 
-    uint8_t buffer;
-    int     i;
+    return result;
+}
+
+// options without a short form
+enum
+{
+    OPTION_CHECKPOINT_EVERY = 256,
+    OPTION_RESUME,
+    OPTION_RECORD,
+    OPTION_REPLAY
+};
+
+static const struct option longOptions[] =
+{
+    { "checkpoint-every", required_argument, NULL, OPTION_CHECKPOINT_EVERY },
+    { "resume",           required_argument, NULL, OPTION_RESUME },
+    { "record",           required_argument, NULL, OPTION_RECORD },
+    { "replay",           required_argument, NULL, OPTION_REPLAY },
+    { NULL,               0,                 NULL, 0 }
+};
+
+// ends a recording or replay, reporting a failed log or a diverged replay
+static int
+stopReplayLog
+(
+    MiniArm *pMiniArm
+)
+{
+    uint64_t instruction;
+
+    if (stopMiniArmReplay(pMiniArm) == -1)
+    {
+        perror("stopMiniArmReplay() failed");
+        return -1;
+    }
 
-    for (i = 0; fread(&buffer, sizeof buffer, 1, f) > 0; i++)
+    if (getMiniArmReplayDivergence(pMiniArm, &instruction))
     {
-        pMemory[i] = buffer;
+        fprintf(stderr, "Replay diverged at instruction %llu\n", (unsigned long long)instruction);
+        return -1;
     }
 
-    fclose(f);
-    return i;
+    return 0;
+}
+
+static int
+usage
+(
+    const char *program
+)
+{
+    printf("Usage: %s [-m interpreter|threaded|jit] [-r ram size] [-n count] [-b] [-t] [-s] [-S stats.json]\n"
+           "          [-p interval] [-y symbols] [-T trace] [-d] [-D] [-c caches]\n"
+           "          [-P predictors] [--checkpoint-every count | --record log | --replay log] <file>\n"
+           "          | --resume <checkpoint>\n"
+           "       %s [-m interpreter|threaded|jit] [-r ram size] [-n count] [-b] [-t] [-j threads] [-l] -f <manifest>\n",
+           program, program);
+    return 1;
 }
 
 int
@@ -204,62 +609,437 @@ main
     char *argv[]
 )
 {
-    if (argc != 2) 
+    int      mode = MINIARM_INTERPRETER;
+    bool     benchmark = false;
+    bool     lockstep = false;
+    bool     timing = false;
+    bool     summary = false;
+    char    *statisticsPath = NULL;
+    uint32_t interval = 0;
+    char    *symbolPath = NULL;
+    char    *tracePath = NULL;
+    bool     debug = false;
+    bool     devices = false;
+    bool     caches = false;
+    bool     predictors = false;
+    uint64_t memorySize = MINIARM_MEMORY_SIZE;
+    uint64_t limit = 0;
+    uint32_t threads = 0;
+    char    *manifest = NULL;
+    uint64_t checkpointEvery = 0;
+    char    *resumePath = NULL;
+    char    *recordPath = NULL;
+    char    *replayPath = NULL;
+    char    *pEnd;
+    int      option;
+
+    MiniArmCacheConfig     cacheConfigs[MINIARM_CACHE_LEVELS];
+    MiniArmPredictorConfig predictorConfig;
+
+    while ((option = getopt_long(argc, argv, "m:r:n:btsS:p:y:T:dDc:P:j:lf:", longOptions, NULL)) != -1)
+    {
+        switch(option)
+        {
+        case 'm':
+            if (strcmp(optarg, "interpreter") == 0)
+            {
+                mode = MINIARM_INTERPRETER;
+            }
+            else if (strcmp(optarg, "threaded") == 0)
+            {
+                mode = MINIARM_THREADED;
+            }
+            else if (strcmp(optarg, "jit") == 0)
+            {
+                mode = MINIARM_JIT;
+            }
+            else
+            {
+                printf("Unknown mode: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            if (parseSize(optarg, &memorySize) == -1 || memorySize == 0 || memorySize > MINIARM_MEMORY_SIZE)
+            {
+                printf("Invalid RAM size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            limit = strtoull(optarg, &pEnd, 0);
+
+            if (pEnd == optarg || *pEnd != '\0')
+            {
+                printf("Invalid instruction count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            benchmark = true;
+            break;
+        case 't':
+            timing = true;
+            break;
+        case 's':
+            summary = true;
+            break;
+        case 'S':
+            statisticsPath = optarg;
+            break;
+        case 'p':
+            interval = strtoul(optarg, &pEnd, 0);
+
+            if (pEnd == optarg || *pEnd != '\0' || interval == 0)
+            {
+                printf("Invalid profile interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'y':
+            symbolPath = optarg;
+            break;
+        case 'T':
+            tracePath = optarg;
+            break;
+        case 'd':
+            debug = true;
+            break;
+        case 'D':
+            devices = true;
+            break;
+        case 'c':
+            if (parseCaches(optarg, cacheConfigs) == -1)
+            {
+                printf("Invalid caches: %s\n", optarg);
+                return 1;
+            }
+
+            caches = true;
+            break;
+        case 'P':
+            if (parsePredictors(optarg, &predictorConfig) == -1)
+            {
+                printf("Invalid predictors: %s\n", optarg);
+                return 1;
+            }
+
+            predictors = true;
+            break;
+        case 'j':
+            threads = strtoul(optarg, &pEnd, 0);
+
+            if (pEnd == optarg || *pEnd != '\0' || threads == 0)
+            {
+                printf("Invalid thread count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'l':
+            lockstep = true;
+            break;
+        case 'f':
+            manifest = optarg;
+            break;
+        case OPTION_CHECKPOINT_EVERY:
+            checkpointEvery = strtoull(optarg, &pEnd, 0);
+
+            if (pEnd == optarg || *pEnd != '\0' || checkpointEvery == 0)
+            {
+                printf("Invalid checkpoint interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case OPTION_RESUME:
+            resumePath = optarg;
+            break;
+        case OPTION_RECORD:
+            recordPath = optarg;
+            break;
+        case OPTION_REPLAY:
+            replayPath = optarg;
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    if (manifest)
+    {
+        if (optind != argc || checkpointEvery || resumePath || recordPath || replayPath)
+        {
+            return usage(argv[0]);
+        }
+
+        BatchOptions options = { mode, memorySize, limit, threads, benchmark, lockstep, timing };
+        return runBatch(manifest, &options);
+    }
+
+    // a checkpoint brings its own image, profiles, debugging sessions and replay logs aren't checkpointed
+    if (optind != argc - !resumePath || (recordPath && replayPath) ||
+        ((checkpointEvery || resumePath) && (interval || debug || recordPath || replayPath)))
+    {
+        return usage(argv[0]);
+    }
+
+    const char *image = resumePath ? resumePath : argv[optind];
+
+    MiniArm *pMiniArm = createMiniArm(memorySize, mode);
+
+    if (!pMiniArm)
     {
-        printf("Usage: %s <file>\n", argv[0]);
+        perror("createMiniArm() failed");
         return 1;
     }
 
-    uint8_t *pMemory = (uint8_t *)malloc(MEMORY_SIZE);
-    int      programSize = loadProgram(pMemory, argv[1]);
+    // the guest's console and services write to our stdout and read our stdin, set first so a resume can seek stdin
+    setMiniArmSemihosting(pMiniArm, stdout, stdin);
 
-    if (!pMemory)
+    if (devices && mapMiniArmDevices(pMiniArm, stdout, stdin) == -1)
     {
-        perror("malloc() failed");
+        perror("mapMiniArmDevices() failed");
+        destroyMiniArm(pMiniArm);
         return 1;
     }
 
-    if (programSize == -1) 
+    if (resumePath ? resumeMiniArm(pMiniArm, resumePath) == -1 : loadMiniArmFile(pMiniArm, image) == -1)
     {
-        perror("loadProgram() failed");
+        perror(resumePath ? "resumeMiniArm() failed" : "loadProgram() failed");
+        destroyMiniArm(pMiniArm);
         return 1;
     }
-    
-    // Using last index as CPSR register
-    uint32_t            registers[17] = {0};
-    TemporaryRegisters *pTemporaryRegisters;
 
-    pTemporaryRegisters = (TemporaryRegisters *)malloc(sizeof *pTemporaryRegisters);
+    setMiniArmTiming(pMiniArm, timing);
 
-    if (!pTemporaryRegisters)
+    if (caches && setMiniArmCaches(pMiniArm, cacheConfigs) == -1)
     {
-        perror("malloc() failed");
+        perror("setMiniArmCaches() failed");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    if (predictors && setMiniArmPredictors(pMiniArm, &predictorConfig) == -1)
+    {
+        perror("setMiniArmPredictors() failed");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    if (tracePath && startMiniArmTrace(pMiniArm, tracePath) == -1)
+    {
+        perror("startMiniArmTrace() failed");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    if ((recordPath && recordMiniArm(pMiniArm, recordPath) == -1) ||
+        (replayPath && replayMiniArm(pMiniArm, replayPath) == -1))
+    {
+        perror(recordPath ? "recordMiniArm() failed" : "replayMiniArm() failed");
+        destroyMiniArm(pMiniArm);
         return 1;
     }
 
-    while (registers[PC] != programSize) 
+    if (debug)
     {
-        uint32_t instruction = load32(pMemory, registers[PC]);
-        registers[PC] += 4;
+        char *defaultPath = symbolPath ? NULL : symbolPathFor(image);
+        int   status = 0;
 
-        registerFetch(instruction, pTemporaryRegisters, registers);
-        pTemporaryRegisters->operation = decode(instruction);
-        
-        if (!validCondition(pTemporaryRegisters->condition, registers[CPSR])) 
+        // -n runs that far before the first prompt, e.g. to the instruction of a replay to look into
+        if (limit)
         {
-            continue;
+            runMiniArm(pMiniArm, limit);
+        }
+
+        if (runDebugger(pMiniArm, symbolPath ? symbolPath : defaultPath, stdin) == -1)
+        {
+            perror("runDebugger() failed");
+            status = 1;
         }
-        
-        execute(pTemporaryRegisters, registers);
 
-        memoryReference(pMemory, pTemporaryRegisters);
+        if (stopReplayLog(pMiniArm) == -1)
+        {
+            status = 1;
+        }
 
-        registerWriteback(pTemporaryRegisters, registers);
+        if (tracePath && stopMiniArmTrace(pMiniArm) == -1)
+        {
+            perror("stopMiniArmTrace() failed");
+            status = 1;
+        }
+
+        free(defaultPath);
+        destroyMiniArm(pMiniArm);
+        return status;
+    }
+
+    MiniArmExecutionStatistics executionStatistics;
+
+    if ((summary || statisticsPath) && getMiniArmExecutionStatistics(pMiniArm, &executionStatistics) == -1)
+    {
+        printf("Execution statistics need a build with make STATS=1\n");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    // checkpoints go to prog.ckpt, or back to the one resumed from
+    char *checkpointPath = checkpointEvery && !resumePath ? pathWithExtension(image, ".ckpt") : NULL;
+
+    if (checkpointEvery && !resumePath && !checkpointPath)
+    {
+        perror("malloc() failed");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    Profile     profile;
+    struct stat imageFile;
+
+    if (interval && (stat(image, &imageFile) == -1 || createProfile(&profile, interval, imageFile.st_size) == -1))
+    {
+        perror("createProfile() failed");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    MiniArmStatistics resumed;
+    getMiniArmStatistics(pMiniArm, &resumed);
+
+    int result = interval ? runProfiled(pMiniArm, limit, &profile)
+               : checkpointEvery ? runCheckpointed(pMiniArm, limit, checkpointEvery, resumePath ? resumePath : checkpointPath)
+               : runMiniArm(pMiniArm, limit);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(checkpointPath);
+
+    int status = stopReplayLog(pMiniArm) == -1;
+
+    // the trace is complete once the writer thread has drained the ring
+    if (tracePath && stopMiniArmTrace(pMiniArm) == -1)
+    {
+        perror("stopMiniArmTrace() failed");
+        status = 1;
+    }
+
+    double   seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    uint32_t registers[MINIARM_REGISTERS];
+
+    for (int index = 0; index < MINIARM_REGISTERS; index++)
+    {
+        registers[index] = getMiniArmRegister(pMiniArm, index);
     }
 
     dump(registers);
 
-    free(pTemporaryRegisters);
-    free(pMemory);
-    return 0;
+    uint32_t faultAddress;
+    uint32_t exitStatus;
+
+    if (result == MINIARM_FAULT && getMiniArmFault(pMiniArm, &faultAddress))
+    {
+        fprintf(stderr, "Memory fault at 0x%08x\n", faultAddress);
+        status = 1;
+    }
+    else if (result == MINIARM_HALTED && getMiniArmExitStatus(pMiniArm, &exitStatus))
+    {
+        fprintf(stderr, "Program exited with status %u\n", exitStatus);
+        status = status ? status : (int)(exitStatus & 0xFF);
+    }
+
+    if (benchmark)
+    {
+        MiniArmStatistics statistics;
+        getMiniArmStatistics(pMiniArm, &statistics);
+
+        // a resumed run counts from the checkpoint on
+        uint64_t instructions = statistics.instructions - resumed.instructions;
+
+        fprintf(stderr, "%llu instructions in %.3fs (%.2f MIPS)\n", (unsigned long long)instructions,
+                seconds, instructions / seconds / 1e6);
+
+        if (mode == MINIARM_JIT)
+        {
+            fprintf(stderr, "jit: %llu hits, %llu misses, %llu chained, %llu invalidations, %llu flushes\n",
+                    (unsigned long long)statistics.hits, (unsigned long long)statistics.misses,
+                    (unsigned long long)statistics.chained, (unsigned long long)statistics.invalidations,
+                    (unsigned long long)statistics.flushes);
+        }
+
+        if (mode == MINIARM_THREADED)
+        {
+            fprintf(stderr, "fusions: %llu compare-branch, %llu add/sub-compare, %llu load-use\n",
+                    (unsigned long long)statistics.fusions[MINIARM_FUSION_COMPARE_BRANCH],
+                    (unsigned long long)statistics.fusions[MINIARM_FUSION_ARITHMETIC_COMPARE],
+                    (unsigned long long)statistics.fusions[MINIARM_FUSION_LOAD_USE]);
+        }
+
+        if (tracePath)
+        {
+            fprintf(stderr, "trace: %llu instructions, %llu dropped while the ring was full\n",
+                    (unsigned long long)statistics.tracedInstructions, (unsigned long long)statistics.traceDropped);
+        }
+    }
+
+    if (summary || statisticsPath)
+    {
+        getMiniArmExecutionStatistics(pMiniArm, &executionStatistics);
+    }
+
+    if (summary)
+    {
+        printStatistics(&executionStatistics, seconds);
+    }
+
+    if (statisticsPath && writeStatistics(statisticsPath, &executionStatistics, seconds) != 0)
+    {
+        perror("writeStatistics() failed");
+        status = 1;
+    }
+
+    if (timing)
+    {
+        MiniArmStatistics statistics;
+        getMiniArmStatistics(pMiniArm, &statistics);
+
+        fprintf(stderr, "pipeline: %llu cycles, CPI %.3f, %llu load-use stall cycles, %llu flush cycles "
+                "(%llu flushes)\n", (unsigned long long)statistics.cycles,
+                statistics.instructions ? (double)statistics.cycles / statistics.instructions : 0.0,
+                (unsigned long long)statistics.loadUseStalls, (unsigned long long)statistics.flushCycles,
+                (unsigned long long)statistics.pipelineFlushes);
+    }
+
+    if (caches)
+    {
+        char *defaultPath = symbolPath ? NULL : symbolPathFor(image);
+
+        printCaches(pMiniArm, cacheConfigs, symbolPath ? symbolPath : defaultPath);
+        free(defaultPath);
+    }
+
+    if (predictors)
+    {
+        char *defaultPath = symbolPath ? NULL : symbolPathFor(image);
+
+        printPredictors(pMiniArm, symbolPath ? symbolPath : defaultPath);
+        free(defaultPath);
+    }
+
+    if (interval)
+    {
+        char *defaultPath = symbolPath ? NULL : symbolPathFor(image);
+
+        if (printProfile(&profile, symbolPath ? symbolPath : defaultPath, stderr) == -1)
+        {
+            perror("printProfile() failed");
+            status = 1;
+        }
+
+        free(defaultPath);
+        destroyProfile(&profile);
+    }
+
+    destroyMiniArm(pMiniArm);
+    return status;
 }
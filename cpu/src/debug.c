@@ -0,0 +1,193 @@
+#include <errno.h>
+#include "debug.h"
+
+bool
+isBreakpoint
+(
+    const Debug *pDebug,
+    uint32_t     address
+)
+{
+    for (uint32_t index = 0; index < pDebug->breakpointCount; index++)
+    {
+        if (pDebug->breakpoints[index] == address)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int
+setBreakpoint
+(
+    CpuState *pState,
+    uint32_t  address,
+    bool      enabled
+)
+{
+    Debug *pDebug = pState->pDebug;
+
+    if (address % 4 != 0 || !inMemory(&pState->memory, address, 4))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (enabled == isBreakpoint(pDebug, address))
+    {
+        errno = enabled ? EEXIST : ENOENT;
+        return -1;
+    }
+
+    if (enabled && pDebug->breakpointCount == DEBUG_BREAKPOINTS)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if (enabled)
+    {
+        pDebug->breakpoints[pDebug->breakpointCount++] = address;
+    }
+    else
+    {
+        for (uint32_t index = 0; index < pDebug->breakpointCount; index++)
+        {
+            if (pDebug->breakpoints[index] == address)
+            {
+                pDebug->breakpoints[index] = pDebug->breakpoints[--pDebug->breakpointCount];
+                break;
+            }
+        }
+    }
+
+    pState->decodeCache.pBreakpoints = pDebug->breakpoints;
+    pState->decodeCache.breakpointCount = pDebug->breakpointCount;
+
+    // the instruction is decoded again, with or without the breakpoint, the next time it runs
+    codeWritten(pState, address, 4);
+    return 0;
+}
+
+static void
+markWatchedPages
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  length,
+    bool      watched
+)
+{
+    uint8_t *pPageFlags = pState->memory.pPageFlags;
+
+    for (uint64_t page = address >> PAGE_SHIFT; page <= ((uint64_t)address + length - 1) >> PAGE_SHIFT; page++)
+    {
+        if (watched)
+        {
+            pPageFlags[page] |= PAGE_WATCH;
+        }
+        else
+        {
+            pPageFlags[page] &= ~PAGE_WATCH;
+        }
+    }
+}
+
+int
+setWatchpoint
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  length,
+    bool      enabled
+)
+{
+    Debug   *pDebug = pState->pDebug;
+    uint32_t index;
+
+    if (length == 0 || !inMemory(&pState->memory, address, length))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (index = 0; index < pDebug->watchpointCount; index++)
+    {
+        if (pDebug->watchpoints[index].address == address && pDebug->watchpoints[index].length == length)
+        {
+            break;
+        }
+    }
+
+    if (enabled == (index < pDebug->watchpointCount))
+    {
+        errno = enabled ? EEXIST : ENOENT;
+        return -1;
+    }
+
+    if (enabled && pDebug->watchpointCount == DEBUG_WATCHPOINTS)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if (enabled)
+    {
+        pDebug->watchpoints[pDebug->watchpointCount++] = (Watchpoint){ address, length };
+        markWatchedPages(pState, address, length, true);
+        return 0;
+    }
+
+    pDebug->watchpoints[index] = pDebug->watchpoints[--pDebug->watchpointCount];
+
+    // the pages may still be shared with other watchpoints
+    markWatchedPages(pState, address, length, false);
+
+    for (index = 0; index < pDebug->watchpointCount; index++)
+    {
+        markWatchedPages(pState, pDebug->watchpoints[index].address, pDebug->watchpoints[index].length, true);
+    }
+
+    return 0;
+}
+
+void
+stopAtBreakpoint
+(
+    CpuState *pState
+)
+{
+    pState->pDebug->stop = DEBUG_BREAKPOINT;
+    pState->stopped = true;
+}
+
+// true when the store overlaps a watchpoint, the run then stops after the storing instruction
+bool
+watchWritten
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  length
+)
+{
+    Debug *pDebug = pState->pDebug;
+
+    for (uint32_t index = 0; index < pDebug->watchpointCount; index++)
+    {
+        const Watchpoint *pWatchpoint = &pDebug->watchpoints[index];
+
+        if ((uint64_t)address + length > pWatchpoint->address &&
+            (uint64_t)pWatchpoint->address + pWatchpoint->length > address)
+        {
+            pDebug->stop = DEBUG_WATCHPOINT;
+            // the first watched byte, an LDM or STM can start below it
+            pDebug->watchAddress = address > pWatchpoint->address ? address : pWatchpoint->address;
+            pState->stopped = true;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,483 @@
+#include <errno.h>
+#include <string.h>
+#include "batch.h"
+#include "debugger.h"
+#include "symbols.h"
+#include "utils.h"
+
+#define DEBUGGER_LIMIT 64
+
+typedef struct Debugger
+{
+    MiniArm *pMiniArm;
+    Symbol  *pSymbols;
+    uint32_t symbolCount;
+
+    // what was set, for info, in the order it was set
+    uint32_t breakpoints[DEBUGGER_LIMIT];
+    uint32_t breakpointCount;
+    uint32_t watchpoints[DEBUGGER_LIMIT][2];
+    uint32_t watchpointCount;
+    bool     finished;
+} Debugger;
+
+// an address or a label
+static bool
+parseLocation
+(
+    const Debugger *pDebugger,
+    const char     *text,
+    uint32_t       *pAddress
+)
+{
+    char         *pEnd;
+    unsigned long address = strtoul(text, &pEnd, 0);
+
+    if (pEnd != text && *pEnd == '\0' && address <= UINT32_MAX)
+    {
+        *pAddress = address;
+        return true;
+    }
+
+    uint32_t symbol = findSymbolNamed(pDebugger->pSymbols, pDebugger->symbolCount, text);
+
+    if (symbol == pDebugger->symbolCount)
+    {
+        printf("No address or label %s\n", text);
+        return false;
+    }
+
+    *pAddress = pDebugger->pSymbols[symbol].address;
+    return true;
+}
+
+static bool
+parseCount
+(
+    const char *text,
+    uint32_t    fallback,
+    uint32_t   *pCount
+)
+{
+    char         *pEnd;
+    unsigned long count = text ? strtoul(text, &pEnd, 0) : fallback;
+
+    if (text && (pEnd == text || *pEnd != '\0' || count == 0 || count > UINT32_MAX))
+    {
+        printf("Invalid count: %s\n", text);
+        return false;
+    }
+
+    *pCount = count;
+    return true;
+}
+
+// 0x0000000c <LOOP+0x4>
+static void
+printLocation
+(
+    const Debugger *pDebugger,
+    uint32_t        address
+)
+{
+    uint32_t symbol = findSymbol(pDebugger->pSymbols, pDebugger->symbolCount, address);
+
+    printf("0x%08x", address);
+
+    if (symbol < pDebugger->symbolCount && address == pDebugger->pSymbols[symbol].address)
+    {
+        printf(" <%s>", pDebugger->pSymbols[symbol].pName);
+    }
+    else if (symbol < pDebugger->symbolCount)
+    {
+        printf(" <%s+0x%x>", pDebugger->pSymbols[symbol].pName, address - pDebugger->pSymbols[symbol].address);
+    }
+}
+
+// where the program stands, with the instruction it runs next
+static void
+printStop
+(
+    const Debugger *pDebugger
+)
+{
+    uint32_t pc = getMiniArmRegister(pDebugger->pMiniArm, MINIARM_PC);
+    uint32_t instruction;
+
+    printLocation(pDebugger, pc);
+
+    if (readMiniArmMemory(pDebugger->pMiniArm, pc, &instruction, 4) == 0)
+    {
+        printf("  %08x", instruction);
+    }
+
+    printf("\n");
+}
+
+static void
+run
+(
+    Debugger *pDebugger,
+    uint64_t  count
+)
+{
+    MiniArm *pMiniArm = pDebugger->pMiniArm;
+
+    if (pDebugger->finished)
+    {
+        printf("The program is not being run.\n");
+        return;
+    }
+
+    int      result = runMiniArm(pMiniArm, count);
+    uint32_t address;
+
+    MiniArmStatistics statistics;
+    getMiniArmStatistics(pMiniArm, &statistics);
+
+    switch(result)
+    {
+    case MINIARM_HALTED:
+        printf("Program halted after %llu instructions\n", (unsigned long long)statistics.instructions);
+        pDebugger->finished = true;
+        return;
+    case MINIARM_FAULT:
+        getMiniArmFault(pMiniArm, &address);
+        printf("Memory fault at 0x%08x after %llu instructions\n", address,
+               (unsigned long long)statistics.instructions);
+        pDebugger->finished = true;
+        return;
+    case MINIARM_BREAKPOINT:
+        printf("Breakpoint, ");
+        break;
+    case MINIARM_WATCHPOINT:
+        if (getMiniArmWatchpoint(pMiniArm, &address))
+        {
+            uint32_t value = 0;
+
+            readMiniArmMemory(pMiniArm, address & ~3u, &value, 4);
+            printf("Watchpoint, store to 0x%08x, word now 0x%08x, ", address, value);
+        }
+        break;
+    }
+
+    printStop(pDebugger);
+}
+
+static void
+printRegisters
+(
+    Debugger   *pDebugger,
+    const char *name
+)
+{
+    if (!name)
+    {
+        uint32_t registers[MINIARM_REGISTERS];
+
+        for (int index = 0; index < MINIARM_REGISTERS; index++)
+        {
+            registers[index] = getMiniArmRegister(pDebugger->pMiniArm, index);
+        }
+
+        dump(registers);
+        return;
+    }
+
+    int index = parseRegister(name, strlen(name));
+
+    if (index == -1)
+    {
+        printf("No register %s\n", name);
+        return;
+    }
+
+    uint32_t value = getMiniArmRegister(pDebugger->pMiniArm, index);
+
+    printf("%s = 0x%08x (%d)\n", name, value, (int32_t)value);
+}
+
+static void
+examine
+(
+    Debugger   *pDebugger,
+    const char *location,
+    const char *countText
+)
+{
+    uint32_t address;
+    uint32_t count;
+
+    if (!location)
+    {
+        printf("x needs an address\n");
+        return;
+    }
+
+    if (!parseLocation(pDebugger, location, &address) || !parseCount(countText, 1, &count))
+    {
+        return;
+    }
+
+    for (uint32_t word = 0; word < count; word++, address += 4)
+    {
+        uint32_t value;
+
+        if (readMiniArmMemory(pDebugger->pMiniArm, address, &value, 4) == -1)
+        {
+            printf("Cannot access memory at 0x%08x\n", address);
+            return;
+        }
+
+        if (word % 4 == 0)
+        {
+            printf(word ? "\n0x%08x:" : "0x%08x:", address);
+        }
+
+        printf("  0x%08x", value);
+    }
+
+    printf("\n");
+}
+
+static void
+breakCommand
+(
+    Debugger   *pDebugger,
+    const char *location,
+    bool        enabled
+)
+{
+    uint32_t address;
+
+    if (!location)
+    {
+        printf("%s needs a location\n", enabled ? "break" : "delete");
+        return;
+    }
+
+    if (!parseLocation(pDebugger, location, &address))
+    {
+        return;
+    }
+
+    if (enabled && pDebugger->breakpointCount == DEBUGGER_LIMIT)
+    {
+        errno = ENOSPC;
+    }
+    else if (setMiniArmBreakpoint(pDebugger->pMiniArm, address, enabled) == 0)
+    {
+        if (enabled)
+        {
+            pDebugger->breakpoints[pDebugger->breakpointCount++] = address;
+            printf("Breakpoint at ");
+            printLocation(pDebugger, address);
+            printf("\n");
+            return;
+        }
+
+        for (uint32_t index = 0; index < pDebugger->breakpointCount; index++)
+        {
+            if (pDebugger->breakpoints[index] == address)
+            {
+                memmove(&pDebugger->breakpoints[index], &pDebugger->breakpoints[index + 1],
+                        (--pDebugger->breakpointCount - index) * sizeof pDebugger->breakpoints[0]);
+                break;
+            }
+        }
+
+        return;
+    }
+
+    printf("Cannot %s a breakpoint at 0x%08x: %s\n", enabled ? "set" : "delete", address, strerror(errno));
+}
+
+static void
+watchCommand
+(
+    Debugger   *pDebugger,
+    const char *location,
+    const char *lengthText,
+    bool        enabled
+)
+{
+    uint32_t address;
+    uint32_t length;
+
+    if (!location)
+    {
+        printf("%s needs an address\n", enabled ? "watch" : "unwatch");
+        return;
+    }
+
+    if (!parseLocation(pDebugger, location, &address) || !parseCount(lengthText, 4, &length))
+    {
+        return;
+    }
+
+    if (enabled && pDebugger->watchpointCount == DEBUGGER_LIMIT)
+    {
+        errno = ENOSPC;
+    }
+    else if (setMiniArmWatchpoint(pDebugger->pMiniArm, address, length, enabled) == 0)
+    {
+        if (enabled)
+        {
+            pDebugger->watchpoints[pDebugger->watchpointCount][0] = address;
+            pDebugger->watchpoints[pDebugger->watchpointCount++][1] = length;
+            printf("Watchpoint on %u bytes at 0x%08x\n", length, address);
+            return;
+        }
+
+        for (uint32_t index = 0; index < pDebugger->watchpointCount; index++)
+        {
+            if (pDebugger->watchpoints[index][0] == address && pDebugger->watchpoints[index][1] == length)
+            {
+                memmove(&pDebugger->watchpoints[index], &pDebugger->watchpoints[index + 1],
+                        (--pDebugger->watchpointCount - index) * sizeof pDebugger->watchpoints[0]);
+                break;
+            }
+        }
+
+        return;
+    }
+
+    printf("Cannot %s a watchpoint at 0x%08x: %s\n", enabled ? "set" : "delete", address, strerror(errno));
+}
+
+static void
+printInfo
+(
+    const Debugger *pDebugger
+)
+{
+    if (pDebugger->breakpointCount == 0 && pDebugger->watchpointCount == 0)
+    {
+        printf("No breakpoints or watchpoints.\n");
+    }
+
+    for (uint32_t index = 0; index < pDebugger->breakpointCount; index++)
+    {
+        printf("breakpoint  ");
+        printLocation(pDebugger, pDebugger->breakpoints[index]);
+        printf("\n");
+    }
+
+    for (uint32_t index = 0; index < pDebugger->watchpointCount; index++)
+    {
+        printf("watchpoint  0x%08x, %u bytes\n", pDebugger->watchpoints[index][0], pDebugger->watchpoints[index][1]);
+    }
+}
+
+static bool
+command
+(
+    const char *word,
+    const char *name,
+    const char *alias
+)
+{
+    return strcmp(word, name) == 0 || (alias && strcmp(word, alias) == 0);
+}
+
+int
+runDebugger
+(
+    MiniArm    *pMiniArm,
+    const char *symbolPath,
+    FILE       *input
+)
+{
+    Debugger debugger = { .pMiniArm = pMiniArm };
+    char    *pLine = NULL;
+    size_t   size = 0;
+    char     line[256];
+    char     last[256] = "";
+
+    if (symbolPath && loadSymbols(symbolPath, &debugger.pSymbols, &debugger.symbolCount) == -1)
+    {
+        return -1;
+    }
+
+    printStop(&debugger);
+
+    while (printf("(miniarm) "), fflush(stdout), getline(&pLine, &size, input) != -1)
+    {
+        char *pSave;
+        char *words[3];
+
+        // an empty line repeats the last command, like it does in GDB
+        if (strspn(pLine, " \t\r\n") == strlen(pLine))
+        {
+            strcpy(line, last);
+        }
+        else
+        {
+            snprintf(line, sizeof line, "%s", pLine);
+            strcpy(last, line);
+        }
+
+        words[0] = strtok_r(line, " \t\r\n", &pSave);
+        words[1] = words[0] ? strtok_r(NULL, " \t\r\n", &pSave) : NULL;
+        words[2] = words[1] ? strtok_r(NULL, " \t\r\n", &pSave) : NULL;
+
+        uint32_t count;
+
+        if (!words[0])
+        {
+            continue;
+        }
+        else if (command(words[0], "step", "s"))
+        {
+            if (parseCount(words[1], 1, &count))
+            {
+                run(&debugger, count);
+            }
+        }
+        else if (command(words[0], "continue", "c"))
+        {
+            run(&debugger, 0);
+        }
+        else if (command(words[0], "break", "b"))
+        {
+            breakCommand(&debugger, words[1], true);
+        }
+        else if (command(words[0], "delete", "d"))
+        {
+            breakCommand(&debugger, words[1], false);
+        }
+        else if (command(words[0], "watch", "w"))
+        {
+            watchCommand(&debugger, words[1], words[2], true);
+        }
+        else if (command(words[0], "unwatch", NULL))
+        {
+            watchCommand(&debugger, words[1], words[2], false);
+        }
+        else if (command(words[0], "info", "i"))
+        {
+            printInfo(&debugger);
+        }
+        else if (command(words[0], "print", "p"))
+        {
+            printRegisters(&debugger, words[1]);
+        }
+        else if (command(words[0], "x", NULL))
+        {
+            examine(&debugger, words[1], words[2]);
+        }
+        else if (command(words[0], "quit", "q"))
+        {
+            break;
+        }
+        else
+        {
+            printf("Commands: step [n], continue, break <location>, delete <location>, watch <address> [n], "
+                   "unwatch <address> [n], info, print [register], x <address> [n], quit\n");
+        }
+    }
+
+    free(pLine);
+    freeSymbols(debugger.pSymbols, debugger.symbolCount);
+    return 0;
+}
@@ -1,14 +1,17 @@
 #include "execute.h"
+#include "flags.h"
+#include "predecode.h"
 
 void
 multiply
 (
     TemporaryRegisters *pTemporaryRegisters,
-    uint32_t           *pCurrentProcessStateRegister
+    uint32_t           *pCurrentProcessStateRegister,
+    LazyFlags          *pFlags
 )
 {
-    bool     accumulate = bit(pTemporaryRegisters->instruction, 21);
-    bool     alterCPSR = bit(pTemporaryRegisters->instruction, 20);
+    bool     accumulate = pTemporaryRegisters->pDecoded->accumulate;
+    bool     alterCPSR = pTemporaryRegisters->pDecoded->alterCPSR;
     uint32_t result = pTemporaryRegisters->c * pTemporaryRegisters->d + accumulate * pTemporaryRegisters->b;
 
     pTemporaryRegisters->ALUOutput = result;
@@ -16,8 +19,7 @@ multiply
 
     if (alterCPSR) 
     {
-        *pCurrentProcessStateRegister = changeBit(*pCurrentProcessStateRegister, N, bit(result, 31));
-        *pCurrentProcessStateRegister = changeBit(*pCurrentProcessStateRegister, Z, result == 0);
+        recordFlags(pCurrentProcessStateRegister, pFlags, FLAGS_MULTIPLY, 0, 0, result, 0);
     }
 }
 
@@ -25,69 +27,14 @@ void
 barrelShifter
 (
     barrelShifterParameters *pShift, 
-    uint32_t                 currentProcessStateRegister
+    uint32_t                 currentProcessStateRegister,
+    const LazyFlags         *pFlags
 )
 {
-    pShift->carry = 0;
+    // only a zero amount lets the carry in through
+    uint32_t carryIn = pShift->amount == 0 ? lazyFlag(currentProcessStateRegister, pFlags, C) : 0;
 
-    switch(pShift->type) 
-    {
-    case LSL:
-        pShift->output = logicalShiftLeft(pShift->sequence, pShift->amount);
-
-        if (pShift->amount == 0)
-        {
-            pShift->carry = bit(currentProcessStateRegister, C);
-        }
-        else if (pShift->amount <= 32)
-        {
-            pShift->carry = bit(pShift->sequence, 32 - pShift->amount);
-        }
-        break;
-
-    case LSR:
-        if (pShift->amount == 0)
-        {
-            pShift->amount = 32;
-
-        }
-
-        pShift->output = logicalShiftRight(pShift->sequence, pShift->amount);
-
-        if (pShift->amount <= 32)
-        {
-            pShift->carry = bit(pShift->sequence, pShift->amount - 1);
-        }
-        break;
-
-    case ASR:
-        if (pShift->amount == 0 || pShift->amount > 31)
-        {
-            pShift->amount = 32;
-        }
-
-        pShift->output = arithmeticShiftRight(pShift->sequence, pShift->amount);
-        pShift->carry = bit(pShift->sequence, pShift->amount - 1);
-        break;
-
-    case ROR:
-        while (pShift->amount > 32)
-        {
-            pShift->amount -= 32;
-        }
-
-        if (pShift->amount == 0) 
-        {
-            pShift->output = rotateRightExtended(pShift->sequence, bit(currentProcessStateRegister, C));
-            pShift->carry = bit(pShift->sequence, 0);
-        } 
-        else 
-        {
-            pShift->output = rotateRight(pShift->sequence, pShift->amount);
-            pShift->carry = bit(pShift->sequence, pShift->amount - 1);
-        }
-        break;
-    }
+    pShift->output = barrelShift(pShift->type, pShift->sequence, pShift->amount, carryIn, &pShift->carry);
 }
 
 
@@ -95,27 +42,23 @@ barrelShifterParameters
 decodeOp2
 (
     TemporaryRegisters      *pTemporaryRegisters, 
-    uint32_t                 registers[]
+    uint32_t                 registers[],
+    const LazyFlags         *pFlags
 )
 {
-    bool                    immediate = bit(pTemporaryRegisters->instruction, 25);
-    bool                    shiftAmountSpecifiedByRegister = bit(pTemporaryRegisters->instruction, 4);
-    barrelShifterParameters shift;
+    const DecodedInstruction *pDecoded = pTemporaryRegisters->pDecoded;
+    barrelShifterParameters   shift;
 
-    if (immediate) 
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE) 
     {
-        shift.amount = 2 * bits(pTemporaryRegisters->instruction, 11, 8);
-        shift.sequence = bits(pTemporaryRegisters->instruction, 7, 0);
-
-        if (shift.amount == 0)
-        {
-            shift.type = LSL;
-        }
+        // the rotation was applied by predecode, only the carry is left to pick
+        shift.output = pDecoded->immediate;
+        shift.carry = pDecoded->shiftAmount ? bit(pDecoded->immediate, 31) : lazyFlag(registers[CPSR], pFlags, C);
+        return shift;
     } 
-    else if (shiftAmountSpecifiedByRegister) 
+    else if (pDecoded->operand2 == OPERAND_REGISTER_SHIFT) 
     {
-        uint32_t shiftRegister = bits(pTemporaryRegisters->instruction, 11, 8);
-        shift.amount = bits(registers[shiftRegister], 7, 0);
+        shift.amount = bits(registers[pDecoded->rs], 7, 0);
         shift.sequence = pTemporaryRegisters->d;
 
         if (shift.amount == 0)
@@ -124,17 +67,17 @@ decodeOp2
         } 
         else 
         {
-            shift.type = bits(pTemporaryRegisters->instruction, 6, 5);
+            shift.type = pDecoded->shiftType;
         }
     } 
     else 
     {
-        shift.amount = bits(pTemporaryRegisters->instruction, 11, 7);
+        shift.amount = pDecoded->shiftAmount;
         shift.sequence = pTemporaryRegisters->d;
-        shift.type = bits(pTemporaryRegisters->instruction, 6, 5);
+        shift.type = pDecoded->shiftType;
     }
 
-    barrelShifter(&shift, registers[CPSR]);
+    barrelShifter(&shift, registers[CPSR], pFlags);
     return shift;
 }
 
@@ -143,101 +86,31 @@ void
 dataProcessing
 (
     TemporaryRegisters *pTemporaryRegisters,
-    uint32_t            registers[]
+    uint32_t            registers[],
+    LazyFlags          *pFlags
 )
 {
-    barrelShifterParameters shift = decodeOp2(pTemporaryRegisters, registers);
+    barrelShifterParameters shift = decodeOp2(pTemporaryRegisters, registers, pFlags);
 
     uint32_t  operand2 = shift.output;
     uint32_t  operand1 = pTemporaryRegisters->a;
-    uint32_t  opcode = bits(pTemporaryRegisters->instruction, 24, 21);
-    uint32_t  result;
-    bool      logicOperation = false;
-    bool      writeback = true;
-    bool      alterCPSR = bit(pTemporaryRegisters->instruction, 20);
-
-    switch(opcode) {
-    case AND:
-        result = operand1 & operand2;
-        logicOperation = true;
-        break;
-    case EOR:
-        result = operand1 ^ operand2;
-        logicOperation = true;
-        break;
-    case SUB:
-        result = operand1 - operand2;
-        break;
-    case RSB:
-        result = operand2 - operand1;
-        break;
-    case ADD:
-        result = operand1 + operand2;
-        break;
-    case ADC:
-        result = operand1 + operand2 + bit(registers[CPSR], C);
-        break;
-    case SBC:
-        result = operand1 - operand2 + bit(registers[CPSR], C) - 1;
-        break;
-    case RSC:
-        result = operand2 - operand1 + bit(registers[CPSR], C) - 1;
-        break;
-    case TST:
-        result = operand1 & operand2;
-        logicOperation = true;
-        writeback = false;
-        break;
-    case TEQ:
-        result = operand1 ^ operand2;
-        logicOperation = true;
-        writeback = false;
-        break;
-    case CMP:
-        result = operand1 - operand2;
-        logicOperation = true;
-        writeback = false;
-        break;
-    case CMN:
-        result = operand1 + operand2;
-        writeback = false;
-        break;
-    case ORR:
-        result = operand1 | operand2;
-        logicOperation = true;
-        break;
-    case MOV:
-        result = operand2;
-        logicOperation = true;
-        break;
-    case BIC:
-        result = operand1 & ~operand2;
-        logicOperation = true;
-        break;
-    case MVN:
-        result = ~operand2;
-        logicOperation = true;
-    }
+    uint32_t  opcode = pTemporaryRegisters->pDecoded->opcode;
+    uint32_t  carry = aluCarryIn(opcode) ? lazyFlag(registers[CPSR], pFlags, C) : 0;
+    uint32_t  result = aluOperation(opcode, operand1, operand2, carry);
+    bool      alterCPSR = pTemporaryRegisters->pDecoded->alterCPSR;
 
     pTemporaryRegisters->ALUOutput = result;
-    pTemporaryRegisters->writeback = writeback;
-
+    pTemporaryRegisters->writeback = aluWriteback(opcode);
 
     if (alterCPSR)
     {
-        registers[CPSR] = changeBit(registers[CPSR], Z, result == 0);
-        registers[CPSR] = changeBit(registers[CPSR], N, bit(result, 31));
-        
-        if (logicOperation)
+        if (aluLogicOperation(opcode))
         {
-            registers[CPSR] = changeBit(registers[CPSR], C, shift.carry);
+            recordFlags(&registers[CPSR], pFlags, FLAGS_LOGIC, 0, 0, result, shift.carry);
         }
         else
         {
-            bool overflow = ((bit(31, operand1) ^ bit(31, operand2)) == 0) && (bit(31, result) != bit(31, operand1));
-            bool carry = result < operand1;
-            registers[CPSR] = changeBit(registers[CPSR], V, overflow);
-            registers[CPSR] = changeBit(registers[CPSR], C, carry);
+            recordFlags(&registers[CPSR], pFlags, FLAGS_ARITHMETIC, operand1, operand2, result, 0);
         }
     }
 }
@@ -246,21 +119,22 @@ uint32_t
 decodeOffset
 (
     TemporaryRegisters *pTemporaryRegisters, 
-    uint32_t            currentProcessStateRegister
+    uint32_t            currentProcessStateRegister,
+    const LazyFlags    *pFlags
 )
 {
-    bool immediate = bit(pTemporaryRegisters->instruction, 25);
+    const DecodedInstruction *pDecoded = pTemporaryRegisters->pDecoded;
 
-    if (immediate) 
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE) 
     {
-        return bits(pTemporaryRegisters->instruction, 11, 0);
+        return pDecoded->immediate;
     } 
 
     struct barrelShifterParameters shift;
-    shift.type = bits(pTemporaryRegisters->instruction, 6, 5);
-    shift.amount = bits(pTemporaryRegisters->instruction, 11, 7);
+    shift.type = pDecoded->shiftType;
+    shift.amount = pDecoded->shiftAmount;
     shift.sequence = pTemporaryRegisters->d;
-    barrelShifter(&shift, currentProcessStateRegister);
+    barrelShifter(&shift, currentProcessStateRegister, pFlags);
     return shift.output;
 }
 
@@ -268,48 +142,74 @@ void
 singleDataTransfer
 (
     TemporaryRegisters *pTemporaryRegisters,
-    uint32_t            currentProcessStateRegister
+    uint32_t            currentProcessStateRegister,
+    const LazyFlags    *pFlags
 )
 {
-    uint32_t offset = decodeOffset(pTemporaryRegisters, currentProcessStateRegister);
-    bool     preindex = bit(pTemporaryRegisters->instruction, 24);
-    int      addOffset = bit(pTemporaryRegisters->instruction, 23) ? 1 : -1;
+    uint32_t offset = decodeOffset(pTemporaryRegisters, currentProcessStateRegister, pFlags);
+    bool     preindex = pTemporaryRegisters->pDecoded->preindex;
+    int      addOffset = pTemporaryRegisters->pDecoded->up ? 1 : -1;
     uint32_t addr = pTemporaryRegisters->a + addOffset * preindex * offset;
 
     pTemporaryRegisters->singleDataTransferOffset = pTemporaryRegisters->a + addOffset * offset;
     pTemporaryRegisters->ALUOutput = addr;
 }
 
-void branch(TemporaryRegisters *pTemporaryRegisters)
+// STM gathers its registers here, the PC reads 4 ahead like it does everywhere else
+void
+blockDataTransfer
+(
+    TemporaryRegisters *pTemporaryRegisters,
+    uint32_t            registers[]
+)
 {
-    uint32_t offset = bits(pTemporaryRegisters->instruction, 23, 0);
-    pTemporaryRegisters->link = bit(pTemporaryRegisters->instruction, 24);
+    const DecodedInstruction *pDecoded = pTemporaryRegisters->pDecoded;
+
+    pTemporaryRegisters->ALUOutput = blockAddress(pDecoded, pTemporaryRegisters->a,
+                                                  &pTemporaryRegisters->singleDataTransferOffset);
 
-    /* assembler assumes the PC is 2 instructions ahead of the current instruction
-       but we add only 4 because our PC is 1 instruction ahead since it's not pipelined */
+    if (pTemporaryRegisters->operation == STM)
+    {
+        uint32_t word = 0;
 
-    pTemporaryRegisters->ALUOutput = arithmeticShiftRight(offset << 8, 6) + 4;
+        for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+        {
+            pTemporaryRegisters->blockData[word++] = registers[__builtin_ctz(list)];
+        }
+    }
+}
+
+void branch(TemporaryRegisters *pTemporaryRegisters)
+{
+    // the offset was sign extended and adjusted for our PC by predecode
+    pTemporaryRegisters->link = pTemporaryRegisters->pDecoded->link;
+    pTemporaryRegisters->ALUOutput = pTemporaryRegisters->pDecoded->immediate;
 }
 
 void 
 execute
 (
     TemporaryRegisters *pTemporaryRegisters, 
-    uint32_t registers[]
+    uint32_t            registers[],
+    LazyFlags          *pFlags
 )
 {
     switch(pTemporaryRegisters->operation) {
     case MUL:
-        multiply(pTemporaryRegisters, &registers[CPSR]);
+        multiply(pTemporaryRegisters, &registers[CPSR], pFlags);
         break;
     case DATA:
-        dataProcessing(pTemporaryRegisters, registers);
+        dataProcessing(pTemporaryRegisters, registers, pFlags);
         break;
     case LDR:
     case LDRB:
     case STR:
     case STRB:
-        singleDataTransfer(pTemporaryRegisters, registers[CPSR]);
+        singleDataTransfer(pTemporaryRegisters, registers[CPSR], pFlags);
+        break;
+    case LDM:
+    case STM:
+        blockDataTransfer(pTemporaryRegisters, registers);
         break;
     case BRANCH:
         branch(pTemporaryRegisters);
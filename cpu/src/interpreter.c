@@ -0,0 +1,324 @@
+#include "cache.h"
+#include "debug.h"
+#include "execute.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "native.h"
+#include "predictor.h"
+#include "semihost.h"
+#include "stats.h"
+
+// reads only the flags the condition needs, straight from the lazy record
+bool 
+validCondition
+(
+    uint32_t         condition, 
+    uint32_t         currentProcessStateRegister,
+    const LazyFlags *pFlags
+)
+{
+    switch(condition) 
+    {
+    case EQ:
+        return lazyFlag(currentProcessStateRegister, pFlags, Z);
+    case NE:
+        return !lazyFlag(currentProcessStateRegister, pFlags, Z);
+    case CS:
+        return lazyFlag(currentProcessStateRegister, pFlags, C);
+    case CC:
+        return !lazyFlag(currentProcessStateRegister, pFlags, C);
+    case MI:
+        return lazyFlag(currentProcessStateRegister, pFlags, N);
+    case PL:
+        return !lazyFlag(currentProcessStateRegister, pFlags, N);
+    case VS:
+        return lazyFlag(currentProcessStateRegister, pFlags, V);
+    case VC:
+        return !lazyFlag(currentProcessStateRegister, pFlags, V);
+    case HI:
+        return lazyFlag(currentProcessStateRegister, pFlags, C) && !lazyFlag(currentProcessStateRegister, pFlags, Z);
+    case LS:
+        return !lazyFlag(currentProcessStateRegister, pFlags, C) || lazyFlag(currentProcessStateRegister, pFlags, Z);
+    case GE:
+        return lazyFlag(currentProcessStateRegister, pFlags, N) == lazyFlag(currentProcessStateRegister, pFlags, V);
+    case LT:
+        return lazyFlag(currentProcessStateRegister, pFlags, N) != lazyFlag(currentProcessStateRegister, pFlags, V);
+    case GT:
+        return !lazyFlag(currentProcessStateRegister, pFlags, Z) && 
+            (lazyFlag(currentProcessStateRegister, pFlags, N) == lazyFlag(currentProcessStateRegister, pFlags, V));
+    case LE:
+        return lazyFlag(currentProcessStateRegister, pFlags, Z) || 
+            (lazyFlag(currentProcessStateRegister, pFlags, N) != lazyFlag(currentProcessStateRegister, pFlags, V));
+    case AL:
+        return  true;
+    case CONDITION_BREAKPOINT:
+        return false;
+    default:
+        printf("Invalid Condition");
+    }
+
+    return false;
+}
+
+// forgets everything decoded or translated from the written pages
+void
+codeWritten
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  length
+)
+{
+    uint32_t first = address >> PAGE_SHIFT;
+    uint32_t last = (address + length - 1) >> PAGE_SHIFT;
+
+    for (uint32_t page = first; page <= last; page++)
+    {
+        if (!(pState->memory.pPageFlags[page] & PAGE_CODE))
+        {
+            continue;
+        }
+
+        pState->memory.pPageFlags[page] &= ~PAGE_CODE;
+        invalidateDecoded(&pState->decodeCache, page << PAGE_SHIFT, PAGE_SIZE);
+
+        if (pState->pJit)
+        {
+            invalidateJitPage(pState->pJit, page);
+        }
+
+        if (pState->pNative && page << PAGE_SHIFT < pState->pNative->size)
+        {
+            pState->pNative = NULL;
+        }
+    }
+}
+
+// a store hit a page holding code or a watchpoint, true when a watchpoint stops the run
+bool
+storeWritten
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  length
+)
+{
+    bool watched = pState->pDebug && watchWritten(pState, address, length);
+
+    codeWritten(pState, address, length);
+    return watched;
+}
+
+void 
+memoryReference
+(
+    CpuState           *pState, 
+    TemporaryRegisters *pTemporaryRegisters
+)
+{
+    Memory *pMemory = &pState->memory;
+
+    // the PC still points past the instruction
+    if (pState->pCaches)
+    {
+        cacheReference(pState->pCaches, pState->registers[PC] - 4, pTemporaryRegisters);
+    }
+
+    switch(pTemporaryRegisters->operation) {
+    case LDR:
+        pTemporaryRegisters->loadMemoryData = load32(pMemory, pTemporaryRegisters->ALUOutput);
+        break;
+    case LDRB:
+        pTemporaryRegisters->loadMemoryData = load8(pMemory, pTemporaryRegisters->ALUOutput);
+        break;
+    case STR:
+        if (store32(pMemory, pTemporaryRegisters->ALUOutput, pTemporaryRegisters->b))
+        {
+            storeWritten(pState, pTemporaryRegisters->ALUOutput, 4);
+        }
+        break;
+    case STRB:
+        if (store8(pMemory, pTemporaryRegisters->ALUOutput, pTemporaryRegisters->b))
+        {
+            storeWritten(pState, pTemporaryRegisters->ALUOutput, 1);
+        }
+        break;
+    case LDM:
+        COUNT_BLOCK(pState->pCounts, pTemporaryRegisters->pDecoded);
+        loadBlock(pMemory, pTemporaryRegisters->ALUOutput, pTemporaryRegisters->blockData,
+                  pTemporaryRegisters->pDecoded->registerCount);
+        break;
+    case STM:
+        COUNT_BLOCK(pState->pCounts, pTemporaryRegisters->pDecoded);
+
+        if (storeBlock(pMemory, pTemporaryRegisters->ALUOutput, pTemporaryRegisters->blockData,
+                       pTemporaryRegisters->pDecoded->registerCount))
+        {
+            storeWritten(pState, pTemporaryRegisters->ALUOutput, 4 * pTemporaryRegisters->pDecoded->registerCount);
+        }
+        break;
+    case SWI:
+        // the service reads its arguments and writes its result itself
+        semihost(pState, pTemporaryRegisters->pDecoded->immediate);
+        break;
+    }
+} 
+
+void 
+registerWriteback
+(
+    TemporaryRegisters *pTemporaryRegisters, 
+    uint32_t            registers[]
+)
+{
+    uint32_t rs = pTemporaryRegisters->pDecoded->rn;
+    uint32_t rt = pTemporaryRegisters->pDecoded->rd;
+
+    if (pTemporaryRegisters->operation == LDR || pTemporaryRegisters->operation == LDRB) 
+    {
+        registers[rs] = pTemporaryRegisters->singleDataTransferOffset;
+        registers[rt] = pTemporaryRegisters->loadMemoryData;
+    } 
+    else if (pTemporaryRegisters->operation == STR || pTemporaryRegisters->operation == STRB) 
+    {
+        registers[rs] = pTemporaryRegisters->singleDataTransferOffset;
+    } 
+    else if (pTemporaryRegisters->operation == DATA && pTemporaryRegisters->writeback) 
+    {
+        registers[rt] = pTemporaryRegisters->ALUOutput;
+    }
+    else if (pTemporaryRegisters->operation == MUL)
+    {
+        registers[rs] = pTemporaryRegisters->ALUOutput;
+    }
+    else if (pTemporaryRegisters->operation == LDM || pTemporaryRegisters->operation == STM)
+    {
+        // a loaded base wins over the written back one
+        registers[rs] = pTemporaryRegisters->singleDataTransferOffset;
+
+        if (pTemporaryRegisters->operation == LDM)
+        {
+            uint32_t word = 0;
+
+            for (uint32_t list = pTemporaryRegisters->pDecoded->immediate; list; list &= list - 1)
+            {
+                registers[__builtin_ctz(list)] = pTemporaryRegisters->blockData[word++];
+            }
+        }
+    }
+    else if (pTemporaryRegisters->operation == BRANCH)
+    {
+        if (pTemporaryRegisters->link)
+        {
+            registers[LR] = registers[PC];
+        }
+
+        registers[PC] += pTemporaryRegisters->ALUOutput;
+    }
+}
+
+void 
+registerFetch
+(
+    const DecodedInstruction *pDecoded, 
+    TemporaryRegisters       *pTemporaryRegisters,
+    uint32_t                  registers[]
+)
+{
+    pTemporaryRegisters->a = registers[pDecoded->rn];
+    pTemporaryRegisters->b = registers[pDecoded->rd];
+    pTemporaryRegisters->c = registers[pDecoded->rs];
+    pTemporaryRegisters->d = registers[pDecoded->rm];
+    pTemporaryRegisters->instruction = pDecoded->instruction;
+    pTemporaryRegisters->condition = pDecoded->condition;
+    pTemporaryRegisters->operation = pDecoded->operation;
+    pTemporaryRegisters->pDecoded = pDecoded;
+}
+
+// false when the condition failed, otherwise pTemporaryRegisters is left as the stages filled it
+bool
+executeRecorded
+(
+    CpuState                 *pState,
+    const DecodedInstruction *pDecoded,
+    TemporaryRegisters       *pTemporaryRegisters
+)
+{
+    if (!validCondition(pDecoded->condition, pState->registers[CPSR], &pState->flags)) 
+    {
+        // the instruction under the breakpoint runs when the run is resumed
+        if (pDecoded->operation == BREAKPOINT)
+        {
+            pState->registers[PC] -= 4;
+            pState->instructions--;
+            stopAtBreakpoint(pState);
+            return false;
+        }
+
+        COUNT_SKIPPED(pState->pCounts, pDecoded);
+
+        if (pState->pPredictors)
+        {
+            predictBranch(pState->pPredictors, pDecoded, pState->registers[PC] - 4, false, pState->registers[PC]);
+        }
+
+        return false;
+    }
+
+    COUNT_EXECUTED(pState->pCounts, pDecoded);
+
+    // the PC still points past the instruction
+    uint32_t pc = pState->registers[PC] - 4;
+
+    registerFetch(pDecoded, pTemporaryRegisters, pState->registers);
+    
+    execute(pTemporaryRegisters, pState->registers, &pState->flags);
+
+    memoryReference(pState, pTemporaryRegisters);
+
+    registerWriteback(pTemporaryRegisters, pState->registers);
+
+    if (pState->pPredictors)
+    {
+        predictBranch(pState->pPredictors, pDecoded, pc, true, pState->registers[PC]);
+    }
+
+    return true;
+}
+
+// false when the condition failed
+bool
+executeDecoded
+(
+    CpuState                 *pState,
+    const DecodedInstruction *pDecoded
+)
+{
+    TemporaryRegisters temporaryRegisters;
+
+    return executeRecorded(pState, pDecoded, &temporaryRegisters);
+}
+
+void
+interpret
+(
+    CpuState *pState
+)
+{
+    uint32_t *registers = pState->registers;
+
+    while (registers[PC] != pState->programSize && !pState->memory.faulted && 
+           pState->instructions < pState->limit && !pState->stopped) 
+    {
+        if (pState->pCaches)
+        {
+            cacheFetch(pState->pCaches, registers[PC]);
+        }
+
+        const DecodedInstruction *pDecoded = fetchDecoded(&pState->decodeCache, &pState->memory, registers[PC]);
+        registers[PC] += 4;
+        pState->instructions++;
+        
+        executeDecoded(pState, pDecoded);
+    }
+}
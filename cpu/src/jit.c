@@ -0,0 +1,1279 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "flags.h"
+#include "threaded.h"
+
+/* Basic block JIT. A block runs from a guest PC up to the first instruction
+   that writes the PC (branches included), the end of the program or
+   JIT_BLOCK_INSTRUCTIONS. Guest registers stay in the CpuState addressed
+   through rbx; instructions the translator doesn't cover call back into
+   executeDecoded(). Exits with a fixed target get chained to the block
+   they lead to, so hot loops never return to the dispatcher. */
+
+#if defined(__x86_64__)
+
+#define REGISTER_OFFSET(r)  ((int32_t)(offsetof(CpuState, registers) + 4 * (r)))
+#define INSTRUCTIONS_OFFSET ((int32_t)offsetof(CpuState, instructions))
+#define CHAIN_LIMIT_OFFSET  ((int32_t)offsetof(CpuState, chainLimit))
+#define FLAGS_OFFSET(field) ((int32_t)offsetof(CpuState, flags.field))
+#define FAULTED_OFFSET      ((int32_t)offsetof(CpuState, memory.faulted))
+#define NO_JUMP             ((size_t)-1)
+
+// the flag record kind at a point of the block, when the translator knows it
+#define FLAGS_UNKNOWN       (-1)
+
+/* Flag records are stored and single flag conditions tested inline. The
+   cross-checking build goes through the C helpers so every flag is
+   compared with its eager value. */
+#ifdef CHECK_LAZY_FLAGS
+static const bool inlineFlags = false;
+#else
+static const bool inlineFlags = true;
+#endif
+
+enum
+{
+    CARRY_CONSTANT,
+    CARRY_IN,
+    CARRY_COMPUTED
+};
+
+static void
+jitMaterializeFlags
+(
+    CpuState *pState
+)
+{
+    materializeFlags(&pState->registers[CPSR], &pState->flags);
+}
+
+static uint32_t
+jitCondition
+(
+    CpuState *pState,
+    uint32_t  condition
+)
+{
+    return validCondition(condition, pState->registers[CPSR], &pState->flags);
+}
+
+static void
+jitLogicFlags
+(
+    CpuState *pState,
+    uint32_t  result,
+    uint32_t  carry
+)
+{
+    recordFlags(&pState->registers[CPSR], &pState->flags, FLAGS_LOGIC, 0, 0, result, carry);
+}
+
+static void
+jitArithmeticFlags
+(
+    CpuState *pState,
+    uint32_t  operand1,
+    uint32_t  operand2,
+    uint32_t  result
+)
+{
+    recordFlags(&pState->registers[CPSR], &pState->flags, FLAGS_ARITHMETIC, operand1, operand2, result, 0);
+}
+
+static void
+jitMultiplyFlags
+(
+    CpuState *pState,
+    uint32_t  result
+)
+{
+    recordFlags(&pState->registers[CPSR], &pState->flags, FLAGS_MULTIPLY, 0, 0, result, 0);
+}
+
+/* The instruction count in the state is that of the block's start, so a
+   helper that may reach a device or a service gets the place of its
+   instruction in the block, count, and adds it while the call runs, for
+   the replay log to see the exact count. */
+static uint32_t
+jitDeviceLoad
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  width,
+    uint32_t  count
+)
+{
+    pState->instructions += count;
+
+    uint32_t data = deviceLoad(&pState->memory, address, width);
+
+    pState->instructions -= count;
+    return data;
+}
+
+static uint32_t
+jitLoad32
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  count
+)
+{
+    if (!inMemory(&pState->memory, address - address % 4, 4))
+    {
+        return jitDeviceLoad(pState, address, 4, count);
+    }
+
+    return load32(&pState->memory, address);
+}
+
+static uint32_t
+jitLoad8
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  count
+)
+{
+    if (!inMemory(&pState->memory, address, 1))
+    {
+        return jitDeviceLoad(pState, address, 1, count);
+    }
+
+    return load8(&pState->memory, address);
+}
+
+static void
+jitExecute
+(
+    CpuState                 *pState,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  count
+)
+{
+    pState->instructions += count;
+    executeDecoded(pState, pDecoded);
+    pState->instructions -= count;
+}
+
+static uint32_t
+jitStore32
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  data
+)
+{
+    // the block leaves when the store hit a page holding code or a watchpoint, or faulted
+    if (store32(&pState->memory, address, data))
+    {
+        storeWritten(pState, address, 4);
+        return 1;
+    }
+
+    return pState->memory.faulted;
+}
+
+static uint32_t
+jitStore8
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  data
+)
+{
+    if (store8(&pState->memory, address, data))
+    {
+        storeWritten(pState, address, 1);
+        return 1;
+    }
+
+    return pState->memory.faulted;
+}
+
+// LDM and STM run whole in C, the block leaves after a fault or a store like jitStore32's
+static uint32_t
+jitBlockTransfer
+(
+    CpuState                 *pState,
+    const DecodedInstruction *pDecoded
+)
+{
+    uint32_t *registers = pState->registers;
+    uint32_t  words[16];
+    uint32_t  written;
+    uint32_t  address = blockAddress(pDecoded, registers[pDecoded->rn], &written);
+    uint32_t  word = 0;
+    uint32_t  modified = 0;
+
+    if (pDecoded->operation == STM)
+    {
+        for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+        {
+            words[word++] = registers[__builtin_ctz(list)];
+        }
+
+        if (storeBlock(&pState->memory, address, words, word))
+        {
+            storeWritten(pState, address, 4 * word);
+            modified = 1;
+        }
+
+        registers[pDecoded->rn] = written;
+        return modified | pState->memory.faulted;
+    }
+
+    loadBlock(&pState->memory, address, words, pDecoded->registerCount);
+    registers[pDecoded->rn] = written;
+
+    for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+    {
+        registers[__builtin_ctz(list)] = words[word++];
+    }
+
+    return pState->memory.faulted;
+}
+
+static bool
+translatable
+(
+    const DecodedInstruction *pDecoded
+)
+{
+    // validCondition() reports the invalid condition, service calls run in C and end their block
+    if (pDecoded->condition > AL || pDecoded->operation == SWI)
+    {
+        return false;
+    }
+
+    return pDecoded->operation != DATA || pDecoded->operand2 != OPERAND_REGISTER_SHIFT;
+}
+
+static void
+emitGuestRegister
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    uint32_t    reg,
+    uint32_t    address
+)
+{
+    // the PC reads one instruction ahead, as in the interpreter
+    if (reg == PC)
+    {
+        emitMoveImmediate(pEmitter, destination, address + 4);
+    }
+    else
+    {
+        emitLoad(pEmitter, destination, REGISTER_OFFSET(reg));
+    }
+}
+
+static void
+emitExtractBit
+(
+    Emitter    *pEmitter,
+    X86Register source,
+    uint8_t     index
+)
+{
+    emitMove(pEmitter, EAX, source);
+
+    if (index != 0)
+    {
+        emitShift(pEmitter, X86_SHR, EAX, index);
+    }
+
+    emitArithmeticImmediate(pEmitter, X86_AND, EAX, 1);
+}
+
+// leaves the block with the next PC already stored by the guest code
+static void
+emitExit
+(
+    Emitter *pEmitter,
+    uint32_t count
+)
+{
+    emitAddMemory64(pEmitter, INSTRUCTIONS_OFFSET, count);
+    emitArithmetic(pEmitter, X86_XOR, EAX, EAX);
+    emitReturn(pEmitter);
+}
+
+/* Leaves the block for a fixed target through a jump the dispatcher can
+   chain. Once the run is within a block of its instruction limit the exit
+   returns to the dispatcher instead, which steps the rest exactly. */
+static void
+emitChainedExit
+(
+    Emitter *pEmitter,
+    uint32_t target,
+    uint32_t count
+)
+{
+    emitStoreImmediate(pEmitter, REGISTER_OFFSET(PC), target);
+    emitAddMemory64(pEmitter, INSTRUCTIONS_OFFSET, count);
+    emitLoad64(pEmitter, EAX, CHAIN_LIMIT_OFFSET);
+    emitCompareMemory64(pEmitter, INSTRUCTIONS_OFFSET, EAX);
+
+    size_t limited = emitJumpCondition(pEmitter, X86_JAE);
+    size_t jump = emitJump(pEmitter);
+
+    patchJump(pEmitter, jump, pEmitter->offset);
+    emitMovePointer(pEmitter, EAX, pEmitter->pCode + jump);
+    emitReturn(pEmitter);
+
+    patchJump(pEmitter, limited, pEmitter->offset);
+    emitArithmetic(pEmitter, X86_XOR, EAX, EAX);
+    emitReturn(pEmitter);
+}
+
+static void
+emitFunctionCall
+(
+    Emitter    *pEmitter,
+    const void *pFunction
+)
+{
+    emitMoveStateArgument(pEmitter);
+    emitCall(pEmitter, pFunction);
+}
+
+// shifts rm by an immediate into destination, leaving the shifter carry in eax when asked
+static int
+emitShiftedRegister
+(
+    Emitter                  *pEmitter,
+    X86Register               destination,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  address,
+    bool                      carry
+)
+{
+    uint8_t amount = pDecoded->shiftAmount;
+
+    emitGuestRegister(pEmitter, destination, pDecoded->rm, address);
+
+    switch(pDecoded->shiftType)
+    {
+    case LSL:
+        if (amount == 0)
+        {
+            return CARRY_IN;
+        }
+
+        if (carry)
+        {
+            emitExtractBit(pEmitter, destination, 32 - amount);
+        }
+
+        emitShift(pEmitter, X86_SHL, destination, amount);
+        break;
+
+    case LSR:
+        if (carry)
+        {
+            emitExtractBit(pEmitter, destination, amount == 0 ? 31 : amount - 1);
+        }
+
+        if (amount == 0)
+        {
+            emitMoveImmediate(pEmitter, destination, 0);
+        }
+        else
+        {
+            emitShift(pEmitter, X86_SHR, destination, amount);
+        }
+        break;
+
+    case ASR:
+        if (carry)
+        {
+            emitExtractBit(pEmitter, destination, amount == 0 ? 31 : amount - 1);
+        }
+
+        emitShift(pEmitter, X86_SAR, destination, amount == 0 ? 31 : amount);
+        break;
+
+    case ROR:
+        if (carry)
+        {
+            emitExtractBit(pEmitter, destination, amount == 0 ? 0 : amount - 1);
+        }
+
+        if (amount == 0)
+        {
+            emitBitTest(pEmitter, REGISTER_OFFSET(CPSR), C);
+            emitRotateRightCarry(pEmitter, destination);
+        }
+        else
+        {
+            emitShift(pEmitter, X86_ROR, destination, amount);
+        }
+        break;
+    }
+
+    return CARRY_COMPUTED;
+}
+
+// returns the jump taken when the condition fails
+static size_t
+emitCondition
+(
+    Emitter *pEmitter,
+    uint8_t  condition,
+    int      flagsKind
+)
+{
+    static const uint8_t flags[] = { Z, C, N, V };
+
+    if (condition == AL)
+    {
+        return NO_JUMP;
+    }
+
+    if (inlineFlags && flagsKind == FLAGS_EAGER && condition < HI)
+    {
+        // EQ, CS, MI and VS need their flag set, the odd conditions need it clear
+        emitTestMemory(pEmitter, REGISTER_OFFSET(CPSR), 1u << flags[condition / 2]);
+        return emitJumpCondition(pEmitter, condition % 2 == 0 ? X86_JE : X86_JNE);
+    }
+
+    // every record kind holds Z and N in its result
+    if (inlineFlags && flagsKind > FLAGS_EAGER && (condition == EQ || condition == NE))
+    {
+        emitTestMemory(pEmitter, FLAGS_OFFSET(result), UINT32_MAX);
+        return emitJumpCondition(pEmitter, condition == EQ ? X86_JNE : X86_JE);
+    }
+
+    if (inlineFlags && flagsKind > FLAGS_EAGER && (condition == MI || condition == PL))
+    {
+        emitTestMemory(pEmitter, FLAGS_OFFSET(result), 1u << 31);
+        return emitJumpCondition(pEmitter, condition == MI ? X86_JE : X86_JNE);
+    }
+
+    emitMoveImmediate(pEmitter, ESI, condition);
+    emitFunctionCall(pEmitter, jitCondition);
+    emitTest(pEmitter, EAX, EAX);
+    return emitJumpCondition(pEmitter, X86_JE);
+}
+
+// folds a pending record into the CPSR unless its kind is at most threshold
+static void
+emitFlagsBelow
+(
+    Emitter *pEmitter,
+    int     *pFlagsKind,
+    int      threshold
+)
+{
+    if (threshold == FLAGS_ARITHMETIC || (*pFlagsKind != FLAGS_UNKNOWN && *pFlagsKind <= threshold))
+    {
+        return;
+    }
+
+    if (!inlineFlags || *pFlagsKind != FLAGS_UNKNOWN)
+    {
+        emitFunctionCall(pEmitter, jitMaterializeFlags);
+        *pFlagsKind = FLAGS_EAGER;
+        return;
+    }
+
+    emitCompareMemory(pEmitter, FLAGS_OFFSET(kind), threshold);
+    size_t below = emitJumpCondition(pEmitter, X86_JBE);
+    emitFunctionCall(pEmitter, jitMaterializeFlags);
+    patchJump(pEmitter, below, pEmitter->offset);
+}
+
+static void
+emitRecordFlags
+(
+    Emitter *pEmitter,
+    int     *pFlagsKind,
+    int      kind
+)
+{
+    emitStoreImmediate(pEmitter, FLAGS_OFFSET(kind), kind);
+    *pFlagsKind = kind;
+}
+
+// rrx, a register operand rotated right by #0, shifts the carry in
+static bool
+rotatesCarry
+(
+    const DecodedInstruction *pDecoded
+)
+{
+    return pDecoded->operand2 == OPERAND_REGISTER && pDecoded->shiftType == ROR && pDecoded->shiftAmount == 0;
+}
+
+// unrotated immediates and lsl #0 pass the carry in through as the shifter carry
+static bool
+keepsCarry
+(
+    const DecodedInstruction *pDecoded
+)
+{
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE)
+    {
+        return pDecoded->shiftAmount == 0;
+    }
+
+    return pDecoded->operand2 == OPERAND_REGISTER && pDecoded->shiftType == LSL && pDecoded->shiftAmount == 0;
+}
+
+static void
+translateDataProcessing
+(
+    Emitter                  *pEmitter,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  address,
+    int                      *pFlagsKind
+)
+{
+    uint32_t opcode = pDecoded->opcode;
+    bool     logicFlagsNeeded = pDecoded->alterCPSR && aluLogicOperation(opcode);
+    int      carry = CARRY_CONSTANT;
+    int      threshold = FLAGS_ARITHMETIC;
+
+    // the carry in is read from the CPSR, so it must not be pending
+    if (aluCarryIn(opcode) || rotatesCarry(pDecoded) || (!inlineFlags && logicFlagsNeeded && keepsCarry(pDecoded)))
+    {
+        threshold = FLAGS_MULTIPLY;
+    }
+
+    // a logic record may replace a pending one and keep its carry
+    if (inlineFlags && logicFlagsNeeded && threshold > FLAGS_LOGIC)
+    {
+        threshold = FLAGS_LOGIC;
+    }
+
+    emitFlagsBelow(pEmitter, pFlagsKind, threshold);
+
+    // operand2 in edx, operand1 in esi, result in ecx
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE)
+    {
+        emitMoveImmediate(pEmitter, EDX, pDecoded->immediate);
+        carry = pDecoded->shiftAmount ? CARRY_CONSTANT : CARRY_IN;
+    }
+    else
+    {
+        carry = emitShiftedRegister(pEmitter, EDX, pDecoded, address, logicFlagsNeeded);
+    }
+
+    emitGuestRegister(pEmitter, ESI, pDecoded->rn, address);
+
+    switch(opcode)
+    {
+    case AND:
+    case TST:
+        emitMove(pEmitter, ECX, ESI);
+        emitArithmetic(pEmitter, X86_AND, ECX, EDX);
+        break;
+    case EOR:
+    case TEQ:
+        emitMove(pEmitter, ECX, ESI);
+        emitArithmetic(pEmitter, X86_XOR, ECX, EDX);
+        break;
+    case SUB:
+    case CMP:
+        emitMove(pEmitter, ECX, ESI);
+        emitArithmetic(pEmitter, X86_SUB, ECX, EDX);
+        break;
+    case RSB:
+        emitMove(pEmitter, ECX, EDX);
+        emitArithmetic(pEmitter, X86_SUB, ECX, ESI);
+        break;
+    case ADD:
+    case CMN:
+        emitMove(pEmitter, ECX, ESI);
+        emitArithmetic(pEmitter, X86_ADD, ECX, EDX);
+        break;
+    case ADC:
+        emitMove(pEmitter, ECX, ESI);
+        emitBitTest(pEmitter, REGISTER_OFFSET(CPSR), C);
+        emitArithmetic(pEmitter, X86_ADC, ECX, EDX);
+        break;
+    case SBC:
+        // x86 borrows where ARM carries
+        emitMove(pEmitter, ECX, ESI);
+        emitBitTest(pEmitter, REGISTER_OFFSET(CPSR), C);
+        emitComplementCarry(pEmitter);
+        emitArithmetic(pEmitter, X86_SBB, ECX, EDX);
+        break;
+    case RSC:
+        emitMove(pEmitter, ECX, EDX);
+        emitBitTest(pEmitter, REGISTER_OFFSET(CPSR), C);
+        emitComplementCarry(pEmitter);
+        emitArithmetic(pEmitter, X86_SBB, ECX, ESI);
+        break;
+    case ORR:
+        emitMove(pEmitter, ECX, ESI);
+        emitArithmetic(pEmitter, X86_OR, ECX, EDX);
+        break;
+    case MOV:
+        emitMove(pEmitter, ECX, EDX);
+        break;
+    case BIC:
+        emitMove(pEmitter, ECX, EDX);
+        emitNot(pEmitter, ECX);
+        emitArithmetic(pEmitter, X86_AND, ECX, ESI);
+        break;
+    case MVN:
+        emitMove(pEmitter, ECX, EDX);
+        emitNot(pEmitter, ECX);
+        break;
+    }
+
+    if (aluWriteback(opcode))
+    {
+        emitStore(pEmitter, REGISTER_OFFSET(pDecoded->rd), ECX);
+    }
+
+    if (!pDecoded->alterCPSR)
+    {
+        return;
+    }
+
+    if (!logicFlagsNeeded && inlineFlags)
+    {
+        emitStore(pEmitter, FLAGS_OFFSET(operand1), ESI);
+        emitStore(pEmitter, FLAGS_OFFSET(operand2), EDX);
+        emitStore(pEmitter, FLAGS_OFFSET(result), ECX);
+        emitRecordFlags(pEmitter, pFlagsKind, FLAGS_ARITHMETIC);
+        return;
+    }
+
+    if (!logicFlagsNeeded)
+    {
+        emitFunctionCall(pEmitter, jitArithmeticFlags);
+        *pFlagsKind = FLAGS_UNKNOWN;
+        return;
+    }
+
+    if (carry == CARRY_CONSTANT)
+    {
+        emitMoveImmediate(pEmitter, EDX, bit(pDecoded->immediate, 31));
+    }
+    else if (carry == CARRY_IN && inlineFlags && *pFlagsKind == FLAGS_LOGIC)
+    {
+        emitLoad(pEmitter, EDX, FLAGS_OFFSET(carry));
+    }
+    else if (carry == CARRY_IN)
+    {
+        emitLoad(pEmitter, EDX, REGISTER_OFFSET(CPSR));
+        emitShift(pEmitter, X86_SHR, EDX, C);
+        emitArithmeticImmediate(pEmitter, X86_AND, EDX, 1);
+
+        if (inlineFlags && *pFlagsKind == FLAGS_UNKNOWN)
+        {
+            emitCompareMemory(pEmitter, FLAGS_OFFSET(kind), FLAGS_LOGIC);
+            size_t settled = emitJumpCondition(pEmitter, X86_JNE);
+            emitLoad(pEmitter, EDX, FLAGS_OFFSET(carry));
+            patchJump(pEmitter, settled, pEmitter->offset);
+        }
+    }
+    else
+    {
+        emitMove(pEmitter, EDX, EAX);
+    }
+
+    if (inlineFlags)
+    {
+        emitStore(pEmitter, FLAGS_OFFSET(result), ECX);
+        emitStore(pEmitter, FLAGS_OFFSET(carry), EDX);
+        emitRecordFlags(pEmitter, pFlagsKind, FLAGS_LOGIC);
+        return;
+    }
+
+    emitMove(pEmitter, ESI, ECX);
+    emitFunctionCall(pEmitter, jitLogicFlags);
+    *pFlagsKind = FLAGS_UNKNOWN;
+}
+
+static void
+translateMultiply
+(
+    Emitter                  *pEmitter,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  address,
+    int                      *pFlagsKind
+)
+{
+    if (inlineFlags && pDecoded->alterCPSR)
+    {
+        emitFlagsBelow(pEmitter, pFlagsKind, FLAGS_MULTIPLY);
+    }
+
+    emitGuestRegister(pEmitter, EAX, pDecoded->rs, address);
+    emitGuestRegister(pEmitter, ECX, pDecoded->rm, address);
+    emitMultiply(pEmitter, EAX, ECX);
+
+    if (pDecoded->accumulate)
+    {
+        emitGuestRegister(pEmitter, ECX, pDecoded->rd, address);
+        emitArithmetic(pEmitter, X86_ADD, EAX, ECX);
+    }
+
+    emitStore(pEmitter, REGISTER_OFFSET(pDecoded->rn), EAX);
+
+    if (inlineFlags && pDecoded->alterCPSR)
+    {
+        emitStore(pEmitter, FLAGS_OFFSET(result), EAX);
+        emitRecordFlags(pEmitter, pFlagsKind, FLAGS_MULTIPLY);
+    }
+    else if (pDecoded->alterCPSR)
+    {
+        emitMove(pEmitter, ESI, EAX);
+        emitFunctionCall(pEmitter, jitMultiplyFlags);
+        *pFlagsKind = FLAGS_UNKNOWN;
+    }
+}
+
+static void
+translateTransfer
+(
+    Emitter                  *pEmitter,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  address,
+    uint32_t                  count,
+    int                      *pFlagsKind
+)
+{
+    bool load = pDecoded->operation == LDR || pDecoded->operation == LDRB;
+
+    if (rotatesCarry(pDecoded))
+    {
+        emitFlagsBelow(pEmitter, pFlagsKind, FLAGS_MULTIPLY);
+    }
+
+    // base in eax, offset in edx, written back base in ecx, address in esi
+    emitGuestRegister(pEmitter, EAX, pDecoded->rn, address);
+
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE)
+    {
+        emitMoveImmediate(pEmitter, EDX, pDecoded->immediate);
+    }
+    else
+    {
+        emitShiftedRegister(pEmitter, EDX, pDecoded, address, false);
+    }
+
+    emitMove(pEmitter, ECX, EAX);
+    emitArithmetic(pEmitter, pDecoded->up ? X86_ADD : X86_SUB, ECX, EDX);
+    emitMove(pEmitter, ESI, pDecoded->preindex ? ECX : EAX);
+
+    if (!load)
+    {
+        emitGuestRegister(pEmitter, EDX, pDecoded->rd, address);
+    }
+
+    emitStore(pEmitter, REGISTER_OFFSET(pDecoded->rn), ECX);
+
+    switch(pDecoded->operation)
+    {
+    case LDR:
+        emitMoveImmediate(pEmitter, EDX, count);
+        emitFunctionCall(pEmitter, jitLoad32);
+        break;
+    case LDRB:
+        emitMoveImmediate(pEmitter, EDX, count);
+        emitFunctionCall(pEmitter, jitLoad8);
+        break;
+    case STR:
+        emitFunctionCall(pEmitter, jitStore32);
+        break;
+    case STRB:
+        emitFunctionCall(pEmitter, jitStore8);
+        break;
+    }
+
+    size_t unmodified;
+
+    if (load)
+    {
+        // a faulting load still writes its registers before the run stops
+        emitStore(pEmitter, REGISTER_OFFSET(pDecoded->rd), EAX);
+        emitTestMemory8(pEmitter, FAULTED_OFFSET, 1);
+        unmodified = emitJumpCondition(pEmitter, X86_JE);
+    }
+    else
+    {
+        // leave the block if the store modified translated code
+        emitTest(pEmitter, EAX, EAX);
+        unmodified = emitJumpCondition(pEmitter, X86_JE);
+    }
+
+    if (!writesProgramCounter(pDecoded))
+    {
+        emitStoreImmediate(pEmitter, REGISTER_OFFSET(PC), address + 4);
+    }
+
+    emitExit(pEmitter, count);
+    patchJump(pEmitter, unmodified, pEmitter->offset);
+}
+
+static void
+translateBlockTransfer
+(
+    Emitter                  *pEmitter,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  address,
+    uint32_t                  count
+)
+{
+    // the helper reads the PC like the interpreter does
+    if (!writesProgramCounter(pDecoded))
+    {
+        emitStoreImmediate(pEmitter, REGISTER_OFFSET(PC), address + 4);
+    }
+
+    emitMoveStateArgument(pEmitter);
+    emitMovePointer(pEmitter, ESI, pDecoded);
+    emitCall(pEmitter, jitBlockTransfer);
+    emitTest(pEmitter, EAX, EAX);
+
+    size_t unmodified = emitJumpCondition(pEmitter, X86_JE);
+
+    emitExit(pEmitter, count);
+    patchJump(pEmitter, unmodified, pEmitter->offset);
+}
+
+static void
+translateBranch
+(
+    Emitter                  *pEmitter,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  address,
+    uint32_t                  count,
+    int                       flagsKind
+)
+{
+    size_t notTaken = emitCondition(pEmitter, pDecoded->condition, flagsKind);
+
+    if (pDecoded->link)
+    {
+        emitStoreImmediate(pEmitter, REGISTER_OFFSET(LR), address + 4);
+    }
+
+    emitChainedExit(pEmitter, address + 4 + pDecoded->immediate, count);
+
+    if (notTaken != NO_JUMP)
+    {
+        patchJump(pEmitter, notTaken, pEmitter->offset);
+        emitChainedExit(pEmitter, address + 4, count);
+    }
+}
+
+// the entry of an aligned guest address, its region is allocated on first use
+static JitEntry *
+jitEntry
+(
+    Jit     *pJit,
+    uint32_t address
+)
+{
+    uint32_t region = address >> JIT_REGION_SHIFT;
+
+    if (region >= pJit->regionCount)
+    {
+        return NULL;
+    }
+
+    if (!pJit->ppRegions[region])
+    {
+        pJit->ppRegions[region] = (JitEntry *)allocateZeroed(JIT_REGION_ENTRIES * sizeof(JitEntry));
+
+        if (!pJit->ppRegions[region])
+        {
+            return NULL;
+        }
+
+        if (region >= pJit->regionsUsed)
+        {
+            pJit->regionsUsed = region + 1;
+        }
+    }
+
+    return &pJit->ppRegions[region][address % (1u << JIT_REGION_SHIFT) / 4];
+}
+
+static JitBlock
+translate
+(
+    CpuState *pState,
+    uint32_t  start
+)
+{
+    Jit *pJit = pState->pJit;
+
+    if (pJit->size - pJit->used < 2 * JIT_INSTRUCTION_BYTES)
+    {
+        flushJit(pJit);
+    }
+
+    Emitter  emitter = { pJit->pBuffer + pJit->used, 0, pJit->size - pJit->used };
+    Emitter *pEmitter = &emitter;
+    uint32_t address = start;
+    uint32_t count = 0;
+    int      flagsKind = FLAGS_UNKNOWN;
+
+    emitPrologue(pEmitter);
+
+    size_t body = emitter.offset;
+
+    for (;;)
+    {
+        const DecodedInstruction *pDecoded = fetchDecoded(&pState->decodeCache, &pState->memory, address);
+        bool                      exits = writesProgramCounter(pDecoded) || pDecoded->operation == SWI;
+
+        // blocks end in front of a breakpoint, which the interpreter steps into
+        if (pDecoded->operation == BREAKPOINT && count == 0)
+        {
+            return NULL;
+        }
+        else if (pDecoded->operation == BREAKPOINT)
+        {
+            emitChainedExit(pEmitter, address, count);
+            break;
+        }
+
+        count++;
+
+        if (!translatable(pDecoded))
+        {
+            emitStoreImmediate(pEmitter, REGISTER_OFFSET(PC), address + 4);
+            emitMoveStateArgument(pEmitter);
+            emitMovePointer(pEmitter, ESI, pDecoded);
+            emitMoveImmediate(pEmitter, EDX, count);
+            emitCall(pEmitter, jitExecute);
+            flagsKind = FLAGS_UNKNOWN;
+        }
+        else if (pDecoded->operation == BRANCH)
+        {
+            translateBranch(pEmitter, pDecoded, address, count, flagsKind);
+            address += 4;
+            break;
+        }
+        else
+        {
+            // a PC write that fails its condition falls through to the next instruction
+            if (exits)
+            {
+                emitStoreImmediate(pEmitter, REGISTER_OFFSET(PC), address + 4);
+            }
+
+            size_t skip = emitCondition(pEmitter, pDecoded->condition, flagsKind);
+            int    skippedFlagsKind = flagsKind;
+
+            switch(pDecoded->operation)
+            {
+            case DATA:
+                translateDataProcessing(pEmitter, pDecoded, address, &flagsKind);
+                break;
+            case MUL:
+                translateMultiply(pEmitter, pDecoded, address, &flagsKind);
+                break;
+            case LDR:
+            case LDRB:
+            case STR:
+            case STRB:
+                translateTransfer(pEmitter, pDecoded, address, count, &flagsKind);
+                break;
+            case LDM:
+            case STM:
+                translateBlockTransfer(pEmitter, pDecoded, address, count);
+                break;
+            }
+
+            if (skip != NO_JUMP)
+            {
+                patchJump(pEmitter, skip, pEmitter->offset);
+
+                // the skipped and the executed path may leave different records
+                if (flagsKind != skippedFlagsKind)
+                {
+                    flagsKind = FLAGS_UNKNOWN;
+                }
+            }
+        }
+
+        address += 4;
+
+        if (exits)
+        {
+            emitExit(pEmitter, count);
+            break;
+        }
+
+        if (address == pState->programSize || !inMemory(&pState->memory, address, 4) ||
+            count == JIT_BLOCK_INSTRUCTIONS || emitter.size - emitter.offset < JIT_INSTRUCTION_BYTES)
+        {
+            emitChainedExit(pEmitter, address, count);
+            break;
+        }
+    }
+
+    if (emitter.offset > emitter.size)
+    {
+        flushJit(pJit);
+        return NULL;
+    }
+
+    JitEntry *pEntry = jitEntry(pJit, start);
+
+    pEntry->block = (JitBlock)(void *)emitter.pCode;
+    pEntry->pBody = emitter.pCode + body;
+    pEntry->end = address;
+
+    // keep blocks 16-byte aligned
+    pJit->used += (emitter.offset + 15) & ~(size_t)15;
+    return pEntry->block;
+}
+
+// points a chained exit at the body of its target, skipping the prologue
+static void
+chainExit
+(
+    uint8_t *pJump,
+    uint8_t *pTarget
+)
+{
+    Emitter emitter = { pJump, 0, 4 };
+
+    emit32(&emitter, (uint32_t)(pTarget - (pJump + 4)));
+}
+
+int
+createJit
+(
+    Jit     *pJit,
+    uint64_t memorySize
+)
+{
+    pJit->size = JIT_BUFFER_SIZE;
+    pJit->used = 0;
+    pJit->pBuffer = mmap(NULL, pJit->size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (pJit->pBuffer == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    pJit->regionCount = (memorySize + (1u << JIT_REGION_SHIFT) - 1) >> JIT_REGION_SHIFT;
+    pJit->ppRegions = (JitEntry **)allocateZeroed(pJit->regionCount * sizeof *pJit->ppRegions);
+    pJit->regionsUsed = 0;
+
+    if (!pJit->ppRegions)
+    {
+        munmap(pJit->pBuffer, pJit->size);
+        return -1;
+    }
+
+    memset(&pJit->statistics, 0, sizeof pJit->statistics);
+    return 0;
+}
+
+void
+destroyJit
+(
+    Jit *pJit
+)
+{
+    munmap(pJit->pBuffer, pJit->size);
+
+    for (uint32_t region = 0; region < pJit->regionsUsed; region++)
+    {
+        freeZeroed(pJit->ppRegions[region], JIT_REGION_ENTRIES * sizeof(JitEntry));
+    }
+
+    freeZeroed(pJit->ppRegions, pJit->regionCount * sizeof *pJit->ppRegions);
+    pJit->ppRegions = NULL;
+}
+
+void
+flushJit
+(
+    Jit *pJit
+)
+{
+    for (uint32_t region = 0; region < pJit->regionsUsed; region++)
+    {
+        if (pJit->ppRegions[region])
+        {
+            memset(pJit->ppRegions[region], 0, JIT_REGION_ENTRIES * sizeof(JitEntry));
+        }
+    }
+
+    pJit->used = 0;
+    pJit->statistics.flushes++;
+}
+
+/* Drops the blocks overlapping a written page. Their code stays in the
+   buffer until the next flush, with the body turned into a plain return
+   so exits already chained to it come back to the dispatcher. */
+void
+invalidateJitPage
+(
+    Jit     *pJit,
+    uint32_t page
+)
+{
+    uint64_t start = (uint64_t)page << PAGE_SHIFT;
+    uint64_t first = start < JIT_BLOCK_INSTRUCTIONS * 4 ? 0 : start - JIT_BLOCK_INSTRUCTIONS * 4 + 4;
+
+    for (uint64_t address = first; address < start + PAGE_SIZE; address += 4)
+    {
+        uint32_t  region = address >> JIT_REGION_SHIFT;
+        JitEntry *pEntry;
+
+        if (region >= pJit->regionCount || !pJit->ppRegions[region])
+        {
+            continue;
+        }
+
+        pEntry = &pJit->ppRegions[region][address % (1u << JIT_REGION_SHIFT) / 4];
+
+        if (!pEntry->block || pEntry->end <= start)
+        {
+            continue;
+        }
+
+        Emitter emitter = { pEntry->pBody, 0, JIT_INSTRUCTION_BYTES };
+
+        emitArithmetic(&emitter, X86_XOR, EAX, EAX);
+        emitReturn(&emitter);
+
+        pEntry->block = NULL;
+        pJit->statistics.invalidations++;
+    }
+}
+
+void
+runJit
+(
+    CpuState *pState
+)
+{
+    Jit      *pJit = pState->pJit;
+    uint32_t *registers = pState->registers;
+    uint8_t  *pExit = NULL;
+
+    // without a JIT the threaded interpreter runs everything, it counts the statistics too
+    if (!pJit)
+    {
+        interpretThreaded(pState);
+        return;
+    }
+
+    // any block fits below chainLimit, so chained exits never overshoot the limit
+    if (pState->limit < JIT_BLOCK_INSTRUCTIONS)
+    {
+        pState->chainLimit = 0;
+    }
+    else
+    {
+        pState->chainLimit = pState->limit - JIT_BLOCK_INSTRUCTIONS;
+    }
+
+    while (registers[PC] != pState->programSize && !pState->memory.faulted && 
+           pState->instructions < pState->limit && !pState->stopped)
+    {
+        uint32_t  pc = registers[PC];
+        JitEntry *pEntry = NULL;
+
+        if (pc % 4 == 0 && inMemory(&pState->memory, pc, 4))
+        {
+            pEntry = jitEntry(pJit, pc);
+        }
+
+        if (pEntry && pEntry->block)
+        {
+            pJit->statistics.hits++;
+        }
+        else if (pEntry)
+        {
+            uint64_t flushes = pJit->statistics.flushes;
+
+            pJit->statistics.misses++;
+            translate(pState, pc);
+
+            // a flush took the exit waiting to be chained with it
+            if (pJit->statistics.flushes != flushes)
+            {
+                pExit = NULL;
+            }
+        }
+
+        // a block that could run past the limit is stepped instead
+        if (pEntry && pEntry->block && (pEntry->end - pc) / 4 <= pState->limit - pState->instructions)
+        {
+            if (pExit)
+            {
+                chainExit(pExit, pEntry->pBody);
+                pJit->statistics.chained++;
+            }
+
+            pExit = pEntry->block(pState);
+            continue;
+        }
+
+        // misaligned or untranslatable PC, or close to the limit, step it in the interpreter
+        const DecodedInstruction *pDecoded = fetchDecoded(&pState->decodeCache, &pState->memory, pc);
+        registers[PC] += 4;
+        pState->instructions++;
+        executeDecoded(pState, pDecoded);
+        pExit = NULL;
+    }
+}
+
+#else
+
+int
+createJit
+(
+    Jit     *pJit,
+    uint64_t memorySize
+)
+{
+    return -1;
+}
+
+void
+destroyJit
+(
+    Jit *pJit
+)
+{
+}
+
+void
+flushJit
+(
+    Jit *pJit
+)
+{
+}
+
+void
+invalidateJitPage
+(
+    Jit     *pJit,
+    uint32_t page
+)
+{
+}
+
+// no code generator for this host, the threaded interpreter runs everything
+void
+runJit
+(
+    CpuState *pState
+)
+{
+    interpretThreaded(pState);
+}
+
+#endif
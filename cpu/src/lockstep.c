@@ -0,0 +1,886 @@
+#include <string.h>
+#include "lockstep.h"
+#include "alu.h"
+#include "flags.h"
+
+/* One element per instance. GCC lowers the vector operations to AVX2 or
+   SSE depending on the clone of runGroup() the host picks at load time. */
+typedef uint32_t Lanes __attribute__((vector_size(LOCKSTEP_LANES * sizeof(uint32_t))));
+typedef int32_t  SignedLanes __attribute__((vector_size(LOCKSTEP_LANES * sizeof(int32_t))));
+
+#define LANES_INLINE static inline __attribute__((always_inline))
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(NO_TARGET_CLONES)
+#define LANES_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define LANES_CLONES
+#endif
+
+#define LOCKSTEP_PAGES 8
+
+typedef struct Lockstep
+{
+    // registers[r][lane], the CPSR is kept eagerly
+    Lanes     registers[17];
+
+    // all ones for the lanes still running in the group
+    Lanes     active;
+    uint32_t  activeCount;
+    CpuState *pStates[LOCKSTEP_LANES];
+
+    // instructions of each state when the group formed and how many more it may run
+    uint64_t  start[LOCKSTEP_LANES];
+    uint64_t  allowance[LOCKSTEP_LANES];
+    uint64_t  steps;
+
+    // code pages whose bytes every lane was found to share
+    uint32_t  verified[LOCKSTEP_PAGES];
+} Lockstep;
+
+LANES_INLINE Lanes
+blend
+(
+    Lanes mask,
+    Lanes chosen,
+    Lanes other
+)
+{
+    return (chosen & mask) | (other & ~mask);
+}
+
+LANES_INLINE bool
+anyLane
+(
+    Lanes mask
+)
+{
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (mask[lane])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+LANES_INLINE Lanes
+conditionLanes
+(
+    uint32_t condition,
+    Lanes    currentProcessStateRegister
+)
+{
+    Lanes zero = { 0 };
+    Lanes n = (currentProcessStateRegister >> N) & 1;
+    Lanes z = (currentProcessStateRegister >> Z) & 1;
+    Lanes c = (currentProcessStateRegister >> C) & 1;
+    Lanes v = (currentProcessStateRegister >> V) & 1;
+
+    switch(condition)
+    {
+    case EQ:
+        return (Lanes)(z != zero);
+    case NE:
+        return (Lanes)(z == zero);
+    case CS:
+        return (Lanes)(c != zero);
+    case CC:
+        return (Lanes)(c == zero);
+    case MI:
+        return (Lanes)(n != zero);
+    case PL:
+        return (Lanes)(n == zero);
+    case VS:
+        return (Lanes)(v != zero);
+    case VC:
+        return (Lanes)(v == zero);
+    case HI:
+        return (Lanes)((c != zero) & (z == zero));
+    case LS:
+        return (Lanes)((c == zero) | (z != zero));
+    case GE:
+        return (Lanes)(n == v);
+    case LT:
+        return (Lanes)(n != v);
+    case GT:
+        return (Lanes)((z == zero) & (n == v));
+    case LE:
+        return (Lanes)((z != zero) | (n != v));
+    }
+
+    return ~zero;
+}
+
+LANES_INLINE Lanes
+setFlag
+(
+    Lanes    currentProcessStateRegister,
+    uint32_t index,
+    Lanes    value
+)
+{
+    return (currentProcessStateRegister & ~(1u << index)) | (value << index);
+}
+
+LANES_INLINE Lanes
+logicLanes
+(
+    Lanes currentProcessStateRegister,
+    Lanes result,
+    Lanes carry
+)
+{
+    Lanes zero = { 0 };
+
+    currentProcessStateRegister = setFlag(currentProcessStateRegister, Z, (Lanes)(result == zero) & 1);
+    currentProcessStateRegister = setFlag(currentProcessStateRegister, N, result >> 31);
+    return setFlag(currentProcessStateRegister, C, carry);
+}
+
+// arithmeticFlags() lane by lane, bit(31, x) included
+LANES_INLINE Lanes
+arithmeticLanes
+(
+    Lanes currentProcessStateRegister,
+    Lanes operand1,
+    Lanes operand2,
+    Lanes result
+)
+{
+    Lanes zero = { 0 };
+    Lanes five = zero + 5;
+    Lanes bit1 = (Lanes)((operand1 & 31) < five) & 1;
+    Lanes bit2 = (Lanes)((operand2 & 31) < five) & 1;
+    Lanes bitResult = (Lanes)((result & 31) < five) & 1;
+    Lanes overflow = (Lanes)((bit1 == bit2) & (bitResult != bit1)) & 1;
+
+    currentProcessStateRegister = setFlag(currentProcessStateRegister, Z, (Lanes)(result == zero) & 1);
+    currentProcessStateRegister = setFlag(currentProcessStateRegister, N, result >> 31);
+    currentProcessStateRegister = setFlag(currentProcessStateRegister, V, overflow);
+    return setFlag(currentProcessStateRegister, C, (Lanes)(result < operand1) & 1);
+}
+
+LANES_INLINE Lanes
+multiplyFlagsLanes
+(
+    Lanes currentProcessStateRegister,
+    Lanes result
+)
+{
+    Lanes zero = { 0 };
+
+    currentProcessStateRegister = setFlag(currentProcessStateRegister, N, result >> 31);
+    return setFlag(currentProcessStateRegister, Z, (Lanes)(result == zero) & 1);
+}
+
+// barrelShift() for an immediate amount, the same for every lane
+LANES_INLINE Lanes
+shiftImmediate
+(
+    uint32_t type,
+    Lanes    sequence,
+    uint32_t amount,
+    Lanes    carryIn,
+    Lanes   *pCarry
+)
+{
+    Lanes zero = { 0 };
+
+    switch(type)
+    {
+    case LSL:
+        if (amount == 0)
+        {
+            *pCarry = carryIn;
+            return sequence;
+        }
+
+        *pCarry = (sequence >> (32 - amount)) & 1;
+        return sequence << amount;
+
+    case LSR:
+        if (amount == 0)
+        {
+            *pCarry = sequence >> 31;
+            return zero;
+        }
+
+        *pCarry = (sequence >> (amount - 1)) & 1;
+        return sequence >> amount;
+
+    case ASR:
+        if (amount == 0)
+        {
+            *pCarry = sequence >> 31;
+            return (Lanes)((SignedLanes)sequence >> 31);
+        }
+
+        *pCarry = (sequence >> (amount - 1)) & 1;
+        return (Lanes)((SignedLanes)sequence >> amount);
+    }
+
+    if (amount == 0)
+    {
+        *pCarry = sequence & 1;
+        return (sequence >> 1) | (carryIn << 31);
+    }
+
+    *pCarry = (sequence >> (amount - 1)) & 1;
+    return (sequence >> amount) | (sequence << (32 - amount));
+}
+
+/* Operand2 shifted by the bottom byte of rs, which differs per lane. Shift
+   counts are masked to 0-31 and the out of range cases blended in. */
+LANES_INLINE Lanes
+shiftRegister
+(
+    uint32_t type,
+    Lanes    sequence,
+    Lanes    amount,
+    Lanes    carryIn,
+    Lanes   *pCarry
+)
+{
+    Lanes zero = { 0 };
+    Lanes below = (Lanes)(amount < zero + 32);
+    Lanes exact = (Lanes)(amount == zero + 32);
+    Lanes count = amount & 31;
+    Lanes last = (amount - 1) & 31;
+    Lanes result;
+    Lanes carry;
+
+    switch(type)
+    {
+    case LSL:
+        result = blend(below, sequence << count, zero);
+        carry = blend(below, (sequence >> ((32 - amount) & 31)) & 1, blend(exact, sequence & 1, zero));
+        break;
+
+    case LSR:
+        result = blend(below, sequence >> count, zero);
+        carry = blend(below, (sequence >> last) & 1, blend(exact, sequence >> 31, zero));
+        break;
+
+    case ASR:
+        result = blend(below, (Lanes)((SignedLanes)sequence >> count), (Lanes)((SignedLanes)sequence >> 31));
+        carry = blend(below, (sequence >> last) & 1, sequence >> 31);
+        break;
+
+    default:
+    {
+        // amounts above 32 wrap to 1-32
+        Lanes rotation = last + 1;
+        Lanes whole = (Lanes)(rotation == zero + 32);
+        Lanes right = rotation & 31;
+
+        result = blend(whole, sequence, (sequence >> right) | (sequence << ((32 - right) & 31)));
+        carry = (sequence >> last) & 1;
+        break;
+    }
+    }
+
+    // a zero amount leaves both the operand and the carry alone
+    Lanes unshifted = (Lanes)(amount == zero);
+
+    *pCarry = blend(unshifted, carryIn, carry);
+    return blend(unshifted, sequence, result);
+}
+
+LANES_INLINE Lanes
+aluLanes
+(
+    uint32_t opcode,
+    Lanes    operand1,
+    Lanes    operand2,
+    Lanes    carryIn
+)
+{
+    switch(opcode)
+    {
+    case AND:
+    case TST:
+        return operand1 & operand2;
+    case EOR:
+    case TEQ:
+        return operand1 ^ operand2;
+    case SUB:
+    case CMP:
+        return operand1 - operand2;
+    case RSB:
+        return operand2 - operand1;
+    case ADD:
+    case CMN:
+        return operand1 + operand2;
+    case ADC:
+        return operand1 + operand2 + carryIn;
+    case SBC:
+        return operand1 - operand2 + carryIn - 1;
+    case RSC:
+        return operand2 - operand1 + carryIn - 1;
+    case ORR:
+        return operand1 | operand2;
+    case MOV:
+        return operand2;
+    case BIC:
+        return operand1 & ~operand2;
+    }
+
+    return ~operand2;
+}
+
+LANES_INLINE void
+dataLanes
+(
+    Lanes                    *registers,
+    const DecodedInstruction *pDecoded,
+    Lanes                     execute
+)
+{
+    Lanes zero = { 0 };
+    Lanes currentProcessStateRegister = registers[CPSR];
+    Lanes carryIn = (currentProcessStateRegister >> C) & 1;
+    Lanes carry;
+    Lanes operand2;
+
+    switch(pDecoded->operand2)
+    {
+    case OPERAND_IMMEDIATE:
+        operand2 = zero + pDecoded->immediate;
+        carry = pDecoded->shiftAmount ? zero + (pDecoded->immediate >> 31) : carryIn;
+        break;
+    case OPERAND_REGISTER:
+        operand2 = shiftImmediate(pDecoded->shiftType, registers[pDecoded->rm], pDecoded->shiftAmount, carryIn, &carry);
+        break;
+    default:
+        operand2 = shiftRegister(pDecoded->shiftType, registers[pDecoded->rm], registers[pDecoded->rs] & 0xFF,
+                                 carryIn, &carry);
+        break;
+    }
+
+    Lanes operand1 = registers[pDecoded->rn];
+    Lanes result = aluLanes(pDecoded->opcode, operand1, operand2, carryIn);
+
+    if (pDecoded->alterCPSR)
+    {
+        Lanes flags = aluLogicOperation(pDecoded->opcode)
+            ? logicLanes(currentProcessStateRegister, result, carry)
+            : arithmeticLanes(currentProcessStateRegister, operand1, operand2, result);
+
+        registers[CPSR] = blend(execute, flags, currentProcessStateRegister);
+    }
+
+    if (aluWriteback(pDecoded->opcode))
+    {
+        registers[pDecoded->rd] = blend(execute, result, registers[pDecoded->rd]);
+    }
+}
+
+LANES_INLINE void
+multiplyLanes
+(
+    Lanes                    *registers,
+    const DecodedInstruction *pDecoded,
+    Lanes                     execute
+)
+{
+    Lanes result = registers[pDecoded->rs] * registers[pDecoded->rm];
+
+    if (pDecoded->accumulate)
+    {
+        result += registers[pDecoded->rd];
+    }
+
+    if (pDecoded->alterCPSR)
+    {
+        registers[CPSR] = blend(execute, multiplyFlagsLanes(registers[CPSR], result), registers[CPSR]);
+    }
+
+    registers[pDecoded->rn] = blend(execute, result, registers[pDecoded->rn]);
+}
+
+// loads and stores go lane by lane to the memory of each state
+LANES_INLINE void
+transferLanes
+(
+    Lockstep                 *pGroup,
+    const DecodedInstruction *pDecoded,
+    Lanes                     execute,
+    Lanes                    *pFaulted,
+    bool                     *pCodeWritten
+)
+{
+    Lanes *registers = pGroup->registers;
+    Lanes  zero = { 0 };
+    Lanes  base = registers[pDecoded->rn];
+    Lanes  data = registers[pDecoded->rd];
+    Lanes  offset;
+    Lanes  unused;
+
+    if (pDecoded->operand2 == OPERAND_IMMEDIATE)
+    {
+        offset = zero + pDecoded->immediate;
+    }
+    else
+    {
+        offset = shiftImmediate(pDecoded->shiftType, registers[pDecoded->rm], pDecoded->shiftAmount,
+                                (registers[CPSR] >> C) & 1, &unused);
+    }
+
+    Lanes written = pDecoded->up ? base + offset : base - offset;
+    Lanes address = pDecoded->preindex ? written : base;
+    Lanes loaded = data;
+
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (!execute[lane])
+        {
+            continue;
+        }
+
+        CpuState *pState = pGroup->pStates[lane];
+        Memory   *pMemory = &pState->memory;
+
+        switch(pDecoded->operation)
+        {
+        case LDR:
+            loaded[lane] = load32(pMemory, address[lane]);
+            break;
+        case LDRB:
+            loaded[lane] = load8(pMemory, address[lane]);
+            break;
+        case STR:
+            if (store32(pMemory, address[lane], data[lane]))
+            {
+                codeWritten(pState, address[lane], 4);
+                *pCodeWritten = true;
+            }
+            break;
+        case STRB:
+            if (store8(pMemory, address[lane], data[lane]))
+            {
+                codeWritten(pState, address[lane], 1);
+                *pCodeWritten = true;
+            }
+            break;
+        }
+
+        if (pMemory->faulted)
+        {
+            (*pFaulted)[lane] = ~0u;
+        }
+    }
+
+    registers[pDecoded->rn] = blend(execute, written, registers[pDecoded->rn]);
+
+    if (pDecoded->operation == LDR || pDecoded->operation == LDRB)
+    {
+        registers[pDecoded->rd] = blend(execute, loaded, registers[pDecoded->rd]);
+    }
+}
+
+// LDM and STM copy each lane's words to or from its memory in one go
+LANES_INLINE void
+blockLanes
+(
+    Lockstep                 *pGroup,
+    const DecodedInstruction *pDecoded,
+    Lanes                     execute,
+    Lanes                    *pFaulted,
+    bool                     *pCodeWritten
+)
+{
+    Lanes   *registers = pGroup->registers;
+    Lanes    written = registers[pDecoded->rn];
+    Lanes    words[16];
+    uint32_t count = pDecoded->registerCount;
+
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (!execute[lane])
+        {
+            continue;
+        }
+
+        CpuState *pState = pGroup->pStates[lane];
+        Memory   *pMemory = &pState->memory;
+        uint32_t  data[16];
+        uint32_t  word = 0;
+        uint32_t  base;
+        uint32_t  address = blockAddress(pDecoded, written[lane], &base);
+
+        written[lane] = base;
+
+        if (pDecoded->operation == LDM)
+        {
+            loadBlock(pMemory, address, data, count);
+
+            for (word = 0; word < count; word++)
+            {
+                words[word][lane] = data[word];
+            }
+        }
+        else
+        {
+            for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+            {
+                data[word++] = registers[__builtin_ctz(list)][lane];
+            }
+
+            if (storeBlock(pMemory, address, data, count))
+            {
+                codeWritten(pState, address, 4 * count);
+                *pCodeWritten = true;
+            }
+        }
+
+        if (pMemory->faulted)
+        {
+            (*pFaulted)[lane] = ~0u;
+        }
+    }
+
+    registers[pDecoded->rn] = blend(execute, written, registers[pDecoded->rn]);
+
+    if (pDecoded->operation == LDM)
+    {
+        uint32_t word = 0;
+
+        for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+        {
+            registers[__builtin_ctz(list)] = blend(execute, words[word++], registers[__builtin_ctz(list)]);
+        }
+    }
+}
+
+// hands a lane back to its state, which continues on its own
+static void
+leaveGroup
+(
+    Lockstep *pGroup,
+    uint32_t  lane
+)
+{
+    CpuState *pState = pGroup->pStates[lane];
+
+    for (uint32_t index = 0; index < CPSR; index++)
+    {
+        pState->registers[index] = pGroup->registers[index][lane];
+    }
+
+    writeFlags(&pState->registers[CPSR], &pState->flags, pGroup->registers[CPSR][lane]);
+    pState->instructions = pGroup->start[lane] + pGroup->steps;
+    pState->lockstepInstructions += pGroup->steps;
+    pGroup->active[lane] = 0;
+    pGroup->activeCount--;
+}
+
+static void
+leaveMasked
+(
+    Lockstep *pGroup,
+    Lanes     mask
+)
+{
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (mask[lane] && pGroup->active[lane])
+        {
+            leaveGroup(pGroup, lane);
+        }
+    }
+}
+
+// keeps the lanes at the PC most of them agree on
+static uint32_t
+converge
+(
+    Lockstep *pGroup
+)
+{
+    Lanes    zero = { 0 };
+    Lanes    pc = pGroup->registers[PC];
+    uint32_t best = 0;
+    uint32_t bestCount = 0;
+    uint32_t lead = 0;
+
+    while (lead < LOCKSTEP_LANES - 1 && !pGroup->active[lead])
+    {
+        lead++;
+    }
+
+    // the usual case, every lane took the same way
+    if (!anyLane((Lanes)(pc != zero + pc[lead]) & pGroup->active))
+    {
+        return pc[lead];
+    }
+
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (!pGroup->active[lane])
+        {
+            continue;
+        }
+
+        uint32_t count = 0;
+
+        for (uint32_t other = 0; other < LOCKSTEP_LANES; other++)
+        {
+            count += pGroup->active[other] && pc[other] == pc[lane];
+        }
+
+        if (count > bestCount)
+        {
+            best = pc[lane];
+            bestCount = count;
+        }
+    }
+
+    Lanes diverged = (Lanes)(pc != zero + best) & pGroup->active;
+
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (diverged[lane])
+        {
+            pGroup->pStates[lane]->divergences++;
+            leaveGroup(pGroup, lane);
+        }
+    }
+
+    return best;
+}
+
+/* Code is decoded from the first state only, so a lane stays when it
+   enters a page only if it holds the same bytes there. The check holds
+   for the rest of the group's run: the page is marked as code in every
+   lane, and a store to it by any of them ends the group. */
+static void
+enterPage
+(
+    Lockstep *pGroup,
+    uint32_t  page
+)
+{
+    uint32_t *pVerified = &pGroup->verified[page % LOCKSTEP_PAGES];
+
+    if (*pVerified == page)
+    {
+        return;
+    }
+
+    const Memory *pFirst = &pGroup->pStates[0]->memory;
+    uint64_t      start = (uint64_t)page << PAGE_SHIFT;
+    size_t        length = pFirst->size - start < PAGE_SIZE ? pFirst->size - start : PAGE_SIZE;
+
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (!pGroup->active[lane])
+        {
+            continue;
+        }
+
+        Memory *pMemory = &pGroup->pStates[lane]->memory;
+
+        if (pMemory != pFirst && memcmp(pMemory->pBytes + start, pFirst->pBytes + start, length) != 0)
+        {
+            leaveGroup(pGroup, lane);
+            continue;
+        }
+
+        pMemory->pPageFlags[page] |= PAGE_CODE;
+    }
+
+    *pVerified = page;
+}
+
+// the smallest number of steps after which some lane runs out of instructions
+static uint64_t
+nextStop
+(
+    const Lockstep *pGroup
+)
+{
+    uint64_t stop = UINT64_MAX;
+
+    for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+    {
+        if (pGroup->active[lane] && pGroup->allowance[lane] < stop)
+        {
+            stop = pGroup->allowance[lane];
+        }
+    }
+
+    return stop;
+}
+
+LANES_CLONES static void
+runGroup
+(
+    Lockstep *pGroup
+)
+{
+    Lanes              *registers = pGroup->registers;
+    Lanes               zero = { 0 };
+    CpuState           *pFirst = pGroup->pStates[0];
+    uint32_t            page = UINT32_MAX;
+    uint32_t            pc = converge(pGroup);
+    uint64_t            stop = nextStop(pGroup);
+
+    while (pGroup->activeCount > 0)
+    {
+        // every lane remaining is at pc, the others left with their own PC
+        if (pc == pFirst->programSize)
+        {
+            break;
+        }
+
+        if (pGroup->steps == stop)
+        {
+            for (uint32_t lane = 0; lane < LOCKSTEP_LANES; lane++)
+            {
+                if (pGroup->active[lane] && pGroup->allowance[lane] == stop)
+                {
+                    leaveGroup(pGroup, lane);
+                }
+            }
+
+            stop = nextStop(pGroup);
+            continue;
+        }
+
+        // faulting and misaligned fetches are left to the scalar engines
+        if (pc % 4 != 0 || !inMemory(&pFirst->memory, pc, 4))
+        {
+            break;
+        }
+
+        if (pc >> PAGE_SHIFT != page)
+        {
+            page = pc >> PAGE_SHIFT;
+            enterPage(pGroup, page);
+            continue;
+        }
+
+        const DecodedInstruction *pDecoded = lookupDecoded(&pFirst->decodeCache, pc);
+
+        if (!pDecoded)
+        {
+            pDecoded = fetchDecoded(&pFirst->decodeCache, &pFirst->memory, pc);
+        }
+
+        // service calls do I/O of their own, each state makes them alone
+        if (pDecoded->condition > AL || pDecoded->operation == SWI)
+        {
+            break;
+        }
+
+        registers[PC] = zero + (pc + 4);
+        pGroup->steps++;
+
+        Lanes execute = pGroup->active;
+        Lanes faulted = zero;
+        bool  changed = false;
+        bool  written = false;
+
+        if (pDecoded->condition != AL)
+        {
+            execute &= conditionLanes(pDecoded->condition, registers[CPSR]);
+        }
+
+        switch(pDecoded->operation)
+        {
+        case DATA:
+            dataLanes(registers, pDecoded, execute);
+            changed = aluWriteback(pDecoded->opcode) && pDecoded->rd == PC;
+            break;
+        case MUL:
+            multiplyLanes(registers, pDecoded, execute);
+            changed = pDecoded->rn == PC;
+            break;
+        case LDR:
+        case LDRB:
+        case STR:
+        case STRB:
+            transferLanes(pGroup, pDecoded, execute, &faulted, &written);
+            changed = pDecoded->rn == PC || pDecoded->rd == PC;
+            break;
+        case LDM:
+        case STM:
+            blockLanes(pGroup, pDecoded, execute, &faulted, &written);
+            changed = (pDecoded->operation == LDM && (pDecoded->immediate >> PC & 1)) ||
+                      (pDecoded->writeback && pDecoded->rn == PC);
+            break;
+        case BRANCH:
+            if (pDecoded->link)
+            {
+                registers[LR] = blend(execute, registers[PC], registers[LR]);
+            }
+
+            registers[PC] = blend(execute, registers[PC] + pDecoded->immediate, registers[PC]);
+            changed = true;
+            break;
+        }
+
+        if (anyLane(faulted))
+        {
+            leaveMasked(pGroup, faulted);
+        }
+
+        pc = changed ? converge(pGroup) : pc + 4;
+
+        // code the group decoded may be stale in some of the states
+        if (written)
+        {
+            break;
+        }
+    }
+
+    registers[PC] = blend(pGroup->active, zero + pc, registers[PC]);
+    leaveMasked(pGroup, pGroup->active);
+}
+
+void
+runLockstep
+(
+    CpuState *pStates[],
+    uint32_t  count
+)
+{
+    Lockstep group;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    memset(&group, 0, sizeof group);
+    memset(group.verified, 0xFF, sizeof group.verified);
+
+    for (uint32_t lane = 0; lane < count && lane < LOCKSTEP_LANES; lane++)
+    {
+        CpuState *pState = pStates[lane];
+
+        materializeFlags(&pState->registers[CPSR], &pState->flags);
+
+        for (uint32_t index = 0; index <= CPSR; index++)
+        {
+            group.registers[index][lane] = pState->registers[index];
+        }
+
+        group.pStates[lane] = pState;
+        group.start[lane] = pState->instructions;
+        group.allowance[lane] = pState->limit > pState->instructions ? pState->limit - pState->instructions : 0;
+        group.active[lane] = ~0u;
+        group.activeCount++;
+
+        // a state that can't share the first one's code runs alone
+        if (pState->memory.faulted || pState->programSize != pStates[0]->programSize ||
+            pState->memory.size != pStates[0]->memory.size)
+        {
+            leaveGroup(&group, lane);
+        }
+    }
+
+    runGroup(&group);
+}
@@ -1,49 +1,177 @@
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "mem_op.h"
 
-uint32_t 
-load8
+/* Large tables that stay mostly zero come straight from mmap, so they
+   cost nothing until touched. calloc would clear them with memset once
+   free() has raised its mmap threshold, and contexts get created often. */
+void *
+allocateZeroed
 (
-    uint8_t *pMemory, 
-    uint8_t  address
+    size_t size
 )
 {
-    return pMemory[address];
+    void *pBlock = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return pBlock == MAP_FAILED ? NULL : pBlock;
+}
+
+void
+freeZeroed
+(
+    void  *pBlock,
+    size_t size
+)
+{
+    if (pBlock)
+    {
+        munmap(pBlock, size);
+    }
+}
+
+int
+createMemory
+(
+    Memory  *pMemory,
+    uint64_t size
+)
+{
+    *pMemory = (Memory){0};
+
+    if (size == 0 || size > MAX_MEMORY_SIZE)
+    {
+        return -1;
+    }
+
+    if (size > DEVICE_BASE)
+    {
+        size = DEVICE_BASE;
+    }
+
+    // whole pages, so the page flags cover every byte
+    pMemory->size = (size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    pMemory->pBytes = mmap(NULL, pMemory->size, PROT_READ | PROT_WRITE, 
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (pMemory->pBytes == MAP_FAILED)
+    {
+        pMemory->pBytes = NULL;
+        return -1;
+    }
+
+    pMemory->pPageFlags = (uint8_t *)allocateZeroed(pMemory->size >> PAGE_SHIFT);
+
+    if (!pMemory->pPageFlags)
+    {
+        destroyMemory(pMemory);
+        return -1;
+    }
+
+    return 0;
 }
 
-uint32_t 
-load32
+void
+destroyMemory
 (
-    uint8_t *pMemory, 
+    Memory *pMemory
+)
+{
+    if (pMemory->pBytes)
+    {
+        munmap(pMemory->pBytes, pMemory->size);
+    }
+
+    freeZeroed(pMemory->pPageFlags, pMemory->size >> PAGE_SHIFT);
+    freeZeroed(pMemory->pDirtyPages, (pMemory->size >> PAGE_SHIFT) * sizeof *pMemory->pDirtyPages);
+    pMemory->pBytes = NULL;
+    pMemory->pPageFlags = NULL;
+    pMemory->pDirtyPages = NULL;
+    pMemory->size = 0;
+}
+
+/* Maps the first length bytes of an image file copy-on-write over the
+   start of guest RAM, the rest of its last host page reads as zero. */
+int
+mapImage
+(
+    Memory  *pMemory,
+    int      fd,
+    uint64_t length
+)
+{
+    if (length > pMemory->size)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    // the reservation covers whole host pages, so the mapping always fits
+    void *pImage = mmap(pMemory->pBytes, length, PROT_READ | PROT_WRITE, 
+                        MAP_PRIVATE | MAP_FIXED, fd, 0);
+
+    if (pImage == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+// keeps the first fault, that is the one the run stops on
+void
+memoryFault
+(
+    Memory  *pMemory,
     uint32_t address
 )
 {
-    uint32_t wordBoundaryOffset = address % 4;
-    address -= wordBoundaryOffset;
-    uint32_t data = pMemory[address] | pMemory[address + 1] << 8 | pMemory[address + 2] << 16 | pMemory[address + 3] << 24;
-    return rotateRight(data, 8 * wordBoundaryOffset);
+    if (!pMemory->faulted)
+    {
+        pMemory->faulted = true;
+        pMemory->faultAddress = address;
+    }
 }
 
-void 
-store8
+// a fault latched with halted set, the run stops on it the same way
+void
+memoryHalt
 (
-    uint8_t *pMemory, 
-    uint32_t address, 
-    uint8_t  data
+    Memory  *pMemory,
+    uint32_t status
 )
 {
-    pMemory[address] = data;
+    if (!pMemory->faulted)
+    {
+        pMemory->faulted = true;
+        pMemory->halted = true;
+        pMemory->exitStatus = status;
+    }
 }
 
-void 
-store32
+// marks a page dirty, and logs it the first time while there is a snapshot to restore it from
+void
+pageDirtied
 (
-    uint8_t *pMemory, 
-    uint32_t address, 
-    uint32_t data
+    Memory  *pMemory,
+    uint32_t page
 )
 {
-    pMemory[address] = bits(data, 7, 0);
-    pMemory[address + 1] = bits(data, 15, 8);
-    pMemory[address + 2] = bits(data, 23, 16);
-    pMemory[address + 3] = bits(data, 31, 24);
-} 
+    if (pMemory->pPageFlags[page] & PAGE_DIRTY)
+    {
+        return;
+    }
+
+    pMemory->pPageFlags[page] |= PAGE_DIRTY | PAGE_WRITTEN;
+    pMemory->writtenChunks[page >> WRITTEN_CHUNK_SHIFT >> 6] |= 1ull << (page >> WRITTEN_CHUNK_SHIFT & 63);
+
+    if (pMemory->pDirtyPages)
+    {
+        pMemory->pDirtyPages[pMemory->dirtyCount++] = page;
+    }
+}
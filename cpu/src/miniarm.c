@@ -0,0 +1,1133 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "miniarm.h"
+#include "bus.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "debug.h"
+#include "interpreter.h"
+#include "lockstep.h"
+#include "native.h"
+#include "pipeline.h"
+#include "predictor.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "threaded.h"
+#include "trace.h"
+#include "jit.h"
+
+struct MiniArm
+{
+    CpuState   state;
+    Jit        jit;
+    Pipeline   pipeline;
+    Debug      debug;
+    Bus        bus;
+    Caches     caches;
+    Predictors predictors;
+    Snapshot   snapshot;
+    Replay     replay;
+    int        mode;
+
+    // the child writing the last checkpoint, 0 once it was waited for
+    pid_t checkpointWriter;
+
+    // instructions traced and dropped from full rings by the traces already stopped
+    uint64_t tracedInstructions;
+    uint64_t traceDropped;
+#ifdef MINIARM_STATS
+    ExecutionCounts counts;
+#endif
+};
+
+MiniArm *
+createMiniArm
+(
+    uint64_t memorySize,
+    int      mode
+)
+{
+    if (mode != MINIARM_INTERPRETER && mode != MINIARM_THREADED && mode != MINIARM_JIT)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    MiniArm *pMiniArm = (MiniArm *)calloc(1, sizeof *pMiniArm);
+
+    if (!pMiniArm)
+    {
+        return NULL;
+    }
+
+    CpuState *pState = &pMiniArm->state;
+
+    pMiniArm->mode = mode;
+
+    if (createMemory(&pState->memory, memorySize) == -1)
+    {
+        free(pMiniArm);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (createDecodeCache(&pState->decodeCache, pState->memory.size) == -1)
+    {
+        destroyMemory(&pState->memory);
+        free(pMiniArm);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+#ifdef MINIARM_STATS
+    // translated blocks don't count, so runJit() runs JIT mode on the threaded interpreter, which does
+    pState->pCounts = &pMiniArm->counts;
+#else
+    // without a JIT runJit() falls back to the threaded interpreter
+    if (mode == MINIARM_JIT && createJit(&pMiniArm->jit, pState->memory.size) == 0)
+    {
+        pState->pJit = &pMiniArm->jit;
+    }
+#endif
+
+    return pMiniArm;
+}
+
+void
+destroyMiniArm
+(
+    MiniArm *pMiniArm
+)
+{
+    if (!pMiniArm)
+    {
+        return;
+    }
+
+    if (pMiniArm->state.pJit)
+    {
+        destroyJit(pMiniArm->state.pJit);
+    }
+
+    stopMiniArmTrace(pMiniArm);
+    stopMiniArmReplay(pMiniArm);
+    waitMiniArmCheckpoint(pMiniArm);
+    destroyCaches(&pMiniArm->caches);
+    destroyPredictors(&pMiniArm->predictors);
+    destroySnapshot(&pMiniArm->snapshot, &pMiniArm->state.memory);
+    destroyDecodeCache(&pMiniArm->state.decodeCache);
+    destroyMemory(&pMiniArm->state.memory);
+    free(pMiniArm);
+}
+
+// code decoded or translated from the old contents of the image pages is stale, and a snapshot has to restore them
+static void
+imageLoaded
+(
+    MiniArm *pMiniArm,
+    size_t   size
+)
+{
+    if (size > 0)
+    {
+        markRangeDirty(&pMiniArm->state.memory, 0, size);
+        codeWritten(&pMiniArm->state, 0, size);
+    }
+
+    pMiniArm->state.programSize = size;
+}
+
+int
+loadMiniArmImage
+(
+    MiniArm    *pMiniArm,
+    const void *pImage,
+    size_t      size
+)
+{
+    // the program size is kept in 32 bits
+    if (size > pMiniArm->state.memory.size || size > UINT32_MAX)
+    {
+        errno = EFBIG;
+        return -1;
+    }
+
+    memcpy(pMiniArm->state.memory.pBytes, pImage, size);
+    imageLoaded(pMiniArm, size);
+    return 0;
+}
+
+// maps the image instead of copying it, so loading takes the same time at any size
+int
+loadMiniArmFile
+(
+    MiniArm    *pMiniArm,
+    const char *path
+)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    struct stat status;
+
+    if (fstat(fd, &status) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // pipes and devices cannot be mapped
+    if (!S_ISREG(status.st_mode))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((uint64_t)status.st_size > pMiniArm->state.memory.size || (uint64_t)status.st_size > UINT32_MAX)
+    {
+        close(fd);
+        errno = EFBIG;
+        return -1;
+    }
+
+    int result = mapImage(&pMiniArm->state.memory, fd, status.st_size);
+    int error = errno;
+
+    // the mapping keeps its own reference to the file
+    close(fd);
+
+    if (result == -1)
+    {
+        errno = error;
+        return -1;
+    }
+
+    imageLoaded(pMiniArm, status.st_size);
+    return 0;
+}
+
+static void
+setLimit
+(
+    CpuState *pState,
+    uint64_t  count
+)
+{
+    if (count == 0 || count > UINT64_MAX - pState->instructions)
+    {
+        pState->limit = UINT64_MAX;
+    }
+    else
+    {
+        pState->limit = pState->instructions + count;
+    }
+
+    // a replay stops where its recording did
+    if (pState->memory.pReplay && pState->memory.pReplay->replaying && pState->memory.pReplay->end < pState->limit)
+    {
+        pState->limit = pState->memory.pReplay->end;
+    }
+}
+
+static int
+runMode
+(
+    MiniArm *pMiniArm
+)
+{
+    CpuState *pState = &pMiniArm->state;
+
+    if (pState->pDebug)
+    {
+        pState->pDebug->stop = DEBUG_NONE;
+    }
+
+    pState->stopped = false;
+
+    // a run stopped by a fault or a halt stays stopped, a traced, cached or predicted one is interpreted whatever the mode
+    if (pState->pTracer && !pState->memory.faulted)
+    {
+        interpretTraced(pState);
+    }
+    else if (pState->pPipeline && (pMiniArm->mode == MINIARM_INTERPRETER || pState->pCaches || pState->pPredictors) &&
+             !pState->memory.faulted)
+    {
+        interpretTimed(pState);
+    }
+    else if (pState->pPipeline && !pState->memory.faulted)
+    {
+        // the threaded handlers time the run too, translated code doesn't, neither predicts
+        interpretThreaded(pState);
+    }
+    else if ((pState->pCaches || pState->pPredictors) && !pState->memory.faulted)
+    {
+        interpret(pState);
+    }
+    else if (pState->pNative && !pState->pDebug && !pState->memory.pReplay && !pState->memory.faulted)
+    {
+        // breakpoints and watchpoints live in the decoded instructions the translation doesn't use,
+        // and it only counts instructions at the end of its run, too late for a replay log
+        runNative(pState);
+    }
+    else if (!pState->memory.faulted)
+    {
+        switch(pMiniArm->mode)
+        {
+        case MINIARM_INTERPRETER:
+            interpret(pState);
+            break;
+        case MINIARM_THREADED:
+            interpretThreaded(pState);
+            break;
+        case MINIARM_JIT:
+            runJit(pState);
+            break;
+        }
+    }
+
+    if (pState->memory.faulted)
+    {
+        return pState->memory.halted ? MINIARM_HALTED : MINIARM_FAULT;
+    }
+
+    if (pState->pDebug && pState->pDebug->stop != DEBUG_NONE)
+    {
+        return pState->pDebug->stop == DEBUG_BREAKPOINT ? MINIARM_BREAKPOINT : MINIARM_WATCHPOINT;
+    }
+
+    return pState->registers[PC] == pState->programSize ? MINIARM_HALTED : MINIARM_LIMIT;
+}
+
+// runs the instruction under the breakpoint at the PC on its own
+static int
+stepOverBreakpoint
+(
+    MiniArm *pMiniArm
+)
+{
+    CpuState *pState = &pMiniArm->state;
+    uint32_t  pc = pState->registers[PC];
+    uint64_t  limit = pState->limit;
+
+    setBreakpoint(pState, pc, false);
+    pState->limit = pState->instructions + 1;
+
+    int result = runMode(pMiniArm);
+
+    setBreakpoint(pState, pc, true);
+
+    if (result == MINIARM_LIMIT)
+    {
+        pState->limit = limit;
+    }
+
+    return result;
+}
+
+int
+runMiniArm
+(
+    MiniArm *pMiniArm,
+    uint64_t count
+)
+{
+    CpuState *pState = &pMiniArm->state;
+
+    setLimit(pState, count);
+
+    // a run resumed at a breakpoint doesn't stop there again right away
+    if (pState->pDebug && isBreakpoint(pState->pDebug, pState->registers[PC]) && !pState->memory.faulted &&
+        pState->registers[PC] != pState->programSize)
+    {
+        int result = stepOverBreakpoint(pMiniArm);
+
+        if (result != MINIARM_LIMIT || pState->instructions == pState->limit)
+        {
+            return result;
+        }
+    }
+
+    return runMode(pMiniArm);
+}
+
+// the same image at the same size, compared byte for byte
+static bool
+sameProgram
+(
+    const MiniArm *pFirst,
+    const MiniArm *pOther
+)
+{
+    const CpuState *pState = &pFirst->state;
+    const CpuState *pOtherState = &pOther->state;
+
+    return pState->programSize == pOtherState->programSize &&
+           pState->memory.size == pOtherState->memory.size &&
+           memcmp(pState->memory.pBytes, pOtherState->memory.pBytes, pState->programSize) == 0;
+}
+
+uint32_t
+getMiniArmLockstepLanes
+(
+    void
+)
+{
+    return LOCKSTEP_LANES;
+}
+
+int
+runMiniArmLockstep
+(
+    MiniArm *pMiniArms[],
+    uint32_t count,
+    uint64_t instructionCount,
+    int      results[]
+)
+{
+    for (uint32_t first = 0; first < count; first += LOCKSTEP_LANES)
+    {
+        uint32_t  end = count - first < LOCKSTEP_LANES ? count : first + LOCKSTEP_LANES;
+        CpuState *pStates[LOCKSTEP_LANES];
+        uint32_t  lanes = 0;
+
+        for (uint32_t index = first; index < end; index++)
+        {
+            setLimit(&pMiniArms[index]->state, instructionCount);
+
+            // the timing, cache and branch models, the statistics, traces and the debugger follow instructions one at a time
+            if (sameProgram(pMiniArms[first], pMiniArms[index]) && !pMiniArms[index]->state.pPipeline &&
+                !pMiniArms[index]->state.pCaches && !pMiniArms[index]->state.pPredictors &&
+                !pMiniArms[index]->state.pCounts &&
+                !pMiniArms[index]->state.pTracer && !pMiniArms[index]->state.pDebug &&
+                !pMiniArms[index]->state.memory.pReplay)
+            {
+                pStates[lanes++] = &pMiniArms[index]->state;
+            }
+        }
+
+        if (lanes > 1)
+        {
+            runLockstep(pStates, lanes);
+        }
+
+        // every instance finishes in its own mode from wherever the group left it
+        for (uint32_t index = first; index < end; index++)
+        {
+            results[index] = runMode(pMiniArms[index]);
+        }
+    }
+
+    return 0;
+}
+
+void
+setMiniArmTiming
+(
+    MiniArm *pMiniArm,
+    bool     enabled
+)
+{
+    if (enabled && !pMiniArm->state.pPipeline)
+    {
+        resetPipeline(&pMiniArm->pipeline);
+        pMiniArm->state.pPipeline = &pMiniArm->pipeline;
+    }
+    else if (!enabled)
+    {
+        pMiniArm->state.pPipeline = NULL;
+    }
+}
+
+int
+setMiniArmCaches
+(
+    MiniArm                  *pMiniArm,
+    const MiniArmCacheConfig  configs[]
+)
+{
+    Caches caches;
+
+    if (configs && createCaches(&caches, configs, pMiniArm->state.programSize) == -1)
+    {
+        return -1;
+    }
+
+    destroyCaches(&pMiniArm->caches);
+    pMiniArm->state.pCaches = NULL;
+
+    if (configs)
+    {
+        pMiniArm->caches = caches;
+        pMiniArm->state.pCaches = &pMiniArm->caches;
+    }
+
+    return 0;
+}
+
+void
+getMiniArmCacheStatistics
+(
+    const MiniArm          *pMiniArm,
+    MiniArmCacheStatistics  statistics[]
+)
+{
+    for (int level = 0; level < MINIARM_CACHE_LEVELS; level++)
+    {
+        statistics[level] = pMiniArm->caches.levels[level].statistics;
+    }
+}
+
+static uint64_t
+cacheMisses
+(
+    const MiniArmCacheCounts *pCounts
+)
+{
+    return pCounts->fetchMisses + pCounts->dataMisses;
+}
+
+// keeps the count instructions that missed most in order as it walks the image
+uint32_t
+getMiniArmCacheHotspots
+(
+    const MiniArm      *pMiniArm,
+    MiniArmCacheCounts  counts[],
+    uint32_t            count
+)
+{
+    const Caches *pCaches = &pMiniArm->caches;
+    uint32_t      filled = 0;
+
+    for (uint32_t word = 0; word < pCaches->words && pCaches->pCounts; word++)
+    {
+        MiniArmCacheCounts candidate = pCaches->pCounts[word];
+        uint32_t           position = filled;
+
+        if (cacheMisses(&candidate) == 0)
+        {
+            continue;
+        }
+
+        candidate.pc = word * 4;
+
+        while (position > 0 && cacheMisses(&counts[position - 1]) < cacheMisses(&candidate))
+        {
+            if (position < count)
+            {
+                counts[position] = counts[position - 1];
+            }
+
+            position--;
+        }
+
+        if (position < count)
+        {
+            counts[position] = candidate;
+            filled += filled < count;
+        }
+    }
+
+    return filled;
+}
+
+int
+setMiniArmPredictors
+(
+    MiniArm                      *pMiniArm,
+    const MiniArmPredictorConfig *pConfig
+)
+{
+    Predictors predictors;
+
+    if (pConfig && createPredictors(&predictors, pConfig, pMiniArm->state.programSize) == -1)
+    {
+        return -1;
+    }
+
+    destroyPredictors(&pMiniArm->predictors);
+    pMiniArm->state.pPredictors = NULL;
+
+    if (pConfig)
+    {
+        pMiniArm->predictors = predictors;
+        pMiniArm->state.pPredictors = &pMiniArm->predictors;
+    }
+
+    return 0;
+}
+
+void
+getMiniArmBranchStatistics
+(
+    const MiniArm           *pMiniArm,
+    MiniArmBranchStatistics *pStatistics
+)
+{
+    *pStatistics = pMiniArm->predictors.statistics;
+}
+
+static uint64_t
+branchMisses
+(
+    const MiniArmBranchCounts *pCounts,
+    int                        predictor
+)
+{
+    return pCounts->mispredictions[predictor] + pCounts->btbMisses;
+}
+
+// keeps the count branches predicted worst in order as it walks the image
+uint32_t
+getMiniArmBranchHotspots
+(
+    const MiniArm       *pMiniArm,
+    int                  predictor,
+    MiniArmBranchCounts  counts[],
+    uint32_t             count
+)
+{
+    const Predictors *pPredictors = &pMiniArm->predictors;
+    uint32_t          filled = 0;
+
+    if (predictor < 0 || predictor >= MINIARM_PREDICTORS)
+    {
+        return 0;
+    }
+
+    for (uint32_t word = 0; word < pPredictors->words && pPredictors->pCounts; word++)
+    {
+        MiniArmBranchCounts candidate = pPredictors->pCounts[word];
+        uint32_t            position = filled;
+
+        if (branchMisses(&candidate, predictor) == 0)
+        {
+            continue;
+        }
+
+        candidate.pc = word * 4;
+
+        while (position > 0 && branchMisses(&counts[position - 1], predictor) < branchMisses(&candidate, predictor))
+        {
+            if (position < count)
+            {
+                counts[position] = counts[position - 1];
+            }
+
+            position--;
+        }
+
+        if (position < count)
+        {
+            counts[position] = candidate;
+            filled += filled < count;
+        }
+    }
+
+    return filled;
+}
+
+int
+setMiniArmNative
+(
+    MiniArm           *pMiniArm,
+    const NativeImage *pNative
+)
+{
+    CpuState *pState = &pMiniArm->state;
+
+    if (pNative && pNative->size != pState->programSize)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pState->pNative = pNative;
+
+    // so that codeWritten() drops the translation when the image is written
+    for (uint32_t page = 0; pNative && page << PAGE_SHIFT < pNative->size; page++)
+    {
+        pState->memory.pPageFlags[page] |= PAGE_CODE;
+    }
+
+    return 0;
+}
+
+int
+setMiniArmBreakpoint
+(
+    MiniArm *pMiniArm,
+    uint32_t address,
+    bool     enabled
+)
+{
+    pMiniArm->state.pDebug = &pMiniArm->debug;
+    return setBreakpoint(&pMiniArm->state, address, enabled);
+}
+
+int
+setMiniArmWatchpoint
+(
+    MiniArm *pMiniArm,
+    uint32_t address,
+    uint32_t length,
+    bool     enabled
+)
+{
+    pMiniArm->state.pDebug = &pMiniArm->debug;
+    return setWatchpoint(&pMiniArm->state, address, length, enabled);
+}
+
+bool
+getMiniArmWatchpoint
+(
+    const MiniArm *pMiniArm,
+    uint32_t      *pAddress
+)
+{
+    const Debug *pDebug = pMiniArm->state.pDebug;
+
+    if (!pDebug || pDebug->stop != DEBUG_WATCHPOINT)
+    {
+        return false;
+    }
+
+    if (pAddress)
+    {
+        *pAddress = pDebug->watchAddress;
+    }
+
+    return true;
+}
+
+int
+mapMiniArmDevice
+(
+    MiniArm             *pMiniArm,
+    uint32_t             address,
+    uint32_t             length,
+    const MiniArmDevice *pDevice
+)
+{
+    return mapDevice(&pMiniArm->bus, &pMiniArm->state.memory, address, length, pDevice);
+}
+
+int
+mapMiniArmDevices
+(
+    MiniArm *pMiniArm,
+    FILE    *pOutput,
+    FILE    *pInput
+)
+{
+    return mapStandardDevices(&pMiniArm->bus, &pMiniArm->state.memory, pOutput, pInput);
+}
+
+void
+setMiniArmSemihosting
+(
+    MiniArm *pMiniArm,
+    FILE    *pOutput,
+    FILE    *pInput
+)
+{
+    pMiniArm->state.pOutput = pOutput;
+    pMiniArm->state.pInput = pInput;
+}
+
+bool
+getMiniArmExitStatus
+(
+    const MiniArm *pMiniArm,
+    uint32_t      *pStatus
+)
+{
+    if (pMiniArm->state.memory.halted && pStatus)
+    {
+        *pStatus = pMiniArm->state.memory.exitStatus;
+    }
+
+    return pMiniArm->state.memory.halted;
+}
+
+int
+startMiniArmTrace
+(
+    MiniArm    *pMiniArm,
+    const char *path
+)
+{
+    if (pMiniArm->state.pTracer)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    Tracer *pTracer = (Tracer *)aligned_alloc(_Alignof(Tracer), sizeof *pTracer);
+
+    if (!pTracer)
+    {
+        return -1;
+    }
+
+    if (startTrace(pTracer, &pMiniArm->state, path) == -1)
+    {
+        free(pTracer);
+        return -1;
+    }
+
+    pMiniArm->state.pTracer = pTracer;
+    return 0;
+}
+
+int
+stopMiniArmTrace
+(
+    MiniArm *pMiniArm
+)
+{
+    Tracer *pTracer = pMiniArm->state.pTracer;
+
+    if (!pTracer)
+    {
+        return 0;
+    }
+
+    int result = stopTrace(pTracer);
+    int error = errno;
+
+    pMiniArm->tracedInstructions += atomic_load(&pTracer->head) - pTracer->gaps;
+    pMiniArm->traceDropped += pTracer->dropped;
+    pMiniArm->state.pTracer = NULL;
+    free(pTracer);
+
+    errno = error;
+    return result;
+}
+
+int
+recordMiniArm
+(
+    MiniArm    *pMiniArm,
+    const char *path
+)
+{
+    if (pMiniArm->state.memory.pReplay)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    return startRecording(&pMiniArm->replay, &pMiniArm->state, path);
+}
+
+int
+replayMiniArm
+(
+    MiniArm    *pMiniArm,
+    const char *path
+)
+{
+    if (pMiniArm->state.memory.pReplay)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    return startReplay(&pMiniArm->replay, &pMiniArm->state, path);
+}
+
+int
+stopMiniArmReplay
+(
+    MiniArm *pMiniArm
+)
+{
+    return stopReplay(&pMiniArm->replay);
+}
+
+bool
+getMiniArmReplayDivergence
+(
+    const MiniArm *pMiniArm,
+    uint64_t      *pInstruction
+)
+{
+    if (pMiniArm->replay.diverged && pInstruction)
+    {
+        *pInstruction = pMiniArm->replay.divergence;
+    }
+
+    return pMiniArm->replay.diverged;
+}
+
+int
+getMiniArmExecutionStatistics
+(
+    const MiniArm              *pMiniArm,
+    MiniArmExecutionStatistics *pStatistics
+)
+{
+#ifdef MINIARM_STATS
+    summarizeCounts(pMiniArm->state.pCounts, pStatistics);
+    return 0;
+#else
+    (void)pMiniArm;
+    memset(pStatistics, 0, sizeof *pStatistics);
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+uint32_t
+getMiniArmRegister
+(
+    MiniArm *pMiniArm,
+    int      index
+)
+{
+    CpuState *pState = &pMiniArm->state;
+
+    if (index < 0 || index >= MINIARM_REGISTERS)
+    {
+        return 0;
+    }
+
+    if (index == CPSR)
+    {
+        materializeFlags(&pState->registers[CPSR], &pState->flags);
+    }
+
+    return pState->registers[index];
+}
+
+void
+setMiniArmRegister
+(
+    MiniArm *pMiniArm,
+    int      index,
+    uint32_t value
+)
+{
+    CpuState *pState = &pMiniArm->state;
+
+    if (index < 0 || index >= MINIARM_REGISTERS)
+    {
+        return;
+    }
+
+    if (index == CPSR)
+    {
+        writeFlags(&pState->registers[CPSR], &pState->flags, value);
+        return;
+    }
+
+    pState->registers[index] = value;
+}
+
+int
+readMiniArmMemory
+(
+    MiniArm *pMiniArm,
+    uint32_t address,
+    void    *pBuffer,
+    size_t   length
+)
+{
+    Memory *pMemory = &pMiniArm->state.memory;
+
+    if ((uint64_t)address + length > pMemory->size)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    memcpy(pBuffer, pMemory->pBytes + address, length);
+    return 0;
+}
+
+int
+writeMiniArmMemory
+(
+    MiniArm    *pMiniArm,
+    uint32_t    address,
+    const void *pBuffer,
+    size_t      length
+)
+{
+    Memory *pMemory = &pMiniArm->state.memory;
+
+    if ((uint64_t)address + length > pMemory->size)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    memcpy(pMemory->pBytes + address, pBuffer, length);
+    markRangeDirty(pMemory, address, length);
+    codeWritten(&pMiniArm->state, address, length);
+    return 0;
+}
+
+int
+snapshotMiniArm
+(
+    MiniArm *pMiniArm
+)
+{
+    return takeSnapshot(&pMiniArm->snapshot, &pMiniArm->state);
+}
+
+int
+restoreMiniArm
+(
+    MiniArm *pMiniArm
+)
+{
+    if (!pMiniArm->snapshot.pBytes)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    restoreSnapshot(&pMiniArm->snapshot, &pMiniArm->state);
+    return 0;
+}
+
+int
+checkpointMiniArm
+(
+    MiniArm    *pMiniArm,
+    const char *path
+)
+{
+    if (pMiniArm->checkpointWriter)
+    {
+        int result = finishCheckpoint(pMiniArm->checkpointWriter, false);
+
+        if (result == 1)
+        {
+            errno = EBUSY;
+            return -1;
+        }
+
+        // whether or not the last writer managed, this checkpoint replaces its file
+        pMiniArm->checkpointWriter = 0;
+    }
+
+    pid_t writer = startCheckpoint(&pMiniArm->state, path);
+
+    if (writer == -1)
+    {
+        return -1;
+    }
+
+    pMiniArm->checkpointWriter = writer;
+    return 0;
+}
+
+int
+waitMiniArmCheckpoint
+(
+    MiniArm *pMiniArm
+)
+{
+    if (!pMiniArm->checkpointWriter)
+    {
+        return 0;
+    }
+
+    int result = finishCheckpoint(pMiniArm->checkpointWriter, true);
+
+    pMiniArm->checkpointWriter = 0;
+    return result;
+}
+
+int
+resumeMiniArm
+(
+    MiniArm    *pMiniArm,
+    const char *path
+)
+{
+    if (pMiniArm->state.programSize || pMiniArm->state.instructions)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    return loadCheckpoint(&pMiniArm->state, path);
+}
+
+bool
+getMiniArmFault
+(
+    const MiniArm *pMiniArm,
+    uint32_t      *pAddress
+)
+{
+    const Memory *pMemory = &pMiniArm->state.memory;
+
+    // a halt stops the run like a fault does, but isn't one
+    if (pMemory->faulted && !pMemory->halted && pAddress)
+    {
+        *pAddress = pMemory->faultAddress;
+    }
+
+    return pMemory->faulted && !pMemory->halted;
+}
+
+void
+getMiniArmStatistics
+(
+    const MiniArm     *pMiniArm,
+    MiniArmStatistics *pStatistics
+)
+{
+    memset(pStatistics, 0, sizeof *pStatistics);
+    pStatistics->instructions = pMiniArm->state.instructions;
+    pStatistics->lockstepInstructions = pMiniArm->state.lockstepInstructions;
+    pStatistics->divergences = pMiniArm->state.divergences;
+    memcpy(pStatistics->fusions, pMiniArm->state.fusions, sizeof pStatistics->fusions);
+
+    if (pMiniArm->state.pPipeline)
+    {
+        pStatistics->cycles = pMiniArm->pipeline.cycles;
+        pStatistics->loadUseStalls = pMiniArm->pipeline.loadUseStalls;
+        pStatistics->flushCycles = pMiniArm->pipeline.flushCycles;
+        pStatistics->pipelineFlushes = pMiniArm->pipeline.flushes;
+    }
+
+    pStatistics->tracedInstructions = pMiniArm->tracedInstructions;
+    pStatistics->traceDropped = pMiniArm->traceDropped;
+
+    if (pMiniArm->state.pTracer)
+    {
+        pStatistics->tracedInstructions += atomic_load(&pMiniArm->state.pTracer->head) - pMiniArm->state.pTracer->gaps;
+        pStatistics->traceDropped += pMiniArm->state.pTracer->dropped;
+    }
+
+    if (pMiniArm->state.pJit)
+    {
+        const JitStatistics *pJitStatistics = &pMiniArm->state.pJit->statistics;
+
+        pStatistics->hits = pJitStatistics->hits;
+        pStatistics->misses = pJitStatistics->misses;
+        pStatistics->chained = pJitStatistics->chained;
+        pStatistics->invalidations = pJitStatistics->invalidations;
+        pStatistics->flushes = pJitStatistics->flushes;
+    }
+}
@@ -0,0 +1,157 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "native.h"
+
+void
+runNative
+(
+    CpuState *pState
+)
+{
+    uint32_t *registers = pState->registers;
+
+    while (registers[PC] != pState->programSize && !pState->memory.faulted &&
+           pState->instructions < pState->limit)
+    {
+        if (pState->pNative)
+        {
+            pState->pNative->run(pState, pState->limit - pState->instructions);
+
+            if (registers[PC] == pState->programSize || pState->memory.faulted ||
+                pState->instructions == pState->limit)
+            {
+                break;
+            }
+        }
+
+        // no block at the PC, a block past the limit or a stale translation, step it in the interpreter
+        const DecodedInstruction *pDecoded = fetchDecoded(&pState->decodeCache, &pState->memory, registers[PC]);
+        registers[PC] += 4;
+        pState->instructions++;
+        executeDecoded(pState, pDecoded);
+    }
+}
+
+static int
+usage
+(
+    const char *program
+)
+{
+    printf("Usage: %s [-n count] [-b] [-D]\n", program);
+    return 1;
+}
+
+int
+runNativeProgram
+(
+    const NativeImage *pNative,
+    int                argc,
+    char              *argv[]
+)
+{
+    bool     benchmark = false;
+    bool     devices = false;
+    uint64_t limit = 0;
+    char    *pEnd;
+    int      option;
+
+    while ((option = getopt(argc, argv, "n:bD")) != -1)
+    {
+        switch(option)
+        {
+        case 'n':
+            limit = strtoull(optarg, &pEnd, 0);
+
+            if (pEnd == optarg || *pEnd != '\0')
+            {
+                printf("Invalid instruction count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            benchmark = true;
+            break;
+        case 'D':
+            devices = true;
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    if (optind != argc)
+    {
+        return usage(argv[0]);
+    }
+
+    MiniArm *pMiniArm = createMiniArm(MINIARM_MEMORY_SIZE, MINIARM_INTERPRETER);
+
+    if (!pMiniArm)
+    {
+        perror("createMiniArm() failed");
+        return 1;
+    }
+
+    if (loadMiniArmImage(pMiniArm, pNative->pImage, pNative->size) == -1 ||
+        setMiniArmNative(pMiniArm, pNative) == -1)
+    {
+        perror("loadMiniArmImage() failed");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    setMiniArmSemihosting(pMiniArm, stdout, stdin);
+
+    if (devices && mapMiniArmDevices(pMiniArm, stdout, stdin) == -1)
+    {
+        perror("mapMiniArmDevices() failed");
+        destroyMiniArm(pMiniArm);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int result = runMiniArm(pMiniArm, limit);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double   seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    uint32_t registers[MINIARM_REGISTERS];
+    int      status = 0;
+
+    for (int index = 0; index < MINIARM_REGISTERS; index++)
+    {
+        registers[index] = getMiniArmRegister(pMiniArm, index);
+    }
+
+    dump(registers);
+
+    uint32_t faultAddress;
+    uint32_t exitStatus;
+
+    if (result == MINIARM_FAULT && getMiniArmFault(pMiniArm, &faultAddress))
+    {
+        fprintf(stderr, "Memory fault at 0x%08x\n", faultAddress);
+        status = 1;
+    }
+    else if (result == MINIARM_HALTED && getMiniArmExitStatus(pMiniArm, &exitStatus))
+    {
+        fprintf(stderr, "Program exited with status %u\n", exitStatus);
+        status = exitStatus & 0xFF;
+    }
+
+    if (benchmark)
+    {
+        MiniArmStatistics statistics;
+        getMiniArmStatistics(pMiniArm, &statistics);
+
+        fprintf(stderr, "%llu instructions in %.3fs (%.2f MIPS)\n", (unsigned long long)statistics.instructions,
+                seconds, statistics.instructions / seconds / 1e6);
+    }
+
+    destroyMiniArm(pMiniArm);
+    return status;
+}
@@ -0,0 +1,50 @@
+#include <string.h>
+#include "cache.h"
+#include "debug.h"
+#include "pipeline.h"
+
+void
+resetPipeline
+(
+    Pipeline *pPipeline
+)
+{
+    memset(pPipeline, 0, sizeof *pPipeline);
+    pPipeline->loadRegister = PIPELINE_NO_REGISTER;
+}
+
+void
+interpretTimed
+(
+    CpuState *pState
+)
+{
+    uint32_t *registers = pState->registers;
+    Pipeline *pPipeline = pState->pPipeline;
+
+    while (registers[PC] != pState->programSize && !pState->memory.faulted && 
+           pState->instructions < pState->limit && !pState->stopped) 
+    {
+        uint32_t                  pc = registers[PC];
+        const DecodedInstruction *pDecoded = fetchDecoded(&pState->decodeCache, &pState->memory, pc);
+
+        // the instruction under a breakpoint isn't timed until the run resumes
+        if (pDecoded->operation == BREAKPOINT)
+        {
+            stopAtBreakpoint(pState);
+            break;
+        }
+
+        if (pState->pCaches)
+        {
+            cacheFetch(pState->pCaches, pc);
+        }
+
+        registers[PC] += 4;
+        pState->instructions++;
+
+        bool executed = executeDecoded(pState, pDecoded);
+
+        retireTimed(pPipeline, pDecoded, executed, registers[PC] == pc + 4);
+    }
+}
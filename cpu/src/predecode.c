@@ -0,0 +1,453 @@
+#include "alu.h"
+#include "predecode.h"
+#include "threaded.h"
+
+uint32_t
+decode
+(
+    uint32_t instruction
+)
+{
+    uint32_t operation = UNDEFINED;
+
+    if ((instruction & MULT_MASK) == MUL)
+    {
+        operation = MUL;
+    }
+    else if ((instruction & SDT_MASK) == LDR)
+    {
+        operation = LDR;
+    }
+    else if ((instruction & SDT_MASK) == LDRB)
+    {
+        operation = LDRB;
+    }
+    else if ((instruction & SDT_MASK) == STR)
+    {
+        operation = STR;
+    }
+    else if ((instruction & SDT_MASK) == STRB)
+    {
+        operation = STRB;
+    }
+    else if ((instruction & DATA_MASK) == DATA)
+    {
+        operation = DATA;
+    }
+    else if ((instruction & BLOCK_MASK) == LDM)
+    {
+        operation = LDM;
+    }
+    else if ((instruction & BLOCK_MASK) == STM)
+    {
+        operation = STM;
+    }
+    else if ((instruction & BRANCH_MASK) == BRANCH)
+    {
+        operation = BRANCH;
+    }
+    else if ((instruction & SWI_MASK) == SWI)
+    {
+        operation = SWI;
+    }
+
+    return operation;
+}
+
+void
+predecode
+(
+    uint32_t            instruction,
+    DecodedInstruction *pDecoded
+)
+{
+    *pDecoded = (DecodedInstruction){0};
+
+    pDecoded->instruction = instruction;
+    pDecoded->operation = decode(instruction);
+    pDecoded->condition = bits(instruction, 31, 28);
+    pDecoded->rn = bits(instruction, 19, 16);
+    pDecoded->rd = bits(instruction, 15, 12);
+    pDecoded->rs = bits(instruction, 11, 8);
+    pDecoded->rm = bits(instruction, 3, 0);
+    pDecoded->alterCPSR = bit(instruction, 20);
+
+    switch(pDecoded->operation)
+    {
+    case DATA:
+        pDecoded->opcode = bits(instruction, 24, 21);
+        pDecoded->shiftType = bits(instruction, 6, 5);
+
+        if (bit(instruction, 25))
+        {
+            pDecoded->operand2 = OPERAND_IMMEDIATE;
+            pDecoded->shiftAmount = 2 * bits(instruction, 11, 8);
+            pDecoded->immediate = bits(instruction, 7, 0);
+
+            if (pDecoded->shiftAmount != 0)
+            {
+                pDecoded->immediate = rotateRight(pDecoded->immediate, pDecoded->shiftAmount);
+            }
+        }
+        else if (bit(instruction, 4))
+        {
+            pDecoded->operand2 = OPERAND_REGISTER_SHIFT;
+        }
+        else
+        {
+            pDecoded->operand2 = OPERAND_REGISTER;
+            pDecoded->shiftAmount = bits(instruction, 11, 7);
+        }
+
+        pDecoded->handler = HANDLER_DATA + (pDecoded->opcode * 2 + pDecoded->alterCPSR) * OPERAND2_VARIANT_COUNT;
+
+        if (pDecoded->operand2 == OPERAND_REGISTER)
+        {
+            pDecoded->handler += 1 + pDecoded->shiftType;
+        }
+        else if (pDecoded->operand2 == OPERAND_REGISTER_SHIFT)
+        {
+            pDecoded->handler += 5 + pDecoded->shiftType;
+        }
+        break;
+
+    case MUL:
+        pDecoded->accumulate = bit(instruction, 21);
+        pDecoded->handler = HANDLER_MUL + pDecoded->accumulate * 2 + pDecoded->alterCPSR;
+        break;
+
+    case LDR:
+    case LDRB:
+    case STR:
+    case STRB:
+        pDecoded->preindex = bit(instruction, 24);
+        pDecoded->up = bit(instruction, 23);
+        pDecoded->shiftType = bits(instruction, 6, 5);
+        pDecoded->shiftAmount = bits(instruction, 11, 7);
+
+        if (bit(instruction, 25))
+        {
+            pDecoded->operand2 = OPERAND_IMMEDIATE;
+            pDecoded->immediate = bits(instruction, 11, 0);
+        }
+        else
+        {
+            pDecoded->operand2 = OPERAND_REGISTER;
+        }
+
+        switch(pDecoded->operation)
+        {
+        case LDR:
+            pDecoded->handler = HANDLER_LDR_IMM + pDecoded->operand2;
+            break;
+        case LDRB:
+            pDecoded->handler = HANDLER_LDRB_IMM + pDecoded->operand2;
+            break;
+        case STR:
+            pDecoded->handler = HANDLER_STR_IMM + pDecoded->operand2;
+            break;
+        case STRB:
+            pDecoded->handler = HANDLER_STRB_IMM + pDecoded->operand2;
+            break;
+        }
+        break;
+
+    case LDM:
+    case STM:
+        // bit 20 is the load bit here, not S
+        pDecoded->alterCPSR = false;
+        pDecoded->preindex = bit(instruction, 24);
+        pDecoded->up = bit(instruction, 23);
+        pDecoded->writeback = bit(instruction, 21);
+        pDecoded->immediate = bits(instruction, 15, 0);
+        pDecoded->registerCount = __builtin_popcount(pDecoded->immediate);
+        pDecoded->handler = pDecoded->operation == LDM ? HANDLER_LDM : HANDLER_STM;
+        break;
+
+    case BRANCH:
+        pDecoded->link = bit(instruction, 24);
+        pDecoded->handler = pDecoded->link ? HANDLER_BL : HANDLER_B;
+
+        /* assembler assumes the PC is 2 instructions ahead of the current instruction
+           but we add only 4 because our PC is 1 instruction ahead since it's not pipelined */
+
+        pDecoded->immediate = arithmeticShiftRight(bits(instruction, 23, 0) << 8, 6) + 4;
+        break;
+
+    case SWI:
+        // the comment field is the number of the service called
+        pDecoded->alterCPSR = false;
+        pDecoded->immediate = bits(instruction, 23, 0);
+        pDecoded->handler = HANDLER_SWI;
+        break;
+    }
+
+    pDecoded->dispatch = pDecoded->handler;
+    pDecoded->valid = true;
+}
+
+int
+createDecodeCache
+(
+    DecodeCache *pCache,
+    uint64_t     memorySize
+)
+{
+    pCache->regionCount = (memorySize + (1u << DECODE_REGION_SHIFT) - 1) >> DECODE_REGION_SHIFT;
+    pCache->ppRegions = (DecodedInstruction **)allocateZeroed(pCache->regionCount * sizeof *pCache->ppRegions);
+    pCache->regionsUsed = 0;
+
+    if (!pCache->ppRegions)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+destroyDecodeCache
+(
+    DecodeCache *pCache
+)
+{
+    for (uint32_t region = 0; region < pCache->regionsUsed; region++)
+    {
+        freeZeroed(pCache->ppRegions[region], DECODE_REGION_ENTRIES * sizeof(DecodedInstruction));
+    }
+
+    freeZeroed(pCache->ppRegions, pCache->regionCount * sizeof *pCache->ppRegions);
+    pCache->ppRegions = NULL;
+    pCache->regionCount = 0;
+    pCache->regionsUsed = 0;
+}
+
+static void
+markBreakpoint
+(
+    const DecodeCache  *pCache,
+    uint32_t            address,
+    DecodedInstruction *pDecoded
+)
+{
+    for (uint32_t index = 0; index < pCache->breakpointCount; index++)
+    {
+        if (pCache->pBreakpoints[index] == address)
+        {
+            pDecoded->operation = BREAKPOINT;
+            pDecoded->handler = HANDLER_BREAKPOINT;
+            pDecoded->dispatch = HANDLER_BREAKPOINT;
+            pDecoded->condition = CONDITION_BREAKPOINT;
+            return;
+        }
+    }
+}
+
+#ifndef NO_FUSION
+// an immediate or a register shifted by nothing
+static bool
+plainOperand2
+(
+    const DecodedInstruction *pDecoded
+)
+{
+    return pDecoded->operand2 == OPERAND_IMMEDIATE ||
+           (pDecoded->operand2 == OPERAND_REGISTER && pDecoded->shiftType == LSL && pDecoded->shiftAmount == 0);
+}
+
+static bool
+readsRegister
+(
+    const DecodedInstruction *pDecoded,
+    uint32_t                  reg
+)
+{
+    bool readsFirst = pDecoded->opcode != MOV && pDecoded->opcode != MVN;
+
+    return (readsFirst && pDecoded->rn == reg) ||
+           (pDecoded->operand2 != OPERAND_IMMEDIATE && pDecoded->rm == reg) ||
+           (pDecoded->operand2 == OPERAND_REGISTER_SHIFT && pDecoded->rs == reg);
+}
+
+// the fused handler of a pair, the handler of the first instruction alone if it has none
+static uint16_t
+fusedHandler
+(
+    const DecodedInstruction *pFirst,
+    const DecodedInstruction *pSecond
+)
+{
+    if (pFirst->condition != AL)
+    {
+        return pFirst->handler;
+    }
+
+    if (pFirst->operation == DATA && pFirst->opcode >= TST && pFirst->opcode <= CMN && pFirst->alterCPSR &&
+        plainOperand2(pFirst) && pSecond->operation == BRANCH && pSecond->condition != AL)
+    {
+        return HANDLER_TST_IMM_B + (pFirst->opcode - TST) * 2 + (pFirst->operand2 != OPERAND_IMMEDIATE);
+    }
+
+    if (pFirst->operation == DATA && (pFirst->opcode == ADD || pFirst->opcode == SUB) &&
+        pFirst->operand2 == OPERAND_IMMEDIATE && pFirst->rd != PC &&
+        pSecond->operation == DATA && pSecond->opcode == CMP && pSecond->alterCPSR &&
+        pSecond->condition == AL && pSecond->rn == pFirst->rd && plainOperand2(pSecond))
+    {
+        return pFirst->opcode == ADD ? HANDLER_ADD_IMM_CMP : HANDLER_SUB_IMM_CMP;
+    }
+
+    if (pFirst->operation == LDR && pFirst->operand2 == OPERAND_IMMEDIATE && pFirst->rd != PC &&
+        pFirst->rn != PC && pSecond->operation == DATA && readsRegister(pSecond, pFirst->rd))
+    {
+        return HANDLER_LDR_IMM_USE;
+    }
+
+    return pFirst->handler;
+}
+
+// decodes the next entry along with a new one so the two can run as a pair, see threaded.h
+static void
+fuseDecoded
+(
+    const DecodeCache  *pCache,
+    Memory             *pMemory,
+    uint32_t            address,
+    DecodedInstruction *pFirst
+)
+{
+    DecodedInstruction *pSecond = pFirst + 1;
+    uint32_t            next = address + 4;
+
+    // a pair never spans pages, so it stays within the region too
+    if (next % PAGE_SIZE == 0 || !inMemory(pMemory, next, 4))
+    {
+        return;
+    }
+
+    if (!pSecond->valid)
+    {
+        predecode(load32(pMemory, next), pSecond);
+
+        if (pCache->breakpointCount)
+        {
+            markBreakpoint(pCache, next, pSecond);
+        }
+
+        // left invalid so its own first fetch still pairs it with the instruction after it
+        pSecond->valid = false;
+    }
+
+    pFirst->dispatch = fusedHandler(pFirst, pSecond);
+}
+#endif
+
+DecodedInstruction *
+fetchDecoded
+(
+    DecodeCache *pCache,
+    Memory      *pMemory,
+    uint32_t     address
+)
+{
+    uint32_t region = address >> DECODE_REGION_SHIFT;
+
+    if (!inMemory(pMemory, address - address % 4, 4))
+    {
+        memoryFault(pMemory, address);
+        predecode(FAULT_INSTRUCTION, &pCache->scratch);
+        return &pCache->scratch;
+    }
+
+    // misaligned fetches rotate the word in load32 so they can't share an entry
+    if (address % 4 != 0)
+    {
+        predecode(load32(pMemory, address), &pCache->scratch);
+        return &pCache->scratch;
+    }
+
+    if (!pCache->ppRegions[region])
+    {
+        pCache->ppRegions[region] = (DecodedInstruction *)allocateZeroed(DECODE_REGION_ENTRIES * sizeof(DecodedInstruction));
+
+        if (!pCache->ppRegions[region])
+        {
+            predecode(load32(pMemory, address), &pCache->scratch);
+            return &pCache->scratch;
+        }
+
+        if (region >= pCache->regionsUsed)
+        {
+            pCache->regionsUsed = region + 1;
+        }
+    }
+
+    DecodedInstruction *pDecoded = &pCache->ppRegions[region][address % (1u << DECODE_REGION_SHIFT) / 4];
+
+    if (!pDecoded->valid)
+    {
+        predecode(load32(pMemory, address), pDecoded);
+        pMemory->pPageFlags[address >> PAGE_SHIFT] |= PAGE_CODE;
+
+        if (pCache->breakpointCount)
+        {
+            markBreakpoint(pCache, address, pDecoded);
+        }
+
+#ifndef NO_FUSION
+        fuseDecoded(pCache, pMemory, address, pDecoded);
+#endif
+    }
+
+    return pDecoded;
+}
+
+void
+invalidateDecoded
+(
+    DecodeCache *pCache,
+    uint32_t     address,
+    uint32_t     length
+)
+{
+    uint64_t end = (uint64_t)address + length;
+
+    for (uint64_t word = address & ~3u; word < end; word += 4)
+    {
+        uint32_t region = word >> DECODE_REGION_SHIFT;
+
+        if (region < pCache->regionCount && pCache->ppRegions[region])
+        {
+            pCache->ppRegions[region][word % (1u << DECODE_REGION_SHIFT) / 4].valid = false;
+        }
+    }
+}
+
+// true for B and BL and for anything else that can leave a new PC, whether or not its condition passes
+bool
+writesProgramCounter
+(
+    const DecodedInstruction *pDecoded
+)
+{
+    switch(pDecoded->operation)
+    {
+    case DATA:
+        return aluWriteback(pDecoded->opcode) && pDecoded->rd == PC;
+    case MUL:
+        return pDecoded->rn == PC;
+    case LDR:
+    case LDRB:
+        return pDecoded->rn == PC || pDecoded->rd == PC;
+    case STR:
+    case STRB:
+        return pDecoded->rn == PC;
+    case LDM:
+        return (pDecoded->immediate >> PC & 1) || (pDecoded->writeback && pDecoded->rn == PC);
+    case STM:
+        return pDecoded->writeback && pDecoded->rn == PC;
+    case BRANCH:
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,163 @@
+#include <errno.h>
+#include <string.h>
+#include "predictor.h"
+
+// 2-bit saturating counters, taken from 2 up
+#define COUNTER_WEAKLY_NOT_TAKEN 1
+#define COUNTER_WEAKLY_TAKEN     2
+#define COUNTER_STRONGLY_TAKEN   3
+
+static bool
+powerOfTwo
+(
+    uint32_t value
+)
+{
+    return value && !(value & (value - 1));
+}
+
+int
+createPredictors
+(
+    Predictors                   *pPredictors,
+    const MiniArmPredictorConfig *pConfig,
+    uint32_t                      imageSize
+)
+{
+    memset(pPredictors, 0, sizeof *pPredictors);
+
+    if (!powerOfTwo(pConfig->bimodalEntries) || !powerOfTwo(pConfig->gshareEntries) ||
+        !powerOfTwo(pConfig->btbEntries) || pConfig->historyBits > 31)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pPredictors->words = (imageSize + 3) / 4;
+    pPredictors->pBimodal = (uint8_t *)malloc(pConfig->bimodalEntries);
+    pPredictors->pGshare = (uint8_t *)malloc(pConfig->gshareEntries);
+    pPredictors->pTargets = (BranchTarget *)calloc(pConfig->btbEntries, sizeof *pPredictors->pTargets);
+    pPredictors->pCounts = (MiniArmBranchCounts *)calloc(pPredictors->words ? pPredictors->words : 1,
+                                                         sizeof *pPredictors->pCounts);
+
+    if (!pPredictors->pBimodal || !pPredictors->pGshare || !pPredictors->pTargets || !pPredictors->pCounts)
+    {
+        destroyPredictors(pPredictors);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memset(pPredictors->pBimodal, COUNTER_WEAKLY_NOT_TAKEN, pConfig->bimodalEntries);
+    memset(pPredictors->pGshare, COUNTER_WEAKLY_NOT_TAKEN, pConfig->gshareEntries);
+    pPredictors->bimodalMask = pConfig->bimodalEntries - 1;
+    pPredictors->gshareMask = pConfig->gshareEntries - 1;
+    pPredictors->historyMask = (1u << pConfig->historyBits) - 1;
+    pPredictors->targetMask = pConfig->btbEntries - 1;
+    return 0;
+}
+
+void
+destroyPredictors
+(
+    Predictors *pPredictors
+)
+{
+    free(pPredictors->pBimodal);
+    free(pPredictors->pGshare);
+    free(pPredictors->pTargets);
+    free(pPredictors->pCounts);
+    memset(pPredictors, 0, sizeof *pPredictors);
+}
+
+static inline void
+train
+(
+    uint8_t *pCounter,
+    bool     taken
+)
+{
+    if (taken && *pCounter < COUNTER_STRONGLY_TAKEN)
+    {
+        (*pCounter)++;
+    }
+    else if (!taken && *pCounter > 0)
+    {
+        (*pCounter)--;
+    }
+}
+
+// next is the PC the instruction left behind, pc + 4 unless it branched
+void
+predictBranch
+(
+    Predictors               *pPredictors,
+    const DecodedInstruction *pDecoded,
+    uint32_t                  pc,
+    bool                      executed,
+    uint32_t                  next
+)
+{
+    MiniArmBranchStatistics *pStatistics = &pPredictors->statistics;
+    bool                     taken = executed && next != pc + 4;
+    bool                     conditional = pDecoded->condition != AL;
+
+    if (!taken && !writesProgramCounter(pDecoded))
+    {
+        if (conditional)
+        {
+            pStatistics->predicated++;
+            pStatistics->predicatedSkipped += !executed;
+        }
+
+        return;
+    }
+
+    // a branch outside the image is counted overall only
+    MiniArmBranchCounts  outside = { 0 };
+    MiniArmBranchCounts *pCounts = pc / 4 < pPredictors->words ? &pPredictors->pCounts[pc / 4] : &outside;
+
+    pCounts->executions++;
+    pCounts->taken += taken;
+
+    if (conditional)
+    {
+        uint8_t *pBimodal = &pPredictors->pBimodal[pc >> 2 & pPredictors->bimodalMask];
+        uint8_t *pGshare = &pPredictors->pGshare[((pc >> 2) ^ pPredictors->history) & pPredictors->gshareMask];
+        bool     predictions[MINIARM_PREDICTORS];
+
+        // the branch offset is relative to pc + 4, so any negative one goes backwards
+        predictions[MINIARM_PREDICTOR_BTFN] = pDecoded->operation == BRANCH && (int32_t)pDecoded->immediate < 0;
+        predictions[MINIARM_PREDICTOR_BIMODAL] = *pBimodal >= COUNTER_WEAKLY_TAKEN;
+        predictions[MINIARM_PREDICTOR_GSHARE] = *pGshare >= COUNTER_WEAKLY_TAKEN;
+
+        for (int predictor = 0; predictor < MINIARM_PREDICTORS; predictor++)
+        {
+            bool wrong = predictions[predictor] != taken;
+
+            pStatistics->mispredictions[predictor] += wrong;
+            pCounts->mispredictions[predictor] += wrong;
+        }
+
+        train(pBimodal, taken);
+        train(pGshare, taken);
+        pPredictors->history = (pPredictors->history << 1 | taken) & pPredictors->historyMask;
+        pStatistics->conditional++;
+        pStatistics->taken += taken;
+    }
+
+    if (taken)
+    {
+        // the low bit marks the entry valid, instructions are word aligned
+        BranchTarget *pTarget = &pPredictors->pTargets[pc >> 2 & pPredictors->targetMask];
+
+        pStatistics->transfers++;
+
+        if (pTarget->pc != (pc | 1) || pTarget->target != next)
+        {
+            pStatistics->btbMisses++;
+            pCounts->btbMisses++;
+            pTarget->pc = pc | 1;
+            pTarget->target = next;
+        }
+    }
+}
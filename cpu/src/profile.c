@@ -0,0 +1,202 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+#include "symbols.h"
+
+// how many labels and instructions the report lists
+#define PROFILE_TOP 20
+
+typedef struct Hotspot
+{
+    uint64_t samples;
+    uint32_t index;
+} Hotspot;
+
+int
+createProfile
+(
+    Profile *pProfile,
+    uint32_t interval,
+    uint64_t imageSize
+)
+{
+    memset(pProfile, 0, sizeof *pProfile);
+    pProfile->interval = interval ? interval : 1;
+    pProfile->words = (imageSize + 3) / 4;
+    pProfile->pCounts = (uint64_t *)calloc(pProfile->words ? pProfile->words : 1, sizeof *pProfile->pCounts);
+    return pProfile->pCounts ? 0 : -1;
+}
+
+void
+destroyProfile
+(
+    Profile *pProfile
+)
+{
+    free(pProfile->pCounts);
+    pProfile->pCounts = NULL;
+}
+
+int
+runProfiled
+(
+    MiniArm *pMiniArm,
+    uint64_t count,
+    Profile *pProfile
+)
+{
+    uint64_t remaining = count;
+
+    for (;;)
+    {
+        uint64_t slice = pProfile->interval;
+
+        if (count != 0 && remaining < slice)
+        {
+            slice = remaining;
+        }
+
+        if (slice == 0)
+        {
+            return MINIARM_LIMIT;
+        }
+
+        int result = runMiniArm(pMiniArm, slice);
+
+        if (result != MINIARM_LIMIT)
+        {
+            return result;
+        }
+
+        remaining -= count != 0 ? slice : 0;
+
+        // a slice cut short by the count isn't a full interval
+        if (slice == pProfile->interval)
+        {
+            uint32_t pc = getMiniArmRegister(pMiniArm, MINIARM_PC);
+
+            if (pc / 4 < pProfile->words)
+            {
+                pProfile->pCounts[pc / 4]++;
+            }
+            else
+            {
+                pProfile->outside++;
+            }
+
+            pProfile->samples++;
+        }
+    }
+}
+
+static int
+compareHotspots
+(
+    const void *pLeft,
+    const void *pRight
+)
+{
+    const Hotspot *pLeftHotspot = (const Hotspot *)pLeft;
+    const Hotspot *pRightHotspot = (const Hotspot *)pRight;
+
+    if (pLeftHotspot->samples != pRightHotspot->samples)
+    {
+        return pLeftHotspot->samples > pRightHotspot->samples ? -1 : 1;
+    }
+
+    return pLeftHotspot->index < pRightHotspot->index ? -1 : pLeftHotspot->index > pRightHotspot->index;
+}
+
+/* The hottest labels, each covering the code up to the next label, then
+   the hottest instructions. Instruction counts are estimated as samples
+   times the interval. */
+int
+printProfile
+(
+    const Profile *pProfile,
+    const char    *symbolPath,
+    FILE          *output
+)
+{
+    Symbol  *pSymbols = NULL;
+    uint32_t symbolCount = 0;
+
+    if (symbolPath && loadSymbols(symbolPath, &pSymbols, &symbolCount) == -1)
+    {
+        return -1;
+    }
+
+    // one more entry for code before the first label, or the whole image without symbols
+    Hotspot *pLabels = (Hotspot *)calloc(symbolCount + 1, sizeof *pLabels);
+    Hotspot *pWords = (Hotspot *)calloc(pProfile->words ? pProfile->words : 1, sizeof *pWords);
+
+    if (!pLabels || !pWords)
+    {
+        free(pLabels);
+        free(pWords);
+        freeSymbols(pSymbols, symbolCount);
+        return -1;
+    }
+
+    for (uint32_t symbol = 0; symbol <= symbolCount; symbol++)
+    {
+        pLabels[symbol].index = symbol;
+    }
+
+    for (uint32_t word = 0; word < pProfile->words; word++)
+    {
+        pWords[word] = (Hotspot){ pProfile->pCounts[word], word };
+        pLabels[findSymbol(pSymbols, symbolCount, word * 4)].samples += pProfile->pCounts[word];
+    }
+
+    qsort(pLabels, symbolCount + 1, sizeof *pLabels, compareHotspots);
+    qsort(pWords, pProfile->words, sizeof *pWords, compareHotspots);
+
+    double total = pProfile->samples ? pProfile->samples : 1;
+
+    fprintf(output, "profile: %llu samples, one every %u instructions\n", (unsigned long long)pProfile->samples,
+            pProfile->interval);
+
+    if (symbolCount > 0)
+    {
+        fprintf(output, "%14s %7s  %s\n", "instructions", "%", "label");
+
+        for (uint32_t rank = 0; rank < PROFILE_TOP && rank <= symbolCount && pLabels[rank].samples; rank++)
+        {
+            uint32_t symbol = pLabels[rank].index;
+
+            fprintf(output, "%14llu %6.2f%%  %s\n", (unsigned long long)(pLabels[rank].samples * pProfile->interval),
+                    100.0 * pLabels[rank].samples / total, symbol < symbolCount ? pSymbols[symbol].pName : "(no label)");
+        }
+    }
+
+    fprintf(output, "%14s %7s  %s\n", "instructions", "%", "address");
+
+    for (uint32_t rank = 0; rank < PROFILE_TOP && rank < pProfile->words && pWords[rank].samples; rank++)
+    {
+        uint32_t address = pWords[rank].index * 4;
+        uint32_t symbol = findSymbol(pSymbols, symbolCount, address);
+
+        fprintf(output, "%14llu %6.2f%%  0x%08x", (unsigned long long)(pWords[rank].samples * pProfile->interval),
+                100.0 * pWords[rank].samples / total, address);
+
+        if (symbol < symbolCount)
+        {
+            fprintf(output, "  %s+0x%x", pSymbols[symbol].pName, address - pSymbols[symbol].address);
+        }
+
+        fprintf(output, "\n");
+    }
+
+    if (pProfile->outside)
+    {
+        fprintf(output, "%14llu %6.2f%%  beyond the image\n", (unsigned long long)(pProfile->outside * pProfile->interval),
+                100.0 * pProfile->outside / total);
+    }
+
+    free(pLabels);
+    free(pWords);
+    freeSymbols(pSymbols, symbolCount);
+    return 0;
+}
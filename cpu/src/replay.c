@@ -0,0 +1,505 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+
+#define REPLAY_HEADER_BYTES 24
+
+// a varint of a 64-bit count takes up to 10 bytes
+#define REPLAY_EVENT_BYTES  (1 + 10 + 5 + 5)
+
+static uint8_t *
+putVarint
+(
+    uint8_t *pOutput,
+    uint64_t value
+)
+{
+    while (value >= 0x80)
+    {
+        *pOutput++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+
+    *pOutput++ = (uint8_t)value;
+    return pOutput;
+}
+
+static uint8_t *
+putWord
+(
+    uint8_t *pOutput,
+    uint64_t value
+)
+{
+    for (int byte = 0; byte < 8; byte++)
+    {
+        *pOutput++ = (uint8_t)(value >> 8 * byte);
+    }
+
+    return pOutput;
+}
+
+// false when the log ends first
+static bool
+getVarint
+(
+    const Replay *pReplay,
+    size_t       *pOffset,
+    uint64_t     *pValue
+)
+{
+    uint64_t value = 0;
+
+    for (uint32_t shift = 0; *pOffset < pReplay->size && shift < 64; shift += 7)
+    {
+        uint8_t byte = pReplay->pEvents[(*pOffset)++];
+
+        value |= (uint64_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *pValue = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint64_t
+getWord
+(
+    const uint8_t *pInput
+)
+{
+    uint64_t value = 0;
+
+    for (int byte = 0; byte < 8; byte++)
+    {
+        value |= (uint64_t)pInput[byte] << 8 * byte;
+    }
+
+    return value;
+}
+
+// only ever compared with a hash of the same kind of host
+static uint64_t
+mixWord
+(
+    uint64_t hash,
+    uint64_t word
+)
+{
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+    return hash ^ hash >> 29;
+}
+
+// the registers, the instruction count and each page ever written, the loaded image among them
+static uint64_t
+stateHash
+(
+    const CpuState *pState
+)
+{
+    const Memory *pMemory = &pState->memory;
+    uint64_t      hash = pMemory->size;
+
+    for (int index = 0; index < CPSR; index++)
+    {
+        hash = mixWord(hash, pState->registers[index]);
+    }
+
+    hash = mixWord(hash, applyFlags(pState->registers[CPSR], &pState->flags));
+    hash = mixWord(hash, pState->instructions);
+
+    uint64_t pages = pMemory->size >> PAGE_SHIFT;
+
+    for (uint32_t chunk = 0; chunk < WRITTEN_CHUNKS; chunk++)
+    {
+        if (!(pMemory->writtenChunks[chunk / 64] & 1ull << chunk % 64))
+        {
+            continue;
+        }
+
+        uint64_t first = (uint64_t)chunk << WRITTEN_CHUNK_SHIFT;
+        uint64_t end = first + (1u << WRITTEN_CHUNK_SHIFT);
+
+        for (uint64_t page = first; page < end && page < pages; page++)
+        {
+            if (!(pMemory->pPageFlags[page] & PAGE_WRITTEN))
+            {
+                continue;
+            }
+
+            const uint8_t *pPage = pMemory->pBytes + (page << PAGE_SHIFT);
+
+            hash = mixWord(hash, page);
+
+            for (uint32_t offset = 0; offset < PAGE_SIZE; offset += 8)
+            {
+                uint64_t word;
+
+                memcpy(&word, pPage + offset, sizeof word);
+                hash = mixWord(hash, word);
+            }
+        }
+    }
+
+    return hash;
+}
+
+// the tag and count of the event at next, REPLAY_END after the last, scanEvents() left only whole ones
+static void
+readEvent
+(
+    Replay *pReplay
+)
+{
+    uint64_t elapsed = 0;
+
+    if (pReplay->next >= pReplay->size)
+    {
+        pReplay->kind = REPLAY_END;
+        pReplay->at = pReplay->end;
+        return;
+    }
+
+    pReplay->kind = pReplay->pEvents[pReplay->next++];
+    getVarint(pReplay, &pReplay->next, &elapsed);
+    pReplay->at += elapsed;
+}
+
+static bool
+diverge
+(
+    Replay *pReplay
+)
+{
+    if (!pReplay->diverged)
+    {
+        pReplay->diverged = true;
+        pReplay->divergence = pReplay->pState->instructions;
+    }
+
+    return false;
+}
+
+/* Finds where the log ends, its end event or the end of its last whole
+   event, so a replay knows up front where to stop. A log truncated in an
+   event drops that event. */
+static int
+scanEvents
+(
+    Replay *pReplay
+)
+{
+    size_t   offset = REPLAY_HEADER_BYTES;
+    uint64_t at = pReplay->pState->instructions;
+
+    pReplay->end = UINT64_MAX;
+
+    while (offset < pReplay->size)
+    {
+        size_t   start = offset;
+        uint8_t  kind = pReplay->pEvents[offset++];
+        uint64_t elapsed;
+        uint64_t first;
+        uint64_t second;
+        bool     whole;
+
+        if (!getVarint(pReplay, &offset, &elapsed))
+        {
+            pReplay->size = start;
+            break;
+        }
+
+        at += elapsed;
+
+        switch(kind)
+        {
+        case REPLAY_LOAD:
+            whole = getVarint(pReplay, &offset, &first) && getVarint(pReplay, &offset, &second);
+            break;
+        case REPLAY_READ:
+            whole = getVarint(pReplay, &offset, &first) && first <= pReplay->size - offset;
+            offset += whole ? first : 0;
+            break;
+        case REPLAY_END:
+            whole = pReplay->size - offset >= 8;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (!whole)
+        {
+            pReplay->size = start;
+            break;
+        }
+
+        if (kind == REPLAY_END)
+        {
+            pReplay->end = at;
+            pReplay->endHash = getWord(pReplay->pEvents + offset);
+            pReplay->size = start;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void
+releaseReplay
+(
+    Replay *pReplay
+)
+{
+    free(pReplay->pEvents);
+    pReplay->pEvents = NULL;
+    pReplay->pLog = NULL;
+    pReplay->pState->memory.pReplay = NULL;
+}
+
+int
+startRecording
+(
+    Replay     *pReplay,
+    CpuState   *pState,
+    const char *path
+)
+{
+    memset(pReplay, 0, sizeof *pReplay);
+    pReplay->pState = pState;
+    pReplay->recorded = pState->instructions;
+    pReplay->pLog = fopen(path, "wb");
+
+    if (!pReplay->pLog)
+    {
+        return -1;
+    }
+
+    // stdio's buffer takes the events, so recording costs a few stores per input
+    setvbuf(pReplay->pLog, NULL, _IOFBF, 1 << 16);
+
+    uint8_t header[REPLAY_HEADER_BYTES] = REPLAY_MAGIC;
+
+    header[4] = REPLAY_VERSION;
+    putWord(putWord(header + 8, pState->memory.size), stateHash(pState));
+
+    if (fwrite(header, 1, sizeof header, pReplay->pLog) != sizeof header)
+    {
+        int error = errno ? errno : EIO;
+
+        fclose(pReplay->pLog);
+        pReplay->pLog = NULL;
+        errno = error;
+        return -1;
+    }
+
+    pState->memory.pReplay = pReplay;
+    return 0;
+}
+
+int
+startReplay
+(
+    Replay     *pReplay,
+    CpuState   *pState,
+    const char *path
+)
+{
+    memset(pReplay, 0, sizeof *pReplay);
+    pReplay->pState = pState;
+    pReplay->replaying = true;
+
+    FILE *pLog = fopen(path, "rb");
+
+    if (!pLog)
+    {
+        return -1;
+    }
+
+    long     size = fseek(pLog, 0, SEEK_END) == 0 ? ftell(pLog) : -1;
+    uint8_t *pEvents = size >= REPLAY_HEADER_BYTES ? (uint8_t *)malloc(size) : NULL;
+    bool     read = pEvents && fseek(pLog, 0, SEEK_SET) == 0 && fread(pEvents, 1, size, pLog) == (size_t)size;
+
+    fclose(pLog);
+
+    if (!read)
+    {
+        free(pEvents);
+        errno = size < REPLAY_HEADER_BYTES ? EINVAL : pEvents ? EIO : ENOMEM;
+        return -1;
+    }
+
+    pReplay->pEvents = pEvents;
+    pReplay->size = size;
+
+    // a log of another image, RAM size or starting point would diverge at once or, worse, later
+    if (memcmp(pReplay->pEvents, REPLAY_MAGIC, 4) != 0 || pReplay->pEvents[4] != REPLAY_VERSION ||
+        getWord(pReplay->pEvents + 8) != pState->memory.size || getWord(pReplay->pEvents + 16) != stateHash(pState) ||
+        scanEvents(pReplay) == -1)
+    {
+        free(pReplay->pEvents);
+        pReplay->pEvents = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+
+    pReplay->next = REPLAY_HEADER_BYTES;
+    pReplay->at = pState->instructions;
+    readEvent(pReplay);
+
+    pState->memory.pReplay = pReplay;
+    return 0;
+}
+
+int
+stopReplay
+(
+    Replay *pReplay
+)
+{
+    CpuState *pState = pReplay->pState;
+
+    if (!pState || !pState->memory.pReplay)
+    {
+        return 0;
+    }
+
+    if (pReplay->replaying)
+    {
+        bool stopped = pState->memory.faulted || pState->registers[PC] == pState->programSize;
+
+        // a replay that got as far as the recording has to end in its state, one that ended short went another way
+        if (pState->instructions == pReplay->end && !pReplay->diverged &&
+            (pReplay->kind != REPLAY_END || stateHash(pState) != pReplay->endHash))
+        {
+            diverge(pReplay);
+        }
+        else if (stopped && pState->instructions < pReplay->end && pReplay->end != UINT64_MAX)
+        {
+            diverge(pReplay);
+        }
+
+        releaseReplay(pReplay);
+        return 0;
+    }
+
+    uint8_t  event[REPLAY_EVENT_BYTES];
+    uint8_t *pOutput = event;
+
+    *pOutput++ = REPLAY_END;
+    pOutput = putVarint(pOutput, pState->instructions - pReplay->recorded);
+    pOutput = putWord(pOutput, stateHash(pState));
+
+    fwrite(event, 1, pOutput - event, pReplay->pLog);
+
+    int error = ferror(pReplay->pLog) ? EIO : 0;
+
+    if (fclose(pReplay->pLog) != 0 && !error)
+    {
+        error = errno;
+    }
+
+    releaseReplay(pReplay);
+
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+bool
+replayLoad
+(
+    Replay   *pReplay,
+    uint32_t  address,
+    uint32_t *pValue
+)
+{
+    uint64_t offset;
+    uint64_t value;
+
+    if (pReplay->diverged || pReplay->kind != REPLAY_LOAD || pReplay->at != pReplay->pState->instructions ||
+        !getVarint(pReplay, &pReplay->next, &offset) || !getVarint(pReplay, &pReplay->next, &value) ||
+        offset != address - DEVICE_BASE)
+    {
+        return diverge(pReplay);
+    }
+
+    *pValue = (uint32_t)value;
+    readEvent(pReplay);
+    return true;
+}
+
+bool
+replayRead
+(
+    Replay   *pReplay,
+    uint8_t  *pBuffer,
+    uint32_t  length,
+    uint32_t *pCount
+)
+{
+    uint64_t count;
+
+    if (pReplay->diverged || pReplay->kind != REPLAY_READ || pReplay->at != pReplay->pState->instructions ||
+        !getVarint(pReplay, &pReplay->next, &count) || count > length)
+    {
+        return diverge(pReplay);
+    }
+
+    memcpy(pBuffer, pReplay->pEvents + pReplay->next, count);
+    pReplay->next += count;
+    *pCount = (uint32_t)count;
+    readEvent(pReplay);
+    return true;
+}
+
+void
+recordLoad
+(
+    Replay  *pReplay,
+    uint32_t address,
+    uint32_t value
+)
+{
+    uint8_t  event[REPLAY_EVENT_BYTES];
+    uint8_t *pOutput = event;
+
+    *pOutput++ = REPLAY_LOAD;
+    pOutput = putVarint(pOutput, pReplay->pState->instructions - pReplay->recorded);
+    pOutput = putVarint(pOutput, address - DEVICE_BASE);
+    pOutput = putVarint(pOutput, value);
+
+    // a write error sticks to the stream and fails stopReplay()
+    fwrite(event, 1, pOutput - event, pReplay->pLog);
+    pReplay->recorded = pReplay->pState->instructions;
+}
+
+void
+recordRead
+(
+    Replay        *pReplay,
+    const uint8_t *pBuffer,
+    uint32_t       count
+)
+{
+    uint8_t  event[REPLAY_EVENT_BYTES];
+    uint8_t *pOutput = event;
+
+    *pOutput++ = REPLAY_READ;
+    pOutput = putVarint(pOutput, pReplay->pState->instructions - pReplay->recorded);
+    pOutput = putVarint(pOutput, count);
+
+    fwrite(event, 1, pOutput - event, pReplay->pLog);
+    fwrite(pBuffer, 1, count, pReplay->pLog);
+    pReplay->recorded = pReplay->pState->instructions;
+}
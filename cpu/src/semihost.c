@@ -0,0 +1,116 @@
+#include "semihost.h"
+#include "miniarm.h"
+#include "replay.h"
+
+// a range the guest names, faulting at its start unless all of it is RAM
+static bool
+guestRange
+(
+    Memory  *pMemory,
+    uint32_t address,
+    uint32_t length
+)
+{
+    if (!inMemory(pMemory, address, length))
+    {
+        memoryFault(pMemory, address);
+        return false;
+    }
+
+    return true;
+}
+
+// the pages of a write made by a service, true when a watchpoint stops the run
+static bool
+serviceWritten
+(
+    CpuState *pState,
+    uint32_t  address,
+    uint32_t  length
+)
+{
+    return length && markRangeDirty(&pState->memory, address, length) && storeWritten(pState, address, length);
+}
+
+bool
+semihost
+(
+    CpuState *pState,
+    uint32_t  service
+)
+{
+    uint32_t *registers = pState->registers;
+    Memory   *pMemory = &pState->memory;
+    uint8_t  *pBytes = pMemory->pBytes;
+    uint32_t  length = registers[2];
+    uint32_t  result = UINT32_MAX;
+    bool      watched = false;
+
+    switch(service)
+    {
+    case MINIARM_SERVICE_EXIT:
+        memoryHalt(pMemory, registers[0]);
+        return false;
+    case MINIARM_SERVICE_WRITE:
+        if (pState->pOutput && guestRange(pMemory, registers[0], registers[1]))
+        {
+            result = fwrite(pBytes + registers[0], 1, registers[1], pState->pOutput);
+        }
+        break;
+    case MINIARM_SERVICE_READ:
+        if (pState->pInput && guestRange(pMemory, registers[0], registers[1]))
+        {
+            Replay *pReplay = pMemory->pReplay;
+
+            if (pReplay && pReplay->replaying)
+            {
+                if (!replayRead(pReplay, pBytes + registers[0], registers[1], &result))
+                {
+                    memoryFault(pMemory, registers[0]);
+                    break;
+                }
+            }
+            else
+            {
+                result = fread(pBytes + registers[0], 1, registers[1], pState->pInput);
+
+                if (pReplay)
+                {
+                    recordRead(pReplay, pBytes + registers[0], result);
+                }
+            }
+
+            watched = serviceWritten(pState, registers[0], result);
+        }
+        break;
+    case MINIARM_SERVICE_MEMCPY:
+        if (guestRange(pMemory, registers[1], length) && guestRange(pMemory, registers[0], length))
+        {
+            memmove(pBytes + registers[0], pBytes + registers[1], length);
+            watched = serviceWritten(pState, registers[0], length);
+        }
+
+        result = registers[0];
+        break;
+    case MINIARM_SERVICE_MEMSET:
+        if (guestRange(pMemory, registers[0], length))
+        {
+            memset(pBytes + registers[0], (uint8_t)registers[1], length);
+            watched = serviceWritten(pState, registers[0], length);
+        }
+
+        result = registers[0];
+        break;
+    case MINIARM_SERVICE_MEMCMP:
+        if (guestRange(pMemory, registers[0], length) && guestRange(pMemory, registers[1], length))
+        {
+            int difference = memcmp(pBytes + registers[0], pBytes + registers[1], length);
+
+            result = (difference > 0) - (difference < 0);
+        }
+        break;
+    }
+
+    registers[0] = result;
+    return watched;
+}
@@ -0,0 +1,128 @@
+#include <errno.h>
+#include <string.h>
+#include "native.h"
+#include "snapshot.h"
+
+static void
+copyPage
+(
+    uint8_t       *pTo,
+    const uint8_t *pFrom,
+    uint32_t       page
+)
+{
+    uint64_t address = (uint64_t)page << PAGE_SHIFT;
+
+    memcpy(pTo + address, pFrom + address, PAGE_SIZE);
+}
+
+int
+takeSnapshot
+(
+    Snapshot *pSnapshot,
+    CpuState *pState
+)
+{
+    Memory  *pMemory = &pState->memory;
+    uint32_t pages = pMemory->size >> PAGE_SHIFT;
+
+    if (!pSnapshot->pBytes)
+    {
+        pSnapshot->pBytes = (uint8_t *)allocateZeroed(pMemory->size);
+        pSnapshot->size = pMemory->size;
+        pMemory->pDirtyPages = (uint32_t *)allocateZeroed(pages * sizeof *pMemory->pDirtyPages);
+
+        if (!pSnapshot->pBytes || !pMemory->pDirtyPages)
+        {
+            destroySnapshot(pSnapshot, pMemory);
+            errno = ENOMEM;
+            return -1;
+        }
+
+        pMemory->dirtyCount = 0;
+
+        // a page that was never written is zero in both
+        for (uint32_t page = 0; page < pages; page++)
+        {
+            if (pMemory->pPageFlags[page] & PAGE_DIRTY)
+            {
+                copyPage(pSnapshot->pBytes, pMemory->pBytes, page);
+                pMemory->pPageFlags[page] &= ~PAGE_DIRTY;
+            }
+        }
+    }
+    else
+    {
+        // the rest of the copy still matches RAM
+        for (uint32_t index = 0; index < pMemory->dirtyCount; index++)
+        {
+            copyPage(pSnapshot->pBytes, pMemory->pBytes, pMemory->pDirtyPages[index]);
+            pMemory->pPageFlags[pMemory->pDirtyPages[index]] &= ~PAGE_DIRTY;
+        }
+
+        pMemory->dirtyCount = 0;
+    }
+
+    memcpy(pSnapshot->registers, pState->registers, sizeof pSnapshot->registers);
+    pSnapshot->flags = pState->flags;
+    pSnapshot->programSize = pState->programSize;
+    pSnapshot->instructions = pState->instructions;
+    pSnapshot->faulted = pMemory->faulted;
+    pSnapshot->faultAddress = pMemory->faultAddress;
+    pSnapshot->halted = pMemory->halted;
+    pSnapshot->exitStatus = pMemory->exitStatus;
+    pSnapshot->pNative = pState->pNative;
+    return 0;
+}
+
+void
+restoreSnapshot
+(
+    const Snapshot *pSnapshot,
+    CpuState       *pState
+)
+{
+    Memory *pMemory = &pState->memory;
+
+    for (uint32_t index = 0; index < pMemory->dirtyCount; index++)
+    {
+        uint32_t page = pMemory->pDirtyPages[index];
+        uint64_t address = (uint64_t)page << PAGE_SHIFT;
+
+        copyPage(pMemory->pBytes, pSnapshot->pBytes, page);
+        pMemory->pPageFlags[page] &= ~PAGE_DIRTY;
+        codeWritten(pState, address, PAGE_SIZE);
+
+        // codeWritten() dropped the translation, which the copied back image matches again
+        if (pSnapshot->pNative && address < pSnapshot->pNative->size)
+        {
+            pMemory->pPageFlags[page] |= PAGE_CODE;
+        }
+    }
+
+    pMemory->dirtyCount = 0;
+
+    memcpy(pState->registers, pSnapshot->registers, sizeof pState->registers);
+    pState->flags = pSnapshot->flags;
+    pState->programSize = pSnapshot->programSize;
+    pState->instructions = pSnapshot->instructions;
+    pState->pNative = pSnapshot->pNative;
+    pMemory->faulted = pSnapshot->faulted;
+    pMemory->faultAddress = pSnapshot->faultAddress;
+    pMemory->halted = pSnapshot->halted;
+    pMemory->exitStatus = pSnapshot->exitStatus;
+}
+
+void
+destroySnapshot
+(
+    Snapshot *pSnapshot,
+    Memory   *pMemory
+)
+{
+    freeZeroed(pSnapshot->pBytes, pSnapshot->size);
+    freeZeroed(pMemory->pDirtyPages, (pMemory->size >> PAGE_SHIFT) * sizeof *pMemory->pDirtyPages);
+    memset(pSnapshot, 0, sizeof *pSnapshot);
+    pMemory->pDirtyPages = NULL;
+    pMemory->dirtyCount = 0;
+}
@@ -0,0 +1,75 @@
+#include <string.h>
+#include "stats.h"
+
+void
+summarizeCounts
+(
+    const ExecutionCounts      *pCounts,
+    MiniArmExecutionStatistics *pStatistics
+)
+{
+    memset(pStatistics, 0, sizeof *pStatistics);
+
+    for (uint32_t handler = 0; handler < HANDLER_COUNT; handler++)
+    {
+        uint64_t executed = pCounts->executed[handler];
+        uint64_t skipped = pCounts->skipped[handler];
+
+        pStatistics->instructions += executed + skipped;
+        pStatistics->conditionFailed += skipped;
+
+        // data processing handlers come in blocks of one opcode
+        if (handler >= HANDLER_DATA)
+        {
+            pStatistics->dataProcessing += executed;
+            pStatistics->opcodes[(handler - HANDLER_DATA) / (2 * OPERAND2_VARIANT_COUNT)] += executed;
+            continue;
+        }
+
+        switch(handler)
+        {
+        case HANDLER_MUL:
+        case HANDLER_MULS:
+        case HANDLER_MLA:
+        case HANDLER_MLAS:
+            pStatistics->multiplies += executed;
+            break;
+        case HANDLER_LDR_IMM:
+        case HANDLER_LDR_REG:
+            pStatistics->wordLoads += executed;
+            break;
+        case HANDLER_LDRB_IMM:
+        case HANDLER_LDRB_REG:
+            pStatistics->byteLoads += executed;
+            break;
+        case HANDLER_STR_IMM:
+        case HANDLER_STR_REG:
+            pStatistics->wordStores += executed;
+            break;
+        case HANDLER_STRB_IMM:
+        case HANDLER_STRB_REG:
+            pStatistics->byteStores += executed;
+            break;
+        case HANDLER_LDM:
+            pStatistics->blockLoads += executed;
+            break;
+        case HANDLER_STM:
+            pStatistics->blockStores += executed;
+            break;
+        case HANDLER_B:
+        case HANDLER_BL:
+            pStatistics->takenBranches += executed;
+            pStatistics->untakenBranches += skipped;
+            break;
+        case HANDLER_SWI:
+            pStatistics->serviceCalls += executed;
+            break;
+        default:
+            pStatistics->undefined += executed;
+            break;
+        }
+    }
+
+    pStatistics->blockWordsLoaded = pCounts->blockWords[0];
+    pStatistics->blockWordsStored = pCounts->blockWords[1];
+}
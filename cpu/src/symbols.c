@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "symbols.h"
+
+static int
+compareSymbols
+(
+    const void *pLeft,
+    const void *pRight
+)
+{
+    const Symbol *pLeftSymbol = (const Symbol *)pLeft;
+    const Symbol *pRightSymbol = (const Symbol *)pRight;
+
+    return pLeftSymbol->address < pRightSymbol->address ? -1 : pLeftSymbol->address > pRightSymbol->address;
+}
+
+void
+freeSymbols
+(
+    Symbol  *pSymbols,
+    uint32_t count
+)
+{
+    for (uint32_t symbol = 0; symbol < count; symbol++)
+    {
+        free(pSymbols[symbol].pName);
+    }
+
+    free(pSymbols);
+}
+
+// "0x<address> <label>" lines, returned sorted by address
+int
+loadSymbols
+(
+    const char *path,
+    Symbol    **ppSymbols,
+    uint32_t   *pCount
+)
+{
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+    {
+        return -1;
+    }
+
+    Symbol  *pSymbols = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    char    *pLine = NULL;
+    size_t   size = 0;
+    int      result = 0;
+
+    while (getline(&pLine, &size, f) != -1)
+    {
+        char         *pSave;
+        char         *pAddress = strtok_r(pLine, " \t\r\n", &pSave);
+        char         *pName = strtok_r(NULL, " \t\r\n", &pSave);
+        char         *pEnd;
+        unsigned long address = pAddress ? strtoul(pAddress, &pEnd, 16) : 0;
+
+        if (!pAddress || !pName || *pEnd != '\0' || address > UINT32_MAX)
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+
+            Symbol *pGrown = (Symbol *)realloc(pSymbols, capacity * sizeof *pGrown);
+
+            if (!pGrown)
+            {
+                result = -1;
+                break;
+            }
+
+            pSymbols = pGrown;
+        }
+
+        pSymbols[count].address = address;
+        pSymbols[count].pName = strdup(pName);
+
+        if (!pSymbols[count].pName)
+        {
+            result = -1;
+            break;
+        }
+
+        count++;
+    }
+
+    free(pLine);
+    fclose(f);
+
+    if (result == -1)
+    {
+        freeSymbols(pSymbols, count);
+        return -1;
+    }
+
+    qsort(pSymbols, count, sizeof *pSymbols, compareSymbols);
+    *ppSymbols = pSymbols;
+    *pCount = count;
+    return 0;
+}
+
+// the last label at or below the address, count when there is none
+uint32_t
+findSymbol
+(
+    const Symbol *pSymbols,
+    uint32_t      count,
+    uint32_t      address
+)
+{
+    uint32_t low = 0;
+    uint32_t high = count;
+
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (pSymbols[middle].address <= address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low ? low - 1 : count;
+}
+
+// the label with that name in any case, the assembler upper cases them; count when there is none
+uint32_t
+findSymbolNamed
+(
+    const Symbol *pSymbols,
+    uint32_t      count,
+    const char   *name
+)
+{
+    for (uint32_t symbol = 0; symbol < count; symbol++)
+    {
+        if (strcasecmp(pSymbols[symbol].pName, name) == 0)
+        {
+            return symbol;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,495 @@
+#include "threaded.h"
+#include "debug.h"
+#include "flags.h"
+#include "pipeline.h"
+#include "semihost.h"
+#include "stats.h"
+
+/* Threaded interpreter: the dispatch at the end of every handler jumps
+   straight to the handler of the next instruction, so each guest
+   instruction costs a single indirect jump. Compilers without computed
+   goto (or builds with -DNO_COMPUTED_GOTO) get the same handlers as the
+   cases of one switch. */
+
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define HANDLER(name) LABEL_##name:
+#define DISPATCH()    goto *pHandlers[pDecoded->dispatch]
+#else
+#define HANDLER(name) case HANDLER_##name:
+#define DISPATCH()    goto dispatch
+#endif
+
+#define FETCH(address)                                                    \
+    ((pDecoded = lookupDecoded(pCache, (address))) != NULL                \
+        ? pDecoded                                                        \
+        : fetchDecoded(pCache, pMemory, (address)))
+
+#define ADVANCE()                                                         \
+    do                                                                    \
+    {                                                                     \
+        if (registers[PC] == programSize || instructions == budget)       \
+        {                                                                 \
+            goto done;                                                    \
+        }                                                                 \
+                                                                          \
+        pDecoded = FETCH(registers[PC]);                                  \
+        fetched = registers[PC];                                          \
+        registers[PC] += 4;                                               \
+        instructions++;                                                   \
+        DISPATCH();                                                       \
+    } while (0)
+
+// a timed run retires every instruction on the pipeline model before moving on
+#define RETIRE(executed)                                                  \
+    if (pPipeline)                                                        \
+    {                                                                     \
+        retireTimed(pPipeline, pDecoded, executed, registers[PC] == fetched + 4); \
+    }
+
+#define NEXT()                                                            \
+    do                                                                    \
+    {                                                                     \
+        RETIRE(true);                                                     \
+        ADVANCE();                                                        \
+    } while (0)
+
+// a faulting access completes with its load reading 0, then the run stops
+#define FAULT()                                                           \
+    if (pMemory->faulted)                                                 \
+    {                                                                     \
+        RETIRE(true);                                                     \
+        goto done;                                                        \
+    }
+
+#define CONDITION()                                                       \
+    if (pDecoded->condition != AL &&                                      \
+        !validCondition(pDecoded->condition, registers[CPSR], pFlags))    \
+    {                                                                     \
+        COUNT_SKIPPED(pCounts, pDecoded);                                 \
+        RETIRE(false);                                                    \
+        ADVANCE();                                                        \
+    }                                                                     \
+                                                                          \
+    COUNT_EXECUTED(pCounts, pDecoded);
+
+#define CARRY_IN() lazyFlag(registers[CPSR], pFlags, C)
+
+#define OPERAND2_IMM(type)                                                \
+    (carry = pDecoded->shiftAmount ? bit(pDecoded->immediate, 31) : CARRY_IN(), \
+     pDecoded->immediate)
+
+#define OPERAND2_REG(type)                                                \
+    barrelShift(type, registers[pDecoded->rm], pDecoded->shiftAmount,     \
+                pDecoded->shiftAmount == 0 ? CARRY_IN() : 0, &carry)
+
+#define OPERAND2_RSH(type)                                                \
+    (bits(registers[pDecoded->rs], 7, 0) == 0                             \
+        ? (carry = CARRY_IN(), registers[pDecoded->rm])                   \
+        : barrelShift(type, registers[pDecoded->rm], bits(registers[pDecoded->rs], 7, 0), \
+                      0, &carry))
+
+#define DATA_HANDLER(opcode, s, kind, type)                               \
+    HANDLER(opcode##_##s##_##kind##_##type)                               \
+    {                                                                     \
+        CONDITION();                                                      \
+                                                                          \
+        uint32_t carry = 0;                                               \
+        uint32_t operand2 = OPERAND2_##kind(type);                        \
+        uint32_t operand1 = registers[pDecoded->rn];                      \
+        uint32_t result = aluOperation(opcode, operand1, operand2,        \
+                                       aluCarryIn(opcode) ? CARRY_IN() : 0); \
+                                                                          \
+        if (s && aluLogicOperation(opcode))                               \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_LOGIC, 0, 0, result, carry); \
+        }                                                                 \
+        else if (s)                                                       \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_ARITHMETIC, operand1, operand2, result, 0); \
+        }                                                                 \
+                                                                          \
+        if (aluWriteback(opcode))                                         \
+        {                                                                 \
+            registers[pDecoded->rd] = result;                             \
+        }                                                                 \
+                                                                          \
+        NEXT();                                                           \
+    }
+
+#define MULTIPLY_HANDLER(name, accumulate, s)                             \
+    HANDLER(name)                                                         \
+    {                                                                     \
+        CONDITION();                                                      \
+                                                                          \
+        uint32_t result = registers[pDecoded->rs] * registers[pDecoded->rm] + \
+                          accumulate * registers[pDecoded->rd];           \
+                                                                          \
+        if (s)                                                            \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_MULTIPLY, 0, 0, result, 0); \
+        }                                                                 \
+                                                                          \
+        registers[pDecoded->rn] = result;                                 \
+        NEXT();                                                           \
+    }
+
+#define OFFSET_IMM pDecoded->immediate
+
+#define OFFSET_REG                                                        \
+    barrelShift(pDecoded->shiftType, registers[pDecoded->rm], pDecoded->shiftAmount, \
+                pDecoded->shiftAmount == 0 ? CARRY_IN() : 0, &carry)
+
+#define TRANSFER_HANDLER(operation, kind)                                 \
+    HANDLER(operation##_##kind)                                           \
+    {                                                                     \
+        CONDITION();                                                      \
+                                                                          \
+        uint32_t carry;                                                   \
+        uint32_t base = registers[pDecoded->rn];                          \
+        uint32_t data = registers[pDecoded->rd];                          \
+        uint32_t offset = OFFSET_##kind;                                  \
+        uint32_t address = pDecoded->up ? base + pDecoded->preindex * offset \
+                                        : base - pDecoded->preindex * offset; \
+                                                                          \
+        (void)carry;                                                      \
+        TRANSFER_##operation(address, data);                              \
+        registers[pDecoded->rn] = pDecoded->up ? base + offset : base - offset; \
+        LOAD_##operation(data);                                           \
+        FAULT();                                                          \
+        NEXT();                                                           \
+    }
+
+// a load that misses RAM goes to the device with the instruction count up to date
+#define TRANSFER_LDR(address, data)                                       \
+    data = inMemory(pMemory, (address) - (address) % 4, 4)                \
+        ? load32(pMemory, address)                                        \
+        : countedDeviceLoad(pState, instructions, address, 4)
+#define TRANSFER_LDRB(address, data)                                      \
+    data = inMemory(pMemory, address, 1)                                  \
+        ? load8(pMemory, address)                                         \
+        : countedDeviceLoad(pState, instructions, address, 1)
+#define TRANSFER_STR(address, data)                                       \
+    if (store32(pMemory, address, data) && storeWritten(pState, address, 4)) \
+    {                                                                     \
+        budget = instructions;                                            \
+    }
+#define TRANSFER_STRB(address, data)                                      \
+    if (store8(pMemory, address, data) && storeWritten(pState, address, 1)) \
+    {                                                                     \
+        budget = instructions;                                            \
+    }
+
+#define LOAD_LDR(data)  registers[pDecoded->rd] = data
+#define LOAD_LDRB(data) registers[pDecoded->rd] = data
+#define LOAD_STR(data)
+#define LOAD_STRB(data)
+
+#define BRANCH_HANDLER(name, link)                                        \
+    HANDLER(name)                                                         \
+    {                                                                     \
+        CONDITION();                                                      \
+                                                                          \
+        if (link)                                                         \
+        {                                                                 \
+            registers[LR] = registers[PC];                                \
+        }                                                                 \
+                                                                          \
+        registers[PC] += pDecoded->immediate;                             \
+        NEXT();                                                           \
+    }
+
+// moves on to the second instruction of a pair, whose entry follows the first
+#define NEXT_IN_PAIR()                                                    \
+    RETIRE(true);                                                         \
+                                                                          \
+    if (registers[PC] == programSize || instructions == budget)           \
+    {                                                                     \
+        goto done;                                                        \
+    }                                                                     \
+                                                                          \
+    pDecoded++;                                                           \
+    fetched = registers[PC];                                              \
+    registers[PC] += 4;                                                   \
+    instructions++;
+
+#define COMPARE_BRANCH_HANDLER(opcode, kind)                              \
+    HANDLER(opcode##_##kind##_B)                                          \
+    {                                                                     \
+        COUNT_EXECUTED(pCounts, pDecoded);                                \
+                                                                          \
+        uint32_t carry = 0;                                               \
+        uint32_t operand2 = OPERAND2_##kind(LSL);                         \
+        uint32_t operand1 = registers[pDecoded->rn];                      \
+        uint32_t result = aluOperation(opcode, operand1, operand2, 0);    \
+                                                                          \
+        if (aluLogicOperation(opcode))                                    \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_LOGIC, 0, 0, result, carry); \
+        }                                                                 \
+        else                                                              \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_ARITHMETIC, operand1, operand2, result, 0); \
+        }                                                                 \
+                                                                          \
+        NEXT_IN_PAIR();                                                   \
+        pState->fusions[MINIARM_FUSION_COMPARE_BRANCH]++;                 \
+        CONDITION();                                                      \
+                                                                          \
+        if (pDecoded->link)                                               \
+        {                                                                 \
+            registers[LR] = registers[PC];                                \
+        }                                                                 \
+                                                                          \
+        registers[PC] += pDecoded->immediate;                             \
+        NEXT();                                                           \
+    }
+
+#define ARITHMETIC_COMPARE_HANDLER(opcode)                                \
+    HANDLER(opcode##_IMM_CMP)                                             \
+    {                                                                     \
+        COUNT_EXECUTED(pCounts, pDecoded);                                \
+                                                                          \
+        uint32_t operand1 = registers[pDecoded->rn];                      \
+        uint32_t operand2 = pDecoded->immediate;                          \
+        uint32_t result = aluOperation(opcode, operand1, operand2, 0);    \
+                                                                          \
+        if (pDecoded->alterCPSR)                                          \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_ARITHMETIC, operand1, operand2, result, 0); \
+        }                                                                 \
+                                                                          \
+        registers[pDecoded->rd] = result;                                 \
+        NEXT_IN_PAIR();                                                   \
+        pState->fusions[MINIARM_FUSION_ARITHMETIC_COMPARE]++;             \
+        COUNT_EXECUTED(pCounts, pDecoded);                                \
+                                                                          \
+        uint32_t carry = 0;                                               \
+                                                                          \
+        operand1 = registers[pDecoded->rn];                               \
+        operand2 = pDecoded->operand2 == OPERAND_IMMEDIATE ? OPERAND2_IMM(LSL) : OPERAND2_REG(LSL); \
+        result = aluOperation(CMP, operand1, operand2, 0);                \
+                                                                          \
+        if (aluLogicOperation(CMP))                                       \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_LOGIC, 0, 0, result, carry); \
+        }                                                                 \
+        else                                                              \
+        {                                                                 \
+            recordFlags(&registers[CPSR], pFlags, FLAGS_ARITHMETIC, operand1, operand2, result, 0); \
+        }                                                                 \
+                                                                          \
+        NEXT();                                                           \
+    }
+
+#define HANDLER_ADDRESS(name) &&LABEL_##name,
+#define DATA_HANDLER_ADDRESS(opcode, s, kind, type) &&LABEL_##opcode##_##s##_##kind##_##type,
+
+/* The run's instruction count is kept in a local until the run ends, so
+   device loads and services, which a replay log stamps with it, get it
+   added to the state for their duration. */
+static uint32_t
+countedDeviceLoad
+(
+    CpuState *pState,
+    uint64_t  instructions,
+    uint32_t  address,
+    uint32_t  width
+)
+{
+    pState->instructions += instructions;
+
+    uint32_t data = deviceLoad(&pState->memory, address, width);
+
+    pState->instructions -= instructions;
+    return data;
+}
+
+static bool
+countedService
+(
+    CpuState *pState,
+    uint64_t  instructions,
+    uint32_t  service
+)
+{
+    pState->instructions += instructions;
+
+    bool watched = semihost(pState, service);
+
+    pState->instructions -= instructions;
+    return watched;
+}
+
+void
+interpretThreaded
+(
+    CpuState *pState
+)
+{
+    uint32_t                 *registers = pState->registers;
+    Memory                   *pMemory = &pState->memory;
+    DecodeCache              *pCache = &pState->decodeCache;
+    LazyFlags                *pFlags = &pState->flags;
+#ifdef MINIARM_STATS
+    ExecutionCounts          *pCounts = pState->pCounts;
+#endif
+    uint32_t                  programSize = pState->programSize;
+    uint64_t                  instructions = 0;
+    uint64_t                  budget = pState->limit - pState->instructions;
+    Pipeline                 *pPipeline = pState->pPipeline;
+    const DecodedInstruction *pDecoded;
+    uint32_t                  fetched;
+
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+    static void *pHandlers[HANDLER_COUNT] =
+    {
+        OTHER_HANDLERS(HANDLER_ADDRESS)
+        DATA_HANDLERS(DATA_HANDLER_ADDRESS)
+    };
+#endif
+
+    ADVANCE();
+
+#if !defined(__GNUC__) || defined(NO_COMPUTED_GOTO)
+dispatch:
+    switch(pDecoded->dispatch)
+    {
+#endif
+
+    // also what a fetch outside RAM decodes to
+    HANDLER(UNDEFINED)
+    {
+        FAULT();
+        CONDITION();
+        NEXT();
+    }
+
+    MULTIPLY_HANDLER(MUL, 0, 0)
+    MULTIPLY_HANDLER(MULS, 0, 1)
+    MULTIPLY_HANDLER(MLA, 1, 0)
+    MULTIPLY_HANDLER(MLAS, 1, 1)
+
+    TRANSFER_HANDLER(LDR, IMM)
+    TRANSFER_HANDLER(LDR, REG)
+    TRANSFER_HANDLER(LDRB, IMM)
+    TRANSFER_HANDLER(LDRB, REG)
+    TRANSFER_HANDLER(STR, IMM)
+    TRANSFER_HANDLER(STR, REG)
+    TRANSFER_HANDLER(STRB, IMM)
+    TRANSFER_HANDLER(STRB, REG)
+
+    HANDLER(LDM)
+    {
+        CONDITION();
+
+        uint32_t words[16];
+        uint32_t written;
+        uint32_t address = blockAddress(pDecoded, registers[pDecoded->rn], &written);
+
+        COUNT_BLOCK(pCounts, pDecoded);
+        loadBlock(pMemory, address, words, pDecoded->registerCount);
+        registers[pDecoded->rn] = written;
+
+        uint32_t word = 0;
+
+        for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+        {
+            registers[__builtin_ctz(list)] = words[word++];
+        }
+
+        FAULT();
+        NEXT();
+    }
+
+    HANDLER(STM)
+    {
+        CONDITION();
+
+        uint32_t words[16];
+        uint32_t written;
+        uint32_t address = blockAddress(pDecoded, registers[pDecoded->rn], &written);
+        uint32_t word = 0;
+
+        for (uint32_t list = pDecoded->immediate; list; list &= list - 1)
+        {
+            words[word++] = registers[__builtin_ctz(list)];
+        }
+
+        COUNT_BLOCK(pCounts, pDecoded);
+
+        if (storeBlock(pMemory, address, words, word) && storeWritten(pState, address, 4 * word))
+        {
+            budget = instructions;
+        }
+
+        registers[pDecoded->rn] = written;
+        FAULT();
+        NEXT();
+    }
+
+    BRANCH_HANDLER(B, 0)
+    BRANCH_HANDLER(BL, 1)
+
+    HANDLER(SWI)
+    {
+        CONDITION();
+
+        if (countedService(pState, instructions, pDecoded->immediate))
+        {
+            budget = instructions;
+        }
+
+        FAULT();
+        NEXT();
+    }
+
+    // stops in front of the instruction under the breakpoint
+    HANDLER(BREAKPOINT)
+    {
+        registers[PC] -= 4;
+        instructions--;
+        stopAtBreakpoint(pState);
+        goto done;
+    }
+
+    COMPARE_BRANCH_HANDLER(TST, IMM)
+    COMPARE_BRANCH_HANDLER(TST, REG)
+    COMPARE_BRANCH_HANDLER(TEQ, IMM)
+    COMPARE_BRANCH_HANDLER(TEQ, REG)
+    COMPARE_BRANCH_HANDLER(CMP, IMM)
+    COMPARE_BRANCH_HANDLER(CMP, REG)
+    COMPARE_BRANCH_HANDLER(CMN, IMM)
+    COMPARE_BRANCH_HANDLER(CMN, REG)
+
+    ARITHMETIC_COMPARE_HANDLER(ADD)
+    ARITHMETIC_COMPARE_HANDLER(SUB)
+
+    // the use runs under its own handler, only its fetch is saved
+    HANDLER(LDR_IMM_USE)
+    {
+        COUNT_EXECUTED(pCounts, pDecoded);
+
+        uint32_t base = registers[pDecoded->rn];
+        uint32_t offset = pDecoded->immediate;
+        uint32_t address = pDecoded->up ? base + pDecoded->preindex * offset
+                                        : base - pDecoded->preindex * offset;
+        uint32_t data;
+
+        TRANSFER_LDR(address, data);
+        registers[pDecoded->rn] = pDecoded->up ? base + offset : base - offset;
+        registers[pDecoded->rd] = data;
+        FAULT();
+        NEXT_IN_PAIR();
+        pState->fusions[MINIARM_FUSION_LOAD_USE]++;
+        DISPATCH();
+    }
+
+    DATA_HANDLERS(DATA_HANDLER)
+
+#if !defined(__GNUC__) || defined(NO_COMPUTED_GOTO)
+    }
+#endif
+
+done:
+    pState->instructions += instructions;
+}
@@ -0,0 +1,512 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cache.h"
+#include "pipeline.h"
+#include "trace.h"
+
+// records the writer encodes before it hands their slots back
+#define TRACE_BATCH         1024
+
+// the longest a record can encode to: tag, jump, instruction, 2 writes, a 16 word access, cpsr
+#define TRACE_RECORD_BYTES  (1 + 5 + 4 + 2 * 6 + 5 + 3 + 16 * 5 + 5)
+
+static uint8_t *
+putVarint
+(
+    uint8_t *pOutput,
+    uint64_t value
+)
+{
+    while (value >= 0x80)
+    {
+        *pOutput++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+
+    *pOutput++ = (uint8_t)value;
+    return pOutput;
+}
+
+static uint8_t *
+encodeRecord
+(
+    Tracer            *pTracer,
+    const TraceRecord *pRecord,
+    uint8_t           *pOutput
+)
+{
+    // the instructions of a gap left no trace, the registers after them are where the next record starts from
+    if (pRecord->writes == TRACE_GAP)
+    {
+        *pOutput++ = TRACE_GAP << TRACE_WRITES_SHIFT;
+        pOutput = putVarint(pOutput, (uint64_t)pRecord->values[1] << 32 | pRecord->values[0]);
+
+        for (uint32_t index = 0; index < 16; index++)
+        {
+            pOutput = putVarint(pOutput, pRecord->block[index]);
+        }
+
+        pOutput = putVarint(pOutput, pRecord->cpsr);
+        memcpy(pTracer->registers, pRecord->block, sizeof pRecord->block);
+        pTracer->registers[CPSR] = pRecord->cpsr;
+        pTracer->expected = pRecord->block[PC];
+        return pOutput;
+    }
+
+    uint8_t *pTag = pOutput++;
+    uint8_t  tag = pRecord->access << TRACE_ACCESS_SHIFT | pRecord->writes << TRACE_WRITES_SHIFT;
+    uint32_t slot = (pRecord->pc >> 2) & (TRACE_CACHE_ENTRIES - 1);
+
+    if (pRecord->pc != pTracer->expected)
+    {
+        tag |= TRACE_JUMP;
+        pOutput = putVarint(pOutput, zigzag((int32_t)(pRecord->pc - pTracer->expected)));
+    }
+
+    pTracer->expected = pRecord->pc + 4;
+
+    if (pTracer->cacheAddresses[slot] == pRecord->pc && pTracer->cacheInstructions[slot] == pRecord->instruction)
+    {
+        tag |= TRACE_CACHED;
+    }
+    else
+    {
+        pTracer->cacheAddresses[slot] = pRecord->pc;
+        pTracer->cacheInstructions[slot] = pRecord->instruction;
+        memcpy(pOutput, &pRecord->instruction, 4);
+        pOutput += 4;
+    }
+
+    for (uint32_t write = 0; write < pRecord->writes; write++)
+    {
+        uint32_t index = pRecord->registers[write];
+
+        *pOutput++ = (uint8_t)index;
+        pOutput = putVarint(pOutput, zigzag((int32_t)(pRecord->values[write] - pTracer->registers[index])));
+        pTracer->registers[index] = pRecord->values[write];
+    }
+
+    if (pRecord->access != TRACE_ACCESS_NONE && pRecord->access != TRACE_ACCESS_SKIPPED)
+    {
+        pOutput = putVarint(pOutput, zigzag((int32_t)(pRecord->address - pTracer->lastAddress)));
+        pOutput = putVarint(pOutput, pRecord->data);
+        pTracer->lastAddress = pRecord->address;
+    }
+
+    if (pRecord->access == TRACE_ACCESS_LDM || pRecord->access == TRACE_ACCESS_STM)
+    {
+        uint32_t word = 0;
+
+        for (uint32_t list = pRecord->data; list; list &= list - 1, word++)
+        {
+            pOutput = putVarint(pOutput, pRecord->block[word]);
+
+            // the registers an LDM loads are known from here on, like written ones
+            if (pRecord->access == TRACE_ACCESS_LDM)
+            {
+                pTracer->registers[__builtin_ctz(list)] = pRecord->block[word];
+            }
+        }
+    }
+
+    if (pRecord->cpsrWritten)
+    {
+        tag |= TRACE_CPSR;
+        pOutput = putVarint(pOutput, pRecord->cpsr ^ pTracer->registers[CPSR]);
+        pTracer->registers[CPSR] = pRecord->cpsr;
+    }
+
+    *pTag = tag;
+    return pOutput;
+}
+
+// drains the ring until the emulator stops tracing and everything it published is written
+static void *
+writeTrace
+(
+    void *pArgument
+)
+{
+    Tracer         *pTracer = (Tracer *)pArgument;
+    uint8_t         buffer[TRACE_BATCH * TRACE_RECORD_BYTES];
+    uint64_t        tail = atomic_load_explicit(&pTracer->tail, memory_order_relaxed);
+    struct timespec pause = { 0, 50000 };
+
+    while (true)
+    {
+        uint64_t head = atomic_load_explicit(&pTracer->head, memory_order_acquire);
+
+        if (head == tail)
+        {
+            // stopping is set after the last record was published
+            if (atomic_load_explicit(&pTracer->stopping, memory_order_acquire) &&
+                atomic_load_explicit(&pTracer->head, memory_order_acquire) == tail)
+            {
+                break;
+            }
+
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        if (head - tail > TRACE_BATCH)
+        {
+            head = tail + TRACE_BATCH;
+        }
+
+        uint8_t *pOutput = buffer;
+
+        for (; tail < head; tail++)
+        {
+            pOutput = encodeRecord(pTracer, &pTracer->pRing[tail & (TRACE_RING_RECORDS - 1)], pOutput);
+        }
+
+        atomic_store_explicit(&pTracer->tail, tail, memory_order_release);
+
+        if (!pTracer->error && fwrite(buffer, 1, pOutput - buffer, pTracer->f) != (size_t)(pOutput - buffer))
+        {
+            pTracer->error = errno ? errno : EIO;
+        }
+    }
+
+    return NULL;
+}
+
+int
+startTrace
+(
+    Tracer     *pTracer,
+    CpuState   *pState,
+    const char *path
+)
+{
+    memset(pTracer, 0, sizeof *pTracer);
+    pTracer->pRing = (TraceRecord *)malloc(TRACE_RING_RECORDS * sizeof *pTracer->pRing);
+
+    if (!pTracer->pRing)
+    {
+        return -1;
+    }
+
+    pTracer->f = fopen(path, "wb");
+
+    if (!pTracer->f)
+    {
+        free(pTracer->pRing);
+        return -1;
+    }
+
+    pTracer->pState = pState;
+    materializeFlags(&pState->registers[CPSR], &pState->flags);
+    memcpy(pTracer->registers, pState->registers, sizeof pTracer->registers);
+    pTracer->expected = pState->registers[PC];
+
+    // no encoding has been seen yet, so nothing can match the cache
+    for (uint32_t slot = 0; slot < TRACE_CACHE_ENTRIES; slot++)
+    {
+        pTracer->cacheAddresses[slot] = 1;
+    }
+
+    uint8_t header[8 + sizeof pTracer->registers + 8] = TRACE_MAGIC;
+
+    header[4] = TRACE_VERSION;
+    memcpy(header + 8, pTracer->registers, sizeof pTracer->registers);
+
+    int error = 0;
+
+    if (fwrite(header, 1, sizeof header, pTracer->f) != sizeof header)
+    {
+        error = errno ? errno : EIO;
+    }
+    else
+    {
+        error = pthread_create(&pTracer->writer, NULL, writeTrace, pTracer);
+    }
+
+    if (error)
+    {
+        fclose(pTracer->f);
+        free(pTracer->pRing);
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+// the registers the guest is left with after a gap, which the next record carries on from
+static void
+recordGap
+(
+    Tracer      *pTracer,
+    CpuState    *pState,
+    TraceRecord *pRecord
+)
+{
+    materializeFlags(&pState->registers[CPSR], &pState->flags);
+    pRecord->writes = TRACE_GAP;
+    pRecord->values[0] = (uint32_t)pTracer->gap;
+    pRecord->values[1] = (uint32_t)(pTracer->gap >> 32);
+    memcpy(pRecord->block, pState->registers, sizeof pRecord->block);
+    pRecord->cpsr = pState->registers[CPSR];
+
+    pTracer->gap = 0;
+    pTracer->gaps++;
+}
+
+int
+stopTrace
+(
+    Tracer *pTracer
+)
+{
+    // a run that ended in a gap still owes the writer its registers, stopping waits for the room
+    if (pTracer->gap)
+    {
+        uint64_t        head = atomic_load_explicit(&pTracer->head, memory_order_relaxed);
+        struct timespec pause = { 0, 50000 };
+
+        while (head - atomic_load_explicit(&pTracer->tail, memory_order_acquire) == TRACE_RING_RECORDS)
+        {
+            nanosleep(&pause, NULL);
+        }
+
+        recordGap(pTracer, pTracer->pState, &pTracer->pRing[head & (TRACE_RING_RECORDS - 1)]);
+        atomic_store_explicit(&pTracer->head, head + 1, memory_order_release);
+    }
+
+    atomic_store_explicit(&pTracer->stopping, true, memory_order_release);
+    pthread_join(pTracer->writer, NULL);
+
+    int error = pTracer->error;
+
+    // a trace to a pipe can't have its header filled in, its gap records still count what was dropped
+    if (pTracer->dropped && !error && fseek(pTracer->f, 8 + sizeof pTracer->registers, SEEK_SET) == 0)
+    {
+        uint8_t dropped[8];
+
+        for (uint32_t byte = 0; byte < 8; byte++)
+        {
+            dropped[byte] = (uint8_t)(pTracer->dropped >> 8 * byte);
+        }
+
+        if (fwrite(dropped, 1, sizeof dropped, pTracer->f) != sizeof dropped)
+        {
+            error = errno ? errno : EIO;
+        }
+    }
+
+    if (fclose(pTracer->f) != 0 && !error)
+    {
+        error = errno;
+    }
+
+    free(pTracer->pRing);
+    pTracer->pRing = NULL;
+
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+// the next free slot, NULL while the writer hasn't handed any back from a full ring
+static inline TraceRecord *
+reserveRecord
+(
+    Tracer  *pTracer,
+    uint64_t head
+)
+{
+    if (head - pTracer->cachedTail == TRACE_RING_RECORDS)
+    {
+        pTracer->cachedTail = atomic_load_explicit(&pTracer->tail, memory_order_acquire);
+
+        if (head - pTracer->cachedTail == TRACE_RING_RECORDS)
+        {
+            return NULL;
+        }
+    }
+
+    return &pTracer->pRing[head & (TRACE_RING_RECORDS - 1)];
+}
+
+static inline void
+recordWrite
+(
+    TraceRecord *pRecord,
+    uint32_t     index,
+    uint32_t     value
+)
+{
+    // a written PC shows up as the next record's address
+    if (index != PC)
+    {
+        pRecord->registers[pRecord->writes] = index;
+        pRecord->values[pRecord->writes++] = value;
+    }
+}
+
+static inline void
+recordEffects
+(
+    CpuState                 *pState,
+    const DecodedInstruction *pDecoded,
+    const TemporaryRegisters *pTemporaryRegisters,
+    TraceRecord              *pRecord
+)
+{
+    uint32_t *registers = pState->registers;
+
+    switch(pDecoded->operation)
+    {
+    case DATA:
+        if (pTemporaryRegisters->writeback)
+        {
+            recordWrite(pRecord, pDecoded->rd, registers[pDecoded->rd]);
+        }
+        break;
+    case MUL:
+        recordWrite(pRecord, pDecoded->rn, registers[pDecoded->rn]);
+        break;
+    case LDR:
+    case LDRB:
+        pRecord->access = pDecoded->operation == LDR ? TRACE_ACCESS_LDR : TRACE_ACCESS_LDRB;
+        pRecord->address = pTemporaryRegisters->ALUOutput;
+        pRecord->data = pTemporaryRegisters->loadMemoryData;
+        recordWrite(pRecord, pDecoded->rn, pTemporaryRegisters->singleDataTransferOffset);
+        recordWrite(pRecord, pDecoded->rd, pTemporaryRegisters->loadMemoryData);
+        break;
+    case STR:
+    case STRB:
+        pRecord->access = pDecoded->operation == STR ? TRACE_ACCESS_STR : TRACE_ACCESS_STRB;
+        pRecord->address = pTemporaryRegisters->ALUOutput;
+        pRecord->data = pDecoded->operation == STR ? pTemporaryRegisters->b : pTemporaryRegisters->b & 0xFF;
+        recordWrite(pRecord, pDecoded->rn, registers[pDecoded->rn]);
+        break;
+    case LDM:
+    case STM:
+        pRecord->access = pDecoded->operation == LDM ? TRACE_ACCESS_LDM : TRACE_ACCESS_STM;
+        pRecord->address = pTemporaryRegisters->ALUOutput;
+        pRecord->data = pDecoded->immediate;
+        memcpy(pRecord->block, pTemporaryRegisters->blockData, 4 * pDecoded->registerCount);
+
+        if (pDecoded->writeback)
+        {
+            recordWrite(pRecord, pDecoded->rn, registers[pDecoded->rn]);
+        }
+        break;
+    case BRANCH:
+        if (pTemporaryRegisters->link)
+        {
+            recordWrite(pRecord, LR, registers[LR]);
+        }
+        break;
+    case SWI:
+        // the memory a service writes isn't traced, only its result
+        recordWrite(pRecord, 0, registers[0]);
+        break;
+    }
+
+    if ((pDecoded->operation == DATA || pDecoded->operation == MUL) && pDecoded->alterCPSR)
+    {
+        materializeFlags(&registers[CPSR], &pState->flags);
+        pRecord->cpsr = registers[CPSR];
+        pRecord->cpsrWritten = true;
+    }
+}
+
+void
+interpretTraced
+(
+    CpuState *pState
+)
+{
+    uint32_t *registers = pState->registers;
+    Tracer   *pTracer = pState->pTracer;
+    uint64_t  head = atomic_load_explicit(&pTracer->head, memory_order_relaxed);
+
+    while (registers[PC] != pState->programSize && !pState->memory.faulted &&
+           pState->instructions < pState->limit && !pState->stopped)
+    {
+        TemporaryRegisters        temporaryRegisters;
+        TraceRecord              *pRecord = reserveRecord(pTracer, head);
+
+        // the registers after a gap go out first, once the writer has made room
+        if (pTracer->gap && pRecord)
+        {
+            recordGap(pTracer, pState, pRecord);
+            atomic_store_explicit(&pTracer->head, ++head, memory_order_release);
+            pRecord = reserveRecord(pTracer, head);
+        }
+
+        if (pState->pCaches)
+        {
+            cacheFetch(pState->pCaches, registers[PC]);
+        }
+
+        uint32_t                  pc = registers[PC];
+        const DecodedInstruction *pDecoded = fetchDecoded(&pState->decodeCache, &pState->memory, pc);
+
+        // the ring is full, the instruction runs all the same but leaves no record
+        if (!pRecord)
+        {
+            registers[PC] += 4;
+            pState->instructions++;
+
+            bool executed = executeDecoded(pState, pDecoded);
+
+            if (!executed && pDecoded->operation == BREAKPOINT)
+            {
+                break;
+            }
+
+            if (pState->pPipeline)
+            {
+                retireTimed(pState->pPipeline, pDecoded, executed, registers[PC] == pc + 4);
+            }
+
+            pTracer->gap++;
+            pTracer->dropped++;
+            continue;
+        }
+
+        pRecord->pc = pc;
+        pRecord->instruction = pDecoded->instruction;
+        pRecord->writes = 0;
+        pRecord->access = TRACE_ACCESS_NONE;
+        pRecord->cpsrWritten = false;
+
+        registers[PC] += 4;
+        pState->instructions++;
+
+        bool executed = executeRecorded(pState, pDecoded, &temporaryRegisters);
+
+        if (executed)
+        {
+            recordEffects(pState, pDecoded, &temporaryRegisters, pRecord);
+        }
+        else if (pDecoded->operation == BREAKPOINT)
+        {
+            // nothing ran, the record is left unpublished
+            break;
+        }
+        else
+        {
+            pRecord->access = TRACE_ACCESS_SKIPPED;
+        }
+
+        // a timed run is timed under the trace too
+        if (pState->pPipeline)
+        {
+            retireTimed(pState->pPipeline, pDecoded, executed, registers[PC] == pc + 4);
+        }
+
+        atomic_store_explicit(&pTracer->head, ++head, memory_order_release);
+    }
+}
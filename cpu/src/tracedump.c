@@ -0,0 +1,320 @@
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+
+/* Prints a trace written by startMiniArmTrace(), one line per instruction:
+   its address and encoding, then the registers it wrote, the memory it
+   accessed and the CPSR it set, and a line per gap of dropped ones. */
+
+static const char *accessNames[] = { "", "ldr", "ldrb", "str", "strb", "ldm", "stm" };
+
+static bool
+getVarint64
+(
+    FILE     *f,
+    uint64_t *pValue
+)
+{
+    uint64_t value = 0;
+
+    for (int shift = 0; shift < 70; shift += 7)
+    {
+        int byte = getc(f);
+
+        if (byte == EOF)
+        {
+            return false;
+        }
+
+        value |= (uint64_t)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *pValue = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+getVarint
+(
+    FILE     *f,
+    uint32_t *pValue
+)
+{
+    uint64_t value;
+
+    if (!getVarint64(f, &value) || value > UINT32_MAX)
+    {
+        return false;
+    }
+
+    *pValue = (uint32_t)value;
+    return true;
+}
+
+static int
+usage
+(
+    const char *program
+)
+{
+    printf("Usage: %s [-q] [-r] <trace>\n", program);
+    return 1;
+}
+
+int
+main
+(
+    int   argc,
+    char *argv[]
+)
+{
+    bool quiet = false;
+    bool printRegisters = false;
+    int  option;
+
+    while ((option = getopt(argc, argv, "qr")) != -1)
+    {
+        switch(option)
+        {
+        case 'q':
+            quiet = true;
+            break;
+        case 'r':
+            printRegisters = true;
+            break;
+        default:
+            return usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        return usage(argv[0]);
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+
+    if (!f)
+    {
+        perror("fopen() failed");
+        return 1;
+    }
+
+    uint32_t registers[17];
+    uint8_t  header[8 + sizeof registers + 8];
+
+    // the count of dropped instructions came with version 3
+    if (fread(header, 1, 8 + sizeof registers, f) != 8 + sizeof registers || memcmp(header, TRACE_MAGIC, 4) != 0 ||
+        header[4] == 0 || header[4] > TRACE_VERSION ||
+        (header[4] >= 3 && fread(header + 8 + sizeof registers, 1, 8, f) != 8))
+    {
+        fprintf(stderr, "%s is not a version 1 to %d trace\n", argv[optind], TRACE_VERSION);
+        fclose(f);
+        return 1;
+    }
+
+    memcpy(registers, header + 8, sizeof registers);
+
+    uint64_t dropped = 0;
+
+    for (uint32_t byte = 0; header[4] >= 3 && byte < 8; byte++)
+    {
+        dropped |= (uint64_t)header[8 + sizeof registers + byte] << 8 * byte;
+    }
+
+    // the encoder only sets TRACE_CACHED on an address match, so the decoder needs just the encodings
+    static uint32_t cacheInstructions[TRACE_CACHE_ENTRIES];
+
+    uint32_t expected = registers[PC];
+    uint32_t lastAddress = 0;
+    uint64_t records = 0;
+    uint64_t gaps = 0;
+    bool     truncated = false;
+    int      tag;
+
+    while ((tag = getc(f)) != EOF)
+    {
+        // the registers after a gap replace what was known, the next record carries on from them
+        if (tag >> TRACE_WRITES_SHIFT == TRACE_GAP)
+        {
+            uint64_t length = 0;
+
+            truncated = !getVarint64(f, &length);
+
+            for (int index = 0; index < 17 && !truncated; index++)
+            {
+                truncated = !getVarint(f, &registers[index]);
+            }
+
+            if (truncated)
+            {
+                break;
+            }
+
+            if (!quiet)
+            {
+                printf("... %llu instructions dropped\n", (unsigned long long)length);
+            }
+
+            expected = registers[PC];
+            gaps += length;
+            continue;
+        }
+
+        uint32_t pc = expected;
+        uint32_t instruction;
+        uint32_t value;
+        uint32_t access = (tag >> TRACE_ACCESS_SHIFT) & 7;
+
+        if (tag & TRACE_JUMP)
+        {
+            if (!getVarint(f, &value))
+            {
+                truncated = true;
+                break;
+            }
+
+            pc += unzigzag(value);
+        }
+
+        uint32_t slot = (pc >> 2) & (TRACE_CACHE_ENTRIES - 1);
+
+        if (tag & TRACE_CACHED)
+        {
+            instruction = cacheInstructions[slot];
+        }
+        else if (fread(&instruction, 4, 1, f) == 1)
+        {
+            cacheInstructions[slot] = instruction;
+        }
+        else
+        {
+            truncated = true;
+            break;
+        }
+
+        if (!quiet)
+        {
+            printf("0x%08x  %08x", pc, instruction);
+        }
+
+        for (int write = 0; write < tag >> TRACE_WRITES_SHIFT; write++)
+        {
+            int index = getc(f);
+
+            if (index == EOF || index >= CPSR || !getVarint(f, &value))
+            {
+                truncated = true;
+                break;
+            }
+
+            registers[index] += unzigzag(value);
+
+            if (!quiet)
+            {
+                printf("  r%d=0x%08x", index, registers[index]);
+            }
+        }
+
+        if (access != TRACE_ACCESS_NONE && access != TRACE_ACCESS_SKIPPED && !truncated)
+        {
+            uint32_t data;
+
+            if (access > TRACE_ACCESS_STM || !getVarint(f, &value) || !getVarint(f, &data))
+            {
+                truncated = true;
+                break;
+            }
+
+            lastAddress += unzigzag(value);
+
+            if (access >= TRACE_ACCESS_LDM)
+            {
+                if (!quiet)
+                {
+                    printf("  %s [0x%08x] %s", accessNames[access], lastAddress,
+                           access == TRACE_ACCESS_LDM ? "->" : "<-");
+                }
+
+                for (uint32_t list = data & 0xFFFF; list && !truncated; list &= list - 1)
+                {
+                    truncated = !getVarint(f, &value);
+
+                    if (access == TRACE_ACCESS_LDM)
+                    {
+                        registers[__builtin_ctz(list)] = value;
+                    }
+
+                    if (!quiet && !truncated)
+                    {
+                        printf(" r%d=0x%08x", __builtin_ctz(list), value);
+                    }
+                }
+            }
+            else if (!quiet)
+            {
+                printf("  %s [0x%08x] %s 0x%08x", accessNames[access], lastAddress,
+                       access <= TRACE_ACCESS_LDRB ? "->" : "<-", data);
+            }
+        }
+
+        if ((tag & TRACE_CPSR) && !truncated)
+        {
+            if (!getVarint(f, &value))
+            {
+                truncated = true;
+                break;
+            }
+
+            registers[CPSR] ^= value;
+
+            if (!quiet)
+            {
+                printf("  cpsr=0x%08x", registers[CPSR]);
+            }
+        }
+
+        if (truncated)
+        {
+            break;
+        }
+
+        if (!quiet)
+        {
+            printf(access == TRACE_ACCESS_SKIPPED ? "  skipped\n" : "\n");
+        }
+
+        expected = pc + 4;
+        records++;
+    }
+
+    fclose(f);
+
+    if (truncated)
+    {
+        fprintf(stderr, "the trace ends in the middle of record %llu\n", (unsigned long long)records);
+        return 1;
+    }
+
+    // a branch taken by the last instruction isn't in the trace, the PC is the address after it
+    if (printRegisters)
+    {
+        registers[PC] = expected;
+        dump(registers);
+    }
+
+    printf("%llu instructions\n", (unsigned long long)records);
+
+    // a trace written to a pipe has only its gaps to count them
+    if (dropped || gaps)
+    {
+        printf("%llu instructions dropped while the ring was full\n", (unsigned long long)(dropped ? dropped : gaps));
+    }
+
+    return 0;
+}
@@ -0,0 +1,425 @@
+#include "x86.h"
+
+void
+emit8
+(
+    Emitter *pEmitter,
+    uint8_t  byte
+)
+{
+    if (pEmitter->offset < pEmitter->size)
+    {
+        pEmitter->pCode[pEmitter->offset] = byte;
+    }
+
+    pEmitter->offset++;
+}
+
+void
+emit32
+(
+    Emitter *pEmitter,
+    uint32_t word
+)
+{
+    emit8(pEmitter, bits(word, 7, 0));
+    emit8(pEmitter, bits(word, 15, 8));
+    emit8(pEmitter, bits(word, 23, 16));
+    emit8(pEmitter, bits(word, 31, 24));
+}
+
+static void
+emitMemoryOperand
+(
+    Emitter *pEmitter,
+    uint8_t  reg,
+    int32_t  displacement
+)
+{
+    // [rbx + disp8] or [rbx + disp32]
+    if (displacement >= -128 && displacement <= 127)
+    {
+        emit8(pEmitter, 0x40 | (reg << 3) | EBX);
+        emit8(pEmitter, (uint8_t)displacement);
+    }
+    else
+    {
+        emit8(pEmitter, 0x80 | (reg << 3) | EBX);
+        emit32(pEmitter, displacement);
+    }
+}
+
+static void
+emitRegisterOperand
+(
+    Emitter *pEmitter,
+    uint8_t  reg,
+    uint8_t  rm
+)
+{
+    emit8(pEmitter, 0xC0 | (reg << 3) | rm);
+}
+
+void
+emitLoad
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    int32_t     displacement
+)
+{
+    emit8(pEmitter, 0x8B);
+    emitMemoryOperand(pEmitter, destination, displacement);
+}
+
+void
+emitLoad64
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    int32_t     displacement
+)
+{
+    emit8(pEmitter, 0x48);
+    emit8(pEmitter, 0x8B);
+    emitMemoryOperand(pEmitter, destination, displacement);
+}
+
+void
+emitStore
+(
+    Emitter    *pEmitter,
+    int32_t     displacement,
+    X86Register source
+)
+{
+    emit8(pEmitter, 0x89);
+    emitMemoryOperand(pEmitter, source, displacement);
+}
+
+void
+emitStoreImmediate
+(
+    Emitter *pEmitter,
+    int32_t  displacement,
+    uint32_t immediate
+)
+{
+    emit8(pEmitter, 0xC7);
+    emitMemoryOperand(pEmitter, 0, displacement);
+    emit32(pEmitter, immediate);
+}
+
+void
+emitMoveImmediate
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    uint32_t    immediate
+)
+{
+    emit8(pEmitter, 0xB8 + destination);
+    emit32(pEmitter, immediate);
+}
+
+void
+emitMove
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    X86Register source
+)
+{
+    emit8(pEmitter, 0x89);
+    emitRegisterOperand(pEmitter, source, destination);
+}
+
+void
+emitArithmetic
+(
+    Emitter    *pEmitter,
+    int         operation,
+    X86Register destination,
+    X86Register source
+)
+{
+    emit8(pEmitter, (operation << 3) | 0x01);
+    emitRegisterOperand(pEmitter, source, destination);
+}
+
+void
+emitArithmeticImmediate
+(
+    Emitter    *pEmitter,
+    int         operation,
+    X86Register destination,
+    uint32_t    immediate
+)
+{
+    emit8(pEmitter, 0x81);
+    emitRegisterOperand(pEmitter, operation, destination);
+    emit32(pEmitter, immediate);
+}
+
+void
+emitShift
+(
+    Emitter    *pEmitter,
+    int         operation,
+    X86Register destination,
+    uint8_t     amount
+)
+{
+    emit8(pEmitter, 0xC1);
+    emitRegisterOperand(pEmitter, operation, destination);
+    emit8(pEmitter, amount);
+}
+
+void
+emitRotateRightCarry
+(
+    Emitter    *pEmitter,
+    X86Register destination
+)
+{
+    // rcr r32, 1
+    emit8(pEmitter, 0xD1);
+    emitRegisterOperand(pEmitter, 3, destination);
+}
+
+void
+emitNot
+(
+    Emitter    *pEmitter,
+    X86Register destination
+)
+{
+    emit8(pEmitter, 0xF7);
+    emitRegisterOperand(pEmitter, 2, destination);
+}
+
+void
+emitMultiply
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    X86Register source
+)
+{
+    emit8(pEmitter, 0x0F);
+    emit8(pEmitter, 0xAF);
+    emitRegisterOperand(pEmitter, destination, source);
+}
+
+void
+emitCompareMemory
+(
+    Emitter *pEmitter,
+    int32_t  displacement,
+    uint32_t immediate
+)
+{
+    emit8(pEmitter, 0x81);
+    emitMemoryOperand(pEmitter, X86_CMP, displacement);
+    emit32(pEmitter, immediate);
+}
+
+void
+emitCompareMemory64
+(
+    Emitter    *pEmitter,
+    int32_t     displacement,
+    X86Register source
+)
+{
+    emit8(pEmitter, 0x48);
+    emit8(pEmitter, 0x39);
+    emitMemoryOperand(pEmitter, source, displacement);
+}
+
+void
+emitTestMemory
+(
+    Emitter *pEmitter,
+    int32_t  displacement,
+    uint32_t immediate
+)
+{
+    emit8(pEmitter, 0xF7);
+    emitMemoryOperand(pEmitter, 0, displacement);
+    emit32(pEmitter, immediate);
+}
+
+void
+emitTestMemory8
+(
+    Emitter *pEmitter,
+    int32_t  displacement,
+    uint8_t  immediate
+)
+{
+    emit8(pEmitter, 0xF6);
+    emitMemoryOperand(pEmitter, 0, displacement);
+    emit8(pEmitter, immediate);
+}
+
+void
+emitTest
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    X86Register source
+)
+{
+    emit8(pEmitter, 0x85);
+    emitRegisterOperand(pEmitter, source, destination);
+}
+
+void
+emitBitTest
+(
+    Emitter *pEmitter,
+    int32_t  displacement,
+    uint8_t  index
+)
+{
+    emit8(pEmitter, 0x0F);
+    emit8(pEmitter, 0xBA);
+    emitMemoryOperand(pEmitter, 4, displacement);
+    emit8(pEmitter, index);
+}
+
+void
+emitComplementCarry
+(
+    Emitter *pEmitter
+)
+{
+    emit8(pEmitter, 0xF5);
+}
+
+void
+emitAddMemory64
+(
+    Emitter *pEmitter,
+    int32_t  displacement,
+    uint32_t immediate
+)
+{
+    emit8(pEmitter, 0x48);
+    emit8(pEmitter, 0x81);
+    emitMemoryOperand(pEmitter, 0, displacement);
+    emit32(pEmitter, immediate);
+}
+
+void
+emitMovePointer
+(
+    Emitter    *pEmitter,
+    X86Register destination,
+    const void *pPointer
+)
+{
+    uint64_t value = (uint64_t)(uintptr_t)pPointer;
+
+    // movabs r64, imm64
+    emit8(pEmitter, 0x48);
+    emit8(pEmitter, 0xB8 + destination);
+    emit32(pEmitter, (uint32_t)value);
+    emit32(pEmitter, (uint32_t)(value >> 32));
+}
+
+void
+emitCall
+(
+    Emitter    *pEmitter,
+    const void *pFunction
+)
+{
+    emitMovePointer(pEmitter, EAX, pFunction);
+
+    // call rax
+    emit8(pEmitter, 0xFF);
+    emit8(pEmitter, 0xD0);
+}
+
+void
+emitMoveStateArgument
+(
+    Emitter *pEmitter
+)
+{
+    // mov rdi, rbx
+    emit8(pEmitter, 0x48);
+    emit8(pEmitter, 0x89);
+    emitRegisterOperand(pEmitter, EBX, EDI);
+}
+
+void
+emitPrologue
+(
+    Emitter *pEmitter
+)
+{
+    // push rbx keeps the stack 16-byte aligned for the helper calls
+    emit8(pEmitter, 0x53);
+
+    // mov rbx, rdi
+    emit8(pEmitter, 0x48);
+    emit8(pEmitter, 0x89);
+    emitRegisterOperand(pEmitter, EDI, EBX);
+}
+
+void
+emitReturn
+(
+    Emitter *pEmitter
+)
+{
+    // pop rbx; ret
+    emit8(pEmitter, 0x5B);
+    emit8(pEmitter, 0xC3);
+}
+
+size_t
+emitJump
+(
+    Emitter *pEmitter
+)
+{
+    emit8(pEmitter, 0xE9);
+    emit32(pEmitter, 0);
+    return pEmitter->offset - 4;
+}
+
+size_t
+emitJumpCondition
+(
+    Emitter *pEmitter,
+    uint8_t  condition
+)
+{
+    emit8(pEmitter, 0x0F);
+    emit8(pEmitter, 0x80 | condition);
+    emit32(pEmitter, 0);
+    return pEmitter->offset - 4;
+}
+
+void
+patchJump
+(
+    Emitter *pEmitter,
+    size_t   jump,
+    size_t   target
+)
+{
+    uint32_t relative = (uint32_t)(target - (jump + 4));
+
+    if (jump + 4 <= pEmitter->size)
+    {
+        pEmitter->pCode[jump] = bits(relative, 7, 0);
+        pEmitter->pCode[jump + 1] = bits(relative, 15, 8);
+        pEmitter->pCode[jump + 2] = bits(relative, 23, 16);
+        pEmitter->pCode[jump + 3] = bits(relative, 31, 24);
+    }
+}
@@ -0,0 +1,194 @@
+"""Shared helpers for the cpu tests: assembling the programs in programs/,
+generating random ones and running the cpu front end on them.
+
+The tests run against the build in ../build unless MINIARM_BUILD names
+another one. MINIARM_SEED and MINIARM_PROGRAMS pick the random programs,
+a failure names the seed that reproduces it."""
+
+import os
+import random
+import struct
+import subprocess
+import sys
+
+TESTS = os.path.dirname(os.path.abspath(__file__))
+BUILD = os.path.abspath(os.environ.get('MINIARM_BUILD', os.path.join(TESTS, '..', 'build')))
+INCLUDE = os.path.abspath(os.path.join(TESTS, '..', 'inc'))
+SEED = int(os.environ.get('MINIARM_SEED', '1'))
+PROGRAMS = int(os.environ.get('MINIARM_PROGRAMS', '100'))
+MODES = ['interpreter', 'threaded', 'jit']
+
+# random programs can loop for good, every run stops after this many instructions
+LIMIT = 200000
+
+sys.path.insert(0, os.path.join(TESTS, '..', '..', 'assembler'))
+from armasm.assemble import AssemblyParser
+
+
+def assemble(source, directory):
+    """Assembles programs/<source> into directory and returns the image path."""
+    image = os.path.join(directory, os.path.splitext(os.path.basename(source))[0] + '.bin')
+    AssemblyParser().assemble(os.path.join(TESTS, 'programs', source), image)
+    return image
+
+
+def sources():
+    return sorted(name for name in os.listdir(os.path.join(TESTS, 'programs')) if name.endswith('.s'))
+
+
+def write(words, image):
+    with open(image, 'wb') as f:
+        f.write(b''.join(struct.pack('<I', word) for word in words))
+    return image
+
+
+def run(arguments, cpu=None, stdin=b''):
+    """Runs the cpu front end and returns what a run is compared by: the
+    exit status and everything printed, the register and CPSR dump included."""
+    result = subprocess.run([cpu or os.path.join(BUILD, 'cpu')] + arguments, input=stdin,
+                            capture_output=True, timeout=60)
+    return result.returncode, result.stdout.decode(errors='replace'), result.stderr.decode(errors='replace')
+
+
+def variant(name):
+    """The cpu front end of a build variant make test keeps in a directory of its own."""
+    return os.path.join(BUILD, name, 'cpu')
+
+
+def describe(outcome):
+    status, out, err = outcome
+    return 'status %d\n%s%s' % (status, out, err)
+
+
+# instruction encodings, in this emulator a branch lands at its address + 8 + offset * 4
+def dp(cond, op, s, rn, rd, op2):
+    return (cond << 28) | (op << 21) | (s << 20) | (rn << 16) | (rd << 12) | op2
+
+
+def imm(value, rotate=0):
+    return (1 << 25) | (rotate << 8) | value
+
+
+def mov(rd, value, rotate=0, cond=14):
+    return dp(cond, 13, 0, 0, rd, imm(value, rotate))
+
+
+def branch(cond, at, target, link=0):
+    return (cond << 28) | (0b101 << 25) | (link << 24) | (((target - at - 8) >> 2) & 0xffffff)
+
+
+# a single transfer with an immediate offset, which this emulator takes with bit 25 set
+def sdt(load, rd, rn, offset=0, p=1, u=1, w=0, cond=14):
+    return (cond << 28) | (1 << 26) | (1 << 25) | (p << 24) | (u << 23) | (w << 21) | (load << 20) | (rn << 16) | (rd << 12) | offset
+
+
+class Generator:
+    """Random programs over the whole instruction set: data processing with
+    every operand form, multiplies, loads and stores around 0x800, block
+    transfers, counted loops, forward branches and writes to the pc. With
+    fusion set a good share of them are pairs the threaded interpreter fuses."""
+
+    def __init__(self, seed, fusion=False):
+        self.random = random.Random(seed)
+        self.fusion = fusion
+
+    def operand(self):
+        r = self.random
+        kind = r.randrange(3)
+        if kind == 0:
+            return imm(r.randrange(256), r.randrange(16))
+        if kind == 1:
+            return (r.randrange(32) << 7) | (r.randrange(4) << 5) | r.randrange(16)
+        return (r.randrange(13) << 8) | (r.randrange(4) << 5) | (1 << 4) | r.randrange(16)
+
+    def cond(self):
+        return 14 if self.random.random() < 0.5 else self.random.randrange(15)
+
+    def multiply(self, rd_limit):
+        r = self.random
+        return ((self.cond() << 28) | (r.randrange(2) << 21) | (r.randrange(2) << 20) | (r.randrange(rd_limit) << 16) |
+                (r.randrange(16) << 12) | (r.randrange(16) << 8) | 0x90 | r.randrange(16))
+
+    def transfer(self, program):
+        r = self.random
+        # the base r13 is 0x800, the offset register r14 small
+        program.append(mov(13, 2, 11))
+        program.append(mov(14, r.randrange(64)))
+        p, u, load = r.randrange(2), r.randrange(2), r.randrange(2)
+        if r.random() < 0.35:
+            # ldm/stm mostly on r13, rarely loading the pc
+            mask = r.randrange(1 << 15) if r.random() < 0.7 else r.randrange(1 << 5)
+            if r.random() < 0.03:
+                mask |= 1 << 15
+            rn = 13 if r.random() < 0.9 else r.randrange(16)
+            program.append((self.cond() << 28) | (0b100 << 25) | (p << 24) | (u << 23) | (r.randrange(2) << 21) |
+                           (load << 20) | (rn << 16) | mask)
+            return
+        if r.randrange(2):
+            offset = (1 << 25) | r.randrange(0x300)
+        else:
+            offset = (r.randrange(4) << 7) | (r.randrange(2) << 5) | 14
+        program.append((self.cond() << 28) | (1 << 26) | (p << 24) | (u << 23) | (r.randrange(2) << 22) |
+                       (load << 20) | (13 << 16) | (r.randrange(13) << 12) | offset)
+
+    def loop(self, program):
+        r = self.random
+        # counts r12 up while the body leaves it alone, so entering the body from a skip stays bounded
+        start = len(program) + 1
+        program.append(mov(12, 0))
+        for _ in range(r.randrange(1, 8)):
+            if r.random() < 0.8:
+                program.append(dp(self.cond(), r.randrange(16), r.randrange(2), r.randrange(16), r.randrange(11), self.operand()))
+            else:
+                program.append(self.multiply(11))
+        program.append(dp(14, 4, 0, 12, 12, imm(1)))
+        program.append(dp(14, 2, 1, 12, 11, imm(r.randrange(1, 20))))
+        program.append(branch(3, len(program) * 4, start * 4))
+
+    def pair(self, program):
+        r = self.random
+        kind = r.randrange(3)
+        plain = lambda: imm(r.randrange(256), r.randrange(16)) if r.randrange(2) else r.randrange(16)
+        if kind == 0:
+            # a compare and a conditional branch
+            program.append(dp(14, r.randrange(8, 12), 1, r.randrange(16), 0, plain()))
+            program.append((r.randrange(14) << 28) | (0b101 << 25) | (r.randrange(2) << 24) | r.randrange(4))
+        elif kind == 1:
+            # an add or subtract of an immediate and a compare of its result
+            rd = r.randrange(11)
+            program.append(dp(14, r.choice([2, 4]), r.randrange(2), r.randrange(16), rd, imm(r.randrange(256), r.randrange(16))))
+            program.append(dp(14, 10, 1, rd, 0, plain()))
+        else:
+            # a load around 0x800 and an instruction using what it loaded
+            program.append(mov(13, 2, 11))
+            rd = r.randrange(13)
+            program.append(sdt(1, rd, 13, r.randrange(0x300), r.randrange(2), r.randrange(2)))
+            op2 = self.operand()
+            if r.randrange(2):
+                op2 = (op2 & ~0xf & ~(1 << 25)) | rd
+            program.append(dp(self.cond(), r.randrange(16), r.randrange(2), rd, r.randrange(13), op2))
+
+    def program(self):
+        r = self.random
+        program = [mov(register, r.randrange(256), r.randrange(16)) for register in range(13)]
+        length = r.randrange(20, 150)
+        while len(program) < length:
+            if self.fusion and r.random() < 0.4:
+                self.pair(program)
+                continue
+            k = r.random()
+            if k < 0.55:
+                program.append(dp(self.cond(), r.randrange(16), r.randrange(2), r.randrange(16), r.randrange(13), self.operand()))
+            elif k < 0.65:
+                program.append(self.multiply(13))
+            elif k < 0.85:
+                self.transfer(program)
+            elif k < 0.90:
+                self.loop(program)
+            elif k < 0.95:
+                program.append((self.cond() << 28) | (0b101 << 25) | (r.randrange(2) << 24) | r.randrange(4))
+            else:
+                # a write to the pc skipping forward
+                program.append(dp(self.cond(), 4, 0, 15, 15, imm(r.choice([0, 4, 8]))))
+        # forward skips land inside the program
+        return program + [mov(0, 0)] * 6
@@ -0,0 +1,42 @@
+    mov r0, #7
+    mov r1, #3
+    add r2, r0, r1
+    sub r3, r0, r1
+    rsb r4, r0, r1
+    and r5, r0, r1
+    orr r6, r0, r1, lsl #4
+    eor r7, r0, r1, lsr #1
+    eor r8, r0, r1, lsl #2
+    mvn r9, r0
+    mov r10, r0, asr #1
+    mov r11, r0, ror #1
+    mov r12, r0, rrx
+    adds r2, r2, r9
+    adcs r3, r3, r1
+    sbcs r4, r4, r0
+    rscs r5, r5, r1
+    movs r6, r0, lsl r1
+    movs r7, r9, lsr r1
+    movs r8, r9, asr r1
+    movs r9, r0, ror r1
+    teq r0, r1
+    tst r0, #4
+    cmn r0, r1
+    addeq r0, r0, #1
+    addne r0, r0, #2
+    addmi r1, r1, #1
+    addpl r1, r1, #2
+    subcs r2, r2, #1
+    subcc r2, r2, #2
+    addvs r3, r3, #1
+    addvc r3, r3, #2
+    addhi r4, r4, #1
+    addls r4, r4, #2
+    addge r5, r5, #1
+    addlt r5, r5, #2
+    addgt r6, r6, #1
+    addle r6, r6, #2
+    mul r7, r0, r1
+    mla r8, r0, r1, r2
+    muls r9, r7, r8
+    mlas r10, r9, r0, r1
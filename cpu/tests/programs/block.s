@@ -0,0 +1,3 @@
+    mov r13, #2048
+    ldmia r13, {r0-r12}
+    stmia r13, {r0-r12}
@@ -0,0 +1,12 @@
+    mov r0, #0
+    mov r1, #10
+loop:
+    bl inc
+    subs r1, r1, #1
+    bne loop
+    b done
+inc:
+    add r0, r0, #3
+    mov r15, r14
+done:
+    mov r2, #9
@@ -0,0 +1,10 @@
+    mov r0, #0
+    mov r1, #1
+    mov r3, #40
+again:
+    add r2, r0, r1
+    mov r0, r1
+    mov r1, r2
+    sub r3, r3, #1
+    cmp r3, #0
+    bgt again
@@ -0,0 +1,19 @@
+    mov r1, #10
+    mov r5, #2048
+    str r1, [r5]
+loop:
+    ldr r2, [r5]
+    addne r3, r3, r2
+    sub r1, r1, #1
+    cmpgt r1, #5
+    addgt r0, r0, #1
+    add r6, r6, #3
+    cmp r6, #12
+    addeq r7, r7, #1
+    tst r1, #1
+    beq even
+    add r4, r4, #1
+even:
+    str r1, [r5]
+    cmp r1, #0
+    bne loop
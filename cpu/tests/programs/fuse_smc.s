@@ -0,0 +1,47 @@
+    mov r10, #144
+    mov r5, #2048
+    mov r6, #5
+    str r6, [r5]
+    mov r9, #0
+start:
+    mov r1, #0
+    mov r3, #0
+loop:
+    ldr r2, [r5]
+    add r3, r3, r2
+    add r1, r1, #1
+    cmp r1, #3
+    blt loop
+    add r9, r9, #1
+    cmp r9, #1
+    beq first
+    cmp r9, #2
+    beq second
+    cmp r9, #3
+    beq third
+    b done
+first:
+    ldr r7, [r10]
+    mov r8, #40
+    str r7, [r8]
+    b start
+second:
+    add r11, r10, #4
+    ldr r7, [r11]
+    mov r8, #36
+    str r7, [r8]
+    b start
+third:
+    add r11, r10, #8
+    ldr r7, [r11]
+    mov r8, #32
+    str r7, [r8]
+    b start
+done:
+    mov r0, r3
+    b end
+    cmp r1, #5
+    add r1, r1, #2
+    eor r3, r3, r2
+end:
+    mov r12, #1
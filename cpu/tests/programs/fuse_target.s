@@ -0,0 +1,25 @@
+    mov r3, #0
+    cmp r3, #1
+    b middle
+top:
+    add r1, r1, #1
+    add r3, r3, #1
+    cmp r1, #8
+middle:
+    bne top
+    b inside
+again:
+    add r4, r4, #2
+inside:
+    cmp r4, #10
+    blt again
+    mov r5, #2048
+    mov r6, #7
+    str r6, [r5]
+    b use
+reload:
+    ldr r6, [r5]
+use:
+    add r7, r7, r6
+    cmp r7, #40
+    blt reload
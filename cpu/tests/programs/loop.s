@@ -0,0 +1,4 @@
+here:
+    add r1, r1, #1
+    cmp r1, #100
+    bne here
@@ -0,0 +1,12 @@
+    mov r1, #200
+    mov r2, #255
+    mov r3, #2
+    str r2, [r1]
+    strb r2, [r1, r3]
+    ldr r4, [r1]
+    ldrb r5, [r1, r3]
+    str r1, [r1], r3
+    ldr r6, [r1, r3]
+    mov r7, #64
+    str r7, [r1, #0]
+    ldr r8, [r7, r3, lsl #2]
@@ -0,0 +1,17 @@
+    mov r3, #0
+outer:
+    mov r2, #0
+middle:
+    mov r1, #0
+inner:
+    add r1, r1, #1
+    add r4, r4, r1
+    eor r5, r5, r4, lsl #3
+    cmp r1, #250
+    bne inner
+    add r2, r2, #1
+    cmp r2, #250
+    bne middle
+    add r3, r3, #1
+    cmp r3, #4
+    bne outer
@@ -0,0 +1,31 @@
+    mov r8, #4278190080
+    orr r8, r8, #16711680
+    orr r9, r8, #512
+    orr r10, r8, #256
+    orr r11, r8, #4
+    orr r12, r10, #4
+    mov r4, #0
+next:
+    ldr r1, [r9]
+    cmn r1, #1
+    beq service
+    add r4, r4, r1
+    ldr r2, [r10]
+    and r2, r2, #1
+    add r4, r4, r2
+    str r4, [r11]
+    mov r1, #10
+    strb r1, [r8]
+    mov r3, #300
+spin:
+    subs r3, r3, #1
+    bne spin
+    b next
+service:
+    mov r0, #12288
+    mov r1, #16
+    swi read
+    add r4, r4, r0
+    ldr r5, [r10]
+    ldr r6, [r12]
+    mov r0, r4
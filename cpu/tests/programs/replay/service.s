@@ -0,0 +1,16 @@
+    mov r8, #4278190080
+    orr r8, r8, #16711680
+    orr r9, r8, #512
+    mov r4, #0
+    mov r0, #12288
+    mov r1, #5
+    swi read
+    mov r7, r0
+    ldr r1, [r9]
+    add r4, r4, r1
+    ldr r1, [r9]
+    add r4, r4, r1
+    mov r0, #12288
+    mov r1, #16
+    swi read
+    add r4, r4, r0
@@ -0,0 +1,21 @@
+    mov r10, #60
+    mov r8, #16
+    mov r9, #0
+start:
+    mov r1, #0
+loop:
+    add r2, r2, #1
+    add r1, r1, #1
+    cmp r1, #20
+    blt loop
+    add r9, r9, #1
+    cmp r9, #2
+    beq done
+    ldr r7, [r10]
+    str r7, [r8]
+    b start
+done:
+    b end
+    add r2, r2, #16
+end:
+    mov r12, #1
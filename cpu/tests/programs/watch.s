@@ -0,0 +1,10 @@
+    mov r1, #0
+    mov r2, #0
+    mov r7, #1024
+loop:
+    add r1, r1, #1
+    add r2, r2, r1
+    str r2, [r7]
+    cmp r1, #20
+    bne loop
+    mov r3, #5
@@ -0,0 +1,165 @@
+/* Runs an image a few instructions in, takes a snapshot, runs on to the
+   end, then restores and runs again, twice. Each restore must bring back
+   the registers and RAM of the snapshot, code the run stored over
+   included, and each run after it must end where the first one did.
+   test_snapshot.py builds it against libminiarm.a. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "miniarm.h"
+
+#define MEMORY (1u << 20)
+#define ROUNDS 2
+
+typedef struct
+{
+    int      result;
+    uint32_t registers[MINIARM_REGISTERS];
+    uint8_t *pMemory;
+} State;
+
+static void
+saveState
+(
+    MiniArm *pMiniArm,
+    int      result,
+    State   *pState
+)
+{
+    pState->result = result;
+
+    for (int index = 0; index < MINIARM_REGISTERS; index++)
+    {
+        pState->registers[index] = getMiniArmRegister(pMiniArm, index);
+    }
+
+    readMiniArmMemory(pMiniArm, 0, pState->pMemory, MEMORY);
+}
+
+// prints what differs and returns whether anything did
+static bool
+compareState
+(
+    const char  *what,
+    const State *pExpected,
+    const State *pActual
+)
+{
+    bool differs = false;
+
+    if (pActual->result != pExpected->result)
+    {
+        printf("%s: returned %d, not %d\n", what, pActual->result, pExpected->result);
+        differs = true;
+    }
+
+    for (int index = 0; index < MINIARM_REGISTERS; index++)
+    {
+        if (pActual->registers[index] != pExpected->registers[index])
+        {
+            printf("%s: r%d is 0x%08x, not 0x%08x\n", what, index, pActual->registers[index], pExpected->registers[index]);
+            differs = true;
+        }
+    }
+
+    for (uint32_t address = 0; address < MEMORY; address += 4)
+    {
+        if (memcmp(pActual->pMemory + address, pExpected->pMemory + address, 4))
+        {
+            uint32_t actual, expected;
+
+            memcpy(&actual, pActual->pMemory + address, 4);
+            memcpy(&expected, pExpected->pMemory + address, 4);
+            printf("%s: the word at 0x%08x is 0x%08x, not 0x%08x\n", what, address, actual, expected);
+            differs = true;
+            break;
+        }
+    }
+
+    return differs;
+}
+
+int
+main
+(
+    int   argc,
+    char *argv[]
+)
+{
+    static const char *pModes[] = { "interpreter", "threaded", "jit" };
+    int mode = -1;
+
+    for (int index = 0; argc == 5 && index < 3; index++)
+    {
+        if (strcmp(argv[1], pModes[index]) == 0)
+        {
+            mode = index;
+        }
+    }
+
+    if (mode == -1)
+    {
+        printf("Usage: %s interpreter|threaded|jit before limit image\n", argv[0]);
+        return 2;
+    }
+
+    uint64_t before = strtoull(argv[2], NULL, 0);
+    uint64_t limit = strtoull(argv[3], NULL, 0);
+    MiniArm *pMiniArm = createMiniArm(MEMORY, mode);
+
+    if (!pMiniArm || loadMiniArmFile(pMiniArm, argv[4]) == -1)
+    {
+        perror(argv[4]);
+        return 2;
+    }
+
+    State snapshot = { .pMemory = malloc(MEMORY) };
+    State first = { .pMemory = malloc(MEMORY) };
+    State now = { .pMemory = malloc(MEMORY) };
+
+    if (!snapshot.pMemory || !first.pMemory || !now.pMemory)
+    {
+        perror("malloc");
+        return 2;
+    }
+
+    // a count of 0 would run to the end
+    int result = before ? runMiniArm(pMiniArm, before) : MINIARM_LIMIT;
+
+    if (snapshotMiniArm(pMiniArm) == -1)
+    {
+        perror("snapshotMiniArm");
+        return 2;
+    }
+
+    saveState(pMiniArm, result, &snapshot);
+    saveState(pMiniArm, runMiniArm(pMiniArm, limit), &first);
+
+    bool differs = false;
+
+    for (int round = 1; round <= ROUNDS; round++)
+    {
+        char what[64];
+
+        if (restoreMiniArm(pMiniArm) == -1)
+        {
+            perror("restoreMiniArm");
+            return 2;
+        }
+
+        snprintf(what, sizeof(what), "restore %d", round);
+        saveState(pMiniArm, result, &now);
+        differs |= compareState(what, &snapshot, &now);
+
+        snprintf(what, sizeof(what), "run %d after the restore", round);
+        saveState(pMiniArm, runMiniArm(pMiniArm, limit), &now);
+        differs |= compareState(what, &first, &now);
+    }
+
+    destroyMiniArm(pMiniArm);
+    free(snapshot.pMemory);
+    free(first.pMemory);
+    free(now.pMemory);
+    return differs;
+}
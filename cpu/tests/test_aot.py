@@ -0,0 +1,52 @@
+#!/usr/bin/python3
+"""A program translated by aot, compiled and linked with libminiarm.a must
+end in exactly the state the interpreter leaves the image in."""
+
+import os
+import subprocess
+import tempfile
+import unittest
+
+from harness import BUILD, INCLUDE, LIMIT, PROGRAMS, SEED, Generator, assemble, describe, run, sources, write
+
+CC = os.environ.get('CC', 'cc')
+
+
+class TestAot(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def translate(self, image):
+        source = os.path.splitext(image)[0] + '.c'
+        program = os.path.splitext(image)[0]
+        result = subprocess.run([os.path.join(BUILD, 'aot'), '-o', source, image], capture_output=True, timeout=60)
+        self.assertEqual(result.returncode, 0, result.stderr.decode())
+        result = subprocess.run([CC, '-O1', '-I', INCLUDE, '-o', program, source, os.path.join(BUILD, 'libminiarm.a'), '-pthread'],
+                                capture_output=True, timeout=300)
+        self.assertEqual(result.returncode, 0, result.stderr.decode())
+        return program
+
+    def assertRoundTrip(self, image, label):
+        expected = run(['-m', 'interpreter', '-n', str(LIMIT), image])
+        outcome = run(['-n', str(LIMIT)], cpu=self.translate(image))
+        self.assertEqual(outcome, expected, '%s: the translation gives\n%s\nthe interpreter\n%s' %
+                         (label, describe(outcome), describe(expected)))
+
+    def test_programs(self):
+        for source in sources():
+            with self.subTest(program=source):
+                self.assertRoundTrip(assemble(source, self.directory.name), source)
+
+    def test_random_programs(self):
+        generator = Generator(SEED)
+        for index in range(PROGRAMS):
+            image = write(generator.program(), os.path.join(self.directory.name, 'random%d.bin' % index))
+            with self.subTest(program=index):
+                self.assertRoundTrip(image, 'random program %d of seed %d' % (index, SEED))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,39 @@
+#!/usr/bin/python3
+"""Per instruction cache counts: a block transfer counts one data access
+per line it touches, and none at all without a data cache."""
+
+import re
+import tempfile
+import unittest
+
+from harness import assemble, run
+
+
+def counts(out):
+    # fetches, i-misses, d-accesses, d-misses and l2-misses by address
+    return {int(address, 16): list(map(int, numbers.split()))
+            for numbers, address in re.findall(r'^((?:\s+\d+){5})\s+(0x[0-9a-f]{8})$', out, re.M)}
+
+
+class TestCaches(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        # an ldm and an stm of 13 words at 0x800, all in one 64-byte line
+        self.image = assemble('block.s', self.directory.name)
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def test_lines(self):
+        for caches in ['l1d=32k:4:64', 'l2=256k:8:64', 'default']:
+            with self.subTest(caches=caches):
+                # the ldm at 4, the listing leaves out instructions that never missed
+                self.assertEqual(counts(run(['-c', caches, self.image])[2])[4][2], 1)
+
+    def test_instruction_cache_only(self):
+        transfers = counts(run(['-c', 'l1i=32k:4:64', self.image])[2])
+        self.assertEqual({address: numbers[2] for address, numbers in transfers.items() if numbers[2]}, {})
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,97 @@
+#!/usr/bin/python3
+"""A run stopped by -n with --checkpoint-every and resumed from its last
+checkpoint must end exactly where the run without a stop does, in every
+mode and resuming in any other. A checkpoint whose extent table doesn't
+fit the file or the RAM must be refused, not mapped."""
+
+import os
+import re
+import struct
+import tempfile
+import unittest
+
+from harness import LIMIT, MODES, PROGRAMS, SEED, Generator, assemble, describe, run, sources, write
+
+# where the first run stops, with checkpoints along the way every EVERY instructions
+STOPS = [10, 1000]
+EVERY = 7
+
+# CheckpointHeader and CheckpointExtent in checkpoint.h, in the order of this host
+HEADER = '@8sIIQQ17I6Iqq'
+EXTENT = '@QQQ'
+
+
+def executed(outcome):
+    return int(re.search(r'(\d+) instructions in', outcome[2]).group(1))
+
+
+class TestCheckpoint(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def assertResumes(self, image, label, modes):
+        checkpoint = os.path.splitext(image)[0] + '.ckpt'
+        for mode in modes:
+            expected = run(['-m', mode, '-n', str(LIMIT), image])
+            for stop in STOPS:
+                stopped = run(['-m', mode, '-b', '-n', str(stop), '--checkpoint-every', str(EVERY), image])
+                if executed(stopped) < stop:
+                    # halted or faulted before the stop, there is no checkpoint at it to resume
+                    continue
+                for resumed in modes:
+                    outcome = run(['-m', resumed, '-n', str(LIMIT - stop), '--resume', checkpoint])
+                    self.assertEqual(outcome, expected, '%s: stopped by -m %s after %d, resumed by -m %s gives\n%s\n'
+                                     'the run without a stop\n%s' % (label, mode, stop, resumed, describe(outcome), describe(expected)))
+
+    def test_programs(self):
+        for source in sources():
+            with self.subTest(program=source):
+                self.assertResumes(assemble(source, self.directory.name), source, MODES)
+
+    def test_random_programs(self):
+        generator = Generator(SEED)
+        for index in range(PROGRAMS):
+            image = write(generator.program(), os.path.join(self.directory.name, 'random%d.bin' % index))
+            # every checkpoint forks, so each program takes one mode in turn
+            mode = MODES[index % len(MODES)]
+            with self.subTest(program=index, mode=mode):
+                self.assertResumes(image, 'random program %d of seed %d' % (index, SEED), [mode])
+
+    def test_damaged(self):
+        image = assemble('nested.s', self.directory.name)
+        checkpoint = os.path.splitext(image)[0] + '.ckpt'
+        self.assertEqual(run(['-n', '1000', '--checkpoint-every', str(EVERY), image])[0], 0)
+        with open(checkpoint, 'rb') as f:
+            original = f.read()
+        header = list(struct.unpack_from(HEADER, original))
+        table = struct.calcsize(HEADER)
+        address, length, offset = struct.unpack_from(EXTENT, original, table)
+        alignment, memory = header[1], header[3]
+
+        def extent(address, length, offset):
+            return original[:table] + struct.pack(EXTENT, address, length, offset) + original[table + struct.calcsize(EXTENT):]
+
+        def count(extents):
+            return struct.pack(HEADER, *(header[:2] + [extents] + header[3:])) + original[table:]
+
+        damaged = {
+            'an extent past the end of the file': extent(address, length, offset + 16 * alignment),
+            'an extent longer than the file': extent(address, len(original), offset),
+            'an extent past the end of RAM': extent(memory, length, offset),
+            'an extent overlapping the table': extent(address, length, 0),
+            'a table longer than the file': count(1 << 20),
+        }
+        for name, contents in damaged.items():
+            with self.subTest(damage=name):
+                with open(checkpoint, 'wb') as f:
+                    f.write(contents)
+                status, out, err = run(['--resume', checkpoint])
+                self.assertEqual(status, 1, '%s\n%s' % (name, describe((status, out, err))))
+                self.assertIn('resumeMiniArm() failed', out + err)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,60 @@
+#!/usr/bin/python3
+"""Breakpoints and watchpoints stop every engine at the same instruction,
+and the run carries on from there as if it had never stopped."""
+
+import tempfile
+import unittest
+
+from harness import MODES, assemble, run
+
+# watch the store in the loop, step past a stop, then break in the loop and run to the end
+SESSION = '''watch 1024
+continue
+continue
+step 3
+print r1
+unwatch 1024
+break 16
+continue
+continue
+print r1
+delete 16
+continue
+print r1
+print r2
+quit
+'''
+
+
+class TestDebug(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        self.image = assemble('watch.s', self.directory.name)
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def test_session(self):
+        transcripts = {mode: run(['-m', mode, '-d', self.image], stdin=SESSION.encode()) for mode in MODES}
+        for mode in MODES[1:]:
+            self.assertEqual(transcripts[mode], transcripts[MODES[0]], '-m %s' % mode)
+
+        out = transcripts[MODES[0]][1]
+        self.assertIn('store to 0x00000400, word now 0x00000001', out)
+        self.assertIn('store to 0x00000400, word now 0x00000003', out)
+        self.assertIn('r1 = 0x00000003 (3)', out)
+        self.assertIn('Breakpoint, 0x00000010', out)
+        self.assertIn('r1 = 0x00000005 (5)', out)
+        self.assertIn('Program halted after 104 instructions', out)
+        self.assertIn('r2 = 0x000000d2 (210)', out)
+
+    def test_limit_after_stop(self):
+        # -n runs that far before the first prompt, across the watchpoint stop the first continue makes
+        session = 'watch 1024\ncontinue\nstep 2\nprint r1\nquit\n'
+        transcripts = {mode: run(['-m', mode, '-n', '9', '-d', self.image], stdin=session.encode()) for mode in MODES}
+        for mode in MODES[1:]:
+            self.assertEqual(transcripts[mode], transcripts[MODES[0]], '-m %s' % mode)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,87 @@
+#!/usr/bin/python3
+"""The threaded interpreter and the JIT must end every program in exactly the
+state the interpreter does: the same registers, CPSR, output and exit status."""
+
+import os
+import tempfile
+import unittest
+
+from harness import LIMIT, MODES, PROGRAMS, SEED, Generator, assemble, describe, run, sources, variant, write
+
+
+class TestEngines(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def assertSameInEveryMode(self, image, label, options=[]):
+        outcomes = {mode: run(['-m', mode, '-n', str(LIMIT)] + options + [image]) for mode in MODES}
+        for mode in MODES[1:]:
+            self.assertEqual(outcomes[mode], outcomes[MODES[0]], '%s: -m %s gives\n%s\n-m %s gives\n%s' %
+                             (label, mode, describe(outcomes[mode]), MODES[0], describe(outcomes[MODES[0]])))
+
+    def test_programs(self):
+        for source in sources():
+            with self.subTest(program=source):
+                self.assertSameInEveryMode(assemble(source, self.directory.name), source)
+
+    def test_random_programs(self):
+        generator = Generator(SEED)
+        for index in range(PROGRAMS):
+            image = write(generator.program(), os.path.join(self.directory.name, 'random%d.bin' % index))
+            with self.subTest(program=index):
+                self.assertSameInEveryMode(image, 'random program %d of seed %d' % (index, SEED))
+
+    def test_timed_programs(self):
+        # -t prints the pipeline's cycles and stalls, the threaded handlers must count them as the interpreter does
+        generator = Generator(SEED)
+        images = [assemble(source, self.directory.name) for source in sources()]
+        images += [write(generator.program(), os.path.join(self.directory.name, 'timed%d.bin' % index)) for index in range(PROGRAMS)]
+        for image in images:
+            with self.subTest(program=os.path.basename(image)):
+                self.assertSameInEveryMode(image, '%s under -t with seed %d' % (os.path.basename(image), SEED), ['-t'])
+
+    def test_timed_predicted_programs(self):
+        # predictors see every branch of a timed run too, whichever engine would time it
+        for source in sources():
+            with self.subTest(program=source):
+                self.assertSameInEveryMode(assemble(source, self.directory.name), '%s under -t -P default' % source,
+                                           ['-t', '-P', 'default'])
+
+
+class TestCheckFlags(unittest.TestCase):
+    """Runs the same programs under the CHECK_FLAGS=1 build, which aborts on
+    the first lazily evaluated flag that disagrees with eager evaluation."""
+
+    def setUp(self):
+        if not os.path.exists(variant('check_flags')):
+            self.skipTest('no CHECK_FLAGS=1 build, make test builds one in check_flags')
+        self.directory = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def assertFlagsAgree(self, image, label):
+        expected = run(['-m', 'interpreter', '-n', str(LIMIT), image])
+        for mode in MODES:
+            outcome = run(['-m', mode, '-n', str(LIMIT), image], cpu=variant('check_flags'))
+            self.assertNotIn('lazy flag', outcome[2], '%s: -m %s' % (label, mode))
+            self.assertEqual(outcome, expected, '%s: -m %s under CHECK_FLAGS=1 gives\n%s' % (label, mode, describe(outcome)))
+
+    def test_programs(self):
+        for source in sources():
+            with self.subTest(program=source):
+                self.assertFlagsAgree(assemble(source, self.directory.name), source)
+
+    def test_random_programs(self):
+        generator = Generator(SEED)
+        for index in range(PROGRAMS):
+            image = write(generator.program(), os.path.join(self.directory.name, 'random%d.bin' % index))
+            with self.subTest(program=index):
+                self.assertFlagsAgree(image, 'random program %d of seed %d' % (index, SEED))
+
+
+if __name__ == '__main__':
+    unittest.main()
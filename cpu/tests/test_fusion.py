@@ -0,0 +1,181 @@
+#!/usr/bin/python3
+"""The threaded interpreter runs some instruction pairs under one handler. A
+fused pair must end every program exactly where the two instructions do on
+their own, so each program here runs in every mode of the normal build and of
+the -DNO_FUSION build make test keeps in no_fusion, with and without -t."""
+
+import os
+import re
+import tempfile
+import unittest
+
+from harness import (LIMIT, MODES, PROGRAMS, SEED, Generator, assemble, branch, describe, dp, imm, mov, run, sdt,
+                     variant, write)
+
+# condition codes and opcodes of the programs below
+EQ, NE, LT, GT, AL = 0, 1, 11, 12, 14
+EOR, SUB, ADD, CMP, ORR, MOV = 1, 2, 4, 10, 12, 13
+
+
+def loadConditional():
+    # the use only runs under its condition, one of them sets the flags
+    return [
+        mov(5, 2, 11),                   # r5 = 0x800
+        mov(1, 10),
+        sdt(0, 1, 5),
+        sdt(1, 2, 5),                    # 12: ldr r2, [r5]
+        dp(NE, ADD, 0, 3, 3, 2),         # addne r3, r3, r2
+        sdt(1, 4, 5),
+        dp(GT, SUB, 1, 4, 6, imm(4)),    # subgts r6, r4, #4
+        dp(AL, SUB, 1, 1, 1, imm(1)),
+        sdt(0, 1, 5),
+        branch(NE, 36, 12),
+    ]
+
+
+def loadTarget():
+    # the first pass branches straight to the use, past its load
+    return [
+        mov(5, 2, 11),
+        mov(2, 3),
+        sdt(0, 2, 5),
+        branch(AL, 12, 20),
+        sdt(1, 2, 5),                    # 16: ldr r2, [r5]
+        dp(AL, ADD, 0, 7, 7, 2),         # 20: add r7, r7, r2
+        dp(AL, CMP, 1, 7, 0, imm(20)),
+        branch(LT, 28, 16),
+    ]
+
+
+def loadRewritten():
+    # runs a load and its use three times, then stores over the use and
+    # runs them again, then over the load and runs them once more
+    return [
+        mov(10, 108),                    # the replacements at the end
+        mov(5, 2, 11),
+        mov(6, 5),
+        sdt(0, 6, 5),
+        mov(9, 0),
+        mov(1, 0),                       # 20: start
+        sdt(1, 2, 5),                    # 24: ldr r2, [r5]
+        dp(AL, ADD, 0, 3, 3, 2),         # 28: add r3, r3, r2
+        dp(AL, ADD, 0, 1, 1, imm(1)),
+        dp(AL, CMP, 1, 1, 0, imm(3)),
+        branch(LT, 40, 24),
+        dp(AL, ADD, 0, 9, 9, imm(1)),
+        dp(AL, CMP, 1, 9, 0, imm(1)),
+        branch(EQ, 52, 68),
+        dp(AL, CMP, 1, 9, 0, imm(2)),
+        branch(EQ, 60, 84),
+        branch(AL, 64, 100),
+        sdt(1, 7, 10),                   # 68: the use becomes an eor
+        mov(8, 28),
+        sdt(0, 7, 8),
+        branch(AL, 80, 20),
+        sdt(1, 7, 10, 4),                # 84: the load becomes a mov
+        mov(8, 24),
+        sdt(0, 7, 8),
+        branch(AL, 96, 20),
+        dp(AL, MOV, 0, 0, 0, 3),         # 100: mov r0, r3
+        branch(AL, 104, 116),
+        dp(AL, EOR, 0, 3, 3, 2),         # 108: eor r3, r3, r2
+        mov(2, 9),                       # 112: mov r2, #9
+        mov(12, 1),                      # 116
+    ]
+
+
+def loadFault(p):
+    # walks r5 up to the device window, which faults with no devices mapped,
+    # preindexed with writeback or postindexed, past a word the faulting
+    # load must not leave behind
+    return [
+        mov(1, 1),
+        mov(5, 255, 4),
+        dp(AL, ORR, 0, 5, 5, imm(255, 8)),
+        dp(AL, SUB, 0, 5, 5, imm(8)),    # r5 = 0xfffefff8
+        mov(6, 7),
+        dp(AL, MOV, 0, 0, 7, 5),
+        sdt(0, 6, 7, 4),                 # str r6, [r7, #4]
+        sdt(1, 2, 5, 4, p, 1, 1 - p),    # 28: ldr r2, [r5, #4]! or ldr r2, [r5], #4
+        dp(AL, ADD, 0, 2, 3, 1),         # add r3, r2, r1
+        dp(AL, ADD, 0, 4, 4, imm(1)),
+        branch(AL, 40, 28),
+    ]
+
+
+PAIRS = {
+    'load_conditional': loadConditional(),
+    'load_target': loadTarget(),
+    'load_rewritten': loadRewritten(),
+    'load_fault_preindexed': loadFault(1),
+    'load_fault_postindexed': loadFault(0),
+}
+
+SOURCES = ['fuse_condition.s', 'fuse_smc.s', 'fuse_target.s']
+
+# the pairs each program must fuse at least once
+FUSED = {
+    'fuse_condition.s': ['compare-branch', 'add/sub-compare'],
+    'fuse_smc.s': ['compare-branch', 'add/sub-compare'],
+    'fuse_target.s': ['compare-branch', 'add/sub-compare'],
+    'load_conditional': ['load-use'],
+    'load_target': ['load-use'],
+    'load_rewritten': ['load-use'],
+    'load_fault_preindexed': ['load-use'],
+    'load_fault_postindexed': ['load-use'],
+}
+
+
+def fusions(image, cpu=None):
+    err = run(['-b', '-m', 'threaded', '-n', str(LIMIT), image], cpu=cpu)[2]
+    return {kind: int(count) for count, kind in re.findall(r'(\d+) ([a-z/-]+)[,\n]', err.split('fusions: ')[1])}
+
+
+class TestFusion(unittest.TestCase):
+    def setUp(self):
+        if not os.path.exists(variant('no_fusion')):
+            self.skipTest('no -DNO_FUSION build, make test builds one in no_fusion')
+        self.directory = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def images(self):
+        images = {source: assemble(source, self.directory.name) for source in SOURCES}
+        images.update({name: write(words, os.path.join(self.directory.name, name + '.bin')) for name, words in PAIRS.items()})
+        return images
+
+    def assertSameFusedOrNot(self, image, label, options=[]):
+        expected = run(['-m', 'interpreter', '-n', str(LIMIT)] + options + [image])
+        for build, cpu in [('fused', None), ('unfused', variant('no_fusion'))]:
+            for mode in MODES:
+                outcome = run(['-m', mode, '-n', str(LIMIT)] + options + [image], cpu=cpu)
+                self.assertEqual(outcome, expected, '%s: -m %s %s gives\n%s\n-m interpreter gives\n%s' %
+                                 (label, mode, build, describe(outcome), describe(expected)))
+
+    def test_pairs(self):
+        for name, image in self.images().items():
+            for options in [[], ['-t']]:
+                with self.subTest(program=name, options=options):
+                    self.assertSameFusedOrNot(image, name, options)
+
+    def test_fused(self):
+        # the programs above must actually run as pairs, and never without fusion
+        images = self.images()
+        for name, kinds in FUSED.items():
+            with self.subTest(program=name):
+                fused = fusions(images[name])
+                for kind in kinds:
+                    self.assertGreater(fused[kind], 0, '%s fuses no %s pair' % (name, kind))
+                self.assertEqual(set(fusions(images[name], variant('no_fusion')).values()), {0})
+
+    def test_random_programs(self):
+        generator = Generator(SEED, fusion=True)
+        for index in range(PROGRAMS):
+            image = write(generator.program(), os.path.join(self.directory.name, 'fused%d.bin' % index))
+            with self.subTest(program=index):
+                self.assertSameFusedOrNot(image, 'random pairs %d of seed %d' % (index, SEED))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,56 @@
+#!/usr/bin/python3
+"""A run recorded with --record and replayed from its log in any mode must
+repeat the recorded run exactly: the same console output, registers and
+exit status, with the cycle counter, the input device and the READ service
+all taken from the log rather than the host."""
+
+import os
+import tempfile
+import unittest
+
+from harness import MODES, assemble, describe, run
+
+PROGRAMS = ['replay/devices.s', 'replay/service.s']
+INPUT = b'each byte read here goes into the checksum, the cycle counter too\n' * 4
+
+
+class TestReplay(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def test_replay(self):
+        log = os.path.join(self.directory.name, 'run.log')
+        for source in PROGRAMS:
+            image = assemble(source, self.directory.name)
+            for options in [['-D'], ['-D', '-t']]:
+                for recorded in MODES:
+                    expected = run(['-m', recorded, '--record', log] + options + [image], stdin=INPUT)
+                    self.assertEqual(expected[0], 0, '%s: -m %s --record\n%s' % (source, recorded, describe(expected)))
+                    for replayed in MODES:
+                        with self.subTest(program=source, options=options, recorded=recorded, replayed=replayed):
+                            outcome = run(['-m', replayed, '--replay', log] + options + [image])
+                            self.assertEqual(outcome, expected, '%s %s: recorded by -m %s, replayed by -m %s gives\n%s\n'
+                                             'the recorded run\n%s' % (source, ' '.join(options), recorded, replayed,
+                                                                       describe(outcome), describe(expected)))
+
+    def test_diverged(self):
+        # a log cut short runs out of input part way, the replay must say where rather than read the host
+        image = assemble('replay/devices.s', self.directory.name)
+        log = os.path.join(self.directory.name, 'run.log')
+        self.assertEqual(run(['-D', '--record', log, image], stdin=INPUT)[0], 0)
+        with open(log, 'rb') as f:
+            contents = f.read()
+        with open(log, 'wb') as f:
+            f.write(contents[:len(contents) // 2])
+        for mode in MODES:
+            with self.subTest(mode=mode):
+                status, out, err = run(['-m', mode, '-D', '--replay', log, image], stdin=INPUT)
+                self.assertNotEqual(status, 0)
+                self.assertIn('Replay diverged at instruction', out + err)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,53 @@
+#!/usr/bin/python3
+"""restoreMiniArm() must roll a context back to its snapshot, code pages the
+program stored to after it included, so that running on again ends where
+the first run did. snapshot.c checks that in every mode."""
+
+import os
+import subprocess
+import tempfile
+import unittest
+
+from harness import BUILD, INCLUDE, LIMIT, MODES, PROGRAMS, SEED, TESTS, Generator, assemble, sources, write
+
+CC = os.environ.get('CC', 'cc')
+
+# where the snapshots are taken, rewrite.s and fuse_smc.s store over their code after them
+BEFORE = [1, 7, 60]
+
+
+class TestSnapshot(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = tempfile.TemporaryDirectory()
+        cls.snapshot = os.path.join(cls.directory.name, 'snapshot')
+        result = subprocess.run([CC, '-O1', '-I', INCLUDE, '-o', cls.snapshot, os.path.join(TESTS, 'snapshot.c'),
+                                 os.path.join(BUILD, 'libminiarm.a'), '-pthread'], capture_output=True, timeout=300)
+        assert result.returncode == 0, result.stderr.decode()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.directory.cleanup()
+
+    def assertRestores(self, image, label):
+        for mode in MODES:
+            for before in BEFORE:
+                result = subprocess.run([self.snapshot, mode, str(before), str(LIMIT), image], capture_output=True, timeout=60)
+                self.assertEqual(result.returncode, 0, '%s: -m %s with a snapshot after %d instructions\n%s%s' %
+                                 (label, mode, before, result.stdout.decode(), result.stderr.decode()))
+
+    def test_programs(self):
+        for source in sources():
+            with self.subTest(program=source):
+                self.assertRestores(assemble(source, self.directory.name), source)
+
+    def test_random_programs(self):
+        generator = Generator(SEED)
+        for index in range(PROGRAMS):
+            image = write(generator.program(), os.path.join(self.directory.name, 'random%d.bin' % index))
+            with self.subTest(program=index):
+                self.assertRestores(image, 'random program %d of seed %d' % (index, SEED))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,82 @@
+#!/usr/bin/python3
+"""A trace decodes back to the run it was written from, and a writer that
+can't keep up costs the trace records, never the run its speed."""
+
+import os
+import re
+import subprocess
+import tempfile
+import threading
+import time
+import unittest
+
+from harness import BUILD, MODES, assemble, describe, run
+
+
+def tracedump(arguments):
+    result = subprocess.run([os.path.join(BUILD, 'tracedump')] + arguments, capture_output=True, timeout=60)
+    return result.returncode, result.stdout.decode()
+
+
+class TestTrace(unittest.TestCase):
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        self.image = assemble('nested.s', self.directory.name)
+        self.trace = os.path.join(self.directory.name, 'nested.trace')
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    def assertDecodes(self, benchmark):
+        # tracedump -r ends with the registers after the last instruction, the run's dump
+        status, out = tracedump(['-q', '-r', self.trace])
+        self.assertEqual(status, 0, out)
+        self.assertIn(run([self.image])[1], out)
+
+        # every instruction is either in the trace or counted as dropped
+        executed = int(re.search(r'(\d+) instructions in', benchmark).group(1))
+        traced, dropped = map(int, re.search(r'trace: (\d+) instructions, (\d+) dropped', benchmark).groups())
+        decoded = re.search(r'^(\d+) instructions$', out, re.M)
+        gaps = re.search(r'^(\d+) instructions dropped', out, re.M)
+        self.assertEqual(traced + dropped, executed)
+        self.assertEqual(int(decoded.group(1)), traced)
+        self.assertEqual(int(gaps.group(1)) if gaps else 0, dropped)
+        return dropped
+
+    def test_trace(self):
+        status, out, err = run(['-b', '-T', self.trace, self.image])
+        self.assertEqual(status, 0, err)
+        self.assertDecodes(err)
+
+    def test_models(self):
+        # a traced run goes through its own loop, which must time, cache and predict as an untraced one does
+        for mode in MODES:
+            for options in [['-t'], ['-c', 'default'], ['-P', 'default'], ['-t', '-c', 'default', '-P', 'default']]:
+                with self.subTest(mode=mode, options=options):
+                    expected = run(['-m', mode] + options + [self.image])
+                    outcome = run(['-m', mode, '-T', self.trace] + options + [self.image])
+                    self.assertEqual(outcome, expected, '-m %s %s traced gives\n%s\nuntraced\n%s' %
+                                     (mode, ' '.join(options), describe(outcome), describe(expected)))
+
+    def test_full_ring(self):
+        # the writer blocks on a pipe nobody reads yet, so the ring fills and the run drops records
+        fifo = os.path.join(self.directory.name, 'nested.fifo')
+        os.mkfifo(fifo)
+
+        def drain():
+            with open(fifo, 'rb') as source:
+                time.sleep(1)
+                with open(self.trace, 'wb') as destination:
+                    destination.write(source.read())
+
+        reader = threading.Thread(target=drain)
+        reader.start()
+        status, out, err = run(['-b', '-T', fifo, self.image])
+        reader.join()
+        self.assertEqual(status, 0, err)
+        self.assertEqual(out, run([self.image])[1])
+        self.assertGreater(self.assertDecodes(err), 0)
+
+
+if __name__ == '__main__':
+    unittest.main()